@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+
+// Milliseconds since start
+inline double ElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Read a 4096 x 4096 raw heightmap on one thread and on the pool, and check the heights read back
+void BenchmarkReading();
+
+// Box and Gaussian blur a 4096 x 4096 heightmap on one thread and on the pool, checked against the
+// 3x3 average the sample used to smooth with and a 2D reference filter
+void BenchmarkBlur();
+
+// Normals and slopes of a 4096 x 4096 heightmap on one thread and on the pool, checked against scalar
+// central differences
+void BenchmarkGradients();
+
+// Pyramids of a 4096 x 4096 heightmap with and without bounds on one thread and on the pool, checking
+// level sizes and that every bound is the lowest or highest height under it
+void BenchmarkPyramid();
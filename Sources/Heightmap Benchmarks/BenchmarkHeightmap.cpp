@@ -0,0 +1,446 @@
+#include "Benchmark.h"
+#include "DxHeightmap.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Size of the heightmaps timed, the largest the samples are likely to be given
+	constexpr uint32_t SIZE = 4096;
+
+	// An odd sized heightmap for the checks, so edges, odd pyramid levels and rows that are not a multiple
+	// of four wide all get tested
+	constexpr uint32_t ODD_WIDTH = 257;
+	constexpr uint32_t ODD_HEIGHT = 131;
+
+	constexpr float HEIGHT_SCALE = 255.0f / 8.0f;
+	constexpr float CELL_SPACING = 0.5f;
+	constexpr float GAUSSIAN_SIGMA = 1.5f;
+
+	// Each pass is timed this many times and the fastest run kept
+	constexpr int RUNS = 3;
+
+	// Hills with noise on top, so blurs and gradients have something to work on
+	DX::Heightmap CreateHeightmap(uint32_t width, uint32_t height)
+	{
+		DX::Heightmap heightmap(width, height);
+
+		std::mt19937 random(11);
+		std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+		for (uint32_t z = 0; z < height; ++z)
+		{
+			float* row = heightmap.GetRow(z);
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				float hills = std::sin(x * 0.013f) * std::cos(z * 0.021f) + 0.5f * std::sin((x + z) * 0.057f);
+				row[x] = HEIGHT_SCALE * (0.5f + 0.3f * hills) + noise(random);
+			}
+		}
+
+		return heightmap;
+	}
+
+	void Check(bool condition, const std::string& message)
+	{
+		if (!condition)
+			throw std::runtime_error(message);
+	}
+
+	// Floats that went through different but equivalent arithmetic
+	bool Near(float a, float b, float tolerance = 1e-4f)
+	{
+		return std::abs(a - b) <= tolerance * std::max(1.0f, std::abs(b));
+	}
+
+	void PrintHeader()
+	{
+		std::cout << "threads " << ThreadPool::Get().GetThreadCount() << ", milliseconds\n";
+		std::cout << std::left << std::setw(24) << "pass" << std::right << std::setw(12) << "1 thread" << std::setw(12) << "pool" << std::setw(10) << "speedup"
+			<< "\n" << std::fixed << std::setprecision(2);
+	}
+
+	// Time pass(pool) on a single thread and on the shared pool. The pass times itself and returns its
+	// milliseconds, so it can leave copying its input out
+	template<typename Pass>
+	void ReportPass(const char* name, const Pass& pass)
+	{
+		ThreadPool single_thread(1);
+
+		double single_ms = 0.0;
+		double pooled_ms = 0.0;
+		for (int run = 0; run < RUNS; ++run)
+		{
+			double single_run = pass(single_thread);
+			double pooled_run = pass(ThreadPool::Get());
+			single_ms = run == 0 ? single_run : std::min(single_ms, single_run);
+			pooled_ms = run == 0 ? pooled_run : std::min(pooled_ms, pooled_run);
+		}
+
+		std::cout << std::left << std::setw(24) << name << std::right << std::setw(12) << single_ms << std::setw(12) << pooled_ms
+			<< std::setw(9) << single_ms / pooled_ms << "x\n";
+	}
+
+	// How the sample smoothed before the blur, every texel averaged with the neighbours it has
+	float OldAverage(const DX::Heightmap& heightmap, int64_t i, int64_t j)
+	{
+		auto average = 0.0f;
+		auto num = 0.0f;
+		for (int64_t m = i - 1; m <= i + 1; ++m)
+		{
+			for (int64_t n = j - 1; n <= j + 1; ++n)
+			{
+				if (m >= 0 && m < heightmap.height && n >= 0 && n < heightmap.width)
+				{
+					average += heightmap.GetRow(static_cast<uint32_t>(m))[n];
+					num += 1.0f;
+				}
+			}
+		}
+
+		return average / num;
+	}
+
+	void CheckBoxBlur(const DX::Heightmap& heightmap)
+	{
+		DX::Heightmap blurred = heightmap;
+		DX::BlurHeightmap(blurred, DX::BoxKernel(1));
+
+		for (uint32_t z = 0; z < heightmap.height; ++z)
+		{
+			for (uint32_t x = 0; x < heightmap.width; ++x)
+			{
+				if (!Near(blurred.GetRow(z)[x], OldAverage(heightmap, z, x)))
+					throw std::runtime_error("Box blur differs from the 3x3 average at " + std::to_string(x) + ", " + std::to_string(z));
+			}
+		}
+	}
+
+	// Every tap in 2D at once, weighted back up to one over the taps inside the heightmap
+	float FilterTexel(const DX::Heightmap& heightmap, const std::vector<float>& kernel, int64_t x, int64_t z)
+	{
+		int64_t radius = static_cast<int64_t>(kernel.size() / 2);
+
+		double sum = 0.0;
+		double weight = 0.0;
+		for (int64_t i = -radius; i <= radius; ++i)
+		{
+			for (int64_t j = -radius; j <= radius; ++j)
+			{
+				if (z + i >= 0 && z + i < heightmap.height && x + j >= 0 && x + j < heightmap.width)
+				{
+					double tap = static_cast<double>(kernel[i + radius]) * kernel[j + radius];
+					sum += tap * heightmap.GetRow(static_cast<uint32_t>(z + i))[x + j];
+					weight += tap;
+				}
+			}
+		}
+
+		return static_cast<float>(sum / weight);
+	}
+
+	void CheckGaussian(const DX::Heightmap& heightmap)
+	{
+		Check(DX::GaussianKernel(0.0f) == std::vector<float>{ 1.0f }, "A zero sigma Gaussian is not a single tap");
+
+		// Three sigmas either side, summing to one, falling off as a Gaussian does
+		auto kernel = DX::GaussianKernel(GAUSSIAN_SIGMA);
+		size_t radius = static_cast<size_t>(std::ceil(GAUSSIAN_SIGMA * 3.0f));
+		Check(kernel.size() == radius * 2 + 1, "Gaussian kernel has " + std::to_string(kernel.size()) + " taps");
+
+		float total = 0.0f;
+		for (size_t k = 0; k < kernel.size(); ++k)
+		{
+			total += kernel[k];
+			Check(kernel[k] == kernel[kernel.size() - 1 - k], "Gaussian kernel is not symmetric");
+		}
+
+		Check(Near(total, 1.0f, 1e-6f), "Gaussian kernel sums to " + std::to_string(total));
+		for (size_t k = 1; k <= radius; ++k)
+		{
+			float expected = std::exp(-static_cast<float>(k * k) / (2.0f * GAUSSIAN_SIGMA * GAUSSIAN_SIGMA));
+			Check(Near(kernel[radius + k] / kernel[radius], expected, 1e-5f), "Gaussian kernel tap " + std::to_string(k) + " is off");
+		}
+
+		DX::Heightmap blurred = heightmap;
+		DX::BlurHeightmap(blurred, kernel);
+
+		for (uint32_t z = 0; z < heightmap.height; ++z)
+		{
+			for (uint32_t x = 0; x < heightmap.width; ++x)
+			{
+				if (!Near(blurred.GetRow(z)[x], FilterTexel(heightmap, kernel, x, z)))
+					throw std::runtime_error("Gaussian blur differs from the 2D filter at " + std::to_string(x) + ", " + std::to_string(z));
+			}
+		}
+	}
+
+	// Central difference, one sided at the edges and flat along an axis a single texel long
+	float Difference(float low, float centre, float high, uint32_t i, uint32_t count)
+	{
+		if (count == 1)
+			return 0.0f;
+
+		if (i == 0)
+			return (high - centre) / CELL_SPACING;
+
+		if (i + 1 == count)
+			return (centre - low) / CELL_SPACING;
+
+		return (high - low) / (2.0f * CELL_SPACING);
+	}
+
+	void CheckGradients(const DX::Heightmap& heightmap)
+	{
+		std::vector<DirectX::XMFLOAT3> normals;
+		DX::ComputeNormals(heightmap, CELL_SPACING, normals);
+		DX::Heightmap slopes = DX::ComputeSlopes(heightmap, CELL_SPACING);
+
+		Check(normals.size() == heightmap.data.size(), "A normal is missing");
+		Check(slopes.width == heightmap.width && slopes.height == heightmap.height, "Slopes are not the size of the heightmap");
+
+		for (uint32_t z = 0; z < heightmap.height; ++z)
+		{
+			for (uint32_t x = 0; x < heightmap.width; ++x)
+			{
+				auto height = [&](uint32_t hx, uint32_t hz) { return heightmap.GetRow(std::min(hz, heightmap.height - 1))[std::min(hx, heightmap.width - 1)]; };
+
+				float centre = height(x, z);
+				float dx = Difference(x > 0 ? height(x - 1, z) : centre, centre, height(x + 1, z), x, heightmap.width);
+				float dz = Difference(z > 0 ? height(x, z - 1) : centre, centre, height(x, z + 1), z, heightmap.height);
+
+				float length = std::sqrt(dx * dx + dz * dz + 1.0f);
+				const auto& normal = normals[static_cast<size_t>(z) * heightmap.width + x];
+				if (!Near(normal.x, -dx / length) || !Near(normal.y, 1.0f / length) || !Near(normal.z, -dz / length))
+					throw std::runtime_error("Normal differs from central differences at " + std::to_string(x) + ", " + std::to_string(z));
+
+				if (!Near(slopes.GetRow(z)[x], std::sqrt(dx * dx + dz * dz)))
+					throw std::runtime_error("Slope differs from central differences at " + std::to_string(x) + ", " + std::to_string(z));
+			}
+		}
+	}
+
+	// Texels of the level below under [begin, end) of a level size texels wide, the last one also taking the
+	// texel an odd edge leaves over
+	void Widen(uint32_t& begin, uint32_t& end, uint32_t size, uint32_t below_size)
+	{
+		end = end == size ? below_size : end * 2;
+		begin *= 2;
+	}
+
+	void CheckPyramid(const DX::Heightmap& heightmap)
+	{
+		DX::HeightmapPyramid pyramid = DX::BuildHeightmapPyramid(heightmap);
+		DX::HeightmapPyramid averages = DX::BuildHeightmapPyramid(heightmap, false);
+
+		// A full mip chain, sizes halved and rounded down to a single texel
+		uint32_t levels = 0;
+		while ((std::max(heightmap.width, heightmap.height) >> (levels + 1)) != 0)
+		{
+			levels++;
+		}
+
+		Check(pyramid.GetLevelCount() == levels, "Pyramid has " + std::to_string(pyramid.GetLevelCount()) + " levels instead of " + std::to_string(levels));
+		Check(pyramid.minimum.size() == levels && pyramid.maximum.size() == levels, "Pyramid bounds are missing levels");
+		Check(averages.GetLevelCount() == levels && averages.minimum.empty() && averages.maximum.empty(), "Pyramid without bounds still built them");
+
+		for (uint32_t level = 0; level < levels; ++level)
+		{
+			const DX::Heightmap& above = level == 0 ? heightmap : pyramid.average[level - 1];
+			const DX::Heightmap& average = pyramid.average[level];
+
+			uint32_t width = std::max(above.width / 2, 1u);
+			uint32_t height = std::max(above.height / 2, 1u);
+			const DX::Heightmap* mips[] = { &average, &pyramid.minimum[level], &pyramid.maximum[level] };
+			for (const auto* mip : mips)
+			{
+				Check(mip->width == width && mip->height == height, "Pyramid level " + std::to_string(level) + " is the wrong size");
+			}
+
+			Check(average.data == averages.average[level].data, "Averages differ with and without bounds");
+		}
+
+		// Every bound is the lowest or highest texel of the heightmap under it, and the average lies between
+		for (uint32_t level = 0; level < levels; ++level)
+		{
+			const DX::Heightmap& average = pyramid.average[level];
+			for (uint32_t z = 0; z < average.height; ++z)
+			{
+				for (uint32_t x = 0; x < average.width; ++x)
+				{
+					uint32_t x_begin = x, x_end = x + 1, z_begin = z, z_end = z + 1;
+					for (uint32_t below = level + 1; below-- > 0;)
+					{
+						const DX::Heightmap& mip = pyramid.average[below];
+						const DX::Heightmap& mip_below = below == 0 ? heightmap : pyramid.average[below - 1];
+						Widen(x_begin, x_end, mip.width, mip_below.width);
+						Widen(z_begin, z_end, mip.height, mip_below.height);
+					}
+
+					float lowest = heightmap.GetRow(z_begin)[x_begin];
+					float highest = lowest;
+					for (uint32_t source_z = z_begin; source_z < z_end; ++source_z)
+					{
+						const float* row = heightmap.GetRow(source_z);
+						for (uint32_t source_x = x_begin; source_x < x_end; ++source_x)
+						{
+							lowest = std::min(lowest, row[source_x]);
+							highest = std::max(highest, row[source_x]);
+						}
+					}
+
+					std::string texel = " at level " + std::to_string(level) + ", " + std::to_string(x) + ", " + std::to_string(z);
+					Check(pyramid.minimum[level].GetRow(z)[x] == lowest, "Lowest bound is not the lowest height" + texel);
+					Check(pyramid.maximum[level].GetRow(z)[x] == highest, "Highest bound is not the highest height" + texel);
+					Check(average.GetRow(z)[x] >= lowest - 1e-4f && average.GetRow(z)[x] <= highest + 1e-4f, "Average is outside the bounds" + texel);
+				}
+			}
+		}
+
+		// The first level averages the 2x2 texels under it, 3 wide at an odd edge
+		const DX::Heightmap& first = pyramid.average[0];
+		for (uint32_t z = 0; z < first.height; ++z)
+		{
+			for (uint32_t x = 0; x < first.width; ++x)
+			{
+				uint32_t x_begin = x, x_end = x + 1, z_begin = z, z_end = z + 1;
+				Widen(x_begin, x_end, first.width, heightmap.width);
+				Widen(z_begin, z_end, first.height, heightmap.height);
+
+				float sum = 0.0f;
+				for (uint32_t source_z = z_begin; source_z < z_end; ++source_z)
+				{
+					for (uint32_t source_x = x_begin; source_x < x_end; ++source_x)
+					{
+						sum += heightmap.GetRow(source_z)[source_x];
+					}
+				}
+
+				Check(Near(first.GetRow(z)[x], sum / ((x_end - x_begin) * (z_end - z_begin))), "First level is not the average under it");
+			}
+		}
+	}
+}
+
+void BenchmarkReading()
+{
+	// 16 bit texels written out to a scratch file
+	std::vector<uint16_t> texels(static_cast<size_t>(SIZE) * SIZE);
+	std::mt19937 random(3);
+	for (auto& texel : texels)
+	{
+		texel = static_cast<uint16_t>(random());
+	}
+
+	auto path = std::filesystem::temp_directory_path() / "heightmap_benchmark.raw";
+	{
+		std::ofstream file(path, std::ios::binary);
+		for (uint16_t texel : texels)
+		{
+			file.put(static_cast<char>(texel & 0xff));
+			file.put(static_cast<char>(texel >> 8));
+		}
+
+		if (!file)
+			throw std::runtime_error("Failed to write " + path.string());
+	}
+
+	PrintHeader();
+
+	DX::Heightmap heightmap;
+	ReportPass("read 16 bit", [&](ThreadPool& pool)
+	{
+		auto start = std::chrono::steady_clock::now();
+		heightmap = DX::ReadRawHeightmap(path, 16, HEIGHT_SCALE, 0, 0, pool);
+		return ElapsedMilliseconds(start);
+	});
+
+	std::filesystem::remove(path);
+
+	Check(heightmap.width == SIZE && heightmap.height == SIZE, "Read a " + std::to_string(heightmap.width) + " x " + std::to_string(heightmap.height) + " heightmap");
+	for (size_t i = 0; i < texels.size(); ++i)
+	{
+		if (!Near(heightmap.data[i], texels[i] * (HEIGHT_SCALE / 65535.0f), 1e-6f))
+			throw std::runtime_error("Texel " + std::to_string(i) + " read back wrong");
+	}
+}
+
+void BenchmarkBlur()
+{
+	CheckBoxBlur(CreateHeightmap(ODD_WIDTH, ODD_HEIGHT));
+	CheckGaussian(CreateHeightmap(ODD_WIDTH, ODD_HEIGHT));
+
+	DX::Heightmap heightmap = CreateHeightmap(SIZE, SIZE);
+	CheckBoxBlur(heightmap);
+
+	PrintHeader();
+
+	auto kernels = { std::make_pair("box, radius 1", DX::BoxKernel(1)), std::make_pair("box, radius 4", DX::BoxKernel(4)),
+		std::make_pair("gaussian, sigma 1.5", DX::GaussianKernel(GAUSSIAN_SIGMA)) };
+	for (const auto& [name, kernel] : kernels)
+	{
+		ReportPass(name, [&](ThreadPool& pool)
+		{
+			DX::Heightmap blurred = heightmap;
+
+			auto start = std::chrono::steady_clock::now();
+			DX::BlurHeightmap(blurred, kernel, pool);
+			return ElapsedMilliseconds(start);
+		});
+	}
+}
+
+void BenchmarkGradients()
+{
+	CheckGradients(CreateHeightmap(ODD_WIDTH, ODD_HEIGHT));
+	CheckGradients(CreateHeightmap(1, ODD_HEIGHT));
+
+	DX::Heightmap heightmap = CreateHeightmap(SIZE, SIZE);
+	CheckGradients(heightmap);
+
+	PrintHeader();
+
+	std::vector<DirectX::XMFLOAT3> normals;
+	ReportPass("normals", [&](ThreadPool& pool)
+	{
+		auto start = std::chrono::steady_clock::now();
+		DX::ComputeNormals(heightmap, CELL_SPACING, normals, pool);
+		return ElapsedMilliseconds(start);
+	});
+
+	ReportPass("slopes", [&](ThreadPool& pool)
+	{
+		auto start = std::chrono::steady_clock::now();
+		DX::Heightmap slopes = DX::ComputeSlopes(heightmap, CELL_SPACING, pool);
+		return ElapsedMilliseconds(start);
+	});
+}
+
+void BenchmarkPyramid()
+{
+	CheckPyramid(CreateHeightmap(ODD_WIDTH, ODD_HEIGHT));
+	CheckPyramid(CreateHeightmap(ODD_HEIGHT, 1));
+
+	DX::Heightmap heightmap = CreateHeightmap(SIZE, SIZE);
+	CheckPyramid(heightmap);
+
+	PrintHeader();
+
+	for (bool bounds : { false, true })
+	{
+		ReportPass(bounds ? "pyramid, bounds" : "pyramid, averages", [&](ThreadPool& pool)
+		{
+			auto start = std::chrono::steady_clock::now();
+			DX::HeightmapPyramid pyramid = DX::BuildHeightmapPyramid(heightmap, bounds, pool);
+			return ElapsedMilliseconds(start);
+		});
+	}
+}
@@ -0,0 +1,463 @@
+#include "DxHeightmap.h"
+#include "ThreadPool.h"
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+#include <cmath>
+
+namespace
+{
+	// Rows handed to a thread at once, enough to keep the cost of a job small next to its work
+	constexpr uint32_t ROWS_PER_JOB = 16;
+
+	// Run rows(z_begin, z_end) over bands of rows on the thread pool
+	template<typename Rows>
+	void ParallelRows(ThreadPool& pool, uint32_t height, const Rows& rows)
+	{
+		size_t jobs = (static_cast<size_t>(height) + ROWS_PER_JOB - 1) / ROWS_PER_JOB;
+		pool.ParallelFor(jobs, [&](size_t job)
+		{
+			uint32_t z_begin = static_cast<uint32_t>(job) * ROWS_PER_JOB;
+			rows(z_begin, std::min(z_begin + ROWS_PER_JOB, height));
+		});
+	}
+
+	DirectX::XMVECTOR Load(const float* source)
+	{
+		return DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(source));
+	}
+
+	void Store(float* dest, DirectX::FXMVECTOR value)
+	{
+		DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(dest), value);
+	}
+
+	// Filter one texel with the taps that land inside the row, weighted back up to one
+	float FilterEdge(const float* source, uint32_t width, uint32_t x, const std::vector<float>& kernel)
+	{
+		int64_t radius = static_cast<int64_t>(kernel.size() / 2);
+
+		auto sum = 0.0f;
+		auto weight = 0.0f;
+		for (int64_t k = 0; k < static_cast<int64_t>(kernel.size()); ++k)
+		{
+			int64_t tap = static_cast<int64_t>(x) + k - radius;
+			if (tap >= 0 && tap < width)
+			{
+				sum += kernel[k] * source[tap];
+				weight += kernel[k];
+			}
+		}
+
+		return sum / weight;
+	}
+
+	// Filter a row, four texels at a time where every tap is inside it
+	void FilterRow(const float* source, float* dest, uint32_t width, const std::vector<float>& kernel, const std::vector<DirectX::XMVECTOR>& weights)
+	{
+		uint32_t radius = static_cast<uint32_t>(kernel.size() / 2);
+		uint32_t begin = std::min(radius, width);
+		uint32_t end = width > radius ? std::max(width - radius, begin) : begin;
+
+		for (uint32_t x = 0; x < begin; ++x)
+		{
+			dest[x] = FilterEdge(source, width, x, kernel);
+		}
+
+		uint32_t x = begin;
+		for (; x + 4 <= end; x += 4)
+		{
+			const float* taps = source + x - radius;
+
+			DirectX::XMVECTOR sum = DirectX::XMVectorZero();
+			for (size_t k = 0; k < weights.size(); ++k)
+			{
+				sum = DirectX::XMVectorMultiplyAdd(weights[k], Load(taps + k), sum);
+			}
+
+			Store(dest + x, sum);
+		}
+
+		for (; x < width; ++x)
+		{
+			dest[x] = FilterEdge(source, width, x, kernel);
+		}
+	}
+
+	// Filter row z of the result down the columns of source, four columns at a time
+	void FilterColumns(const DX::Heightmap& source, uint32_t z, float* dest, const std::vector<float>& kernel)
+	{
+		int64_t radius = static_cast<int64_t>(kernel.size() / 2);
+
+		// Rows the taps land on, weighted back up to one near the top and bottom
+		std::vector<const float*> rows;
+		std::vector<float> row_weights;
+		auto total = 0.0f;
+		for (int64_t k = 0; k < static_cast<int64_t>(kernel.size()); ++k)
+		{
+			int64_t tap = static_cast<int64_t>(z) + k - radius;
+			if (tap >= 0 && tap < source.height)
+			{
+				rows.push_back(source.GetRow(static_cast<uint32_t>(tap)));
+				row_weights.push_back(kernel[k]);
+				total += kernel[k];
+			}
+		}
+
+		std::vector<DirectX::XMVECTOR> weights(row_weights.size());
+		for (size_t k = 0; k < row_weights.size(); ++k)
+		{
+			row_weights[k] /= total;
+			weights[k] = DirectX::XMVectorReplicate(row_weights[k]);
+		}
+
+		uint32_t x = 0;
+		for (; x + 4 <= source.width; x += 4)
+		{
+			DirectX::XMVECTOR sum = DirectX::XMVectorZero();
+			for (size_t k = 0; k < rows.size(); ++k)
+			{
+				sum = DirectX::XMVectorMultiplyAdd(weights[k], Load(rows[k] + x), sum);
+			}
+
+			Store(dest + x, sum);
+		}
+
+		for (; x < source.width; ++x)
+		{
+			auto sum = 0.0f;
+			for (size_t k = 0; k < rows.size(); ++k)
+			{
+				sum += row_weights[k] * rows[k][x];
+			}
+
+			dest[x] = sum;
+		}
+	}
+
+	// Neighbours of a texel along one axis, one sided at the edges, and the distance between them in cells
+	void GetNeighbours(uint32_t i, uint32_t count, uint32_t& low, uint32_t& high, float& cells)
+	{
+		low = i > 0 ? i - 1 : i;
+		high = i + 1 < count ? i + 1 : i;
+		cells = static_cast<float>(std::max(high - low, 1u));
+	}
+
+	// Height gradient of texel (x, z)
+	void GetGradient(const DX::Heightmap& heightmap, uint32_t x, uint32_t z, float cell_spacing, float& dx, float& dz)
+	{
+		uint32_t x0, x1, z0, z1;
+		float x_cells, z_cells;
+		GetNeighbours(x, heightmap.width, x0, x1, x_cells);
+		GetNeighbours(z, heightmap.height, z0, z1, z_cells);
+
+		const float* row = heightmap.GetRow(z);
+		dx = (row[x1] - row[x0]) / (x_cells * cell_spacing);
+		dz = (heightmap.GetRow(z1)[x] - heightmap.GetRow(z0)[x]) / (z_cells * cell_spacing);
+	}
+
+	// Height gradients along row z, four texels at a time away from the first and last column. Calls
+	// texels(x, dx, dz) with XMVECTOR gradients for four texels and with floats for one
+	template<typename Texels>
+	void ForEachGradient(const DX::Heightmap& heightmap, uint32_t z, float cell_spacing, const Texels& texels)
+	{
+		uint32_t z0, z1;
+		float z_cells;
+		GetNeighbours(z, heightmap.height, z0, z1, z_cells);
+
+		const float* row = heightmap.GetRow(z);
+		const float* above = heightmap.GetRow(z0);
+		const float* below = heightmap.GetRow(z1);
+
+		DirectX::XMVECTOR x_scale = DirectX::XMVectorReplicate(1.0f / (2.0f * cell_spacing));
+		DirectX::XMVECTOR z_scale = DirectX::XMVectorReplicate(1.0f / (z_cells * cell_spacing));
+
+		uint32_t x = 0;
+		if (heightmap.width > 0)
+		{
+			float dx, dz;
+			GetGradient(heightmap, x, z, cell_spacing, dx, dz);
+			texels(x++, dx, dz);
+		}
+
+		for (; x + 4 < heightmap.width; x += 4)
+		{
+			DirectX::XMVECTOR dx = DirectX::XMVectorMultiply(DirectX::XMVectorSubtract(Load(row + x + 1), Load(row + x - 1)), x_scale);
+			DirectX::XMVECTOR dz = DirectX::XMVectorMultiply(DirectX::XMVectorSubtract(Load(below + x), Load(above + x)), z_scale);
+			texels(x, dx, dz);
+		}
+
+		for (; x < heightmap.width; ++x)
+		{
+			float dx, dz;
+			GetGradient(heightmap, x, z, cell_spacing, dx, dz);
+			texels(x, dx, dz);
+		}
+	}
+
+	// Halve a level of the pyramid, sizes rounded down like Direct3D's mip chain. reduce(values, count) combines
+	// the texels under each new one, 2x2 of them, or up to 3x3 where the last texel on an odd edge also takes the
+	// row or column rounding down leaves out. reduce_vector(a, b, c, d) does four 2x2 blocks at once
+	template<typename Reduce, typename ReduceVector>
+	DX::Heightmap Downsample(ThreadPool& pool, const DX::Heightmap& source, const Reduce& reduce, const ReduceVector& reduce_vector)
+	{
+		DX::Heightmap dest(std::max(source.width / 2, 1u), std::max(source.height / 2, 1u));
+
+		// Texels 2 * i up to the next texel's, or up to the edge for the last one
+		auto source_end = [](uint32_t i, uint32_t dest_size, uint32_t source_size) { return i + 1 == dest_size ? source_size : i * 2 + 2; };
+
+		// Columns the vector loop may take, the last one of an odd row has three
+		const uint32_t vector_width = source.width % 2 == 1 ? dest.width - 1 : dest.width;
+
+		ParallelRows(pool, dest.height, [&](uint32_t z_begin, uint32_t z_end)
+		{
+			for (uint32_t z = z_begin; z < z_end; ++z)
+			{
+				const uint32_t rows_end = source_end(z, dest.height, source.height);
+				float* row = dest.GetRow(z);
+
+				// Eight source texels a row to four, split into even and odd columns
+				uint32_t x = 0;
+				const float* top = source.GetRow(z * 2);
+				const float* bottom = source.GetRow(std::min(z * 2 + 1, source.height - 1));
+				for (; rows_end == z * 2 + 2 && x + 4 <= vector_width; x += 4)
+				{
+					DirectX::XMVECTOR top_low = Load(top + x * 2);
+					DirectX::XMVECTOR top_high = Load(top + x * 2 + 4);
+					DirectX::XMVECTOR bottom_low = Load(bottom + x * 2);
+					DirectX::XMVECTOR bottom_high = Load(bottom + x * 2 + 4);
+
+					Store(row + x, reduce_vector(
+						DirectX::XMVectorPermute<0, 2, 4, 6>(top_low, top_high),
+						DirectX::XMVectorPermute<1, 3, 5, 7>(top_low, top_high),
+						DirectX::XMVectorPermute<0, 2, 4, 6>(bottom_low, bottom_high),
+						DirectX::XMVectorPermute<1, 3, 5, 7>(bottom_low, bottom_high)));
+				}
+
+				for (; x < dest.width; ++x)
+				{
+					float values[9];
+					size_t count = 0;
+					for (uint32_t source_z = z * 2; source_z < rows_end; ++source_z)
+					{
+						const float* source_row = source.GetRow(source_z);
+						for (uint32_t source_x = x * 2; source_x < source_end(x, dest.width, source.width); ++source_x)
+						{
+							values[count++] = source_row[source_x];
+						}
+					}
+
+					row[x] = reduce(values, count);
+				}
+			}
+		});
+
+		return dest;
+	}
+}
+
+DX::Heightmap DX::ReadRawHeightmap(const std::filesystem::path& path, uint32_t bits, float height_scale, uint32_t width, uint32_t height, ThreadPool& pool)
+{
+	if (bits != 8 && bits != 16)
+		throw std::runtime_error("Raw heightmaps are 8 or 16 bits per texel");
+
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Failed to open heightmap " + path.string());
+
+	size_t bytes_per_texel = bits / 8;
+	size_t file_size = static_cast<size_t>(std::filesystem::file_size(path));
+
+	// Assuming the heightmap is a square texture we can calculate size by sqrt
+	if (width == 0)
+	{
+		width = height = static_cast<uint32_t>(std::sqrt(static_cast<double>(file_size / bytes_per_texel)));
+	}
+
+	Heightmap heightmap(width, height);
+	if (heightmap.data.size() * bytes_per_texel > file_size)
+		throw std::runtime_error("Heightmap " + path.string() + " is smaller than its size");
+
+	std::vector<uint8_t> raw(heightmap.data.size() * bytes_per_texel);
+	file.read(reinterpret_cast<char*>(raw.data()), raw.size());
+
+	// Unsigned texels, so the top half of the range is not read back as negative
+	float scale = height_scale / static_cast<float>((1u << bits) - 1);
+	ParallelRows(pool, height, [&](uint32_t z_begin, uint32_t z_end)
+	{
+		for (size_t i = static_cast<size_t>(z_begin) * width; i < static_cast<size_t>(z_end) * width; ++i)
+		{
+			uint32_t texel = bits == 8 ? raw[i] : raw[i * 2] | (raw[i * 2 + 1] << 8);
+			heightmap.data[i] = texel * scale;
+		}
+	});
+
+	return heightmap;
+}
+
+std::vector<float> DX::BoxKernel(uint32_t radius)
+{
+	return std::vector<float>(static_cast<size_t>(radius) * 2 + 1, 1.0f / (radius * 2 + 1));
+}
+
+std::vector<float> DX::GaussianKernel(float sigma)
+{
+	if (sigma <= 0.0f)
+		return { 1.0f };
+
+	// Three standard deviations hold nearly all of the weight
+	int radius = static_cast<int>(std::ceil(sigma * 3.0f));
+
+	std::vector<float> kernel(static_cast<size_t>(radius) * 2 + 1);
+	auto total = 0.0f;
+	for (int i = -radius; i <= radius; ++i)
+	{
+		kernel[i + radius] = std::exp(-(i * i) / (2.0f * sigma * sigma));
+		total += kernel[i + radius];
+	}
+
+	for (auto& weight : kernel)
+	{
+		weight /= total;
+	}
+
+	return kernel;
+}
+
+void DX::BlurHeightmap(Heightmap& heightmap, const std::vector<float>& kernel, ThreadPool& pool)
+{
+	if (kernel.size() % 2 == 0)
+		throw std::runtime_error("Blur kernels need an odd number of taps");
+
+	std::vector<DirectX::XMVECTOR> weights(kernel.size());
+	for (size_t k = 0; k < kernel.size(); ++k)
+	{
+		weights[k] = DirectX::XMVectorReplicate(kernel[k]);
+	}
+
+	// Along the rows into a scratch heightmap, then down its columns back again
+	Heightmap rows(heightmap.width, heightmap.height);
+	ParallelRows(pool, heightmap.height, [&](uint32_t z_begin, uint32_t z_end)
+	{
+		for (uint32_t z = z_begin; z < z_end; ++z)
+		{
+			FilterRow(heightmap.GetRow(z), rows.GetRow(z), heightmap.width, kernel, weights);
+		}
+	});
+
+	ParallelRows(pool, heightmap.height, [&](uint32_t z_begin, uint32_t z_end)
+	{
+		for (uint32_t z = z_begin; z < z_end; ++z)
+		{
+			FilterColumns(rows, z, heightmap.GetRow(z), kernel);
+		}
+	});
+}
+
+void DX::ComputeNormals(const Heightmap& heightmap, float cell_spacing, std::vector<DirectX::XMFLOAT3>& normals, ThreadPool& pool)
+{
+	normals.resize(heightmap.data.size());
+
+	ParallelRows(pool, heightmap.height, [&](uint32_t z_begin, uint32_t z_end)
+	{
+		for (uint32_t z = z_begin; z < z_end; ++z)
+		{
+			DirectX::XMFLOAT3* row = normals.data() + static_cast<size_t>(z) * heightmap.width;
+
+			ForEachGradient(heightmap, z, cell_spacing, [&](uint32_t x, auto dx, auto dz)
+			{
+				if constexpr (std::is_same_v<decltype(dx), float>)
+				{
+					auto length = std::sqrt(dx * dx + dz * dz + 1.0f);
+					row[x] = DirectX::XMFLOAT3(-dx / length, 1.0f / length, -dz / length);
+				}
+				else
+				{
+					// Normalize (-dx, 1, -dz) for four texels, then write them out one by one
+					DirectX::XMVECTOR length_sq = DirectX::XMVectorMultiplyAdd(dx, dx, DirectX::XMVectorMultiplyAdd(dz, dz, DirectX::XMVectorReplicate(1.0f)));
+					DirectX::XMVECTOR inverse_length = DirectX::XMVectorReciprocalSqrt(length_sq);
+
+					DirectX::XMFLOAT4 nx, ny, nz;
+					DirectX::XMStoreFloat4(&nx, DirectX::XMVectorNegate(DirectX::XMVectorMultiply(dx, inverse_length)));
+					DirectX::XMStoreFloat4(&ny, inverse_length);
+					DirectX::XMStoreFloat4(&nz, DirectX::XMVectorNegate(DirectX::XMVectorMultiply(dz, inverse_length)));
+
+					row[x + 0] = DirectX::XMFLOAT3(nx.x, ny.x, nz.x);
+					row[x + 1] = DirectX::XMFLOAT3(nx.y, ny.y, nz.y);
+					row[x + 2] = DirectX::XMFLOAT3(nx.z, ny.z, nz.z);
+					row[x + 3] = DirectX::XMFLOAT3(nx.w, ny.w, nz.w);
+				}
+			});
+		}
+	});
+}
+
+DX::Heightmap DX::ComputeSlopes(const Heightmap& heightmap, float cell_spacing, ThreadPool& pool)
+{
+	Heightmap slopes(heightmap.width, heightmap.height);
+
+	ParallelRows(pool, heightmap.height, [&](uint32_t z_begin, uint32_t z_end)
+	{
+		for (uint32_t z = z_begin; z < z_end; ++z)
+		{
+			float* row = slopes.GetRow(z);
+
+			ForEachGradient(heightmap, z, cell_spacing, [&](uint32_t x, auto dx, auto dz)
+			{
+				if constexpr (std::is_same_v<decltype(dx), float>)
+				{
+					row[x] = std::sqrt(dx * dx + dz * dz);
+				}
+				else
+				{
+					Store(row + x, DirectX::XMVectorSqrt(DirectX::XMVectorMultiplyAdd(dx, dx, DirectX::XMVectorMultiply(dz, dz))));
+				}
+			});
+		}
+	});
+
+	return slopes;
+}
+
+DX::HeightmapPyramid DX::BuildHeightmapPyramid(const Heightmap& heightmap, bool bounds, ThreadPool& pool)
+{
+	HeightmapPyramid pyramid;
+
+	DirectX::XMVECTOR quarter = DirectX::XMVectorReplicate(0.25f);
+	auto average = [](const float* values, size_t count) { return std::accumulate(values, values + count, 0.0f) / count; };
+	auto average_vector = [&](DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::FXMVECTOR c, DirectX::GXMVECTOR d)
+	{
+		return DirectX::XMVectorMultiply(DirectX::XMVectorAdd(DirectX::XMVectorAdd(a, b), DirectX::XMVectorAdd(c, d)), quarter);
+	};
+
+	auto minimum = [](const float* values, size_t count) { return *std::min_element(values, values + count); };
+	auto minimum_vector = [](DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::FXMVECTOR c, DirectX::GXMVECTOR d)
+	{
+		return DirectX::XMVectorMin(DirectX::XMVectorMin(a, b), DirectX::XMVectorMin(c, d));
+	};
+
+	auto maximum = [](const float* values, size_t count) { return *std::max_element(values, values + count); };
+	auto maximum_vector = [](DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::FXMVECTOR c, DirectX::GXMVECTOR d)
+	{
+		return DirectX::XMVectorMax(DirectX::XMVectorMax(a, b), DirectX::XMVectorMax(c, d));
+	};
+
+	// Every kind of level starts from the heightmap, then from its own level above
+	const Heightmap* above = &heightmap;
+	while (above->width > 1 || above->height > 1)
+	{
+		bool first = pyramid.average.empty();
+		pyramid.average.push_back(Downsample(pool, first ? heightmap : pyramid.average.back(), average, average_vector));
+		if (bounds)
+		{
+			pyramid.minimum.push_back(Downsample(pool, first ? heightmap : pyramid.minimum.back(), minimum, minimum_vector));
+			pyramid.maximum.push_back(Downsample(pool, first ? heightmap : pyramid.maximum.back(), maximum, maximum_vector));
+		}
+
+		above = &pyramid.average.back();
+	}
+
+	return pyramid;
+}
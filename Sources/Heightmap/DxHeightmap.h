@@ -0,0 +1,61 @@
+#pragma once
+
+#include "ThreadPool.h"
+#include <DirectXMath.h>
+#include <filesystem>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// A grid of floats row by row, heights or anything else sampled like them
+	struct Heightmap
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		std::vector<float> data;
+
+		Heightmap() = default;
+		Heightmap(uint32_t width, uint32_t height) : width(width), height(height), data(static_cast<size_t>(width) * height) {}
+
+		float* GetRow(uint32_t z) { return data.data() + static_cast<size_t>(z) * width; }
+		const float* GetRow(uint32_t z) const { return data.data() + static_cast<size_t>(z) * width; }
+	};
+
+	// Passes below split their rows over pool, the application's shared pool unless another is given
+
+	// Read a raw heightmap of 8 or 16 bit little endian texels, scaled so the highest texel value is height_scale.
+	// A width of zero reads a square heightmap as large as the file
+	Heightmap ReadRawHeightmap(const std::filesystem::path& path, uint32_t bits, float height_scale, uint32_t width = 0, uint32_t height = 0,
+		ThreadPool& pool = ThreadPool::Get());
+
+	// Normalized weights of a 2 * radius + 1 tap filter
+	std::vector<float> BoxKernel(uint32_t radius);
+	std::vector<float> GaussianKernel(float sigma);
+
+	// Filter along rows then columns with a symmetric kernel. Taps past the edge are left out and the rest
+	// weighted up to make one, so a radius one box filter averages every texel with the neighbours it has
+	void BlurHeightmap(Heightmap& heightmap, const std::vector<float>& kernel, ThreadPool& pool = ThreadPool::Get());
+
+	// Unit normals from central differences, one sided at the edges, with texels cell_spacing apart
+	void ComputeNormals(const Heightmap& heightmap, float cell_spacing, std::vector<DirectX::XMFLOAT3>& normals, ThreadPool& pool = ThreadPool::Get());
+
+	// Steepness of every texel as rise over run, the same differences as the normals
+	Heightmap ComputeSlopes(const Heightmap& heightmap, float cell_spacing, ThreadPool& pool = ThreadPool::Get());
+
+	// Halved levels down to a single texel, the first half the size of the heightmap, which is not copied in.
+	// Sizes round down as Direct3D's do, so the heightmap and its levels are a full mip chain of
+	// GetLevelCount() + 1 levels. The last texel on an odd edge also covers the row or column left over.
+	// Averages are the mip chain below the heightmap, lowest and highest bound every texel under them for
+	// culling and ray marching. Without bounds only the averages are built
+	struct HeightmapPyramid
+	{
+		std::vector<Heightmap> average;
+		std::vector<Heightmap> minimum;
+		std::vector<Heightmap> maximum;
+
+		uint32_t GetLevelCount() const { return static_cast<uint32_t>(average.size()); }
+	};
+
+	HeightmapPyramid BuildHeightmapPyramid(const Heightmap& heightmap, bool bounds = true, ThreadPool& pool = ThreadPool::Get());
+}
@@ -2,9 +2,20 @@
 #include <DirectXMath.h>
 #include <vector>
 #include "GeometryGenerator.h"
-#include <fstream>
 #include <cmath>
 
+namespace
+{
+	constexpr auto HEIGHTMAP_PATH = "..\\..\\Resources\\terrain\\heightmap_white.raw";
+	constexpr uint32_t HEIGHTMAP_BITS = 8;
+
+	// Height of the highest texel value, one eighth of a byte's range
+	constexpr float HEIGHT_SCALE = 255.0f / 8.0f;
+
+	// Smooth by averaging every texel with its neighbours
+	constexpr uint32_t SMOOTHING_RADIUS = 1;
+}
+
 DX::Model::Model(DX::Renderer* renderer) : m_DxRenderer(renderer)
 {
 	World *= DirectX::XMMatrixTranslation(0.0f, 0.0f, 0.0f);
@@ -26,35 +37,19 @@ void DX::Model::Create()
 void DX::Model::LoadHeightmap(ID3D11Device* d3dDevice)
 {
 	// Load heightmap
-	std::ifstream file("..\\..\\Resources\\terrain\\heightmap_white.raw", std::fstream::in | std::fstream::binary);
-	std::vector<float> heightmap_data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-
-	// Scale down
-	for (size_t i = 0; i < heightmap_data.size(); i++)
-	{
-		heightmap_data[i] /= 8.0f;
-	}
-
-	// Assuming the heightmap is a square texture we can calculate size by sqrt
-	static int heightmap_size = static_cast<int>(std::sqrt(heightmap_data.size()));
+	auto heightmap = DX::ReadRawHeightmap(HEIGHTMAP_PATH, HEIGHTMAP_BITS, HEIGHT_SCALE);
 
 	// Smooth
-	std::vector<float> dest(heightmap_data.size());
-	for (int i = 0; i < heightmap_size; ++i)
-	{
-		for (int j = 0; j < heightmap_size; ++j)
-		{
-			dest[static_cast<size_t>(i * heightmap_size + j)] = Average(i, j, heightmap_data, heightmap_size);
-		}
-	}
+	DX::BlurHeightmap(heightmap, DX::BoxKernel(SMOOTHING_RADIUS));
 
-	heightmap_data = dest;
+	// Mips below the heightmap, the bounds are only needed for culling and ray marching
+	auto pyramid = DX::BuildHeightmapPyramid(heightmap, false);
 
 	// Create Direct3D 11 texture from heightmap data
 	D3D11_TEXTURE2D_DESC texture_desc = {};
-	texture_desc.Width = heightmap_size;
-	texture_desc.Height = heightmap_size;
-	texture_desc.MipLevels = 1;
+	texture_desc.Width = heightmap.width;
+	texture_desc.Height = heightmap.height;
+	texture_desc.MipLevels = pyramid.GetLevelCount() + 1;
 	texture_desc.ArraySize = 1;
 	texture_desc.Format = DXGI_FORMAT_R32_FLOAT;
 	texture_desc.SampleDesc.Count = 1;
@@ -62,12 +57,16 @@ void DX::Model::LoadHeightmap(ID3D11Device* d3dDevice)
 	texture_desc.Usage = D3D11_USAGE_DEFAULT;
 	texture_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
-	D3D11_SUBRESOURCE_DATA subresource_data = {};
-	subresource_data.pSysMem = heightmap_data.data();
-	subresource_data.SysMemPitch = heightmap_size * sizeof(float);
+	std::vector<D3D11_SUBRESOURCE_DATA> subresource_data(texture_desc.MipLevels);
+	for (UINT level = 0; level < texture_desc.MipLevels; ++level)
+	{
+		const auto& mip = level == 0 ? heightmap : pyramid.average[level - 1];
+		subresource_data[level].pSysMem = mip.data.data();
+		subresource_data[level].SysMemPitch = mip.width * sizeof(float);
+	}
 
 	ComPtr<ID3D11Texture2D> heightmap_texture = nullptr;
-	DX::Check(d3dDevice->CreateTexture2D(&texture_desc, &subresource_data, heightmap_texture.GetAddressOf()));
+	DX::Check(d3dDevice->CreateTexture2D(&texture_desc, subresource_data.data(), heightmap_texture.GetAddressOf()));
 
 	// Build Direct3D 11 shader resource view from texture
 	D3D11_SHADER_RESOURCE_VIEW_DESC resource_desc = {};
@@ -134,36 +133,3 @@ void DX::Model::Render()
 	// Render geometry
 	d3dDeviceContext->DrawIndexed(static_cast<UINT>(Indices.size()), 0, 0);
 }
-
-float DX::Model::Average(int i, int j, std::vector<float>& heightmap_data, int heightmap_size)
-{
-	// Function computes the average height of the ij element.
-	// It averages itself with its eight neighbor pixels.  
-	// Note that if a pixel is missing neighbor, we just don't include it in the average. Edge pixels don't have a neighbor pixel.
-	//
-	// ----------
-	// | 1| 2| 3|
-	// ----------
-	// | 4| x| 6|
-	// ----------
-	// | 7| 8| 9|
-	// ----------
-
-	auto average = 0.0f;
-	auto num = 0.0f;
-	for (int m = i - 1; m <= i + 1; ++m)
-	{
-		for (int n = j - 1; n <= j + 1; ++n)
-		{
-			auto in_bounds = (m >= 0 && m < heightmap_size) && (n >= 0 && n < heightmap_size);
-
-			if (in_bounds)
-			{
-				average += heightmap_data[static_cast<size_t>(m * heightmap_size + n)];
-				num += 1.0f;
-			}
-		}
-	}
-
-	return average / num;
-}
\ No newline at end of file
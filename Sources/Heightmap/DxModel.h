@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DxRenderer.h"
+#include "DxHeightmap.h"
 #include <vector>
 #include <DirectXColors.h>
 
@@ -53,8 +54,5 @@ namespace DX
 		// Heightmap texture
 		ComPtr<ID3D11ShaderResourceView> m_HeightmapTexture = nullptr;
 		void LoadHeightmap(ID3D11Device* d3dDevice);
-
-		// Average heightmap data
-		float Average(int i, int j, std::vector<float>& heightmap_data, int heightmap_size);
 	};
 }
\ No newline at end of file
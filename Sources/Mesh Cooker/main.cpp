@@ -0,0 +1,41 @@
+#include "DxMeshCache.h"
+#include "DxMeshImporter.h"
+#include <chrono>
+#include <iostream>
+#include <exception>
+
+// Cook models offline into the mesh caches the Skeletal Animation sample maps at startup, so it never has
+// to import them. Each cache is written next to its model
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "Usage: \"Mesh Cooker\" <model> [<model> ...]\n";
+		return -1;
+	}
+
+	int failures = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		const std::filesystem::path source_path = argv[i];
+		try
+		{
+			auto start = std::chrono::steady_clock::now();
+
+			DX::Mesh mesh = DX::ImportMesh(source_path);
+			auto cache_path = DX::MeshCache::GetCachePath(source_path);
+			DX::MeshCache::Write(cache_path, DX::MeshCache::HashSource(source_path), mesh);
+
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "Cooked " << cache_path.string() << ": " << mesh.vertices.size() << " vertices, " << mesh.indices.size() << " indices, "
+				<< mesh.bones.size() << " bones, " << mesh.animations.size() << " clips in " << milliseconds << " ms\n";
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "Could not cook " << source_path.string() << ": " << e.what() << "\n";
+			++failures;
+		}
+	}
+
+	return failures == 0 ? 0 : -1;
+}
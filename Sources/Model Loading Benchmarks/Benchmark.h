@@ -0,0 +1,15 @@
+#pragma once
+
+#include <chrono>
+
+// Models shared with the samples, relative to the project directory the benchmarks run from
+constexpr auto MODELS_PATH = "../../Resources/Models";
+
+// Milliseconds since start
+inline double ElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Simplify monkey.gltf to several targets and into the sample's LOD chain, and report throughput and error
+void BenchmarkSimplifier();
@@ -0,0 +1,183 @@
+#include "Benchmark.h"
+#include "DxSimplifier.h"
+#include "GltfModelLoader.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+namespace
+{
+	// Simplifications of every target, enough for the timings to settle
+	constexpr int SIMPLIFY_REPEATS = 50;
+
+	// Share of the triangles each run is asked to keep
+	constexpr float TARGETS[] = { 0.5f, 0.25f, 0.1f };
+
+	// The LOD chain DX::Model::BuildLods asks for
+	constexpr size_t LOD_COUNT = 4;
+	constexpr float LOD_REDUCTION = 0.5f;
+	constexpr float LOD_MAX_ERROR = 0.05f;
+
+	DirectX::XMVECTOR LoadPosition(const float* positions, UINT index)
+	{
+		return DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(positions + index * (sizeof(DX::Vertex) / sizeof(float))));
+	}
+
+	// Distance from point to the closest point of triangle abc
+	// Real-Time Collision Detection, 5.1.5
+	float DistanceToTriangle(DirectX::FXMVECTOR point, DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, DirectX::GXMVECTOR c)
+	{
+		using namespace DirectX;
+
+		XMVECTOR ab = XMVectorSubtract(b, a);
+		XMVECTOR ac = XMVectorSubtract(c, a);
+		XMVECTOR ap = XMVectorSubtract(point, a);
+		float d1 = XMVectorGetX(XMVector3Dot(ab, ap));
+		float d2 = XMVectorGetX(XMVector3Dot(ac, ap));
+
+		XMVECTOR bp = XMVectorSubtract(point, b);
+		float d3 = XMVectorGetX(XMVector3Dot(ab, bp));
+		float d4 = XMVectorGetX(XMVector3Dot(ac, bp));
+
+		XMVECTOR cp = XMVectorSubtract(point, c);
+		float d5 = XMVectorGetX(XMVector3Dot(ab, cp));
+		float d6 = XMVectorGetX(XMVector3Dot(ac, cp));
+
+		float va = d3 * d6 - d5 * d4;
+		float vb = d5 * d2 - d1 * d6;
+		float vc = d1 * d4 - d3 * d2;
+
+		XMVECTOR closest;
+		if (d1 <= 0.0f && d2 <= 0.0f)
+			closest = a;
+		else if (d3 >= 0.0f && d4 <= d3)
+			closest = b;
+		else if (d6 >= 0.0f && d5 <= d6)
+			closest = c;
+		else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+			closest = XMVectorAdd(a, XMVectorScale(ab, d1 / (d1 - d3)));
+		else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+			closest = XMVectorAdd(a, XMVectorScale(ac, d2 / (d2 - d6)));
+		else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+			closest = XMVectorAdd(b, XMVectorScale(XMVectorSubtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		else
+		{
+			float denominator = 1.0f / (va + vb + vc);
+			closest = XMVectorAdd(a, XMVectorAdd(XMVectorScale(ab, vb * denominator), XMVectorScale(ac, vc * denominator)));
+		}
+
+		return XMVectorGetX(XMVector3Length(XMVectorSubtract(point, closest)));
+	}
+
+	// Furthest any source vertex ended up from the simplified surface, relative to size
+	float MeasureError(const float* positions, const UINT* source, size_t source_count, const UINT* simplified, size_t simplified_count, float size)
+	{
+		float error = 0.0f;
+		for (size_t i = 0; i < source_count; ++i)
+		{
+			DirectX::XMVECTOR point = LoadPosition(positions, source[i]);
+
+			float distance = std::numeric_limits<float>::max();
+			for (size_t k = 0; k + 2 < simplified_count; k += 3)
+			{
+				distance = std::min(distance, DistanceToTriangle(point,
+					LoadPosition(positions, simplified[k]), LoadPosition(positions, simplified[k + 1]), LoadPosition(positions, simplified[k + 2])));
+			}
+
+			error = std::max(error, distance);
+		}
+
+		return size > 0.0f ? error / size : 0.0f;
+	}
+}
+
+void BenchmarkSimplifier()
+{
+	GltfModelLoader loader;
+	GltfFileData model = loader.Load(std::filesystem::path(MODELS_PATH) / "monkey.gltf");
+
+	for (size_t i = 0; i < model.model_object_data.size(); ++i)
+	{
+		const auto& obj = model.model_object_data[i];
+		size_t vertex_end = i + 1 < model.model_object_data.size() ? model.model_object_data[i + 1].base_vertex : model.vertices.size();
+		size_t vertex_count = vertex_end - obj.base_vertex;
+		const float* positions = &model.vertices[obj.base_vertex].x;
+		const UINT* indices = model.indices.data() + obj.index_start;
+		const size_t index_count = static_cast<size_t>(obj.index_count);
+		const size_t triangles = index_count / 3;
+
+		// Errors are relative to the largest side of the box around the object, as in BuildLods
+		DirectX::XMVECTOR low = DirectX::XMVectorReplicate(std::numeric_limits<float>::max());
+		DirectX::XMVECTOR high = DirectX::XMVectorReplicate(std::numeric_limits<float>::lowest());
+		for (size_t k = 0; k < index_count; ++k)
+		{
+			low = DirectX::XMVectorMin(low, LoadPosition(positions, indices[k]));
+			high = DirectX::XMVectorMax(high, LoadPosition(positions, indices[k]));
+		}
+
+		DirectX::XMFLOAT3 extent;
+		DirectX::XMStoreFloat3(&extent, DirectX::XMVectorSubtract(high, low));
+		float size = std::max({ extent.x, extent.y, extent.z });
+
+		// Error is what the simplifier reported, measured is the furthest a source vertex is from the result
+		std::cout << "object " << i << ": " << triangles << " triangles, " << vertex_count << " vertices\n" << std::fixed
+			<< std::left << std::setw(12) << "target" << std::right << std::setw(10) << "triangles" << std::setw(10) << "ms"
+			<< std::setw(12) << "M tris/s" << std::setw(10) << "error" << std::setw(10) << "measured" << "\n";
+
+		std::vector<UINT> simplified(index_count);
+		for (float target : TARGETS)
+		{
+			size_t target_index_count = static_cast<size_t>(triangles * target) * 3;
+			size_t count = 0;
+			float error = 0.0f;
+
+			auto start = std::chrono::steady_clock::now();
+			for (int repeat = 0; repeat < SIMPLIFY_REPEATS; ++repeat)
+			{
+				count = DX::SimplifyMesh(simplified.data(), indices, index_count, positions, vertex_count, sizeof(DX::Vertex),
+					target_index_count, 1.0f, &error);
+			}
+
+			double ms = ElapsedMilliseconds(start) / SIMPLIFY_REPEATS;
+			std::cout << std::left << std::setw(12) << std::to_string(static_cast<int>(target * 100.0f)) + "%" << std::right
+				<< std::setw(10) << count / 3 << std::setprecision(3) << std::setw(10) << ms
+				<< std::setw(12) << (ms > 0.0 ? triangles / ms / 1000.0 : 0.0)
+				<< std::setprecision(4) << std::setw(10) << error
+				<< std::setw(10) << MeasureError(positions, indices, index_count, simplified.data(), count, size) << "\n";
+		}
+
+		// The whole chain as the sample builds it at load time
+		std::vector<UINT> lod_indices;
+		std::vector<DX::MeshLod> lods;
+		auto start = std::chrono::steady_clock::now();
+		for (int repeat = 0; repeat < SIMPLIFY_REPEATS; ++repeat)
+		{
+			lod_indices.clear();
+			lods.clear();
+			DX::BuildLodChain(indices, index_count, positions, vertex_count, sizeof(DX::Vertex), LOD_COUNT, LOD_REDUCTION, LOD_MAX_ERROR, lod_indices, lods);
+		}
+
+		double ms = ElapsedMilliseconds(start) / SIMPLIFY_REPEATS;
+
+		// Every LOD but the last was simplified into the next
+		size_t simplified_triangles = 0;
+		for (size_t lod = 0; lod + 1 < lods.size(); ++lod)
+		{
+			simplified_triangles += lods[lod].indexCount / 3;
+		}
+
+		std::cout << "LOD chain: " << lods.size() << " LODs in " << std::setprecision(3) << ms << " ms, "
+			<< (ms > 0.0 ? simplified_triangles / ms / 1000.0 : 0.0) << " M triangles/s\n";
+
+		for (size_t lod = 0; lod < lods.size(); ++lod)
+		{
+			const UINT* lod_start = lod_indices.data() + lods[lod].startIndex;
+			std::cout << std::left << std::setw(12) << "LOD " + std::to_string(lod) << std::right << std::setw(10) << lods[lod].indexCount / 3
+				<< std::setw(10) << "" << std::setw(12) << "" << std::setprecision(4) << std::setw(10) << lods[lod].error
+				<< std::setw(10) << MeasureError(positions, indices, index_count, lod_start, lods[lod].indexCount, size) << "\n";
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Models shared with the samples, relative to the project directory the tests run from
+constexpr auto MODELS_PATH = "../../Resources/Models";
+
+// Fail the running test with message unless condition holds
+inline void Expect(bool condition, const std::string& message)
+{
+	if (!condition)
+		throw std::runtime_error(message);
+}
+
+// Every glTF model in MODELS_PATH, sorted by name
+inline std::vector<std::filesystem::path> GetModelPaths()
+{
+	std::vector<std::filesystem::path> paths;
+	for (const auto& entry : std::filesystem::directory_iterator(MODELS_PATH))
+	{
+		auto extension = entry.path().extension();
+		if (extension == ".gltf" || extension == ".glb")
+		{
+			paths.push_back(entry.path());
+		}
+	}
+
+	std::sort(paths.begin(), paths.end());
+	return paths;
+}
+
+// Optimize every model's index order and report the vertex cache ACMR and ATVR before and after
+void TestMeshOptimizer();
+
+// Round trip packed positions, normals and texture coordinates, and split draws for 16 bit indices
+void TestMeshPacker();
+
+// Cull meshlets from cameras around a mesh and check no visible triangle is lost
+void TestMeshletCulling();
@@ -0,0 +1,103 @@
+#include "Test.h"
+#include "DxMeshOptimizer.h"
+#include "GltfModelLoader.h"
+#include <array>
+#include <iomanip>
+#include <iostream>
+#include <tuple>
+
+namespace
+{
+	// Overdraw ordering may give back this much of what the cache ordering won in each cluster, the sample's default
+	constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+	using Triangle = std::array<float, 9>;
+
+	// Triangles as their corner positions, each turned to start at its smallest corner so the winding is
+	// kept and the order of the indices doesn't matter
+	std::vector<Triangle> GetTriangles(const DX::Vertex* vertices, const UINT* indices, size_t index_count)
+	{
+		std::vector<Triangle> triangles;
+		for (size_t i = 0; i + 2 < index_count; i += 3)
+		{
+			std::array<DX::Vertex, 3> corners = { vertices[indices[i]], vertices[indices[i + 1]], vertices[indices[i + 2]] };
+			auto less = [](const DX::Vertex& a, const DX::Vertex& b) { return std::tie(a.x, a.y, a.z) < std::tie(b.x, b.y, b.z); };
+			std::rotate(corners.begin(), std::min_element(corners.begin(), corners.end(), less), corners.end());
+
+			Triangle triangle;
+			for (size_t k = 0; k < 3; ++k)
+			{
+				triangle[k * 3] = corners[k].x;
+				triangle[k * 3 + 1] = corners[k].y;
+				triangle[k * 3 + 2] = corners[k].z;
+			}
+
+			triangles.push_back(triangle);
+		}
+
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+}
+
+void TestMeshOptimizer()
+{
+	std::cout << std::left << std::setw(24) << "model" << std::right << std::setw(10) << "triangles"
+		<< std::setw(16) << "ACMR" << std::setw(16) << "ATVR" << "\n" << std::fixed << std::setprecision(3);
+
+	for (const auto& path : GetModelPaths())
+	{
+		GltfModelLoader loader;
+		GltfFileData model = loader.Load(path);
+		const std::string name = path.filename().string();
+
+		size_t triangles = 0;
+		size_t unique_vertices = 0;
+		size_t transformed_before = 0;
+		size_t transformed_after = 0;
+
+		// The same passes DX::Model::Optimize runs on every object
+		for (size_t i = 0; i < model.model_object_data.size(); ++i)
+		{
+			const auto& obj = model.model_object_data[i];
+			size_t vertex_end = i + 1 < model.model_object_data.size() ? model.model_object_data[i + 1].base_vertex : model.vertices.size();
+			size_t vertex_count = vertex_end - obj.base_vertex;
+
+			UINT* obj_indices = model.indices.data() + obj.index_start;
+			DX::Vertex* obj_vertices = model.vertices.data() + obj.base_vertex;
+
+			const std::vector<Triangle> source = GetTriangles(obj_vertices, obj_indices, obj.index_count);
+			DX::VertexCacheStatistics before = DX::AnalyzeVertexCache(obj_indices, obj.index_count, vertex_count);
+
+			DX::OptimizeVertexCache(obj_indices, obj_indices, obj.index_count, vertex_count);
+			DX::VertexCacheStatistics cache = DX::AnalyzeVertexCache(obj_indices, obj.index_count, vertex_count);
+
+			DX::OptimizeOverdraw(obj_indices, obj_indices, obj.index_count, &obj_vertices->x, vertex_count, sizeof(DX::Vertex), OVERDRAW_THRESHOLD);
+			size_t used = DX::OptimizeVertexFetch(obj_vertices, obj_indices, obj.index_count, obj_vertices, vertex_count, sizeof(DX::Vertex));
+			DX::VertexCacheStatistics after = DX::AnalyzeVertexCache(obj_indices, obj.index_count, vertex_count);
+
+			// Only the order changes
+			Expect(GetTriangles(obj_vertices, obj_indices, obj.index_count) == source, name + ": object " + std::to_string(i) + " draws different triangles");
+			Expect(used == before.unique_vertices, name + ": object " + std::to_string(i) + " kept " + std::to_string(used) + " of " + std::to_string(before.unique_vertices) + " used vertices");
+			Expect(std::all_of(obj_indices, obj_indices + obj.index_count, [&](UINT index) { return index < used; }), name + ": object " + std::to_string(i) + " indexes a dropped vertex");
+
+			// The threshold holds per cluster rather than over the whole object, so overdraw order may give
+			// back a little of what cache order won but never more than all of it
+			Expect(cache.vertices_transformed <= before.vertices_transformed, name + ": object " + std::to_string(i) + " cache order transforms more vertices");
+			Expect(after.vertices_transformed <= before.vertices_transformed, name + ": object " + std::to_string(i) + " overdraw order transforms more vertices than the source");
+
+			triangles += before.triangles;
+			unique_vertices += before.unique_vertices;
+			transformed_before += before.vertices_transformed;
+			transformed_after += after.vertices_transformed;
+		}
+
+		if (triangles == 0)
+			continue;
+
+		// ACMR is vertices transformed per triangle, ATVR per vertex used
+		std::cout << std::left << std::setw(24) << name << std::right << std::setw(10) << triangles
+			<< std::setw(7) << static_cast<float>(transformed_before) / triangles << " -> " << static_cast<float>(transformed_after) / triangles
+			<< std::setw(7) << static_cast<float>(transformed_before) / unique_vertices << " -> " << static_cast<float>(transformed_after) / unique_vertices << "\n";
+	}
+}
@@ -0,0 +1,271 @@
+#include "Test.h"
+#include "DxMeshPacker.h"
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <set>
+
+namespace
+{
+	// Random attributes round tripped through each packing
+	constexpr size_t ATTRIBUTE_COUNT = 100000;
+
+	// Side of the grid split into several 16 bit draws, (GRID_SIZE + 1)^2 vertices
+	constexpr UINT GRID_SIZE = 400;
+
+	// Normals come back within this many radians
+	constexpr double NORMAL_TOLERANCE = 0.0001;
+
+	// Smallest normal half, below it halves lose precision and the error is absolute
+	constexpr float HALF_MIN_NORMAL = 6.1035156e-5f;
+
+	struct Position
+	{
+		float x;
+		float y;
+		float z;
+	};
+
+	void TestPositions(std::mt19937& random)
+	{
+		// A flat box away from the origin, so every axis has its own offset and scale
+		std::uniform_real_distribution<float> coordinate(-50.0f, 120.0f);
+		std::vector<Position> positions(ATTRIBUTE_COUNT);
+		for (auto& position : positions)
+		{
+			position = { coordinate(random), coordinate(random) * 0.1f, coordinate(random) };
+		}
+
+		std::vector<uint16_t> packed(ATTRIBUTE_COUNT * 4);
+		DX::PositionQuantization quantization = DX::QuantizePositions(&positions[0].x, ATTRIBUTE_COUNT, sizeof(Position), packed.data());
+
+		std::vector<DirectX::XMFLOAT3> unpacked(ATTRIBUTE_COUNT);
+		DX::DequantizePositions(packed.data(), ATTRIBUTE_COUNT, quantization, unpacked.data());
+
+		// Half a step plus the rounding of a float the size of the box
+		const float bounds[3] =
+		{
+			quantization.scale.x / 131070.0f + 120.0f * FLT_EPSILON,
+			quantization.scale.y / 131070.0f + 120.0f * FLT_EPSILON,
+			quantization.scale.z / 131070.0f + 120.0f * FLT_EPSILON
+		};
+
+		const DirectX::XMMATRIX matrix = quantization.GetMatrix();
+		float max_error = 0.0f;
+		for (size_t i = 0; i < ATTRIBUTE_COUNT; ++i)
+		{
+			const float errors[3] =
+			{
+				std::abs(unpacked[i].x - positions[i].x),
+				std::abs(unpacked[i].y - positions[i].y),
+				std::abs(unpacked[i].z - positions[i].z)
+			};
+
+			for (size_t k = 0; k < 3; ++k)
+			{
+				Expect(errors[k] <= bounds[k], "position " + std::to_string(i) + " is " + std::to_string(errors[k]) + " off");
+				max_error = std::max(max_error, errors[k]);
+			}
+
+			Expect(packed[i * 4 + 3] == 0, "position " + std::to_string(i) + " has a fourth component");
+
+			// The matrix the vertex shader gets lands on the same place
+			DirectX::XMVECTOR unorm = DirectX::XMVectorSet(packed[i * 4] / 65535.0f, packed[i * 4 + 1] / 65535.0f, packed[i * 4 + 2] / 65535.0f, 1.0f);
+			DirectX::XMVECTOR transformed = DirectX::XMVector3TransformCoord(unorm, matrix);
+			DirectX::XMVECTOR expected = DirectX::XMLoadFloat3(&unpacked[i]);
+			Expect(DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(transformed, expected))) <= 1e-3f,
+				"position " + std::to_string(i) + " moves through the quantization matrix");
+		}
+
+		std::cout << "positions: max error " << max_error << ", bounds " << bounds[0] << " " << bounds[1] << " " << bounds[2] << '\n';
+	}
+
+	void TestNormals(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> component(-1.0f, 1.0f);
+		std::vector<Position> normals(ATTRIBUTE_COUNT);
+		for (auto& normal : normals)
+		{
+			DirectX::XMVECTOR direction = DirectX::XMVector3Normalize(DirectX::XMVectorSet(component(random), component(random), component(random), 0.0f));
+			DirectX::XMStoreFloat3(reinterpret_cast<DirectX::XMFLOAT3*>(&normal), direction);
+		}
+
+		// The corners and folds of the octahedron
+		normals[0] = { 0.0f, 0.0f, -1.0f };
+		normals[1] = { 0.0f, 0.0f, 1.0f };
+		normals[2] = { 1.0f, 0.0f, 0.0f };
+		normals[3] = { 0.0f, -1.0f, 0.0f };
+		normals[4] = { -0.70710678f, 0.0f, -0.70710678f };
+
+		std::vector<int16_t> packed(ATTRIBUTE_COUNT * 2);
+		DX::EncodeNormals(&normals[0].x, ATTRIBUTE_COUNT, sizeof(Position), packed.data());
+
+		std::vector<DirectX::XMFLOAT3> unpacked(ATTRIBUTE_COUNT);
+		DX::DecodeNormals(packed.data(), ATTRIBUTE_COUNT, unpacked.data());
+
+		double max_angle = 0.0;
+		for (size_t i = 0; i < ATTRIBUTE_COUNT; ++i)
+		{
+			const Position& a = normals[i];
+			const DirectX::XMFLOAT3& b = unpacked[i];
+
+			// Angle from the length of the cross product and the dot product, in double so it holds up when tiny
+			double cross[3] =
+			{
+				static_cast<double>(a.y) * b.z - static_cast<double>(a.z) * b.y,
+				static_cast<double>(a.z) * b.x - static_cast<double>(a.x) * b.z,
+				static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x
+			};
+
+			double dot = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y + static_cast<double>(a.z) * b.z;
+			double angle = std::atan2(std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]), dot);
+			double length = std::sqrt(static_cast<double>(b.x) * b.x + static_cast<double>(b.y) * b.y + static_cast<double>(b.z) * b.z);
+
+			Expect(angle <= NORMAL_TOLERANCE, "normal " + std::to_string(i) + " is " + std::to_string(angle) + " radians off");
+			Expect(std::abs(length - 1.0) <= 1e-5, "normal " + std::to_string(i) + " isn't unit length");
+			max_angle = std::max(max_angle, angle);
+		}
+
+		std::cout << "normals: max error " << max_angle << " radians\n";
+	}
+
+	void TestTexCoords(std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> coordinate(-2.0f, 3.0f);
+		std::vector<DirectX::XMFLOAT2> tex_coords(ATTRIBUTE_COUNT);
+		for (auto& tex_coord : tex_coords)
+		{
+			tex_coord = { coordinate(random), coordinate(random) };
+		}
+
+		// Exact values, subnormal halves and values that round up to the next power of two
+		tex_coords[0] = { 0.0f, 1.0f };
+		tex_coords[1] = { 1.0e-6f, -3.0e-7f };
+		tex_coords[2] = { 0.99999f, 2047.9f };
+
+		std::vector<uint16_t> packed(ATTRIBUTE_COUNT * 2);
+		DX::PackTexCoords(&tex_coords[0].x, ATTRIBUTE_COUNT, sizeof(DirectX::XMFLOAT2), packed.data());
+
+		std::vector<DirectX::XMFLOAT2> unpacked(ATTRIBUTE_COUNT);
+		DX::UnpackTexCoords(packed.data(), ATTRIBUTE_COUNT, unpacked.data());
+
+		float max_error = 0.0f;
+		for (size_t i = 0; i < ATTRIBUTE_COUNT; ++i)
+		{
+			const float source[2] = { tex_coords[i].x, tex_coords[i].y };
+			const float result[2] = { unpacked[i].x, unpacked[i].y };
+
+			for (size_t k = 0; k < 2; ++k)
+			{
+				float magnitude = std::abs(source[k]);
+				float error = std::abs(result[k] - source[k]);
+				float bound = magnitude >= HALF_MIN_NORMAL ? magnitude * std::ldexp(1.0f, -11) : std::ldexp(1.0f, -25);
+
+				Expect(error <= bound, "texture coordinate " + std::to_string(i) + " is " + std::to_string(error) + " off");
+				if (magnitude >= HALF_MIN_NORMAL)
+				{
+					max_error = std::max(max_error, error / magnitude);
+				}
+			}
+		}
+
+		Expect(unpacked[0].x == 0.0f && unpacked[0].y == 1.0f, "0 and 1 don't come back exactly");
+		std::cout << "texture coordinates: max relative error " << max_error << '\n';
+	}
+
+	// A grid too large for 16 bit indices and a single triangle after it, drawn from another base vertex
+	void TestIndexSplit()
+	{
+		std::vector<Position> vertices;
+		for (UINT y = 0; y <= GRID_SIZE; ++y)
+		{
+			for (UINT x = 0; x <= GRID_SIZE; ++x)
+			{
+				vertices.push_back({ static_cast<float>(x), static_cast<float>(y), 0.0f });
+			}
+		}
+
+		std::vector<UINT> indices;
+		for (UINT y = 0; y < GRID_SIZE; ++y)
+		{
+			for (UINT x = 0; x < GRID_SIZE; ++x)
+			{
+				UINT a = y * (GRID_SIZE + 1) + x;
+				UINT c = a + GRID_SIZE + 1;
+				indices.insert(indices.end(), { a, c, a + 1, a + 1, c, c + 1 });
+			}
+		}
+
+		const UINT grid_index_count = static_cast<UINT>(indices.size());
+		const UINT triangle_base = static_cast<UINT>(vertices.size());
+		vertices.push_back({ -1.0f, -1.0f, -1.0f });
+		vertices.push_back({ -2.0f, -1.0f, -1.0f });
+		vertices.push_back({ -1.0f, -2.0f, -1.0f });
+		indices.insert(indices.end(), { 0, 1, 2 });
+
+		std::vector<DX::IndexedDraw> draws(2);
+		draws[0] = { 0, grid_index_count, 0, 0 };
+		draws[1] = { grid_index_count, 3, triangle_base, 1 };
+
+		std::vector<DX::IndexedDraw> packed_draws;
+		std::vector<uint16_t> packed_indices;
+		std::vector<uint8_t> packed_vertices;
+		DX::PackIndices16(draws, indices, vertices.data(), sizeof(Position), packed_draws, packed_indices, packed_vertices);
+
+		// Every triangle drawn, as its corners and the draw it came from
+		using Triangle = std::array<float, 10>;
+		auto make_triangle = [](const Position* vertices, UINT a, UINT b, UINT c, UINT source)
+		{
+			return Triangle{ vertices[a].x, vertices[a].y, vertices[a].z, vertices[b].x, vertices[b].y, vertices[b].z, vertices[c].x, vertices[c].y, vertices[c].z, static_cast<float>(source) };
+		};
+
+		std::multiset<Triangle> source;
+		for (const auto& draw : draws)
+		{
+			const Position* draw_vertices = vertices.data() + draw.baseVertex;
+			for (UINT i = 0; i < draw.indexCount; i += 3)
+			{
+				const UINT* triangle = indices.data() + draw.startIndex + i;
+				source.insert(make_triangle(draw_vertices, triangle[0], triangle[1], triangle[2], draw.source));
+			}
+		}
+
+		const Position* unpacked = reinterpret_cast<const Position*>(packed_vertices.data());
+		const size_t packed_vertex_count = packed_vertices.size() / sizeof(Position);
+
+		std::multiset<Triangle> result;
+		for (size_t d = 0; d < packed_draws.size(); ++d)
+		{
+			const auto& draw = packed_draws[d];
+			size_t vertex_end = d + 1 < packed_draws.size() ? packed_draws[d + 1].baseVertex : packed_vertex_count;
+			size_t draw_vertex_count = vertex_end - draw.baseVertex;
+			Expect(draw_vertex_count <= DX::MAX_16BIT_VERTICES, "draw " + std::to_string(d) + " has " + std::to_string(draw_vertex_count) + " vertices");
+
+			for (UINT i = 0; i < draw.indexCount; i += 3)
+			{
+				const uint16_t* triangle = packed_indices.data() + draw.startIndex + i;
+				Expect(triangle[0] < draw_vertex_count && triangle[1] < draw_vertex_count && triangle[2] < draw_vertex_count,
+					"draw " + std::to_string(d) + " indexes past its vertices");
+
+				result.insert(make_triangle(unpacked + draw.baseVertex, triangle[0], triangle[1], triangle[2], draw.source));
+			}
+		}
+
+		Expect(packed_draws.size() > draws.size(), "the grid wasn't split");
+		Expect(result == source, "the packed draws don't draw the same triangles");
+
+		std::cout << "16 bit draws: " << draws.size() << " -> " << packed_draws.size() << ", vertices " << vertices.size() << " -> " << packed_vertex_count
+			<< ", index bytes " << indices.size() * sizeof(UINT) << " -> " << packed_indices.size() * sizeof(uint16_t) << '\n';
+	}
+}
+
+void TestMeshPacker()
+{
+	std::mt19937 random(5);
+	TestPositions(random);
+	TestNormals(random);
+	TestTexCoords(random);
+	TestIndexSplit();
+}
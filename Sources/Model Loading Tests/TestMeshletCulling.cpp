@@ -0,0 +1,186 @@
+#include "Test.h"
+#include "DxMeshlets.h"
+#include "DxMeshOptimizer.h"
+#include "GltfModelLoader.h"
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <set>
+
+namespace
+{
+	// Rings and segments of the unit sphere
+	constexpr UINT SPHERE_RINGS = 200;
+	constexpr UINT SPHERE_SEGMENTS = 400;
+
+	// Cameras around the mesh, looking at it, and one more looking away
+	constexpr UINT ORBIT_CAMERAS = 8;
+	constexpr float ORBIT_DISTANCE = 4.0f;
+
+	// Least share of the triangles a camera outside the sphere should cull, it sees at most half of it
+	constexpr float MIN_OUTSIDE_CULLED = 0.3f;
+
+	struct Mesh
+	{
+		std::string name;
+		std::vector<DX::Vertex> vertices;
+		std::vector<UINT> indices;
+	};
+
+	// Unit sphere, clockwise seen from outside like the rasterizer's front faces
+	Mesh CreateSphere()
+	{
+		Mesh mesh;
+		mesh.name = "sphere";
+		for (UINT ring = 0; ring <= SPHERE_RINGS; ++ring)
+		{
+			for (UINT segment = 0; segment <= SPHERE_SEGMENTS; ++segment)
+			{
+				float theta = DirectX::XM_PI * ring / SPHERE_RINGS;
+				float phi = DirectX::XM_2PI * segment / SPHERE_SEGMENTS;
+				mesh.vertices.push_back({ std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) });
+			}
+		}
+
+		for (UINT ring = 0; ring < SPHERE_RINGS; ++ring)
+		{
+			for (UINT segment = 0; segment < SPHERE_SEGMENTS; ++segment)
+			{
+				UINT a = ring * (SPHERE_SEGMENTS + 1) + segment;
+				UINT d = a + SPHERE_SEGMENTS + 1;
+				mesh.indices.insert(mesh.indices.end(), { a, a + 1, d, a + 1, d + 1, d });
+			}
+		}
+
+		return mesh;
+	}
+
+	// A model mirrored into the left handed space the sample draws it in, scaled into the unit sphere
+	Mesh LoadModel(const char* name)
+	{
+		GltfModelLoader loader;
+		GltfFileData model = loader.Load(std::filesystem::path(MODELS_PATH) / name);
+
+		Mesh mesh;
+		mesh.name = name;
+		mesh.vertices = std::move(model.vertices);
+		mesh.indices = std::move(model.indices);
+
+		float size = 0.0f;
+		for (const auto& vertex : mesh.vertices)
+		{
+			size = std::max(size, std::sqrt(vertex.x * vertex.x + vertex.y * vertex.y + vertex.z * vertex.z));
+		}
+
+		for (auto& vertex : mesh.vertices)
+		{
+			vertex = { vertex.x / size, vertex.y / size, -vertex.z / size };
+		}
+
+		return mesh;
+	}
+
+	// Whether a triangle faces eye and has a corner inside the frustum, so the rasterizer would draw some of it
+	bool IsVisible(const DX::Vertex* corners[3], DirectX::FXMMATRIX view_projection, DirectX::FXMVECTOR eye)
+	{
+		using namespace DirectX;
+
+		XMVECTOR a = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(corners[0]));
+		XMVECTOR b = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(corners[1]));
+		XMVECTOR c = XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(corners[2]));
+
+		XMVECTOR normal = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+		if (XMVectorGetX(XMVector3Dot(normal, XMVectorSubtract(a, eye))) >= 0.0f)
+			return false;
+
+		for (XMVECTOR corner : { a, b, c })
+		{
+			XMVECTOR clip = XMVector4Transform(XMVectorSetW(corner, 1.0f), view_projection);
+			float w = XMVectorGetW(clip);
+			if (w > 0.0f && std::abs(XMVectorGetX(clip)) <= w && std::abs(XMVectorGetY(clip)) <= w && XMVectorGetZ(clip) >= 0.0f && XMVectorGetZ(clip) <= w)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Cull from one camera and check no visible triangle went missing. Returns the share culled
+	float CheckCamera(const Mesh& mesh, const DX::MeshletData& meshlets, DirectX::FXMVECTOR eye, DirectX::FXMVECTOR target)
+	{
+		using namespace DirectX;
+
+		XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+		XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(50.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+		XMMATRIX view_projection = XMMatrixMultiply(view, projection);
+
+		std::vector<UINT> indices;
+		DX::MeshletCullStatistics statistics = DX::CullMeshlets(meshlets, view_projection, eye, indices);
+		Expect(indices.size() == statistics.visible_triangles * 3, mesh.name + ": visible triangles don't match the indices");
+
+		std::multiset<std::array<UINT, 3>> drawn;
+		for (size_t i = 0; i + 2 < indices.size(); i += 3)
+		{
+			drawn.insert({ indices[i], indices[i + 1], indices[i + 2] });
+		}
+
+		for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+		{
+			const DX::Vertex* corners[3] = { &mesh.vertices[mesh.indices[i]], &mesh.vertices[mesh.indices[i + 1]], &mesh.vertices[mesh.indices[i + 2]] };
+			if (IsVisible(corners, view_projection, eye))
+			{
+				Expect(drawn.count({ mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] }) > 0, mesh.name + ": visible triangle " + std::to_string(i / 3) + " was culled");
+			}
+		}
+
+		std::cout << std::left << std::setw(24) << mesh.name << std::right << std::fixed << std::setprecision(1)
+			<< std::setw(10) << statistics.triangles << std::setw(10) << statistics.visible_triangles
+			<< std::setw(10) << statistics.meshlets << std::setw(10) << statistics.frustum_culled << std::setw(10) << statistics.backface_culled
+			<< std::setw(9) << statistics.GetCulledRatio() * 100.0f << "%\n";
+
+		return statistics.GetCulledRatio();
+	}
+}
+
+void TestMeshletCulling()
+{
+	using namespace DirectX;
+
+	// Triangles drawn, then meshlets tested and culled by each test
+	std::cout << std::left << std::setw(24) << "mesh" << std::right << std::setw(10) << "triangles" << std::setw(10) << "visible"
+		<< std::setw(10) << "meshlets" << std::setw(10) << "frustum" << std::setw(10) << "backface" << std::setw(10) << "culled" << "\n";
+
+	for (Mesh mesh : { CreateSphere(), LoadModel("monkey.gltf") })
+	{
+		// Built the way the sample builds them, from a cache optimized order
+		DX::OptimizeVertexCache(mesh.indices.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertices.size());
+
+		DX::MeshletData meshlets;
+		DX::BuildMeshlets(mesh.indices.data(), mesh.indices.size(), &mesh.vertices[0].x, mesh.vertices.size(), sizeof(DX::Vertex), meshlets);
+
+		for (const auto& meshlet : meshlets.meshlets)
+		{
+			Expect(meshlet.vertexCount <= DX::MESHLET_MAX_VERTICES && meshlet.triangleCount <= DX::MESHLET_MAX_TRIANGLES, mesh.name + ": meshlet over the limits");
+		}
+
+		// Orbit looking at the middle. Outside the mesh at most half of it faces the camera
+		for (UINT i = 0; i < ORBIT_CAMERAS; ++i)
+		{
+			float angle = XM_2PI * i / ORBIT_CAMERAS;
+			XMVECTOR eye = XMVectorSet(ORBIT_DISTANCE * std::sin(angle), 0.5f * (i % 3), -ORBIT_DISTANCE * std::cos(angle), 1.0f);
+
+			float culled = CheckCamera(mesh, meshlets, eye, XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f));
+			if (mesh.name == "sphere")
+			{
+				Expect(culled >= MIN_OUTSIDE_CULLED, mesh.name + ": culled only " + std::to_string(culled) + " from outside");
+			}
+		}
+
+		// Close enough that the frustum cuts the mesh
+		CheckCamera(mesh, meshlets, XMVectorSet(0.0f, 0.0f, -1.5f, 1.0f), XMVectorSet(0.6f, 0.0f, 0.0f, 1.0f));
+
+		// Looking away sees nothing
+		float culled = CheckCamera(mesh, meshlets, XMVectorSet(0.0f, 0.0f, -ORBIT_DISTANCE, 1.0f), XMVectorSet(0.0f, 0.0f, -2.0f * ORBIT_DISTANCE, 1.0f));
+		Expect(culled == 1.0f, mesh.name + ": looking away culled only " + std::to_string(culled));
+	}
+}
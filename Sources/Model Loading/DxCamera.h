@@ -26,6 +26,12 @@ namespace DX
 		// Get view matrix
 		constexpr DirectX::XMMATRIX GetView() { return m_View; }
 
+		// Vertical field of view in radians
+		float GetFieldOfViewRadians() const { return DirectX::XMConvertToRadians(m_FieldOfViewDegrees); }
+
+		// Height of the viewport in pixels
+		int GetViewportHeight() const { return m_ViewportHeight; }
+
 	private:
 		// Projection matrix
 		DirectX::XMMATRIX m_Projection;
@@ -45,6 +51,9 @@ namespace DX
 		// Float aspect ratio
 		float m_AspectRatio = 0.0f;
 
+		// Viewport height in pixels
+		int m_ViewportHeight = 0;
+
 		// Recalculates the projection based on the new window size
 		void CalculateProjection();
 	};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <cstddef>
+
+namespace DX
+{
+	// Post transform cache the statistics are simulated with, a small FIFO like most GPUs have
+	constexpr UINT VERTEX_CACHE_SIZE = 16;
+
+	// How well an index order uses the post transform vertex cache
+	struct VertexCacheStatistics
+	{
+		size_t triangles = 0;
+		size_t unique_vertices = 0;
+		size_t vertices_transformed = 0;
+
+		// Vertices transformed per triangle, 3 is no reuse and 0.5 is the best a regular grid can do
+		float acmr = 0.0f;
+
+		// Vertices transformed per vertex referenced, 1 is ideal
+		float atvr = 0.0f;
+	};
+
+	// Run an index list through a FIFO vertex cache and count the misses
+	VertexCacheStatistics AnalyzeVertexCache(const UINT* indices, size_t index_count, size_t vertex_count, UINT cache_size = VERTEX_CACHE_SIZE);
+
+	// Mesh optimization. Each pass works on a triangle list of one draw, indices relative to the start of its
+	// vertices. Positions are read from a vertex stream, the first three floats of every vertex_stride bytes.
+	// Destination and source may be the same array. Run them in order - cache, overdraw, then fetch
+
+	// Reorder triangles so vertices are reused while they are still in the post transform cache.
+	// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+	void OptimizeVertexCache(UINT* destination, const UINT* indices, size_t index_count, size_t vertex_count);
+
+	// Reorder clusters of cache optimized triangles so the ones facing out from the middle of the mesh are
+	// drawn first and hide the rest. Clusters are kept within threshold of the cache efficiency of the input.
+	// Sander, Nehab and Barczak - Fast Triangle Reordering for Vertex Locality and Reduced Overdraw
+	void OptimizeOverdraw(UINT* destination, const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride, float threshold = 1.05f);
+
+	// Reorder vertices into the order the indices first use them, so vertex fetch walks memory forward,
+	// and rewrite the indices to match. Vertices nothing uses are dropped. Returns the vertex count left
+	size_t OptimizeVertexFetch(void* destination, UINT* indices, size_t index_count, const void* vertices, size_t vertex_count, size_t vertex_size);
+}
@@ -0,0 +1,239 @@
+#include "DxMeshPacker.h"
+#include <DirectXPackedVector.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+	constexpr UINT NO_CHUNK = std::numeric_limits<UINT>::max();
+
+	const float* ReadFloats(const float* stream, size_t vertex_stride, size_t index)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(stream) + vertex_stride * index);
+	}
+
+	int16_t ToSnorm16(float value)
+	{
+		return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	float FromSnorm16(int16_t value)
+	{
+		return std::max(static_cast<float>(value) / 32767.0f, -1.0f);
+	}
+
+	float SignNotZero(float value)
+	{
+		return value >= 0.0f ? 1.0f : -1.0f;
+	}
+}
+
+void DX::PackIndices16(const std::vector<IndexedDraw>& draws, const std::vector<UINT>& indices, const void* vertices, size_t vertex_size,
+	std::vector<IndexedDraw>& packed_draws, std::vector<uint16_t>& packed_indices, std::vector<uint8_t>& packed_vertices)
+{
+	packed_draws.clear();
+	packed_indices.clear();
+	packed_vertices.clear();
+	packed_indices.reserve(indices.size());
+
+	size_t vertex_total = 0;
+	for (const auto& draw : draws)
+	{
+		for (UINT i = 0; i < draw.indexCount; ++i)
+		{
+			vertex_total = std::max<size_t>(vertex_total, static_cast<size_t>(draw.baseVertex) + indices[draw.startIndex + i] + 1);
+		}
+	}
+
+	// Slot of each source vertex in the chunk that last took it. Chunks are numbered so nothing is cleared between them
+	std::vector<UINT> vertex_chunk(vertex_total, NO_CHUNK);
+	std::vector<uint16_t> vertex_slot(vertex_total, 0);
+	const uint8_t* source_vertices = static_cast<const uint8_t*>(vertices);
+	size_t packed_vertex_count = 0;
+	size_t chunk_vertex_count = 0;
+
+	auto start_chunk = [&](UINT source)
+	{
+		IndexedDraw chunk;
+		chunk.startIndex = static_cast<UINT>(packed_indices.size());
+		chunk.baseVertex = static_cast<UINT>(packed_vertex_count);
+		chunk.source = source;
+		packed_draws.push_back(chunk);
+		chunk_vertex_count = 0;
+	};
+
+	for (UINT d = 0; d < draws.size(); ++d)
+	{
+		const IndexedDraw& draw = draws[d];
+		start_chunk(d);
+
+		for (UINT i = 0; i + 2 < draw.indexCount; i += 3)
+		{
+			size_t triangle[3];
+			size_t added = 0;
+			for (size_t k = 0; k < 3; ++k)
+			{
+				triangle[k] = static_cast<size_t>(draw.baseVertex) + indices[draw.startIndex + i + k];
+
+				bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+				if (vertex_chunk[triangle[k]] != packed_draws.size() - 1 && !repeated)
+				{
+					added++;
+				}
+			}
+
+			// Full, carry on in a new draw. The triangle's vertices are copied again there
+			if (chunk_vertex_count + added > MAX_16BIT_VERTICES)
+			{
+				start_chunk(d);
+			}
+
+			UINT chunk = static_cast<UINT>(packed_draws.size() - 1);
+			for (size_t k = 0; k < 3; ++k)
+			{
+				size_t vertex = triangle[k];
+				if (vertex_chunk[vertex] != chunk)
+				{
+					vertex_chunk[vertex] = chunk;
+					vertex_slot[vertex] = static_cast<uint16_t>(chunk_vertex_count++);
+
+					packed_vertices.insert(packed_vertices.end(), source_vertices + vertex * vertex_size, source_vertices + (vertex + 1) * vertex_size);
+					packed_vertex_count++;
+				}
+
+				packed_indices.push_back(vertex_slot[vertex]);
+			}
+
+			packed_draws.back().indexCount += 3;
+		}
+	}
+
+	// Draws with no triangles, or splits that got none, aren't worth a draw call
+	packed_draws.erase(std::remove_if(packed_draws.begin(), packed_draws.end(), [](const IndexedDraw& draw) { return draw.indexCount == 0; }), packed_draws.end());
+}
+
+DirectX::XMMATRIX DX::PositionQuantization::GetMatrix() const
+{
+	return DirectX::XMMatrixMultiply(DirectX::XMMatrixScaling(scale.x, scale.y, scale.z), DirectX::XMMatrixTranslation(offset.x, offset.y, offset.z));
+}
+
+DX::PositionQuantization DX::QuantizePositions(const float* positions, size_t count, size_t vertex_stride, uint16_t* output)
+{
+	PositionQuantization quantization;
+	if (count == 0)
+		return quantization;
+
+	float low[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+	float high[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+	for (size_t v = 0; v < count; ++v)
+	{
+		const float* position = ReadFloats(positions, vertex_stride, v);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			low[k] = std::min(low[k], position[k]);
+			high[k] = std::max(high[k], position[k]);
+		}
+	}
+
+	// A flat axis still needs a scale we can divide by
+	float extent[3];
+	for (size_t k = 0; k < 3; ++k)
+	{
+		extent[k] = high[k] > low[k] ? high[k] - low[k] : 1.0f;
+	}
+
+	quantization.offset = DirectX::XMFLOAT3(low[0], low[1], low[2]);
+	quantization.scale = DirectX::XMFLOAT3(extent[0], extent[1], extent[2]);
+
+	for (size_t v = 0; v < count; ++v)
+	{
+		const float* position = ReadFloats(positions, vertex_stride, v);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			float unorm = std::clamp((position[k] - low[k]) / extent[k], 0.0f, 1.0f);
+			output[v * 4 + k] = static_cast<uint16_t>(std::lround(unorm * 65535.0f));
+		}
+
+		output[v * 4 + 3] = 0;
+	}
+
+	return quantization;
+}
+
+void DX::DequantizePositions(const uint16_t* packed, size_t count, const PositionQuantization& quantization, DirectX::XMFLOAT3* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		output[v].x = quantization.offset.x + packed[v * 4 + 0] / 65535.0f * quantization.scale.x;
+		output[v].y = quantization.offset.y + packed[v * 4 + 1] / 65535.0f * quantization.scale.y;
+		output[v].z = quantization.offset.z + packed[v * 4 + 2] / 65535.0f * quantization.scale.z;
+	}
+}
+
+void DX::EncodeNormals(const float* normals, size_t count, size_t vertex_stride, int16_t* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		const float* normal = ReadFloats(normals, vertex_stride, v);
+
+		// Project onto the octahedron |x| + |y| + |z| = 1
+		float length = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+		float x = length > 0.0f ? normal[0] / length : 0.0f;
+		float y = length > 0.0f ? normal[1] / length : 0.0f;
+		float z = length > 0.0f ? normal[2] / length : 1.0f;
+
+		// Fold the lower half over the diagonals
+		if (z < 0.0f)
+		{
+			float folded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+			float folded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+			x = folded_x;
+			y = folded_y;
+		}
+
+		output[v * 2 + 0] = ToSnorm16(x);
+		output[v * 2 + 1] = ToSnorm16(y);
+	}
+}
+
+void DX::DecodeNormals(const int16_t* packed, size_t count, DirectX::XMFLOAT3* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		float x = FromSnorm16(packed[v * 2 + 0]);
+		float y = FromSnorm16(packed[v * 2 + 1]);
+		float z = 1.0f - std::abs(x) - std::abs(y);
+
+		// Unfold the lower half
+		if (z < 0.0f)
+		{
+			float unfolded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+			float unfolded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+			x = unfolded_x;
+			y = unfolded_y;
+		}
+
+		DirectX::XMStoreFloat3(&output[v], DirectX::XMVector3Normalize(DirectX::XMVectorSet(x, y, z, 0.0f)));
+	}
+}
+
+void DX::PackTexCoords(const float* tex_coords, size_t count, size_t vertex_stride, uint16_t* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		const float* tex_coord = ReadFloats(tex_coords, vertex_stride, v);
+		output[v * 2 + 0] = DirectX::PackedVector::XMConvertFloatToHalf(tex_coord[0]);
+		output[v * 2 + 1] = DirectX::PackedVector::XMConvertFloatToHalf(tex_coord[1]);
+	}
+}
+
+void DX::UnpackTexCoords(const uint16_t* packed, size_t count, DirectX::XMFLOAT2* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		output[v].x = DirectX::PackedVector::XMConvertHalfToFloat(packed[v * 2 + 0]);
+		output[v].y = DirectX::PackedVector::XMConvertHalfToFloat(packed[v * 2 + 1]);
+	}
+}
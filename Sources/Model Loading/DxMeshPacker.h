@@ -0,0 +1,59 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// Vertices a draw can reference with 16 bit indices
+	constexpr size_t MAX_16BIT_VERTICES = 65536;
+
+	// Range of an index buffer drawn with one DrawIndexed
+	struct IndexedDraw
+	{
+		UINT startIndex = 0;
+		UINT indexCount = 0;
+		UINT baseVertex = 0;
+
+		// Draw of the input this one came from, split draws share it
+		UINT source = 0;
+	};
+
+	// Rewrite draws with 16 bit indices. A draw that references MAX_16BIT_VERTICES or more vertices is split
+	// into several, vertices the pieces share are duplicated. Vertices are copied as vertex_size bytes each,
+	// and only the ones the draws use are kept
+	void PackIndices16(const std::vector<IndexedDraw>& draws, const std::vector<UINT>& indices, const void* vertices, size_t vertex_size,
+		std::vector<IndexedDraw>& packed_draws, std::vector<uint16_t>& packed_indices, std::vector<uint8_t>& packed_vertices);
+
+	// Maps 16 bit unorm positions back to the mesh, position = offset + unorm * scale
+	struct PositionQuantization
+	{
+		DirectX::XMFLOAT3 offset = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 scale = { 1.0f, 1.0f, 1.0f };
+
+		// Matrix that does the same, for putting in front of the world matrix
+		DirectX::XMMATRIX GetMatrix() const;
+	};
+
+	// Vertex attribute packing. Every function reads the first floats of each vertex_stride bytes and writes
+	// packed values back to back, so they fit R16G16B16A16_UNORM, R16G16_SNORM and R16G16_FLOAT.
+	// Round trip error per component:
+	// - positions, half a step of the bounding box over 65535, scale / 131070, plus float rounding
+	// - octahedral normals, under 0.0001 radians of direction
+	// - half UVs, a relative 2^-11, or 2^-25 for values too small for a normal half
+
+	// Quantize positions to four unorm16 each, the last is zero, normalized to their bounding box
+	PositionQuantization QuantizePositions(const float* positions, size_t count, size_t vertex_stride, uint16_t* output);
+	void DequantizePositions(const uint16_t* packed, size_t count, const PositionQuantization& quantization, DirectX::XMFLOAT3* output);
+
+	// Unit normals as two snorm16 on the octahedron folded onto a square
+	// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+	void EncodeNormals(const float* normals, size_t count, size_t vertex_stride, int16_t* output);
+	void DecodeNormals(const int16_t* packed, size_t count, DirectX::XMFLOAT3* output);
+
+	// Texture coordinates as two half floats
+	void PackTexCoords(const float* tex_coords, size_t count, size_t vertex_stride, uint16_t* output);
+	void UnpackTexCoords(const uint16_t* packed, size_t count, DirectX::XMFLOAT2* output);
+}
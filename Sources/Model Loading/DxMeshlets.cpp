@@ -0,0 +1,244 @@
+#include "DxMeshlets.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	constexpr UINT NOT_IN_MESHLET = std::numeric_limits<UINT>::max();
+
+	// Triangles closer to edge on than this to the average normal leave nothing to cull by
+	constexpr float MIN_CONE_DOT = 0.1f;
+
+	DirectX::XMVECTOR LoadPosition(const float* positions, size_t vertex_stride, UINT index)
+	{
+		const float* position = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex_stride * index);
+		return DirectX::XMVectorSet(position[0], position[1], position[2], 0.0f);
+	}
+
+	// Fill in the sphere and normal cone of a finished meshlet
+	void ComputeBounds(DX::Meshlet& meshlet, const DX::MeshletData& data, const float* positions, size_t vertex_stride)
+	{
+		using namespace DirectX;
+
+		const UINT* vertices = &data.vertices[meshlet.vertexOffset];
+		const uint8_t* triangles = &data.triangles[meshlet.triangleOffset * 3];
+
+		// Sphere around the box of the vertices
+		XMVECTOR low = LoadPosition(positions, vertex_stride, vertices[0]);
+		XMVECTOR high = low;
+		for (UINT i = 1; i < meshlet.vertexCount; ++i)
+		{
+			XMVECTOR position = LoadPosition(positions, vertex_stride, vertices[i]);
+			low = XMVectorMin(low, position);
+			high = XMVectorMax(high, position);
+		}
+
+		XMVECTOR center = XMVectorScale(XMVectorAdd(low, high), 0.5f);
+		float radius = 0.0f;
+		for (UINT i = 0; i < meshlet.vertexCount; ++i)
+		{
+			XMVECTOR offset = XMVectorSubtract(LoadPosition(positions, vertex_stride, vertices[i]), center);
+			radius = std::max(radius, XMVectorGetX(XMVector3Length(offset)));
+		}
+
+		XMStoreFloat3(&meshlet.center, center);
+		meshlet.radius = radius;
+
+		// Average facing direction
+		std::vector<XMVECTOR> normals(meshlet.triangleCount);
+		std::vector<XMVECTOR> corners(meshlet.triangleCount);
+		XMVECTOR axis = XMVectorZero();
+		for (UINT t = 0; t < meshlet.triangleCount; ++t)
+		{
+			XMVECTOR a = LoadPosition(positions, vertex_stride, vertices[triangles[t * 3 + 0]]);
+			XMVECTOR b = LoadPosition(positions, vertex_stride, vertices[triangles[t * 3 + 1]]);
+			XMVECTOR c = LoadPosition(positions, vertex_stride, vertices[triangles[t * 3 + 2]]);
+
+			XMVECTOR normal = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c, a));
+			float length = XMVectorGetX(XMVector3Length(normal));
+
+			// Zero area triangles can't be seen from anywhere, so they don't constrain the cone
+			normals[t] = length > 0.0f ? XMVectorScale(normal, 1.0f / length) : XMVectorZero();
+			corners[t] = a;
+			axis = XMVectorAdd(axis, normals[t]);
+		}
+
+		float axis_length = XMVectorGetX(XMVector3Length(axis));
+		if (axis_length <= 0.0f)
+			return;
+
+		axis = XMVectorScale(axis, 1.0f / axis_length);
+
+		// Widest spread from the axis
+		float min_dot = 1.0f;
+		for (UINT t = 0; t < meshlet.triangleCount; ++t)
+		{
+			if (XMVectorGetX(XMVector3Dot(normals[t], normals[t])) == 0.0f)
+				continue;
+
+			min_dot = std::min(min_dot, XMVectorGetX(XMVector3Dot(normals[t], axis)));
+		}
+
+		if (min_dot < MIN_CONE_DOT)
+			return;
+
+		// Move the apex back along the axis until it is behind every triangle's plane
+		float apex_distance = 0.0f;
+		for (UINT t = 0; t < meshlet.triangleCount; ++t)
+		{
+			float facing = XMVectorGetX(XMVector3Dot(normals[t], axis));
+			if (facing <= 0.0f)
+				continue;
+
+			float distance = XMVectorGetX(XMVector3Dot(normals[t], XMVectorSubtract(center, corners[t]))) / facing;
+			apex_distance = std::max(apex_distance, distance);
+		}
+
+		XMStoreFloat3(&meshlet.coneApex, XMVectorSubtract(center, XMVectorScale(axis, apex_distance)));
+		XMStoreFloat3(&meshlet.coneAxis, axis);
+		meshlet.coneCutoff = std::sqrt(1.0f - min_dot * min_dot);
+	}
+}
+
+void DX::MeshletCullStatistics::Add(const MeshletCullStatistics& other)
+{
+	meshlets += other.meshlets;
+	triangles += other.triangles;
+	frustum_culled += other.frustum_culled;
+	backface_culled += other.backface_culled;
+	visible_triangles += other.visible_triangles;
+}
+
+void DX::BuildMeshlets(const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride, MeshletData& output)
+{
+	output.meshlets.clear();
+	output.vertices.clear();
+	output.triangles.clear();
+
+	// Slot of each vertex in the current meshlet
+	std::vector<UINT> vertex_slot(vertex_count, NOT_IN_MESHLET);
+
+	Meshlet meshlet;
+	auto finish_meshlet = [&]()
+	{
+		if (meshlet.triangleCount == 0)
+			return;
+
+		ComputeBounds(meshlet, output, positions, vertex_stride);
+		output.meshlets.push_back(meshlet);
+
+		for (UINT i = 0; i < meshlet.vertexCount; ++i)
+		{
+			vertex_slot[output.vertices[meshlet.vertexOffset + i]] = NOT_IN_MESHLET;
+		}
+
+		meshlet = Meshlet();
+		meshlet.vertexOffset = static_cast<UINT>(output.vertices.size());
+		meshlet.triangleOffset = static_cast<UINT>(output.triangles.size() / 3);
+	};
+
+	for (size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		const UINT* triangle = &indices[i];
+
+		UINT added = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+			if (vertex_slot[triangle[k]] == NOT_IN_MESHLET && !repeated)
+			{
+				added++;
+			}
+		}
+
+		if (meshlet.vertexCount + added > MESHLET_MAX_VERTICES || meshlet.triangleCount == MESHLET_MAX_TRIANGLES)
+		{
+			finish_meshlet();
+		}
+
+		for (size_t k = 0; k < 3; ++k)
+		{
+			UINT vertex = triangle[k];
+			if (vertex_slot[vertex] == NOT_IN_MESHLET)
+			{
+				vertex_slot[vertex] = meshlet.vertexCount++;
+				output.vertices.push_back(vertex);
+			}
+
+			output.triangles.push_back(static_cast<uint8_t>(vertex_slot[vertex]));
+		}
+
+		meshlet.triangleCount++;
+	}
+
+	finish_meshlet();
+}
+
+DX::MeshletCullStatistics DX::CullMeshlets(const MeshletData& data, DirectX::FXMMATRIX world_view_projection, DirectX::FXMVECTOR eye, std::vector<UINT>& indices)
+{
+	using namespace DirectX;
+
+	// Frustum planes in the positions' space, from the columns of the row-vector matrix. D3D depth is 0 to w
+	XMMATRIX columns = XMMatrixTranspose(world_view_projection);
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),
+		XMVectorSubtract(columns.r[3], columns.r[0]),
+		XMVectorAdd(columns.r[3], columns.r[1]),
+		XMVectorSubtract(columns.r[3], columns.r[1]),
+		columns.r[2],
+		XMVectorSubtract(columns.r[3], columns.r[2])
+	};
+
+	for (auto& plane : planes)
+	{
+		plane = XMPlaneNormalize(plane);
+	}
+
+	MeshletCullStatistics statistics;
+	statistics.meshlets = data.meshlets.size();
+
+	for (const auto& meshlet : data.meshlets)
+	{
+		statistics.triangles += meshlet.triangleCount;
+
+		XMVECTOR center = XMVectorSetW(XMLoadFloat3(&meshlet.center), 1.0f);
+		bool outside = false;
+		for (const auto& plane : planes)
+		{
+			if (XMVectorGetX(XMVector4Dot(plane, center)) < -meshlet.radius)
+			{
+				outside = true;
+				break;
+			}
+		}
+
+		if (outside)
+		{
+			statistics.frustum_culled++;
+			continue;
+		}
+
+		if (meshlet.coneCutoff <= 1.0f)
+		{
+			XMVECTOR view = XMVector3Normalize(XMVectorSubtract(XMLoadFloat3(&meshlet.coneApex), eye));
+			if (XMVectorGetX(XMVector3Dot(view, XMLoadFloat3(&meshlet.coneAxis))) >= meshlet.coneCutoff)
+			{
+				statistics.backface_culled++;
+				continue;
+			}
+		}
+
+		const UINT* vertices = &data.vertices[meshlet.vertexOffset];
+		const uint8_t* triangles = &data.triangles[meshlet.triangleOffset * 3];
+		for (UINT i = 0; i < meshlet.triangleCount * 3; ++i)
+		{
+			indices.push_back(vertices[triangles[i]]);
+		}
+
+		statistics.visible_triangles += meshlet.triangleCount;
+	}
+
+	return statistics;
+}
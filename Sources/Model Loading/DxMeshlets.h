@@ -0,0 +1,66 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// Meshlet limits, small enough that a meshlet's vertices stay in the post transform cache
+	constexpr size_t MESHLET_MAX_VERTICES = 64;
+	constexpr size_t MESHLET_MAX_TRIANGLES = 124;
+
+	// Small cluster of a draw's triangles with what is needed to cull it as a whole
+	struct Meshlet
+	{
+		// Ranges of MeshletData::vertices and MeshletData::triangles
+		UINT vertexOffset = 0;
+		UINT vertexCount = 0;
+		UINT triangleOffset = 0;
+		UINT triangleCount = 0;
+
+		// Sphere around the vertices
+		DirectX::XMFLOAT3 center = { 0.0f, 0.0f, 0.0f };
+		float radius = 0.0f;
+
+		// Every triangle faces away from an eye where dot(normalize(apex - eye), coneAxis) >= coneCutoff. The
+		// axis is the average triangle normal. A cutoff above one never culls
+		DirectX::XMFLOAT3 coneApex = { 0.0f, 0.0f, 0.0f };
+		DirectX::XMFLOAT3 coneAxis = { 0.0f, 0.0f, 0.0f };
+		float coneCutoff = 2.0f;
+	};
+
+	// Meshlets of one draw. Triangles are three bytes each, indices into the meshlet's vertices, which are
+	// in turn indices into the draw's vertices
+	struct MeshletData
+	{
+		std::vector<Meshlet> meshlets;
+		std::vector<UINT> vertices;
+		std::vector<uint8_t> triangles;
+	};
+
+	// What a cull let through
+	struct MeshletCullStatistics
+	{
+		size_t meshlets = 0;
+		size_t triangles = 0;
+		size_t frustum_culled = 0;
+		size_t backface_culled = 0;
+		size_t visible_triangles = 0;
+
+		// Share of the triangles culled, 0 to 1
+		float GetCulledRatio() const { return triangles > 0 ? 1.0f - static_cast<float>(visible_triangles) / triangles : 0.0f; }
+
+		void Add(const MeshletCullStatistics& other);
+	};
+
+	// Split a triangle list into meshlets, walking the triangles in order so a cache optimized order gives
+	// tight meshlets. Positions are the first three floats of every vertex_stride bytes
+	void BuildMeshlets(const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride, MeshletData& output);
+
+	// Indices of the meshlets that can be seen, appended to indices. Meshlets outside the frustum of
+	// world_view_projection are dropped, and so are the ones whose triangles all face away from eye, given
+	// in the same space as the positions. Front faces are clockwise like the rasterizer default
+	MeshletCullStatistics CullMeshlets(const MeshletData& data, DirectX::FXMMATRIX world_view_projection, DirectX::FXMVECTOR eye, std::vector<UINT>& indices);
+}
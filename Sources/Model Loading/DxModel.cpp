@@ -1,8 +1,25 @@
 #include "DxModel.h"
 #include "GltfModelLoader.h"
-#include "ModelLoader.h"
+#include "DxMeshOptimizer.h"
+#include "DxMeshPacker.h"
 #include <DirectXMath.h>
 #include <vector>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+	// Cull meshlets on the CPU and draw what is left, instead of drawing every object whole
+	constexpr bool CULL_MESHLETS = true;
+
+	// Each LOD keeps this share of the last one's triangles, for as long as the error allows
+	constexpr size_t LOD_COUNT = 4;
+	constexpr float LOD_REDUCTION = 0.5f;
+	constexpr float LOD_MAX_ERROR = 0.05f;
+
+	// How far a LOD may move the surface on screen before a finer one is drawn
+	constexpr float LOD_PIXEL_ERROR = 1.0f;
+}
 
 DX::Model::Model(DX::Renderer* renderer, DX::Shader* shader) : m_DxRenderer(renderer), m_DxShader(shader)
 {
@@ -12,72 +29,213 @@ DX::Model::Model(DX::Renderer* renderer, DX::Shader* shader) : m_DxRenderer(rend
 void DX::Model::Create()
 {
 	// Load model
-	GltfModelLoader loader2;
-	////GltfFileData file_data = loader.Load("D:\\Sources\\DirectX11 Samples\\Resources\\Models\\pyramid.gltf");
-	////GltfFileData file_data = loader.Load("D:\\Sources\\DirectX11 Samples\\Resources\\Models\\monkey.gltf");
-	////GltfFileData file_data = loader2.Load("D:\\Sources\\DirectX11 Samples\\Resources\\Models\\multiple_objects.gltf");
+	GltfModelLoader loader;
+	GltfFileData model = loader.Load("..\\..\\Resources\\Models\\multiple_objects.gltf");
 
-	//// Copy model object data
-	//m_ModelObjectData = file_data.model_object_data;
+	// glTF is right handed, mirror z into the left handed space we render in
+	std::vector<DX::Vertex> vertices = std::move(model.vertices);
+	for (auto& vertex : vertices)
+	{
+		vertex.z = -vertex.z;
+	}
+
+	const auto mirror = DirectX::XMMatrixScaling(1.0f, 1.0f, -1.0f);
+	for (auto& obj : model.model_object_data)
+	{
+		obj.transformation = mirror * obj.transformation * mirror;
+		m_ModelObjectData.push_back(obj);
+	}
 
-	Assimp::Loader loader;
-	//Assimp::Model model = loader.Load("D:\\Sources\\DirectX11 Samples\\Resources\\Models\\pyramid.gltf");
-	Assimp::Model model = loader.Load("D:\\Sources\\DirectX11 Samples\\Resources\\Models\\multiple_objects.gltf");
+	// Reorder for the GPU caches before uploading
+	Optimize(vertices, model.indices);
 
-	// Assign vertices
-	std::vector<DX::Vertex> vertices;
-	for (auto& v : model.vertices)
+	// Split into draws that 16 bit indices can address
+	std::vector<DX::IndexedDraw> draws;
+	for (auto& obj : m_ModelObjectData)
 	{
-		DX::Vertex vertex;
+		DX::IndexedDraw draw;
+		draw.startIndex = obj.index_start;
+		draw.indexCount = obj.index_count;
+		draw.baseVertex = obj.base_vertex;
+		draw.source = static_cast<UINT>(draws.size());
+		draws.push_back(draw);
+	}
 
-		// Set position
-		vertex.x = v.x;
-		vertex.y = v.y;
-		vertex.z = v.z;
+	std::vector<DX::IndexedDraw> packed_draws;
+	std::vector<uint16_t> packed_indices;
+	std::vector<uint8_t> packed_vertices;
+	DX::PackIndices16(draws, model.indices, vertices.data(), sizeof(Vertex), packed_draws, packed_indices, packed_vertices);
 
-		vertices.push_back(vertex);
+	std::vector<ModelObjectData> objects;
+	for (auto& draw : packed_draws)
+	{
+		DX::ModelObjectData obj = m_ModelObjectData[draw.source];
+		obj.index_start = draw.startIndex;
+		obj.index_count = draw.indexCount;
+		obj.base_vertex = draw.baseVertex;
+		objects.push_back(obj);
 	}
 
-	// Assign subset
-	for (auto& s : model.subset)
+	m_ModelObjectData = std::move(objects);
+
+	// Positions as 16 bits per axis across the model's bounds, the world matrix scales them back
+	size_t vertex_count = packed_vertices.size() / sizeof(Vertex);
+	std::vector<uint16_t> positions(vertex_count * 4);
+	m_PositionQuantization = DX::QuantizePositions(reinterpret_cast<const float*>(packed_vertices.data()), vertex_count, sizeof(Vertex), positions.data());
+
+	// Coarser versions of every object after the full ones, culling never gives back more than the full ones
+	size_t full_index_count = packed_indices.size();
+	BuildLods(packed_vertices, vertex_count, packed_indices);
+
+	// Meshlets of every object's LODs, from the unquantized positions
+	m_Meshlets.resize(m_ModelObjectData.size());
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
 	{
-		DX::ModelObjectData subset = {};
-		subset.base_vertex = s.base_vertex;
-		subset.index_start = s.start_index;
-		subset.index_count = s.total_index;
-		subset.transformation = s.transformation;
-		m_ModelObjectData.push_back(subset);
+		const auto& obj = m_ModelObjectData[i];
+		size_t vertex_end = i + 1 < m_ModelObjectData.size() ? m_ModelObjectData[i + 1].base_vertex : vertex_count;
+		const float* obj_positions = reinterpret_cast<const float*>(packed_vertices.data() + obj.base_vertex * sizeof(Vertex));
+
+		m_Meshlets[i].resize(m_Lods[i].size());
+		for (size_t lod = 0; lod < m_Lods[i].size(); ++lod)
+		{
+			const auto& range = m_Lods[i][lod];
+			std::vector<UINT> lod_indices(packed_indices.begin() + range.startIndex, packed_indices.begin() + range.startIndex + range.indexCount);
+			DX::BuildMeshlets(lod_indices.data(), lod_indices.size(), obj_positions, vertex_end - obj.base_vertex, sizeof(Vertex), m_Meshlets[i][lod]);
+		}
 	}
 
 	// Create buffers
-	CreateVertexBuffer(vertices);
-	CreateIndexBuffer(model.indices);
+	CreateVertexBuffer(positions);
+	CreateIndexBuffer(packed_indices);
+	CreateCulledIndexBuffer(full_index_count);
+}
+
+void DX::Model::Optimize(std::vector<Vertex>& vertices, std::vector<UINT>& indices)
+{
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
+	{
+		auto& obj = m_ModelObjectData[i];
+
+		// Each object's vertices run up to the next object's
+		size_t vertex_end = i + 1 < m_ModelObjectData.size() ? m_ModelObjectData[i + 1].base_vertex : vertices.size();
+		size_t vertex_count = vertex_end - obj.base_vertex;
+
+		UINT* obj_indices = indices.data() + obj.index_start;
+		Vertex* obj_vertices = vertices.data() + obj.base_vertex;
+
+		DX::OptimizeVertexCache(obj_indices, obj_indices, obj.index_count, vertex_count);
+		DX::OptimizeOverdraw(obj_indices, obj_indices, obj.index_count, &obj_vertices->x, vertex_count, sizeof(Vertex));
+
+		// Vertices nothing draws are left at the end of the object's range
+		DX::OptimizeVertexFetch(obj_vertices, obj_indices, obj.index_count, obj_vertices, vertex_count, sizeof(Vertex));
+	}
+}
+
+void DX::Model::BuildLods(const std::vector<uint8_t>& vertices, size_t vertex_count, std::vector<uint16_t>& indices)
+{
+	m_Lods.assign(m_ModelObjectData.size(), {});
+	m_LodBounds.assign(m_ModelObjectData.size(), DirectX::XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f));
+
+	// LOD 0 stays where it is, the others are appended. Nothing in them moves between objects so the
+	// object's base vertex still applies
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
+	{
+		const auto& obj = m_ModelObjectData[i];
+		size_t vertex_end = i + 1 < m_ModelObjectData.size() ? m_ModelObjectData[i + 1].base_vertex : vertex_count;
+		size_t obj_vertex_count = vertex_end - obj.base_vertex;
+		const float* obj_positions = reinterpret_cast<const float*>(vertices.data() + obj.base_vertex * sizeof(Vertex));
+
+		std::vector<UINT> obj_indices(indices.begin() + obj.index_start, indices.begin() + obj.index_start + obj.index_count);
+
+		// Errors are relative to the largest side of the box around the object
+		float low[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		float high[3] = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+		for (UINT index : obj_indices)
+		{
+			const float* position = obj_positions + index * (sizeof(Vertex) / sizeof(float));
+			for (size_t k = 0; k < 3; ++k)
+			{
+				low[k] = std::min(low[k], position[k]);
+				high[k] = std::max(high[k], position[k]);
+			}
+		}
+
+		if (!obj_indices.empty())
+		{
+			float size = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2] });
+			m_LodBounds[i] = DirectX::XMFLOAT4((low[0] + high[0]) * 0.5f, (low[1] + high[1]) * 0.5f, (low[2] + high[2]) * 0.5f, size);
+		}
+
+		std::vector<UINT> lod_indices;
+		DX::BuildLodChain(obj_indices.data(), obj_indices.size(), obj_positions, obj_vertex_count, sizeof(Vertex),
+			LOD_COUNT, LOD_REDUCTION, LOD_MAX_ERROR, lod_indices, m_Lods[i]);
+
+		for (size_t lod = 0; lod < m_Lods[i].size(); ++lod)
+		{
+			auto& range = m_Lods[i][lod];
+			if (lod == 0)
+			{
+				range.startIndex = obj.index_start;
+				continue;
+			}
+
+			// Collapses leave the triangles in their old order, which the cache no longer likes
+			UINT* lod_start = lod_indices.data() + range.startIndex;
+			DX::OptimizeVertexCache(lod_start, lod_start, range.indexCount, obj_vertex_count);
+
+			range.startIndex = static_cast<UINT>(indices.size());
+			for (UINT k = 0; k < range.indexCount; ++k)
+			{
+				indices.push_back(static_cast<uint16_t>(lod_start[k]));
+			}
+		}
+	}
+}
+
+void DX::Model::SelectLods(DX::Camera* camera)
+{
+	m_SelectedLod.assign(m_ModelObjectData.size(), 0);
+
+	auto view = camera->GetView();
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
+	{
+		// Camera position in the object's space, where the LOD errors were measured
+		auto world_view = DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(World, m_ModelObjectData[i].transformation), view);
+		auto eye = DirectX::XMMatrixInverse(nullptr, world_view).r[3];
+
+		// Distance to the sphere around the object, inside it the full mesh is drawn
+		const auto& bounds = m_LodBounds[i];
+		auto center = DirectX::XMVectorSet(bounds.x, bounds.y, bounds.z, 1.0f);
+		float distance = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(eye, center))) - bounds.w * 0.5f;
+
+		m_SelectedLod[i] = DX::SelectLod(m_Lods[i], bounds.w, distance, camera->GetFieldOfViewRadians(), static_cast<float>(camera->GetViewportHeight()), LOD_PIXEL_ERROR);
+	}
 }
 
-void DX::Model::CreateVertexBuffer(std::vector<Vertex> vertices)
+void DX::Model::CreateVertexBuffer(const std::vector<uint16_t>& positions)
 {
 	auto d3dDevice = m_DxRenderer->GetDevice();
 
-	// Create index buffer
+	// Create vertex buffer
 	D3D11_BUFFER_DESC vertex_buffer_desc = {};
 	vertex_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(Vertex) * vertices.size());
+	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(uint16_t) * positions.size());
 	vertex_buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 
 	D3D11_SUBRESOURCE_DATA vertex_subdata = {};
-	vertex_subdata.pSysMem = vertices.data();
+	vertex_subdata.pSysMem = positions.data();
 
 	DX::Check(d3dDevice->CreateBuffer(&vertex_buffer_desc, &vertex_subdata, m_d3dVertexBuffer.ReleaseAndGetAddressOf()));
 }
 
-void DX::Model::CreateIndexBuffer(std::vector<UINT> indices)
+void DX::Model::CreateIndexBuffer(const std::vector<uint16_t>& indices)
 {
 	auto d3dDevice = m_DxRenderer->GetDevice();
 
 	// Create index buffer
 	D3D11_BUFFER_DESC index_buffer_desc = {};
 	index_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-	index_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(UINT) * indices.size());
+	index_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(uint16_t) * indices.size());
 	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 
 	D3D11_SUBRESOURCE_DATA index_subdata = {};
@@ -86,28 +244,101 @@ void DX::Model::CreateIndexBuffer(std::vector<UINT> indices)
 	DX::Check(d3dDevice->CreateBuffer(&index_buffer_desc, &index_subdata, m_d3dIndexBuffer.ReleaseAndGetAddressOf()));
 }
 
-void DX::Model::Render()
+void DX::Model::CreateCulledIndexBuffer(size_t index_count)
+{
+	auto d3dDevice = m_DxRenderer->GetDevice();
+
+	// Written by the CPU every frame
+	D3D11_BUFFER_DESC index_buffer_desc = {};
+	index_buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+	index_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(uint16_t) * std::max<size_t>(index_count, 1));
+	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+	index_buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	DX::Check(d3dDevice->CreateBuffer(&index_buffer_desc, nullptr, m_d3dCulledIndexBuffer.ReleaseAndGetAddressOf()));
+}
+
+void DX::Model::Cull(DX::Camera* camera)
+{
+	m_CulledIndices.clear();
+	m_CulledStart.resize(m_ModelObjectData.size());
+	m_CulledCount.resize(m_ModelObjectData.size());
+	m_CullStatistics = {};
+
+	auto view = camera->GetView();
+	auto projection = camera->GetProjection();
+
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
+	{
+		// Meshlets are in the space of the unquantized positions
+		auto world = DirectX::XMMatrixMultiply(World, m_ModelObjectData[i].transformation);
+		auto world_view = DirectX::XMMatrixMultiply(world, view);
+
+		// Camera position in that space
+		auto eye = DirectX::XMMatrixInverse(nullptr, world_view).r[3];
+
+		m_CulledStart[i] = static_cast<UINT>(m_CulledIndices.size());
+		m_CullStatistics.Add(DX::CullMeshlets(m_Meshlets[i][m_SelectedLod[i]], DirectX::XMMatrixMultiply(world_view, projection), eye, m_CulledIndices));
+		m_CulledCount[i] = static_cast<UINT>(m_CulledIndices.size()) - m_CulledStart[i];
+	}
+
+	if (m_CulledIndices.empty())
+		return;
+
+	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
+
+	// Every index is local to its object, so they all fit in 16 bits
+	D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
+	DX::Check(d3dDeviceContext->Map(m_d3dCulledIndexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource));
+
+	uint16_t* indices = static_cast<uint16_t*>(mapped_resource.pData);
+	for (size_t i = 0; i < m_CulledIndices.size(); ++i)
+	{
+		indices[i] = static_cast<uint16_t>(m_CulledIndices[i]);
+	}
+
+	d3dDeviceContext->Unmap(m_d3dCulledIndexBuffer.Get(), 0);
+}
+
+void DX::Model::Render(DX::Camera* camera)
 {
+	SelectLods(camera);
+
+	if (CULL_MESHLETS)
+	{
+		Cull(camera);
+	}
+
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
 
-	// We need the stride and offset for the vertex
-	UINT vertex_stride = sizeof(Vertex);
+	// We need the stride and offset for the vertex, four unorm16 per position
+	UINT vertex_stride = sizeof(uint16_t) * 4;
 	auto vertex_offset = 0u;
 
 	// Bind the vertex buffer to the pipeline's Input Assembler stage
 	d3dDeviceContext->IASetVertexBuffers(0, 1, m_d3dVertexBuffer.GetAddressOf(), &vertex_stride, &vertex_offset);
 
 	// Bind the index buffer to the pipeline's Input Assembler stage
-	d3dDeviceContext->IASetIndexBuffer(m_d3dIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
+	d3dDeviceContext->IASetIndexBuffer(CULL_MESHLETS ? m_d3dCulledIndexBuffer.Get() : m_d3dIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
 
 	// Bind the geometry topology to the pipeline's Input Assembler stage
 	d3dDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
 	// Render all geometry
-	for (auto& obj : m_ModelObjectData)
+	for (size_t i = 0; i < m_ModelObjectData.size(); ++i)
 	{
-		// Set obj transformation
+		auto& obj = m_ModelObjectData[i];
+
+		// Nothing of the object survived culling
+		const auto& lod = m_Lods[i][m_SelectedLod[i]];
+		UINT index_count = CULL_MESHLETS ? m_CulledCount[i] : lod.indexCount;
+		UINT index_start = CULL_MESHLETS ? m_CulledStart[i] : lod.startIndex;
+		if (index_count == 0)
+			continue;
+
+		// Set obj transformation, after taking the positions out of their quantized range
 		auto matrix = DirectX::XMMatrixMultiply(World, obj.transformation);
+		matrix = DirectX::XMMatrixMultiply(m_PositionQuantization.GetMatrix(), matrix);
 
 		// Apply object transformation
 		DX::WorldBuffer world_buffer = {};
@@ -115,7 +346,7 @@ void DX::Model::Render()
 		m_DxShader->UpdateWorldConstantBuffer(world_buffer);
 
 		// Render object
-		d3dDeviceContext->DrawIndexed(obj.index_count, obj.index_start, obj.base_vertex);
+		d3dDeviceContext->DrawIndexed(index_count, index_start, obj.base_vertex);
 	}
 }
  
\ No newline at end of file
@@ -3,7 +3,11 @@
 #include "DxRenderer.h"
 #include "DxShader.h"
 #include "DxCamera.h"
+#include "DxMeshPacker.h"
+#include "DxMeshlets.h"
+#include "DxSimplifier.h"
 #include <vector>
+#include <cstdint>
 #include <DirectXColors.h>
 
 namespace DX
@@ -33,8 +37,11 @@ namespace DX
 		// Create device
 		void Create();
 
-		// Render the model
-		void Render();
+		// Render the model, culling its meshlets against the camera
+		void Render(DX::Camera* camera);
+
+		// What the last render culled
+		const DX::MeshletCullStatistics& GetCullStatistics() const { return m_CullStatistics; }
 
 		// World 
 		DirectX::XMMATRIX World = DirectX::XMMatrixIdentity();
@@ -46,12 +53,38 @@ namespace DX
 		// Model object data
 		std::vector<ModelObjectData> m_ModelObjectData;
 
-		// Vertex buffer
+		// Reorder each object's triangles and vertices for the vertex cache, overdraw and vertex fetch
+		void Optimize(std::vector<Vertex>& vertices, std::vector<UINT>& indices);
+
+		// Maps the quantized positions in the vertex buffer back to model space
+		DX::PositionQuantization m_PositionQuantization;
+
+		// Vertex buffer, positions as four unorm16
 		ComPtr<ID3D11Buffer> m_d3dVertexBuffer = nullptr;
-		void CreateVertexBuffer(std::vector<Vertex> vertices);
+		void CreateVertexBuffer(const std::vector<uint16_t>& positions);
 
-		// Index buffer
+		// Index buffer, 16 bit indices
 		ComPtr<ID3D11Buffer> m_d3dIndexBuffer = nullptr;
-		void CreateIndexBuffer(std::vector<UINT> indices);
+		void CreateIndexBuffer(const std::vector<uint16_t>& indices);
+
+		// LODs of each object, ranges of the index buffer over the object's vertices, and the sphere around
+		// the object their errors are measured against
+		std::vector<std::vector<DX::MeshLod>> m_Lods;
+		std::vector<DirectX::XMFLOAT4> m_LodBounds;
+		std::vector<size_t> m_SelectedLod;
+		void BuildLods(const std::vector<uint8_t>& vertices, size_t vertex_count, std::vector<uint16_t>& indices);
+		void SelectLods(DX::Camera* camera);
+
+		// Meshlets of each object's LODs, and the indices of the ones that survived culling this frame
+		std::vector<std::vector<DX::MeshletData>> m_Meshlets;
+		std::vector<UINT> m_CulledIndices;
+		std::vector<UINT> m_CulledStart;
+		std::vector<UINT> m_CulledCount;
+		DX::MeshletCullStatistics m_CullStatistics;
+
+		// Culled index buffer, rewritten every frame
+		ComPtr<ID3D11Buffer> m_d3dCulledIndexBuffer = nullptr;
+		void CreateCulledIndexBuffer(size_t index_count);
+		void Cull(DX::Camera* camera);
 	};
 }
\ No newline at end of file
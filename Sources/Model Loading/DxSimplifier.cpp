@@ -0,0 +1,429 @@
+#include "DxSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+namespace
+{
+	// Collapses that would turn a neighbouring triangle's normal past this cosine are refused, which keeps
+	// slivers from folding over as well as plain flips
+	constexpr double MIN_FLIP_DOT = 0.25;
+
+	struct Vector3
+	{
+		double x = 0.0;
+		double y = 0.0;
+		double z = 0.0;
+	};
+
+	Vector3 Subtract(const Vector3& a, const Vector3& b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+	Vector3 Cross(const Vector3& a, const Vector3& b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+	double Dot(const Vector3& a, const Vector3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	// Sum of squared distances to planes, as the symmetric 4x4 matrix of the plane equations.
+	// Weighted by triangle area, so dividing by weight gives a squared distance
+	struct Quadric
+	{
+		double xx = 0.0, xy = 0.0, xz = 0.0, xw = 0.0;
+		double yy = 0.0, yz = 0.0, yw = 0.0;
+		double zz = 0.0, zw = 0.0;
+		double ww = 0.0;
+		double weight = 0.0;
+
+		void AddPlane(const Vector3& normal, double distance, double area)
+		{
+			xx += area * normal.x * normal.x;
+			xy += area * normal.x * normal.y;
+			xz += area * normal.x * normal.z;
+			xw += area * normal.x * distance;
+			yy += area * normal.y * normal.y;
+			yz += area * normal.y * normal.z;
+			yw += area * normal.y * distance;
+			zz += area * normal.z * normal.z;
+			zw += area * normal.z * distance;
+			ww += area * distance * distance;
+			weight += area;
+		}
+
+		void Add(const Quadric& other)
+		{
+			xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+			yy += other.yy; yz += other.yz; yw += other.yw;
+			zz += other.zz; zw += other.zw;
+			ww += other.ww;
+			weight += other.weight;
+		}
+
+		double Evaluate(const Vector3& p) const
+		{
+			double error = xx * p.x * p.x + yy * p.y * p.y + zz * p.z * p.z + ww
+				+ 2.0 * (xy * p.x * p.y + xz * p.x * p.z + yz * p.y * p.z + xw * p.x + yw * p.y + zw * p.z);
+
+			return std::max(error, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		UINT from = 0;
+		UINT to = 0;
+		double cost = 0.0;
+	};
+
+	uint64_t EdgeKey(UINT a, UINT b)
+	{
+		return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+	}
+}
+
+size_t DX::SimplifyMesh(UINT* destination, const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride,
+	size_t target_index_count, float target_error, float* result_error, const SimplifyAttributes& attributes)
+{
+	auto read_floats = [](const float* stream, size_t stride, size_t index)
+	{
+		return reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(stream) + stride * index);
+	};
+
+	// Positions scaled to the unit box, so errors are relative to the mesh size
+	std::vector<Vector3> points(vertex_count);
+	{
+		double low[3] = { std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max() };
+		double high[3] = { std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest() };
+		for (size_t i = 0; i < index_count; ++i)
+		{
+			const float* position = read_floats(positions, vertex_stride, indices[i]);
+			for (size_t k = 0; k < 3; ++k)
+			{
+				low[k] = std::min(low[k], static_cast<double>(position[k]));
+				high[k] = std::max(high[k], static_cast<double>(position[k]));
+			}
+		}
+
+		double extent = std::max({ high[0] - low[0], high[1] - low[1], high[2] - low[2], 0.0 });
+		double scale = extent > 0.0 ? 1.0 / extent : 1.0;
+		for (size_t v = 0; v < vertex_count; ++v)
+		{
+			const float* position = read_floats(positions, vertex_stride, v);
+			points[v] = { (position[0] - low[0]) * scale, (position[1] - low[1]) * scale, (position[2] - low[2]) * scale };
+		}
+	}
+
+	// Vertices that only differ by index are one vertex as far as the topology goes. Ones that differ in
+	// an attribute stay apart, which leaves a seam that gets locked like a border
+	auto vertex_less = [&](UINT a, UINT b)
+	{
+		const float* pa = read_floats(positions, vertex_stride, a);
+		const float* pb = read_floats(positions, vertex_stride, b);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			if (pa[k] != pb[k])
+				return pa[k] < pb[k];
+		}
+
+		for (size_t k = 0; k < attributes.count; ++k)
+		{
+			float va = read_floats(attributes.data, attributes.stride, a)[k];
+			float vb = read_floats(attributes.data, attributes.stride, b)[k];
+			if (va != vb)
+				return va < vb;
+		}
+
+		return false;
+	};
+
+	std::vector<UINT> order(vertex_count);
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](UINT a, UINT b) { return vertex_less(a, b) || (!vertex_less(b, a) && a < b); });
+
+	std::vector<UINT> remap(vertex_count);
+	for (size_t i = 0; i < vertex_count; ++i)
+	{
+		bool same = i > 0 && !vertex_less(order[i - 1], order[i]);
+		remap[order[i]] = same ? remap[order[i - 1]] : order[i];
+	}
+
+	// Welded triangles, zero area ones dropped
+	std::vector<UINT> triangles;
+	triangles.reserve(index_count);
+	for (size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		UINT a = remap[indices[i]];
+		UINT b = remap[indices[i + 1]];
+		UINT c = remap[indices[i + 2]];
+		if (a != b && b != c && a != c)
+		{
+			triangles.insert(triangles.end(), { a, b, c });
+		}
+	}
+
+	// Quadric of every vertex from the planes of its triangles
+	std::vector<Quadric> quadrics(vertex_count);
+	for (size_t i = 0; i < triangles.size(); i += 3)
+	{
+		const Vector3& p0 = points[triangles[i]];
+		Vector3 normal = Cross(Subtract(points[triangles[i + 1]], p0), Subtract(points[triangles[i + 2]], p0));
+		double length = std::sqrt(Dot(normal, normal));
+		if (length <= 0.0)
+			continue;
+
+		normal = { normal.x / length, normal.y / length, normal.z / length };
+		double distance = -Dot(normal, p0);
+		for (size_t k = 0; k < 3; ++k)
+		{
+			quadrics[triangles[i + k]].AddPlane(normal, distance, length * 0.5);
+		}
+	}
+
+	// Edges not shared by exactly two triangles are borders, their vertices stay where they are
+	std::vector<bool> locked(vertex_count, false);
+	{
+		std::unordered_map<uint64_t, UINT> edge_use;
+		edge_use.reserve(triangles.size());
+		for (size_t i = 0; i < triangles.size(); i += 3)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				edge_use[EdgeKey(triangles[i + k], triangles[i + (k + 1) % 3])]++;
+			}
+		}
+
+		for (const auto& edge : edge_use)
+		{
+			if (edge.second != 2)
+			{
+				locked[static_cast<UINT>(edge.first >> 32)] = true;
+				locked[static_cast<UINT>(edge.first & 0xffffffff)] = true;
+			}
+		}
+	}
+
+	auto attribute_error = [&](UINT a, UINT b)
+	{
+		double error = 0.0;
+		for (size_t k = 0; k < attributes.count; ++k)
+		{
+			double difference = read_floats(attributes.data, attributes.stride, a)[k] - read_floats(attributes.data, attributes.stride, b)[k];
+			double weight = attributes.weights != nullptr ? attributes.weights[k] : 1.0;
+			error += weight * weight * difference * difference;
+		}
+
+		return error;
+	};
+
+	const double error_limit = static_cast<double>(target_error) * target_error;
+	const size_t target_triangles = target_index_count / 3;
+	double reached_error = 0.0;
+
+	std::vector<UINT> triangle_start(vertex_count + 1);
+	std::vector<UINT> vertex_triangles;
+	std::vector<bool> touched(vertex_count);
+	std::vector<Collapse> collapses;
+
+	// Passes of independent collapses, cheapest first, until the target or the error limit is reached
+	while (triangles.size() / 3 > target_triangles)
+	{
+		const size_t triangle_count = triangles.size() / 3;
+
+		// Triangles around every vertex
+		std::fill(triangle_start.begin(), triangle_start.end(), 0);
+		for (UINT index : triangles)
+		{
+			triangle_start[index + 1]++;
+		}
+
+		std::partial_sum(triangle_start.begin(), triangle_start.end(), triangle_start.begin());
+
+		vertex_triangles.resize(triangles.size());
+		std::vector<UINT> fill(triangle_start.begin(), triangle_start.end() - 1);
+		for (size_t t = 0; t < triangle_count; ++t)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				vertex_triangles[fill[triangles[t * 3 + k]]++] = static_cast<UINT>(t);
+			}
+		}
+
+		// Every edge once, moving whichever end is cheaper. Edges of two triangles are seen from both, take the
+		// one where they run in increasing order. Border edges only run one way but both their ends are locked
+		collapses.clear();
+		for (size_t t = 0; t < triangle_count; ++t)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				UINT a = triangles[t * 3 + k];
+				UINT b = triangles[t * 3 + (k + 1) % 3];
+				if (a > b || (locked[a] && locked[b]))
+					continue;
+
+				Quadric quadric = quadrics[a];
+				quadric.Add(quadrics[b]);
+				double attribute_cost = attribute_error(a, b);
+				double cost_a = quadric.weight > 0.0 ? quadric.Evaluate(points[b]) / quadric.weight : 0.0;
+				double cost_b = quadric.weight > 0.0 ? quadric.Evaluate(points[a]) / quadric.weight : 0.0;
+
+				if (locked[b] || (!locked[a] && cost_a <= cost_b))
+				{
+					collapses.push_back({ a, b, cost_a + attribute_cost });
+				}
+				else
+				{
+					collapses.push_back({ b, a, cost_b + attribute_cost });
+				}
+			}
+		}
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		std::fill(touched.begin(), touched.end(), false);
+		size_t removed = 0;
+		size_t collapsed = 0;
+		for (const auto& collapse : collapses)
+		{
+			if (collapse.cost > error_limit || triangle_count - removed <= target_triangles)
+				break;
+
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Refuse if a triangle that stays would flip over
+			bool flips = false;
+			size_t shared = 0;
+			for (UINT i = triangle_start[collapse.from]; i < triangle_start[collapse.from + 1] && !flips; ++i)
+			{
+				const UINT* triangle = &triangles[vertex_triangles[i] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					shared++;
+					continue;
+				}
+
+				Vector3 corners[3];
+				Vector3 moved[3];
+				for (size_t k = 0; k < 3; ++k)
+				{
+					corners[k] = points[triangle[k]];
+					moved[k] = triangle[k] == collapse.from ? points[collapse.to] : corners[k];
+				}
+
+				Vector3 before = Cross(Subtract(corners[1], corners[0]), Subtract(corners[2], corners[0]));
+				Vector3 after = Cross(Subtract(moved[1], moved[0]), Subtract(moved[2], moved[0]));
+				flips = Dot(before, after) <= MIN_FLIP_DOT * std::sqrt(Dot(before, before) * Dot(after, after));
+			}
+
+			if (flips)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].Add(quadrics[collapse.from]);
+			reached_error = std::max(reached_error, collapse.cost);
+			removed += shared;
+			collapsed++;
+
+			// Nothing around the moved vertex can change again this pass, the triangles we looked at would be stale
+			for (UINT i = triangle_start[collapse.from]; i < triangle_start[collapse.from + 1]; ++i)
+			{
+				const UINT* triangle = &triangles[vertex_triangles[i] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+		}
+
+		if (collapsed == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that closed up
+		size_t write = 0;
+		for (size_t t = 0; t < triangle_count; ++t)
+		{
+			UINT a = remap[triangles[t * 3]];
+			UINT b = remap[triangles[t * 3 + 1]];
+			UINT c = remap[triangles[t * 3 + 2]];
+			if (a != b && b != c && a != c)
+			{
+				triangles[write++] = a;
+				triangles[write++] = b;
+				triangles[write++] = c;
+			}
+		}
+
+		triangles.resize(write);
+
+		// Later passes look vertices up through remap once, so point every vertex at where it ended up
+		for (size_t v = 0; v < vertex_count; ++v)
+		{
+			remap[v] = remap[remap[v]];
+		}
+	}
+
+	std::copy(triangles.begin(), triangles.end(), destination);
+
+	if (result_error != nullptr)
+	{
+		*result_error = static_cast<float>(std::sqrt(reached_error));
+	}
+
+	return triangles.size();
+}
+
+void DX::BuildLodChain(const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride,
+	size_t max_lods, float reduction, float max_error, std::vector<UINT>& lod_indices, std::vector<MeshLod>& lods, const SimplifyAttributes& attributes)
+{
+	// LOD 0 is the mesh as it is
+	MeshLod full;
+	full.startIndex = static_cast<UINT>(lod_indices.size());
+	full.indexCount = static_cast<UINT>(index_count);
+	lod_indices.insert(lod_indices.end(), indices, indices + index_count);
+	lods.push_back(full);
+
+	std::vector<UINT> previous(indices, indices + index_count);
+	std::vector<UINT> simplified(index_count);
+	float error = 0.0f;
+
+	for (size_t level = 1; level < max_lods; ++level)
+	{
+		size_t target = static_cast<size_t>(previous.size() / 3 * reduction) * 3;
+		if (error >= max_error)
+			break;
+
+		// Errors add up, each LOD only gets what the earlier ones left
+		float lod_error = 0.0f;
+		size_t count = SimplifyMesh(simplified.data(), previous.data(), previous.size(), positions, vertex_count, vertex_stride, target, max_error - error, &lod_error, attributes);
+
+		// Stuck, or too little gained to be worth another level
+		if (count == 0 || count > previous.size() * (1.0f + reduction) / 2.0f)
+			break;
+
+		error += lod_error;
+
+		MeshLod lod;
+		lod.startIndex = static_cast<UINT>(lod_indices.size());
+		lod.indexCount = static_cast<UINT>(count);
+		lod.error = error;
+		lod_indices.insert(lod_indices.end(), simplified.begin(), simplified.begin() + count);
+		lods.push_back(lod);
+
+		previous.assign(simplified.begin(), simplified.begin() + count);
+	}
+}
+
+size_t DX::SelectLod(const std::vector<MeshLod>& lods, float mesh_size, float distance, float field_of_view_radians, float viewport_height, float pixel_error)
+{
+	if (lods.empty() || distance <= 0.0f)
+		return 0;
+
+	// Pixels per unit of distance at that depth
+	float pixels_per_unit = viewport_height / (2.0f * distance * std::tan(field_of_view_radians * 0.5f));
+
+	size_t selected = 0;
+	for (size_t i = 1; i < lods.size(); ++i)
+	{
+		if (lods[i].error * mesh_size * pixels_per_unit > pixel_error)
+			break;
+
+		selected = i;
+	}
+
+	return selected;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <vector>
+
+namespace DX
+{
+	// Extra per vertex values the simplifier keeps intact as well as the shape, such as normals or UVs.
+	// Reads count floats at the start of every stride bytes, each weighed against position error
+	struct SimplifyAttributes
+	{
+		const float* data = nullptr;
+		size_t stride = 0;
+		const float* weights = nullptr;
+		size_t count = 0;
+	};
+
+	// One level of detail, a range of the LOD index list drawn over the same vertices as the full mesh
+	struct MeshLod
+	{
+		UINT startIndex = 0;
+		UINT indexCount = 0;
+
+		// Estimate of how far the surface moved, relative to the size of the mesh
+		float error = 0.0f;
+	};
+
+	// Simplify a triangle list by collapsing edges in order of quadric error, until it is down to
+	// target_index_count indices or the next collapse would move the surface further than target_error,
+	// relative to the mesh size, as estimated by the quadrics. Vertices are collapsed onto each other, so
+	// the result indexes the same vertices. Vertices on open borders, like the edges of a subset, never move
+	// so neighbours still meet. Returns the index count written to destination, result_error is the error reached
+	// https://www.cs.cmu.edu/~garland/Papers/quadrics.pdf
+	size_t SimplifyMesh(UINT* destination, const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride,
+		size_t target_index_count, float target_error, float* result_error = nullptr, const SimplifyAttributes& attributes = {});
+
+	// Build LODs, each simplified from the last to reduction of its triangles, until max_lods or until the
+	// simplifier can't get within max_error. LOD 0 is the mesh itself. Index ranges are appended to lod_indices
+	void BuildLodChain(const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride,
+		size_t max_lods, float reduction, float max_error, std::vector<UINT>& lod_indices, std::vector<MeshLod>& lods, const SimplifyAttributes& attributes = {});
+
+	// Coarsest LOD whose error stays under pixel_error pixels on screen. mesh_size is the size LOD errors are
+	// relative to, in the same units as distance
+	size_t SelectLod(const std::vector<MeshLod>& lods, float mesh_size, float distance, float field_of_view_radians, float viewport_height, float pixel_error = 1.0f);
+}
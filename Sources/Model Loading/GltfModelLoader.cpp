@@ -1,5 +1,169 @@
 #include "GltfModelLoader.h"
-#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <type_traits>
+
+namespace
+{
+	// Binary glTF container header
+	struct GlbHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t length;
+	};
+
+	struct GlbChunkHeader
+	{
+		uint32_t length;
+		uint32_t type;
+	};
+
+	// "glTF", "JSON" and "BIN\0" in little endian
+	constexpr uint32_t GLB_MAGIC = 0x46546C67;
+	constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+	constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+	// Number of components in an element of the given accessor type
+	size_t ComponentCount(std::string_view type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		if (type == "MAT2") return 4;
+		if (type == "MAT3") return 9;
+		if (type == "MAT4") return 16;
+
+		throw std::runtime_error("Unknown glTF accessor type");
+	}
+
+	// Convert a single component. Normalized integers map onto [0, 1] or [-1, 1] when read as float
+	template <typename Source, typename T>
+	T ConvertComponent(const char* input, bool normalized)
+	{
+		Source value;
+		std::memcpy(&value, input, sizeof(Source));
+
+		if constexpr (std::is_floating_point<T>::value && std::is_integral<Source>::value)
+		{
+			if (normalized)
+				return std::max(static_cast<float>(value) * (1.0f / std::numeric_limits<Source>::max()), -1.0f);
+		}
+
+		return static_cast<T>(value);
+	}
+
+	// Strided loop with the component count known at compile time so the inner loop unrolls
+	template <typename Source, typename T, size_t Components>
+	void ConvertElements(const char* input, size_t input_stride, size_t count, bool normalized, char* output, size_t output_stride)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			const char* element = input + i * input_stride;
+			T* target = reinterpret_cast<T*>(output + i * output_stride);
+			for (size_t c = 0; c < Components; ++c)
+			{
+				target[c] = ConvertComponent<Source, T>(element + c * sizeof(Source), normalized);
+			}
+		}
+	}
+
+	template <typename Source, typename T>
+	void Convert(const char* input, size_t input_stride, size_t input_components, size_t count, bool normalized,
+		T* output, size_t output_components, size_t output_stride)
+	{
+		char* target = reinterpret_cast<char*>(output);
+		size_t components = std::min(input_components, output_components);
+
+		// Both sides tightly packed - a single flat loop over every component, which the compiler vectorises
+		if (input_stride == sizeof(Source) * input_components && output_stride == sizeof(T) * components && input_components == components)
+		{
+			for (size_t i = 0; i < count * components; ++i)
+			{
+				output[i] = ConvertComponent<Source, T>(input + i * sizeof(Source), normalized);
+			}
+
+			return;
+		}
+
+		switch (components)
+		{
+		case 1: ConvertElements<Source, T, 1>(input, input_stride, count, normalized, target, output_stride); return;
+		case 2: ConvertElements<Source, T, 2>(input, input_stride, count, normalized, target, output_stride); return;
+		case 3: ConvertElements<Source, T, 3>(input, input_stride, count, normalized, target, output_stride); return;
+		case 4: ConvertElements<Source, T, 4>(input, input_stride, count, normalized, target, output_stride); return;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const char* element = input + i * input_stride;
+			T* values = reinterpret_cast<T*>(target + i * output_stride);
+			for (size_t c = 0; c < components; ++c)
+			{
+				values[c] = ConvertComponent<Source, T>(element + c * sizeof(Source), normalized);
+			}
+		}
+	}
+}
+
+size_t GltfAccessor::ComponentSize() const
+{
+	switch (component_type)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	}
+
+	throw std::runtime_error("Unknown glTF component type");
+}
+
+template <typename T>
+void GltfAccessor::Read(size_t start, size_t end, T* output, size_t output_components, size_t output_stride) const
+{
+	end = std::min(end, count);
+	if (start >= end)
+		return;
+
+	const char* input = data + start * stride;
+	size_t elements = end - start;
+
+	// Pick the conversion once per range rather than once per component
+	switch (component_type)
+	{
+	case GLTF_BYTE:
+		Convert<int8_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_BYTE:
+		Convert<uint8_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_SHORT:
+		Convert<int16_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_SHORT:
+		Convert<uint16_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_INT:
+		Convert<uint32_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_FLOAT:
+		Convert<float>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	default:
+		throw std::runtime_error("Unknown glTF component type");
+	}
+}
+
+template void GltfAccessor::Read<float>(size_t, size_t, float*, size_t, size_t) const;
+template void GltfAccessor::Read<UINT>(size_t, size_t, UINT*, size_t, size_t) const;
 
 GltfFileData GltfModelLoader::Load(const std::filesystem::path path)
 {
@@ -7,13 +171,16 @@ GltfFileData GltfModelLoader::Load(const std::filesystem::path path)
 
 	// Parser
 	parser parser;
-	m_Document = parser.load(path.string());
-
-	// Vertex total - want to keep track of this so we know the base vertex for each object when rendering
-	UINT vertex_total = 0;
-
-	// Indices count - we want to keep track of the indices for the object_data index_start variable
-	UINT index_total = 0;
+	if (path.extension() == ".glb")
+	{
+		// Binary glTF - a single mapping serves both the JSON and every buffer
+		m_Files.push_back(std::make_unique<MappedFile>(path));
+		m_Document = ParseBinary(parser, *m_Files.back());
+	}
+	else
+	{
+		m_Document = parser.load(path.string());
+	}
 
 	// Loop through the nodes and check for nodes that contain a mesh index
 	for (auto node : m_Document["nodes"])
@@ -23,118 +190,275 @@ GltfFileData GltfModelLoader::Load(const std::filesystem::path path)
 		if (mesh_index.error() != simdjson::SUCCESS)
 			continue;
 
-		// Model data
-		DX::ModelObjectData object_data = {};
-
 		// Load transformation
 		auto transformation_matrix = LoadTransformation(node);
-		object_data.transformation = transformation_matrix;
 
 		// Read mesh
 		auto mesh = m_Document["meshes"].at(mesh_index.value());
 
-		// Mesh name
-		auto mesh_name = mesh["name"].get_string();
+		// Every primitive of the mesh becomes its own object
+		for (auto primitive : mesh["primitives"])
+		{
+			// Model data
+			DX::ModelObjectData object_data = {};
+			object_data.transformation = transformation_matrix;
+			object_data.base_vertex = static_cast<int>(m_Data.vertices.size());
+			object_data.index_start = static_cast<int>(m_Data.indices.size());
+			object_data.index_count = static_cast<int>(LoadPrimitive(primitive));
+
+			// Store the model object data
+			m_Data.model_object_data.push_back(object_data);
+		}
+	}
 
-		// Get first mesh primitive - we're only assuming we will ever have 1 mesh primitive in this situation
-		auto mesh_primitives = mesh["primitives"].at(0);
+	// Everything has been copied into the final layout so the buffers can be unmapped
+	m_Buffers.clear();
+	m_Files.clear();
+	m_SparseData.clear();
+	m_BinaryChunk = {};
 
-		// Load mesh vertices
-		auto mesh_vertex_position_index = mesh_primitives["attributes"]["POSITION"].get_int64();
-		UINT vertex_count = LoadVertices(mesh_vertex_position_index.value());
+	return m_Data;
+}
 
-		// Set base vertex
-		object_data.base_vertex = vertex_total;
+UINT GltfModelLoader::LoadPrimitive(simdjson::dom::element& primitive)
+{
+	// Position is the only attribute we use, converted straight into the vertices
+	GltfAccessor positions = LoadAccessor(primitive["attributes"]["POSITION"].get_int64().value());
 
-		// Increase total vertex
-		vertex_total += vertex_count;
+	size_t base_vertex = m_Data.vertices.size();
+	m_Data.vertices.resize(base_vertex + positions.count);
 
-		// Load mesh indices
-		auto mesh_indices_index = mesh_primitives["indices"].get_int64();
-		UINT index_count = LoadIndices(mesh_indices_index.value());
+	DX::Vertex* vertices = m_Data.vertices.data() + base_vertex;
+	positions.Read(0, positions.count, &vertices->x, 3, sizeof(DX::Vertex));
 
-		// Set index data
-		object_data.index_start = index_total;
-		object_data.index_count = index_count;
+	// 8, 16 and 32 bit indices all widen to UINT
+	size_t start_index = m_Data.indices.size();
+	int64_t indices_index = 0;
+	if (primitive["indices"].get_int64().get(indices_index) == simdjson::SUCCESS)
+	{
+		GltfAccessor indices = LoadAccessor(indices_index);
+		m_Data.indices.resize(start_index + indices.count);
+		indices.Read(0, indices.count, m_Data.indices.data() + start_index, 1, sizeof(UINT));
+	}
+	else
+	{
+		// Non-indexed primitives draw their vertices in order
+		m_Data.indices.resize(start_index + positions.count);
+		for (size_t i = 0; i < positions.count; ++i)
+		{
+			m_Data.indices[start_index + i] = static_cast<UINT>(i);
+		}
+	}
+
+	// Return indices count
+	return static_cast<UINT>(m_Data.indices.size() - start_index);
+}
 
-		// Increase total index so we know when the next object index start is
-		index_total += index_count;
+simdjson_result<element> GltfModelLoader::ParseBinary(parser& parser, const MappedFile& file)
+{
+	// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#binary-gltf-layout
+	const char* data = file.Data();
+	size_t size = file.Size();
+
+	GlbHeader header = {};
+	if (size < sizeof(GlbHeader))
+		throw std::runtime_error("Invalid glb file");
+
+	std::memcpy(&header, data, sizeof(GlbHeader));
+	if (header.magic != GLB_MAGIC || header.version != 2 || header.length > size)
+		throw std::runtime_error("Invalid glb file");
 
-		// Store the model object data
-		m_Data.model_object_data.push_back(object_data);
+	// Walk the chunks - JSON is always first, followed by an optional binary chunk
+	const char* json = nullptr;
+	size_t json_length = 0;
+
+	size_t offset = sizeof(GlbHeader);
+	while (offset + sizeof(GlbChunkHeader) <= header.length)
+	{
+		GlbChunkHeader chunk = {};
+		std::memcpy(&chunk, data + offset, sizeof(GlbChunkHeader));
+		offset += sizeof(GlbChunkHeader);
+
+		if (offset + chunk.length > header.length)
+			throw std::runtime_error("Invalid glb chunk");
+
+		if (chunk.type == GLB_CHUNK_JSON && json == nullptr)
+		{
+			json = data + offset;
+			json_length = chunk.length;
+		}
+		else if (chunk.type == GLB_CHUNK_BIN && m_BinaryChunk.data == nullptr)
+		{
+			m_BinaryChunk.data = data + offset;
+			m_BinaryChunk.size = chunk.length;
+		}
+
+		offset += chunk.length;
 	}
 
-	return m_Data;
+	if (json == nullptr)
+		throw std::runtime_error("glb file has no JSON chunk");
+
+	// simdjson reads up to SIMDJSON_PADDING bytes past the end of the input. When the binary chunk
+	// follows the JSON there is enough of the mapping left to parse in place, otherwise it takes a copy
+	bool parse_in_place = static_cast<size_t>((json + json_length) - data) + SIMDJSON_PADDING <= size;
+	return parser.parse(json, json_length, !parse_in_place);
+}
+
+GltfModelLoader::Buffer GltfModelLoader::LoadBuffer(int64_t buffer_index)
+{
+	// Each buffer is only mapped once no matter how many accessors reference it
+	auto it = m_Buffers.find(buffer_index);
+	if (it != m_Buffers.end())
+		return it->second;
+
+	Buffer buffer;
+	auto buffer_uri = m_Document["buffers"].at(buffer_index)["uri"].get_string();
+	if (buffer_uri.error() == simdjson::SUCCESS)
+	{
+		// External buffer file
+		auto buffer_file = m_Path.parent_path() / buffer_uri.value();
+		m_Files.push_back(std::make_unique<MappedFile>(buffer_file));
+
+		buffer.data = m_Files.back()->Data();
+		buffer.size = m_Files.back()->Size();
+	}
+	else if (m_BinaryChunk.data != nullptr)
+	{
+		// A buffer without a uri refers to the binary chunk of the .glb
+		buffer = m_BinaryChunk;
+	}
+	else
+	{
+		throw std::runtime_error("glTF buffer has no data");
+	}
+
+	return m_Buffers[buffer_index] = buffer;
 }
 
-UINT GltfModelLoader::LoadVertices(int64_t vertices_index)
+GltfModelLoader::Buffer GltfModelLoader::LoadBufferView(int64_t buffer_view_index, int64_t byte_offset, size_t* byte_stride)
 {
-	// Get vertex position accessors
-	auto mesh_vertex_position_accessor = m_Document["accessors"].at(vertices_index);
+	auto buffer_view = m_Document["bufferViews"].at(buffer_view_index);
+	Buffer buffer = LoadBuffer(buffer_view["buffer"].get_int64().value());
 
-	// Vertex count
-	auto vertex_count = mesh_vertex_position_accessor["count"].get_int64();
+	int64_t view_byte_offset = 0;
+	buffer_view["byteOffset"].get_int64().get(view_byte_offset);
 
-	// Buffer
-	auto vertex_buffer_view_index = mesh_vertex_position_accessor["bufferView"].get_int64();
-	std::vector<char> buffer = LoadBuffer(vertex_buffer_view_index.value());
+	int64_t view_byte_length = buffer_view["byteLength"].get_int64().value();
+	if (view_byte_offset + view_byte_length > static_cast<int64_t>(buffer.size) || byte_offset > view_byte_length)
+		throw std::runtime_error("glTF buffer view is out of range");
 
-	// Reinterpret the data to what we set in the input layout
-	DX::Vertex* raw_vertices = reinterpret_cast<DX::Vertex*>(buffer.data());
-	std::vector<DX::Vertex> vertices(raw_vertices, raw_vertices + vertex_count.value());
+	// Interleaved buffer views store a stride, otherwise the elements are tightly packed
+	if (byte_stride != nullptr)
+	{
+		int64_t stride = 0;
+		buffer_view["byteStride"].get_int64().get(stride);
+		*byte_stride = static_cast<size_t>(stride);
+	}
 
-	// Set vertices
-	m_Data.vertices.insert(m_Data.vertices.end(), vertices.begin(), vertices.end());
+	Buffer view;
+	view.data = buffer.data + view_byte_offset + byte_offset;
+	view.size = static_cast<size_t>(view_byte_length - byte_offset);
 
-	// Return vertex count for rendering
-	return static_cast<UINT>(vertices.size());
+	return view;
 }
 
-UINT GltfModelLoader::LoadIndices(int64_t indices_index)
+GltfAccessor GltfModelLoader::LoadAccessor(int64_t accessor_index)
 {
-	// Indices count
-	auto mesh_indices_accessor = m_Document["accessors"].at(indices_index);
-	auto indices_count = mesh_indices_accessor["count"].get_int64();
+	simdjson::dom::element accessor = m_Document["accessors"].at(accessor_index);
+
+	GltfAccessor view;
+	view.count = static_cast<size_t>(accessor["count"].get_int64().value());
+	view.component_type = static_cast<int>(accessor["componentType"].get_int64().value());
+	view.components = ComponentCount(accessor["type"].get_string().value());
+	view.stride = view.ElementSize();
+	accessor["normalized"].get_bool().get(view.normalized);
+
+	// Accessors without a buffer view are all zeros apart from their sparse substitutions
+	int64_t buffer_view_index = 0;
+	if (accessor["bufferView"].get_int64().get(buffer_view_index) == simdjson::SUCCESS)
+	{
+		// Accessor byte offset is optional and relative to the start of the buffer view
+		int64_t accessor_byte_offset = 0;
+		accessor["byteOffset"].get_int64().get(accessor_byte_offset);
 
-	// Buffer
-	auto indices_buffer_view_index = mesh_indices_accessor["bufferView"].get_int64();
-	std::vector<char> buffer = LoadBuffer(indices_buffer_view_index.value());
+		size_t byte_stride = 0;
+		Buffer buffer = LoadBufferView(buffer_view_index, accessor_byte_offset, &byte_stride);
 
-	// Reinterpret the data to what we set in the input layout
-	USHORT* raw_indices = reinterpret_cast<USHORT*>(buffer.data());
-	std::vector<UINT> indices(raw_indices, raw_indices + indices_count.value());
+		view.data = buffer.data;
+		if (byte_stride != 0)
+			view.stride = byte_stride;
 
-	// Set indices
-	m_Data.indices.insert(m_Data.indices.end(), indices.begin(), indices.end());
+		if (view.count != 0 && (view.count - 1) * view.stride + view.ElementSize() > buffer.size)
+			throw std::runtime_error("glTF accessor is out of range");
+	}
 
-	// Return indices count
-	return static_cast<UINT>(indices.size());
+	if (view.data == nullptr || accessor["sparse"].error() == simdjson::SUCCESS)
+		return ExpandAccessor(accessor, view);
+
+	return view;
 }
 
-std::vector<char> GltfModelLoader::LoadBuffer(int64_t index)
+GltfAccessor GltfModelLoader::ExpandAccessor(simdjson::dom::element& accessor, const GltfAccessor& view)
 {
-	// Buffer view data
-	auto vertex_buffer_view = m_Document["bufferViews"].at(index);
-	auto buffer_index = vertex_buffer_view["buffer"].get_int64();
-	auto buffer_byte_length = vertex_buffer_view["byteLength"].get_int64();
-	auto buffer_byte_offset = vertex_buffer_view["byteOffset"].get_int64();
-
-	// Set buffer data
-	auto buffer = m_Document["buffers"].at(buffer_index.value());
-	auto buffer_length = buffer["byteLength"].get_int64();
-	auto buffer_uri = buffer["uri"].get_string();
-
-	// Read buffer
-	auto buffer_file = m_Path.parent_path() / buffer_uri.value();
-	std::ifstream file(buffer_file.string(), std::fstream::in | std::fstream::binary);
-	file.seekg(buffer_byte_offset.value());
-
-	std::vector<char> data;
-	data.resize(buffer_byte_length.value());
-	file.read(data.data(), buffer_byte_length.value());
-	file.close();
-
-	return data;
+	// Tightly packed copy of the base elements, or zeros if there is no buffer view
+	size_t element_size = view.ElementSize();
+	std::vector<char> elements(view.count * element_size);
+	if (view.data != nullptr)
+	{
+		for (size_t i = 0; i < view.count; ++i)
+		{
+			std::memcpy(elements.data() + i * element_size, view.data + i * view.stride, element_size);
+		}
+	}
+
+	// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#sparse-accessors
+	simdjson::dom::element sparse;
+	if (accessor["sparse"].get(sparse) == simdjson::SUCCESS)
+	{
+		size_t sparse_count = static_cast<size_t>(sparse["count"].get_int64().value());
+		auto sparse_indices = sparse["indices"];
+		auto sparse_values = sparse["values"];
+
+		int64_t indices_byte_offset = 0;
+		sparse_indices["byteOffset"].get_int64().get(indices_byte_offset);
+
+		int64_t values_byte_offset = 0;
+		sparse_values["byteOffset"].get_int64().get(values_byte_offset);
+
+		// Indices of the substituted elements
+		GltfAccessor indices;
+		indices.component_type = static_cast<int>(sparse_indices["componentType"].get_int64().value());
+		indices.stride = indices.ComponentSize();
+		indices.count = sparse_count;
+
+		Buffer indices_buffer = LoadBufferView(sparse_indices["bufferView"].get_int64().value(), indices_byte_offset, nullptr);
+		Buffer values_buffer = LoadBufferView(sparse_values["bufferView"].get_int64().value(), values_byte_offset, nullptr);
+		if (sparse_count * indices.stride > indices_buffer.size || sparse_count * element_size > values_buffer.size)
+			throw std::runtime_error("glTF sparse accessor is out of range");
+
+		indices.data = indices_buffer.data;
+
+		std::vector<UINT> targets(sparse_count);
+		indices.Read(0, sparse_count, targets.data(), 1, sizeof(UINT));
+
+		// Values are tightly packed in the same layout as the elements they replace
+		for (size_t i = 0; i < sparse_count; ++i)
+		{
+			if (targets[i] >= view.count)
+				throw std::runtime_error("glTF sparse index is out of range");
+
+			std::memcpy(elements.data() + targets[i] * element_size, values_buffer.data + i * element_size, element_size);
+		}
+	}
+
+	m_SparseData.push_back(std::move(elements));
+
+	GltfAccessor expanded = view;
+	expanded.data = m_SparseData.back().data();
+	expanded.stride = element_size;
+
+	return expanded;
 }
 
 DirectX::XMMATRIX GltfModelLoader::LoadTransformation(simdjson::dom::element& node)
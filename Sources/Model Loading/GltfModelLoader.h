@@ -1,7 +1,11 @@
 #pragma once
 
 #include "DxModel.h"
+#include "MappedFile.h"
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <cstring>
 #include "simdjson.h"
 using namespace simdjson;
 using namespace simdjson::dom;
@@ -19,6 +23,44 @@ struct GltfFileData
 	std::vector<DX::ModelObjectData> model_object_data;
 };
 
+// Accessor component types
+// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#accessor-data-types
+enum GltfComponentType
+{
+	GLTF_BYTE = 5120,
+	GLTF_UNSIGNED_BYTE = 5121,
+	GLTF_SHORT = 5122,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT = 5125,
+	GLTF_FLOAT = 5126
+};
+
+// Stride-aware view over an accessor's elements. Reads straight from the mapped buffer and converts
+// whatever component type the file stores into the type the caller asks for
+struct GltfAccessor
+{
+	const char* data = nullptr;
+	size_t count = 0;
+	size_t stride = 0;
+
+	int component_type = GLTF_FLOAT;
+	size_t components = 1;
+	bool normalized = false;
+
+	// Size of a single component in bytes
+	size_t ComponentSize() const;
+
+	// Size of a tightly packed element in bytes
+	size_t ElementSize() const { return ComponentSize() * components; }
+
+	// Convert elements [start, end) into output, writing the first output_components components of each
+	// element output_stride bytes apart. Supported output types are float and UINT
+	template <typename T>
+	void Read(size_t start, size_t end, T* output, size_t output_components, size_t output_stride) const;
+
+	size_t size() const { return count; }
+};
+
 class GltfModelLoader
 {
 public:
@@ -32,14 +74,41 @@ private:
 	GltfFileData m_Data;
 	simdjson_result<element> m_Document;
 
-	// Load vertices
-	UINT LoadVertices(int64_t vertices_index);
+	// Bytes of a glTF buffer, either an external file or the binary chunk of a .glb
+	struct Buffer
+	{
+		const char* data = nullptr;
+		size_t size = 0;
+	};
+
+	// Buffers are mapped the first time they are referenced and kept until the load finishes
+	std::map<int64_t, Buffer> m_Buffers;
+	std::vector<std::unique_ptr<MappedFile>> m_Files;
+
+	// Binary chunk of a .glb file
+	Buffer m_BinaryChunk;
+
+	// Parse a .glb container - the JSON chunk is parsed in place and the binary chunk backs the buffers
+	simdjson_result<element> ParseBinary(parser& parser, const MappedFile& file);
+
+	// Sparse accessors are expanded into these so they can be read like any other accessor.
+	// The inner vectors are never resized so their data stays put when the outer vector grows
+	std::vector<std::vector<char>> m_SparseData;
+
+	// Load a mesh primitive's vertices and indices, returning its index count
+	UINT LoadPrimitive(simdjson::dom::element& primitive);
+
+	// Map buffer
+	Buffer LoadBuffer(int64_t buffer_index);
+
+	// Bytes of a buffer view starting byte_offset bytes in, optionally returning its byte stride
+	Buffer LoadBufferView(int64_t buffer_view_index, int64_t byte_offset, size_t* byte_stride);
 
-	// Load indices
-	UINT LoadIndices(int64_t indices_index);
+	// Load accessor as a view into the mapped buffer, expanding it first if it is sparse
+	GltfAccessor LoadAccessor(int64_t accessor_index);
 
-	// Load buffer
-	std::vector<char> LoadBuffer(int64_t index);
+	// Copy an accessor into loader owned memory and apply its sparse substitutions
+	GltfAccessor ExpandAccessor(simdjson::dom::element& accessor, const GltfAccessor& view);
 
 	// Load transformation
 	DirectX::XMMATRIX LoadTransformation(simdjson::dom::element& node);
@@ -0,0 +1,87 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::filesystem::path& path)
+{
+#ifdef _WIN32
+	// Open the file and create a read only mapping of the whole file
+	m_File = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_File == INVALID_HANDLE_VALUE)
+	{
+		m_File = nullptr;
+		throw std::runtime_error("Could not open file: " + path.string());
+	}
+
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(m_File, &size);
+	m_Size = static_cast<size_t>(size.QuadPart);
+
+	// Windows can't map an empty file
+	if (m_Size == 0)
+		return;
+
+	m_Mapping = CreateFileMappingW(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_Mapping == nullptr)
+	{
+		CloseHandle(m_File);
+		m_File = nullptr;
+		throw std::runtime_error("Could not map file: " + path.string());
+	}
+
+	m_Data = static_cast<const char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+	m_File = open(path.c_str(), O_RDONLY);
+	if (m_File == -1)
+	{
+		throw std::runtime_error("Could not open file: " + path.string());
+	}
+
+	struct stat file_stat = {};
+	fstat(m_File, &file_stat);
+	m_Size = static_cast<size_t>(file_stat.st_size);
+
+	// mmap fails on a zero length mapping
+	if (m_Size == 0)
+		return;
+
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_File, 0);
+	if (data == MAP_FAILED)
+	{
+		close(m_File);
+		m_File = -1;
+		throw std::runtime_error("Could not map file: " + path.string());
+	}
+
+	m_Data = static_cast<const char*>(data);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_Data != nullptr)
+		UnmapViewOfFile(m_Data);
+
+	if (m_Mapping != nullptr)
+		CloseHandle(m_Mapping);
+
+	if (m_File != nullptr)
+		CloseHandle(m_File);
+#else
+	if (m_Data != nullptr)
+		munmap(const_cast<char*>(m_Data), m_Size);
+
+	if (m_File != -1)
+		close(m_File);
+#endif
+}
\ No newline at end of file
@@ -1,6 +1,7 @@
 // Vertex input
 struct VertexInput
 {
+	// Unorm16 in the model's bounds, the world matrix maps it back
 	float3 position : POSITION;
 };
 
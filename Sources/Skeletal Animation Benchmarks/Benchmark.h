@@ -0,0 +1,27 @@
+#pragma once
+
+#include <chrono>
+
+// Models shared with the samples, relative to the project directory the benchmarks run from
+constexpr auto MODELS_PATH = "../../Resources/Models";
+
+// Milliseconds since start
+inline double ElapsedMilliseconds(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Load every glTF model and report throughput and the time of each loader stage
+void BenchmarkGltfLoading();
+
+// Import man.fbx with Assimp and report the time of each loader stage
+void BenchmarkAssimpImport();
+
+// Import models with Assimp and the glTF loader and compare them to opening the cooked mesh cache
+void BenchmarkMeshCache();
+
+// Sample a crowd of characters from a compiled clip, with and without shared key times
+void BenchmarkClipSampling();
+
+// Sample a 200 bone, 10000 key clip with and without keyframe cursors, playing forward and seeking
+void BenchmarkKeyCursors();
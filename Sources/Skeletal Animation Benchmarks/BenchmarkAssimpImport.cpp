@@ -0,0 +1,50 @@
+#include "Benchmark.h"
+#include "ModelLoader.h"
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+namespace
+{
+	// Imports of every model, enough for the timings to settle
+	constexpr int LOAD_REPEATS = 20;
+
+	// The sample's character in both formats Assimp reads for it
+	constexpr const char* MODELS[] = { "man.fbx", "man.gltf" };
+}
+
+void BenchmarkAssimpImport()
+{
+	std::cout << std::left << std::setw(20) << "model" << std::right << std::setw(10) << "ms" << std::setw(10) << "read"
+		<< std::setw(10) << "convert" << std::setw(10) << "anim" << std::setw(10) << "vertices" << std::setw(10) << "indices" << "\n";
+
+	for (const char* model : MODELS)
+	{
+		const std::string path = (std::filesystem::path(MODELS_PATH) / model).string();
+
+		Assimp::LoadStatistics stages;
+		double total_ms = 0.0;
+		for (int i = 0; i < LOAD_REPEATS; ++i)
+		{
+			Assimp::Loader loader;
+			auto start = std::chrono::steady_clock::now();
+			loader.Load(path);
+			total_ms += ElapsedMilliseconds(start);
+
+			const Assimp::LoadStatistics& statistics = loader.GetStatistics();
+			stages.read_ms += statistics.read_ms;
+			stages.convert_ms += statistics.convert_ms;
+			stages.animation_ms += statistics.animation_ms;
+			stages.vertex_count = statistics.vertex_count;
+			stages.index_count = statistics.index_count;
+		}
+
+		std::cout << std::left << std::setw(20) << model << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << total_ms / LOAD_REPEATS
+			<< std::setw(10) << stages.read_ms / LOAD_REPEATS
+			<< std::setw(10) << stages.convert_ms / LOAD_REPEATS
+			<< std::setw(10) << stages.animation_ms / LOAD_REPEATS
+			<< std::setw(10) << stages.vertex_count
+			<< std::setw(10) << stages.index_count << "\n";
+	}
+}
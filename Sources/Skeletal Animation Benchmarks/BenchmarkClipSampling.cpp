@@ -0,0 +1,108 @@
+#include "Benchmark.h"
+#include "DxCompiledClip.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	// A crowd of characters, each playing the clip from its own start time
+	constexpr UINT CHARACTER_COUNT = 500;
+	constexpr UINT BONE_COUNT = 64;
+	constexpr UINT KEY_COUNT = 61;
+	constexpr float KEY_RATE = 30.0f;
+
+	// Frames of a 60 Hz game played through
+	constexpr UINT FRAME_COUNT = 240;
+	constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+	// Every bone swinging about its own axis. With jitter each bone's inner keys are nudged off the shared
+	// times, which leaves the same motion but forces the per bone path
+	DX::AnimationClip CreateClip(bool jitter)
+	{
+		DX::AnimationClip clip;
+		clip.BoneAnimations.resize(BONE_COUNT);
+
+		for (UINT bone = 0; bone < BONE_COUNT; ++bone)
+		{
+			auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(bone * 1.3f), 1.0f, std::cos(bone * 0.7f), 0.0f));
+
+			auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+			keyframes.resize(KEY_COUNT);
+			for (UINT k = 0; k < KEY_COUNT; ++k)
+			{
+				float time = k / KEY_RATE;
+				if (jitter && k != 0 && k + 1 != KEY_COUNT)
+				{
+					time += bone * 1e-6f;
+				}
+
+				auto& keyframe = keyframes[k];
+				keyframe.TimePos = time;
+				keyframe.Translation = DirectX::XMFLOAT3(0.0f, 0.1f * std::sin(time * 4.0f + bone), 0.0f);
+				keyframe.Scale = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+				DirectX::XMStoreFloat4(&keyframe.RotationQuat, DirectX::XMQuaternionRotationAxis(axis, 1.5f * std::sin(time * 3.0f + bone * 0.5f)));
+			}
+		}
+
+		return clip;
+	}
+
+	// Average milliseconds to sample every character's pose for a frame. Poses are kept so they can be compared
+	double TimeCrowd(const DX::CompiledClip& clip, std::vector<DX::BoneTransform>& poses)
+	{
+		const float length = clip.GetEndTime() - clip.GetStartTime();
+		std::vector<std::vector<UINT>> cursors(CHARACTER_COUNT);
+		poses.resize(static_cast<size_t>(CHARACTER_COUNT) * BONE_COUNT);
+
+		auto start = std::chrono::steady_clock::now();
+		for (UINT frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			for (UINT character = 0; character < CHARACTER_COUNT; ++character)
+			{
+				float t = std::fmod(character * 0.037f + frame * FRAME_TIME, length);
+				clip.Sample(t, poses.data() + static_cast<size_t>(character) * BONE_COUNT, cursors[character]);
+			}
+		}
+
+		return ElapsedMilliseconds(start) / FRAME_COUNT;
+	}
+}
+
+void BenchmarkClipSampling()
+{
+	DX::CompiledClip shared;
+	shared.Compile(CreateClip(false));
+
+	DX::CompiledClip separate;
+	separate.Compile(CreateClip(true));
+
+	std::vector<DX::BoneTransform> shared_poses;
+	std::vector<DX::BoneTransform> separate_poses;
+
+	// Warm the caches and cursors before timing
+	TimeCrowd(shared, shared_poses);
+	TimeCrowd(separate, separate_poses);
+
+	double shared_ms = TimeCrowd(shared, shared_poses);
+	double separate_ms = TimeCrowd(separate, separate_poses);
+
+	// How far the normalised lerp of the shared path strays from slerp
+	float max_degrees = 0.0f;
+	for (size_t i = 0; i < shared_poses.size(); ++i)
+	{
+		float dot = std::abs(DirectX::XMVectorGetX(DirectX::XMQuaternionDot(shared_poses[i].rotation, separate_poses[i].rotation)));
+		max_degrees = std::max(max_degrees, DirectX::XMConvertToDegrees(2.0f * std::acos(std::min(dot, 1.0f))));
+	}
+
+	std::cout << CHARACTER_COUNT << " characters of " << BONE_COUNT << " bones, " << FRAME_COUNT << " frames\n";
+	std::cout << std::left << std::setw(24) << "path" << std::right << std::setw(10) << "ms/frame" << std::setw(10) << "us/char" << "\n" << std::fixed;
+	std::cout << std::left << std::setw(24) << "shared times, nlerp" << std::right << std::setprecision(3)
+		<< std::setw(10) << shared_ms << std::setw(10) << shared_ms * 1000.0 / CHARACTER_COUNT << "\n";
+	std::cout << std::left << std::setw(24) << "per bone times, slerp" << std::right
+		<< std::setw(10) << separate_ms << std::setw(10) << separate_ms * 1000.0 / CHARACTER_COUNT << "\n";
+	std::cout << "largest rotation difference " << std::setprecision(4) << max_degrees << " degrees\n";
+}
@@ -0,0 +1,89 @@
+#include "Benchmark.h"
+#include "GltfModelLoader.h"
+#include <algorithm>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	// Loads of every model, enough for the timings to settle
+	constexpr int LOAD_REPEATS = 50;
+
+	void PrintRow(const std::string& name, size_t bytes, double total_ms, const GltfLoadStatistics& stages, int loads)
+	{
+		double megabytes_per_second = total_ms > 0.0 ? (bytes / (1024.0 * 1024.0)) / (total_ms / 1000.0) : 0.0;
+		std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+			<< std::setw(10) << std::setprecision(1) << bytes / 1024.0 / loads
+			<< std::setw(10) << std::setprecision(3) << total_ms / loads
+			<< std::setw(10) << std::setprecision(1) << megabytes_per_second
+			<< std::setw(10) << std::setprecision(3) << stages.parse_ms / loads
+			<< std::setw(10) << stages.plan_ms / loads
+			<< std::setw(10) << stages.decode_ms / loads
+			<< std::setw(10) << stages.animation_ms / loads << "\n";
+	}
+
+	void Accumulate(GltfLoadStatistics& total, const GltfLoadStatistics& stages)
+	{
+		total.parse_ms += stages.parse_ms;
+		total.plan_ms += stages.plan_ms;
+		total.decode_ms += stages.decode_ms;
+		total.animation_ms += stages.animation_ms;
+		total.bytes_read += stages.bytes_read;
+	}
+}
+
+void BenchmarkGltfLoading()
+{
+	std::vector<std::filesystem::path> paths;
+	for (const auto& entry : std::filesystem::directory_iterator(MODELS_PATH))
+	{
+		auto extension = entry.path().extension();
+		if (extension == ".gltf" || extension == ".glb")
+		{
+			paths.push_back(entry.path());
+		}
+	}
+
+	std::sort(paths.begin(), paths.end());
+
+	std::cout << std::left << std::setw(24) << "model" << std::right
+		<< std::setw(10) << "KB" << std::setw(10) << "ms" << std::setw(10) << "MB/s"
+		<< std::setw(10) << "parse" << std::setw(10) << "plan" << std::setw(10) << "decode" << std::setw(10) << "anim" << "\n";
+
+	GltfLoadStatistics all_stages;
+	double all_ms = 0.0;
+	int all_loads = 0;
+	for (const auto& path : paths)
+	{
+		GltfLoadStatistics stages;
+		double total_ms = 0.0;
+		try
+		{
+			for (int i = 0; i < LOAD_REPEATS; ++i)
+			{
+				GltfModelLoader loader;
+				auto start = std::chrono::steady_clock::now();
+				loader.Load(path);
+				total_ms += ElapsedMilliseconds(start);
+				Accumulate(stages, loader.GetStatistics());
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << std::left << std::setw(24) << path.filename().string() << " failed: " << e.what() << "\n";
+			continue;
+		}
+
+		PrintRow(path.filename().string(), stages.bytes_read, total_ms, stages, LOAD_REPEATS);
+		Accumulate(all_stages, stages);
+		all_ms += total_ms;
+		all_loads += LOAD_REPEATS;
+	}
+
+	if (all_loads > 0)
+	{
+		PrintRow("all", all_stages.bytes_read, all_ms, all_stages, all_loads);
+	}
+}
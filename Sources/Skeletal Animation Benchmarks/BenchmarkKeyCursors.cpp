@@ -0,0 +1,219 @@
+#include "Benchmark.h"
+#include "DxCompiledClip.h"
+#include "DxCompressedClip.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	// A long clip, long enough that finding the key dominates sampling without a cursor
+	constexpr UINT BONE_COUNT = 200;
+	constexpr UINT KEY_COUNT = 10000;
+	constexpr float KEY_RATE = 30.0f;
+
+	// Frames of a 60 Hz game played through from the middle of the clip, and random seeks
+	constexpr UINT FRAME_COUNT = 240;
+	constexpr float FRAME_TIME = 1.0f / 60.0f;
+	constexpr UINT SEEK_COUNT = 240;
+
+	// Every bone swinging about its own axis, its inner keys nudged off the shared times so each bone is a
+	// track of its own and searches its own keys, like clips exported per channel
+	DX::AnimationClip CreateClip()
+	{
+		DX::AnimationClip clip;
+		clip.BoneAnimations.resize(BONE_COUNT);
+
+		for (UINT bone = 0; bone < BONE_COUNT; ++bone)
+		{
+			auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(bone * 1.3f), 1.0f, std::cos(bone * 0.7f), 0.0f));
+
+			auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+			keyframes.resize(KEY_COUNT);
+			for (UINT k = 0; k < KEY_COUNT; ++k)
+			{
+				float time = k / KEY_RATE;
+				if (k != 0 && k + 1 != KEY_COUNT)
+				{
+					time += (bone + 1) * 1e-5f;
+				}
+
+				auto& keyframe = keyframes[k];
+				keyframe.TimePos = time;
+				keyframe.Translation = DirectX::XMFLOAT3(0.0f, 0.1f * std::sin(time * 4.0f + bone), 0.0f);
+				keyframe.Scale = DirectX::XMFLOAT3(1.0f, 1.0f, 1.0f);
+				DirectX::XMStoreFloat4(&keyframe.RotationQuat, DirectX::XMQuaternionRotationAxis(axis, 1.5f * std::sin(time * 3.0f + bone * 0.5f)));
+			}
+		}
+
+		return clip;
+	}
+
+	// Times a pose is sampled at, forward playback or jumping around the clip
+	std::vector<float> GetTimes(float length, bool seek)
+	{
+		std::vector<float> times;
+		std::mt19937 random(5);
+		std::uniform_real_distribution<float> anywhere(0.0f, length);
+		for (UINT i = 0; i < (seek ? SEEK_COUNT : FRAME_COUNT); ++i)
+		{
+			times.push_back(seek ? anywhere(random) : length * 0.5f + i * FRAME_TIME);
+		}
+
+		return times;
+	}
+
+	// Key before t found the way BoneAnimation::Interpolate did before cursors, scanning from the first key.
+	// Spans are half open like FindKey's, so a time on a key lands in the span it starts
+	UINT ScanKey(const std::vector<DX::Keyframe>& keyframes, float t)
+	{
+		for (UINT i = 0; i + 1 < keyframes.size(); ++i)
+		{
+			if (t >= keyframes[i].TimePos && t < keyframes[i + 1].TimePos)
+				return i;
+		}
+
+		return static_cast<UINT>(keyframes.size()) - 1;
+	}
+
+	// Average milliseconds to find every bone's key at each time. Scanning, or through FindKey with a
+	// cursor per bone that is either kept or reset so every search starts over
+	double TimeKeySearch(const DX::AnimationClip& clip, const std::vector<float>& times, int mode, std::vector<UINT>& keys)
+	{
+		std::vector<std::vector<float>> key_times(BONE_COUNT);
+		for (UINT bone = 0; bone < BONE_COUNT; ++bone)
+		{
+			for (const auto& keyframe : clip.BoneAnimations[bone].Keyframes)
+			{
+				key_times[bone].push_back(keyframe.TimePos);
+			}
+		}
+
+		std::vector<UINT> cursors(BONE_COUNT, 0);
+		keys.clear();
+
+		auto start = std::chrono::steady_clock::now();
+		for (float t : times)
+		{
+			for (UINT bone = 0; bone < BONE_COUNT; ++bone)
+			{
+				if (mode == 0)
+				{
+					keys.push_back(ScanKey(clip.BoneAnimations[bone].Keyframes, t));
+					continue;
+				}
+
+				if (mode == 1)
+				{
+					cursors[bone] = 0;
+				}
+
+				DX::CompiledClip::FindKey(key_times[bone].data(), KEY_COUNT, t, cursors[bone]);
+				keys.push_back(cursors[bone]);
+			}
+		}
+
+		return ElapsedMilliseconds(start) / times.size();
+	}
+
+	// Average milliseconds to sample a whole pose at each time, keeping the cursors between samples or
+	// resetting them so every sample seeks. Poses are kept so the two can be compared
+	template <class Clip>
+	double TimeSampling(const Clip& clip, const std::vector<float>& times, bool keep_cursors, std::vector<DX::BoneTransform>& poses)
+	{
+		std::vector<UINT> cursors;
+		poses.resize(times.size() * BONE_COUNT);
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < times.size(); ++i)
+		{
+			if (!keep_cursors)
+			{
+				std::fill(cursors.begin(), cursors.end(), 0);
+			}
+
+			clip.Sample(times[i], poses.data() + i * BONE_COUNT, cursors);
+		}
+
+		return ElapsedMilliseconds(start) / times.size();
+	}
+
+	// Sample a clip with and without cursors, playing and seeking. Cursors only change where the search
+	// starts, so both ways have to land on the same poses
+	template <class Clip>
+	void ReportSampling(const char* name, const Clip& clip, const std::vector<float>& playback, const std::vector<float>& seeks)
+	{
+		double milliseconds[2][2];
+		for (int i = 0; i < 2; ++i)
+		{
+			std::vector<DX::BoneTransform> reset, kept;
+			milliseconds[0][i] = TimeSampling(clip, i == 0 ? playback : seeks, false, reset);
+			milliseconds[1][i] = TimeSampling(clip, i == 0 ? playback : seeks, true, kept);
+
+			for (size_t k = 0; k < kept.size(); ++k)
+			{
+				if (DirectX::XMVector4NotEqual(kept[k].translation, reset[k].translation) || DirectX::XMVector4NotEqual(kept[k].rotation, reset[k].rotation) ||
+					DirectX::XMVector4NotEqual(kept[k].scale, reset[k].scale))
+					throw std::runtime_error(std::string(name) + ": poses with and without cursors differ at bone " + std::to_string(k % BONE_COUNT));
+			}
+		}
+
+		for (int cursor = 0; cursor < 2; ++cursor)
+		{
+			std::cout << std::left << std::setw(28) << std::string(name) + (cursor ? ", cursor" : ", no cursor") << std::right
+				<< std::setw(12) << milliseconds[cursor][0] << std::setw(12) << milliseconds[cursor][1] << "\n";
+		}
+	}
+}
+
+void BenchmarkKeyCursors()
+{
+	DX::AnimationClip source = CreateClip();
+
+	DX::CompiledClip compiled;
+	compiled.Compile(source);
+
+	DX::CompressedClip compressed;
+	DX::ClipCompressionReport report = compressed.Compress(source);
+
+	std::cout << BONE_COUNT << " bones of " << KEY_COUNT << " keys, compiled " << compiled.GetMemoryUsage() / 1024 << " KB, compressed "
+		<< report.compressed_bytes / 1024 << " KB of " << report.source_bytes / 1024 << " KB\n";
+
+	// Milliseconds per pose, playing forward a frame at a time and seeking to random times
+	std::cout << std::left << std::setw(28) << "path" << std::right << std::setw(12) << "playback" << std::setw(12) << "seek" << "\n" << std::fixed << std::setprecision(4);
+
+	const float length = compiled.GetEndTime() - compiled.GetStartTime();
+	const std::vector<float> playback = GetTimes(length, false);
+	const std::vector<float> seeks = GetTimes(length, true);
+
+	// Key search alone, what a cursor saves
+	const char* search_names[] = { "key search, scan", "key search, binary", "key search, cursor" };
+	std::vector<UINT> reference_keys[2];
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		std::vector<UINT> playback_keys, seek_keys;
+		double playback_ms = TimeKeySearch(source, playback, mode, playback_keys);
+		double seek_ms = TimeKeySearch(source, seeks, mode, seek_keys);
+
+		if (mode == 0)
+		{
+			reference_keys[0] = playback_keys;
+			reference_keys[1] = seek_keys;
+		}
+		else if (playback_keys != reference_keys[0] || seek_keys != reference_keys[1])
+		{
+			throw std::runtime_error(std::string(search_names[mode]) + " found other keys than the scan");
+		}
+
+		std::cout << std::left << std::setw(28) << search_names[mode] << std::right << std::setw(12) << playback_ms << std::setw(12) << seek_ms << "\n";
+	}
+
+	// Whole poses through the clips the animation system plays
+	ReportSampling("compiled clip", compiled, playback, seeks);
+	ReportSampling("compressed clip", compressed, playback, seeks);
+}
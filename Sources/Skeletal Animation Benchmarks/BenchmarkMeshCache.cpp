@@ -0,0 +1,80 @@
+#include "Benchmark.h"
+#include "DxMeshCache.h"
+#include "DxMeshImporter.h"
+#include "GltfModelLoader.h"
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace
+{
+	// Loads of every model, enough for the timings to settle
+	constexpr int LOAD_REPEATS = 20;
+
+	// Only Assimp reads the .fbx
+	constexpr const char* MODELS[] = { "3bone.gltf", "skinned_mesh.gltf", "man.gltf", "man.fbx" };
+
+	// Average milliseconds of a load
+	template <typename Load>
+	double TimeLoad(Load load)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < LOAD_REPEATS; ++i)
+		{
+			load();
+		}
+
+		return ElapsedMilliseconds(start) / LOAD_REPEATS;
+	}
+}
+
+void BenchmarkMeshCache()
+{
+	// Cooked away from the models so the sample's own caches are left alone
+	const auto cache_path = std::filesystem::temp_directory_path() / "benchmark.dxmesh";
+
+	std::cout << std::left << std::setw(20) << "model" << std::right << std::setw(10) << "assimp" << std::setw(10) << "gltf"
+		<< std::setw(10) << "hash" << std::setw(10) << "cache" << std::setw(10) << "KB" << "   (ms per load)\n";
+
+	for (const char* model : MODELS)
+	{
+		const std::filesystem::path path = std::filesystem::path(MODELS_PATH) / model;
+
+		double assimp_ms = TimeLoad([&]() { DX::ImportMesh(path); });
+
+		bool gltf = path.extension() == ".gltf" || path.extension() == ".glb";
+		double gltf_ms = gltf ? TimeLoad([&]() { GltfModelLoader loader; loader.Load(path); }) : 0.0;
+
+		// The sample hashes the source every start to find out whether its cache is stale
+		uint64_t source_hash = 0;
+		double hash_ms = TimeLoad([&]() { source_hash = DX::MeshCache::HashSource(path); });
+
+		DX::MeshCache::Write(cache_path, source_hash, DX::ImportMesh(path));
+		double cache_ms = TimeLoad([&]()
+		{
+			DX::MeshCache cache;
+			if (!cache.Open(cache_path, source_hash))
+				throw std::runtime_error("Could not open the cooked " + path.filename().string());
+
+			DX::Mesh mesh;
+			cache.ReadAnimation(&mesh);
+		});
+
+		std::cout << std::left << std::setw(20) << model << std::right << std::fixed << std::setprecision(3)
+			<< std::setw(10) << assimp_ms;
+		if (gltf)
+		{
+			std::cout << std::setw(10) << gltf_ms;
+		}
+		else
+		{
+			std::cout << std::setw(10) << "-";
+		}
+
+		std::cout << std::setw(10) << hash_ms << std::setw(10) << cache_ms
+			<< std::setw(10) << std::setprecision(1) << std::filesystem::file_size(cache_path) / 1024.0 << "\n";
+	}
+
+	std::filesystem::remove(cache_path);
+}
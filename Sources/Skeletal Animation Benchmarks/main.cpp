@@ -0,0 +1,52 @@
+#include "Benchmark.h"
+#include <iostream>
+#include <string>
+#include <exception>
+
+namespace
+{
+	struct NamedBenchmark
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	constexpr NamedBenchmark BENCHMARKS[] =
+	{
+		{ "gltf", BenchmarkGltfLoading },
+		{ "assimp", BenchmarkAssimpImport },
+		{ "meshcache", BenchmarkMeshCache },
+		{ "clips", BenchmarkClipSampling },
+		{ "cursors", BenchmarkKeyCursors },
+	};
+}
+
+// Runs every benchmark, or only the ones named on the command line
+int main(int argc, char** argv)
+{
+	try
+	{
+		for (const auto& benchmark : BENCHMARKS)
+		{
+			bool selected = argc < 2;
+			for (int i = 1; i < argc; ++i)
+			{
+				selected |= benchmark.name == std::string(argv[i]);
+			}
+
+			if (selected)
+			{
+				std::cout << "== " << benchmark.name << " ==\n";
+				benchmark.run();
+				std::cout << "\n";
+			}
+		}
+
+		return 0;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << "\n";
+		return -1;
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Models shared with the samples, relative to the project directory the tests run from
+constexpr auto MODELS_PATH = "../../Resources/Models";
+
+// Fail the running test with message unless condition holds
+inline void Expect(bool condition, const std::string& message)
+{
+	if (!condition)
+		throw std::runtime_error(message);
+}
+
+// Compress clips and check the size and error report against the tolerances
+void TestClipCompression();
+
+// Skin animated meshes with the SIMD kernel and check it against the scalar reference
+void TestSkinning();
+
+// Split meshes into bone partitions, pack their palettes and skin through them against the scalar reference
+void TestBonePalette();
@@ -0,0 +1,332 @@
+#include "Test.h"
+#include "DxBonePalette.h"
+#include "DxModel.h"
+#include "DxSkinning.h"
+#include "GltfModelLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	constexpr const char* MODELS[] = { "3bone.gltf", "skinned_mesh.gltf" };
+
+	// Synthetic rig with more bones than a single draw can hold, skinning a grid of vertices
+	constexpr UINT RIG_BONES = 300;
+	constexpr UINT RIG_GRID = 64;
+
+	// Bones per partition, what the shader holds down to the least a triangle needs
+	constexpr size_t PARTITION_SIZES[] = { DX::MAX_PALETTE_BONES, 32, 12 };
+
+	// Largest difference allowed from the reference, relative to the size of the position
+	constexpr float TOLERANCE = 1e-4f;
+
+	struct SkinnedMesh
+	{
+		std::string name;
+		std::vector<DX::Vertex> vertices;
+		std::vector<UINT> indices;
+		std::vector<DX::Subset> subsets;
+		size_t bone_count = 0;
+	};
+
+	SkinnedMesh LoadModel(const char* name)
+	{
+		GltfModelLoader loader;
+		GltfFileData data = loader.Load(std::filesystem::path(MODELS_PATH) / name);
+		Expect(!data.vertices.empty() && !data.bones.empty(), std::string(name) + ": no skinned mesh");
+
+		SkinnedMesh mesh;
+		mesh.name = name;
+		mesh.vertices = std::move(data.vertices);
+		mesh.indices = std::move(data.indices);
+		mesh.subsets = std::move(data.model_object_data);
+		mesh.bone_count = data.bones.size();
+		return mesh;
+	}
+
+	// Every vertex of the grid weighted to four bones, neighbours sharing some of theirs so partitions
+	// pick up bones gradually. The two halves are separate subsets
+	SkinnedMesh CreateRig()
+	{
+		SkinnedMesh mesh;
+		mesh.name = "rig";
+		mesh.bone_count = RIG_BONES;
+
+		for (UINT z = 0; z < RIG_GRID; ++z)
+		{
+			for (UINT x = 0; x < RIG_GRID; ++x)
+			{
+				DX::Vertex vertex;
+				vertex.x = static_cast<float>(x);
+				vertex.y = std::sin(x * 0.3f) * std::cos(z * 0.2f);
+				vertex.z = static_cast<float>(z);
+
+				const int bones[4] = { static_cast<int>((x * 5 + z * 7) % RIG_BONES), static_cast<int>((x * 5 + z * 7 + 1) % RIG_BONES),
+					static_cast<int>((x + z * 3 + 150) % RIG_BONES), static_cast<int>((x * z) % RIG_BONES) };
+				// Some vertices leave their last influence unweighted
+				const bool three = (x + z) % 3 == 0;
+				const float weights[4] = { 0.4f, 0.3f, three ? 0.3f : 0.2f, three ? 0.0f : 0.1f };
+				for (int k = 0; k < 4; ++k)
+				{
+					vertex.bone[k] = bones[k];
+					vertex.weight[k] = weights[k];
+				}
+
+				mesh.vertices.push_back(vertex);
+			}
+		}
+
+		for (UINT z = 0; z + 1 < RIG_GRID; ++z)
+		{
+			if (z == RIG_GRID / 2)
+			{
+				DX::Subset subset;
+				subset.totalIndex = static_cast<unsigned>(mesh.indices.size());
+				subset.transformation = DirectX::XMMatrixIdentity();
+				mesh.subsets.push_back(subset);
+			}
+
+			for (UINT x = 0; x + 1 < RIG_GRID; ++x)
+			{
+				UINT a = z * RIG_GRID + x;
+				UINT c = a + RIG_GRID;
+				mesh.indices.insert(mesh.indices.end(), { a, c, a + 1, a + 1, c, c + 1 });
+			}
+		}
+
+		DX::Subset subset;
+		subset.startIndex = mesh.subsets.back().totalIndex;
+		subset.totalIndex = static_cast<unsigned>(mesh.indices.size()) - subset.startIndex;
+		subset.transformation = DirectX::XMMatrixIdentity();
+		mesh.subsets.push_back(subset);
+		return mesh;
+	}
+
+	// Row-vector palette where every bone turns, stretches and moves by its own amount. Rigid bones all
+	// turn the same way, so blending their dual quaternions lands where blending their matrices does
+	void CreatePalette(size_t bone_count, bool rigid, std::vector<DirectX::XMMATRIX>& palette)
+	{
+		palette.resize(bone_count);
+		for (size_t bone = 0; bone < bone_count; ++bone)
+		{
+			float phase = rigid ? 0.3f : bone * 0.7f;
+			auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(phase), 1.0f, std::cos(phase * 0.5f), 0.0f));
+			auto scale = rigid ? DirectX::XMMatrixIdentity() : DirectX::XMMatrixScaling(1.0f + 0.2f * std::sin(phase), 1.0f, 1.0f - 0.1f * std::cos(phase));
+
+			palette[bone] = scale * DirectX::XMMatrixRotationAxis(axis, 2.0f * std::sin(phase)) *
+				DirectX::XMMatrixTranslation(std::cos(bone * 0.9f), 0.5f * std::sin(bone * 1.3f), 0.25f * bone);
+		}
+	}
+
+	// SkinAffine of VertexShader.hlsl
+	DirectX::XMVECTOR SkinAffine(const DirectX::XMFLOAT4* palette, const DX::Vertex& vertex)
+	{
+		DirectX::XMVECTOR rows[3] = { DirectX::XMVectorZero(), DirectX::XMVectorZero(), DirectX::XMVectorZero() };
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int r = 0; r < 3; ++r)
+			{
+				rows[r] = DirectX::XMVectorMultiplyAdd(DirectX::XMVectorReplicate(vertex.weight[i]), DirectX::XMLoadFloat4(&palette[vertex.bone[i] * 3 + r]), rows[r]);
+			}
+		}
+
+		DirectX::XMVECTOR p = DirectX::XMVectorSet(vertex.x, vertex.y, vertex.z, 1.0f);
+		return DirectX::XMVectorSet(DirectX::XMVectorGetX(DirectX::XMVector4Dot(rows[0], p)), DirectX::XMVectorGetX(DirectX::XMVector4Dot(rows[1], p)),
+			DirectX::XMVectorGetX(DirectX::XMVector4Dot(rows[2], p)), 0.0f);
+	}
+
+	// SkinDualQuaternion of VertexShader.hlsl
+	DirectX::XMVECTOR SkinDualQuaternion(const DirectX::XMFLOAT4* palette, const DX::Vertex& vertex)
+	{
+		using namespace DirectX;
+
+		XMVECTOR first = XMLoadFloat4(&palette[vertex.bone[0] * 2]);
+		XMVECTOR real = XMVectorZero();
+		XMVECTOR dual = XMVectorZero();
+		for (int i = 0; i < 4; ++i)
+		{
+			XMVECTOR bone_real = XMLoadFloat4(&palette[vertex.bone[i] * 2]);
+			XMVECTOR bone_dual = XMLoadFloat4(&palette[vertex.bone[i] * 2 + 1]);
+
+			XMVECTOR w = XMVectorReplicate(XMVectorGetX(XMVector4Dot(first, bone_real)) < 0.0f ? -vertex.weight[i] : vertex.weight[i]);
+			real = XMVectorMultiplyAdd(w, bone_real, real);
+			dual = XMVectorMultiplyAdd(w, bone_dual, dual);
+		}
+
+		XMVECTOR magnitude = XMVectorReplicate(std::max(XMVectorGetX(XMVector4Length(real)), 1e-6f));
+		real = XMVectorDivide(real, magnitude);
+		dual = XMVectorDivide(dual, magnitude);
+
+		XMVECTOR position = XMVectorSet(vertex.x, vertex.y, vertex.z, 0.0f);
+		XMVECTOR real_w = XMVectorReplicate(XMVectorGetW(real));
+		XMVECTOR dual_w = XMVectorReplicate(XMVectorGetW(dual));
+		XMVECTOR rotated = XMVectorAdd(position, XMVectorScale(XMVector3Cross(real, XMVectorMultiplyAdd(real_w, position, XMVector3Cross(real, position))), 2.0f));
+		XMVECTOR translation = XMVectorScale(XMVectorAdd(XMVectorSubtract(XMVectorMultiply(real_w, dual), XMVectorMultiply(dual_w, real)), XMVector3Cross(real, dual)), 2.0f);
+
+		return XMVectorSetW(XMVectorAdd(rotated, translation), 0.0f);
+	}
+
+	// Check each partition holds at most max_bones, and that every drawn vertex is its source vertex with
+	// local bone indices that lead back to the same skeleton bones
+	void CheckPartitions(const SkinnedMesh& mesh, size_t max_bones, const std::vector<DX::Vertex>& vertices, const std::vector<UINT>& indices,
+		const std::vector<DX::BonePartition>& partitions)
+	{
+		const std::string name = mesh.name + " in " + std::to_string(max_bones) + " bone partitions";
+		Expect(indices.size() == mesh.indices.size(), name + ": draws " + std::to_string(indices.size()) + " indices of " + std::to_string(mesh.indices.size()));
+
+		for (const auto& partition : partitions)
+		{
+			Expect(!partition.bones.empty() && partition.bones.size() <= max_bones, name + ": partition uses " + std::to_string(partition.bones.size()) + " bones");
+		}
+
+		size_t p = 0;
+		size_t drawn = 0;
+		for (const auto& subset : mesh.subsets)
+		{
+			for (UINT i = 0; i < subset.totalIndex; ++i, ++drawn)
+			{
+				while (drawn >= partitions[p].startIndex + partitions[p].totalIndex)
+				{
+					p++;
+				}
+
+				const DX::BonePartition& partition = partitions[p];
+				const DX::Vertex& source = mesh.vertices[subset.baseVertex + mesh.indices[subset.startIndex + i]];
+				const DX::Vertex& vertex = vertices[partition.baseVertex + indices[drawn]];
+				Expect(vertex.x == source.x && vertex.y == source.y && vertex.z == source.z, name + ": index " + std::to_string(drawn) + " draws another vertex");
+
+				for (int k = 0; k < 4; ++k)
+				{
+					Expect(vertex.weight[k] == source.weight[k], name + ": index " + std::to_string(drawn) + " changed weights");
+					if (vertex.weight[k] == 0.0f)
+						continue;
+
+					Expect(vertex.bone[k] >= 0 && static_cast<size_t>(vertex.bone[k]) < partition.bones.size() &&
+						partition.bones[vertex.bone[k]] == static_cast<UINT>(source.bone[k]), name + ": index " + std::to_string(drawn) + " influence " +
+						std::to_string(k) + " points at another bone");
+				}
+			}
+		}
+
+		Expect(p + 1 == partitions.size(), name + ": " + std::to_string(partitions.size() - p - 1) + " partitions draw nothing");
+	}
+
+	// Skin every drawn vertex through its partition's packed palette and check it against the reference
+	// for its source vertex. Returns the largest difference
+	float CheckSkinning(const SkinnedMesh& mesh, const std::vector<DirectX::XMMATRIX>& palette, DX::BonePaletteFormat format,
+		const std::vector<DX::Vertex>& vertices, const std::vector<UINT>& indices, const std::vector<DX::BonePartition>& partitions)
+	{
+		const std::string name = mesh.name + (format == DX::BonePaletteFormat::Affine ? " affine" : " dual quaternion");
+
+		std::vector<DirectX::XMFLOAT3> reference(mesh.vertices.size());
+		DX::SkinVerticesReference(mesh.vertices.data(), mesh.vertices.size(), palette.data(), palette.size(), reference.data());
+
+		float max_difference = 0.0f;
+		size_t drawn = 0;
+		size_t p = 0;
+		DX::BonePalette packed;
+		for (const auto& subset : mesh.subsets)
+		{
+			for (UINT i = 0; i < subset.totalIndex; ++i, ++drawn)
+			{
+				if (drawn == partitions[p].startIndex)
+				{
+					packed.Build(palette.data(), palette.size(), partitions[p].bones, format);
+					Expect(packed.GetBoneCount() == partitions[p].bones.size() && packed.GetSize() == partitions[p].bones.size() * DX::BonePalette::GetBoneSize(format),
+						name + ": packed " + std::to_string(packed.GetSize()) + " bytes for " + std::to_string(partitions[p].bones.size()) + " bones");
+				}
+
+				const auto* data = reinterpret_cast<const DirectX::XMFLOAT4*>(packed.GetData());
+				const DX::Vertex& vertex = vertices[partitions[p].baseVertex + indices[drawn]];
+				DirectX::XMVECTOR skinned = format == DX::BonePaletteFormat::Affine ? SkinAffine(data, vertex) : SkinDualQuaternion(data, vertex);
+
+				DirectX::XMVECTOR expected = DirectX::XMLoadFloat3(&reference[subset.baseVertex + mesh.indices[subset.startIndex + i]]);
+				float difference = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(skinned, expected)));
+				float size = DirectX::XMVectorGetX(DirectX::XMVector3Length(expected));
+				Expect(difference <= TOLERANCE * std::max(1.0f, size), name + ": index " + std::to_string(drawn) + " is " + std::to_string(difference) + " from the reference");
+				max_difference = std::max(max_difference, difference);
+
+				if (drawn + 1 == partitions[p].startIndex + partitions[p].totalIndex)
+				{
+					p++;
+				}
+			}
+		}
+
+		return max_difference;
+	}
+}
+
+void TestBonePalette()
+{
+	Expect(DX::BonePalette::GetBoneSize(DX::BonePaletteFormat::Affine) == 48, "affine bones aren't 48 bytes");
+	Expect(DX::BonePalette::GetBoneSize(DX::BonePaletteFormat::DualQuaternion) == 32, "dual quaternion bones aren't 32 bytes");
+
+	std::vector<SkinnedMesh> meshes = { CreateRig() };
+	for (const char* model : MODELS)
+	{
+		meshes.push_back(LoadModel(model));
+	}
+
+	for (const auto& mesh : meshes)
+	{
+		std::vector<DirectX::XMMATRIX> palette, rigid_palette;
+		CreatePalette(mesh.bone_count, false, palette);
+		CreatePalette(mesh.bone_count, true, rigid_palette);
+
+		for (size_t max_bones : PARTITION_SIZES)
+		{
+			std::vector<DX::Vertex> vertices;
+			std::vector<UINT> indices;
+			std::vector<DX::BonePartition> partitions;
+			DX::PartitionByBones({ mesh.vertices.data(), mesh.vertices.size(), mesh.indices.data(), mesh.indices.size(), mesh.subsets.data(), mesh.subsets.size() },
+				mesh.bone_count, max_bones, vertices, indices, partitions);
+
+			CheckPartitions(mesh, max_bones, vertices, indices, partitions);
+
+			// More bones than fit has to split, and a draw never reaches past what the shader holds
+			if (mesh.bone_count > max_bones)
+			{
+				Expect(partitions.size() > mesh.subsets.size(), mesh.name + ": " + std::to_string(mesh.bone_count) + " bones fit in " + std::to_string(max_bones));
+			}
+
+			float affine = CheckSkinning(mesh, palette, DX::BonePaletteFormat::Affine, vertices, indices, partitions);
+			float dual_quaternion = CheckSkinning(mesh, rigid_palette, DX::BonePaletteFormat::DualQuaternion, vertices, indices, partitions);
+
+			std::cout << mesh.name << ": " << mesh.bone_count << " bones in " << partitions.size() << " partitions of at most " << max_bones
+				<< ", " << vertices.size() << " vertices from " << mesh.vertices.size() << ". Max difference affine " << affine
+				<< ", dual quaternion " << dual_quaternion << '\n';
+		}
+	}
+
+	// A single bone's dual quaternion moves a point the way its rigid matrix does, for any rotation
+	std::vector<DirectX::XMMATRIX> rigid(RIG_BONES);
+	std::vector<UINT> bones(RIG_BONES);
+	for (UINT bone = 0; bone < RIG_BONES; ++bone)
+	{
+		auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(bone * 1.7f), std::cos(bone * 0.3f), 0.5f, 0.0f));
+		rigid[bone] = DirectX::XMMatrixRotationAxis(axis, bone * 0.05f) * DirectX::XMMatrixTranslation(bone * 0.1f, -1.0f, std::sin(bone * 0.4f));
+		bones[bone] = bone;
+	}
+
+	DX::BonePalette packed;
+	packed.Build(rigid.data(), rigid.size(), bones, DX::BonePaletteFormat::DualQuaternion);
+	for (UINT bone = 0; bone < RIG_BONES; ++bone)
+	{
+		DX::Vertex vertex;
+		vertex.x = 1.0f;
+		vertex.y = -2.0f;
+		vertex.z = 0.5f;
+		vertex.weight[0] = 1.0f;
+		vertex.bone[0] = static_cast<int>(bone);
+
+		DirectX::XMVECTOR skinned = SkinDualQuaternion(reinterpret_cast<const DirectX::XMFLOAT4*>(packed.GetData()), vertex);
+		DirectX::XMVECTOR expected = DirectX::XMVector3Transform(DirectX::XMVectorSet(vertex.x, vertex.y, vertex.z, 1.0f), rigid[bone]);
+		float difference = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(skinned, expected)));
+		float size = DirectX::XMVectorGetX(DirectX::XMVector3Length(expected));
+		Expect(difference <= TOLERANCE * std::max(1.0f, size), "bone " + std::to_string(bone) + " dual quaternion is " + std::to_string(difference) + " from its matrix");
+	}
+}
@@ -0,0 +1,161 @@
+#include "Test.h"
+#include "DxCompressedClip.h"
+#include "DxModel.h"
+#include "GltfModelLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	constexpr UINT BONE_COUNT = 32;
+	constexpr UINT KEY_COUNT = 121;
+	constexpr float KEY_RATE = 30.0f;
+
+	// Room for the 16 bit quantization on top of the key reduction tolerances
+	constexpr float RANGE_STEPS = 65535.0f;
+	constexpr float ROTATION_QUANTIZATION = 0.0002f;
+
+	// Animated models with a clip the glTF loader reads
+	constexpr const char* MODELS[] = { "3bone.gltf", "man.gltf", "double_mesh_bone.gltf" };
+
+	// Bones swinging and bobbing, the odd ones holding still for the middle third. Moving is false for a
+	// clip whose keys never change
+	DX::AnimationClip CreateClip(bool moving)
+	{
+		DX::AnimationClip clip;
+		clip.BoneAnimations.resize(BONE_COUNT);
+
+		for (UINT bone = 0; bone < BONE_COUNT; ++bone)
+		{
+			auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(bone * 1.3f), 1.0f, std::cos(bone * 0.7f), 0.0f));
+
+			auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+			keyframes.resize(KEY_COUNT);
+			for (UINT k = 0; k < KEY_COUNT; ++k)
+			{
+				float time = k / KEY_RATE;
+				float phase = moving ? time : 0.0f;
+				if (moving && bone % 2 == 1 && k > KEY_COUNT / 3 && k < 2 * KEY_COUNT / 3)
+				{
+					phase = (KEY_COUNT / 3) / KEY_RATE;
+				}
+
+				auto& keyframe = keyframes[k];
+				keyframe.TimePos = time;
+				keyframe.Translation = DirectX::XMFLOAT3(0.5f * std::cos(phase * 2.0f + bone), 0.1f * std::sin(phase * 4.0f + bone), 0.2f);
+				keyframe.Scale = DirectX::XMFLOAT3(1.0f, 1.0f + 0.1f * std::sin(phase), 1.0f);
+				DirectX::XMStoreFloat4(&keyframe.RotationQuat, DirectX::XMQuaternionRotationAxis(axis, 1.5f * std::sin(phase * 3.0f + bone * 0.5f)));
+			}
+		}
+
+		return clip;
+	}
+
+	// Angle between two rotations, precise for small angles. q and -q are the same rotation
+	float RotationError(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+	{
+		float difference = DirectX::XMVectorGetX(DirectX::XMVector4Length(DirectX::XMVectorSubtract(a, b)));
+		float sum = DirectX::XMVectorGetX(DirectX::XMVector4Length(DirectX::XMVectorAdd(a, b)));
+		return 4.0f * std::asin(std::min(std::min(difference, sum) * 0.5f, 1.0f));
+	}
+
+	float Distance(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b)
+	{
+		return DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(a, b)));
+	}
+
+	// Longest distance between two values of a channel, what its quantization range spans at most
+	float ChannelRange(const std::vector<DX::Keyframe>& keyframes, DirectX::XMFLOAT3 DX::Keyframe::* channel)
+	{
+		float range = 0.0f;
+		for (auto& a : keyframes)
+		{
+			for (auto& b : keyframes)
+			{
+				range = std::max(range, Distance(DirectX::XMLoadFloat3(&(a.*channel)), DirectX::XMLoadFloat3(&(b.*channel))));
+			}
+		}
+
+		return range;
+	}
+
+	// Compress a clip, sample it at every source key and check the errors against the report and the
+	// tolerances
+	DX::ClipCompressionReport CheckClip(const std::string& name, const DX::AnimationClip& clip)
+	{
+		const DX::ClipCompressionSettings settings;
+
+		DX::CompressedClip compressed;
+		DX::ClipCompressionReport report = compressed.Compress(clip, settings);
+
+		std::cout << name << ": compressed from " << report.source_bytes << " to " << report.compressed_bytes << " bytes, "
+			<< report.source_keys << " to " << report.compressed_keys << " keys. Max error: translation " << report.max_translation_error
+			<< ", rotation " << report.max_rotation_error << " rad, scale " << report.max_scale_error << '\n';
+
+		Expect(compressed.GetBoneCount() == clip.BoneAnimations.size(), name + ": bone count changed");
+		Expect(report.compressed_keys <= report.source_keys, name + ": gained keys");
+
+		std::vector<DX::BoneTransform> pose(clip.BoneAnimations.size());
+		float translation_error = 0.0f;
+		float rotation_error = 0.0f;
+		float scale_error = 0.0f;
+
+		for (size_t bone = 0; bone < clip.BoneAnimations.size(); ++bone)
+		{
+			const auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+			const float translation_bound = settings.translation_tolerance + ChannelRange(keyframes, &DX::Keyframe::Translation) * std::sqrt(3.0f) / RANGE_STEPS;
+			const float scale_bound = settings.scale_tolerance + ChannelRange(keyframes, &DX::Keyframe::Scale) * std::sqrt(3.0f) / RANGE_STEPS;
+			const float rotation_bound = settings.rotation_tolerance + ROTATION_QUANTIZATION;
+
+			for (auto& keyframe : keyframes)
+			{
+				std::vector<UINT> cursors;
+				compressed.Sample(keyframe.TimePos, pose.data(), cursors);
+
+				float translation = Distance(pose[bone].translation, DirectX::XMLoadFloat3(&keyframe.Translation));
+				float rotation = RotationError(pose[bone].rotation, DirectX::XMQuaternionNormalize(DirectX::XMLoadFloat4(&keyframe.RotationQuat)));
+				float scale = Distance(pose[bone].scale, DirectX::XMLoadFloat3(&keyframe.Scale));
+
+				Expect(translation <= translation_bound, name + ": translation error " + std::to_string(translation) + " of bone " + std::to_string(bone));
+				Expect(rotation <= rotation_bound, name + ": rotation error " + std::to_string(rotation) + " of bone " + std::to_string(bone));
+				Expect(scale <= scale_bound, name + ": scale error " + std::to_string(scale) + " of bone " + std::to_string(bone));
+
+				translation_error = std::max(translation_error, translation);
+				rotation_error = std::max(rotation_error, rotation);
+				scale_error = std::max(scale_error, scale);
+			}
+		}
+
+		// The report measures the same thing
+		constexpr float REPORT_EPSILON = 1e-5f;
+		Expect(std::abs(report.max_translation_error - translation_error) <= REPORT_EPSILON, name + ": reported translation error is off");
+		Expect(std::abs(report.max_rotation_error - rotation_error) <= REPORT_EPSILON, name + ": reported rotation error is off");
+		Expect(std::abs(report.max_scale_error - scale_error) <= REPORT_EPSILON, name + ": reported scale error is off");
+
+		return report;
+	}
+}
+
+void TestClipCompression()
+{
+	// Holds lose their keys and quantizing shrinks the rest
+	DX::ClipCompressionReport moving = CheckClip("moving", CreateClip(true));
+	Expect(moving.compressed_keys < moving.source_keys, "moving: no keys removed");
+	Expect(moving.compressed_bytes * 3 < moving.source_bytes, "moving: less than three times smaller");
+
+	// A channel that never changes keeps a single key
+	DX::ClipCompressionReport still = CheckClip("still", CreateClip(false));
+	Expect(still.compressed_keys == BONE_COUNT * 3, "still: kept more than a key per channel");
+
+	for (const char* model : MODELS)
+	{
+		GltfModelLoader loader;
+		GltfFileData data = loader.Load(std::filesystem::path(MODELS_PATH) / model);
+		Expect(!data.animationClip.BoneAnimations.empty(), std::string(model) + ": no animation");
+
+		CheckClip(model, data.animationClip);
+	}
+}
@@ -0,0 +1,82 @@
+#include "Test.h"
+#include "DxModel.h"
+#include "DxSkinning.h"
+#include "GltfModelLoader.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	constexpr const char* MODELS[] = { "3bone.gltf", "skinned_mesh.gltf" };
+
+	// Poses each mesh is skinned in
+	constexpr UINT FRAME_COUNT = 60;
+
+	// Copies of the mesh skinned at once, enough for SkinVertices to split them across the thread pool
+	constexpr size_t MESH_COPIES = 400;
+
+	// Largest difference allowed between the two paths, relative to the size of the position
+	constexpr float TOLERANCE = 1e-5f;
+
+	// Row-vector palette of an animated frame. Every bone turns, stretches and moves by its own amount
+	void CreatePalette(UINT frame, size_t bone_count, std::vector<DirectX::XMMATRIX>& palette)
+	{
+		palette.resize(bone_count);
+		for (size_t bone = 0; bone < bone_count; ++bone)
+		{
+			float phase = frame * 0.1f + bone * 0.7f;
+			auto axis = DirectX::XMVector3Normalize(DirectX::XMVectorSet(std::sin(phase), 1.0f, std::cos(phase * 0.5f), 0.0f));
+
+			palette[bone] = DirectX::XMMatrixScaling(1.0f + 0.2f * std::sin(phase), 1.0f, 1.0f - 0.1f * std::cos(phase)) *
+				DirectX::XMMatrixRotationAxis(axis, 2.0f * std::sin(phase)) *
+				DirectX::XMMatrixTranslation(std::cos(phase), 0.5f * std::sin(phase * 2.0f), 0.25f * bone);
+		}
+	}
+}
+
+void TestSkinning()
+{
+	for (const char* model : MODELS)
+	{
+		GltfModelLoader loader;
+		GltfFileData data = loader.Load(std::filesystem::path(MODELS_PATH) / model);
+		Expect(!data.vertices.empty() && !data.bones.empty(), std::string(model) + ": no skinned mesh");
+
+		std::vector<DX::Vertex> vertices;
+		vertices.reserve(data.vertices.size() * MESH_COPIES);
+		for (size_t copy = 0; copy < MESH_COPIES; ++copy)
+		{
+			vertices.insert(vertices.end(), data.vertices.begin(), data.vertices.end());
+		}
+
+		std::vector<DirectX::XMMATRIX> palette;
+		std::vector<DirectX::XMFLOAT3> fast(vertices.size());
+		std::vector<DirectX::XMFLOAT3> reference(vertices.size());
+
+		float max_difference = 0.0f;
+		for (UINT frame = 0; frame < FRAME_COUNT; ++frame)
+		{
+			CreatePalette(frame, data.bones.size(), palette);
+			DX::SkinVertices(vertices.data(), vertices.size(), palette.data(), palette.size(), fast.data());
+			DX::SkinVerticesReference(vertices.data(), vertices.size(), palette.data(), palette.size(), reference.data());
+
+			for (size_t i = 0; i < vertices.size(); ++i)
+			{
+				auto a = DirectX::XMLoadFloat3(&fast[i]);
+				auto b = DirectX::XMLoadFloat3(&reference[i]);
+				float difference = DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(a, b)));
+				float size = DirectX::XMVectorGetX(DirectX::XMVector3Length(b));
+
+				Expect(difference <= TOLERANCE * std::max(1.0f, size), std::string(model) + ": vertex " + std::to_string(i) +
+					" is " + std::to_string(difference) + " from the reference in frame " + std::to_string(frame));
+				max_difference = std::max(max_difference, difference);
+			}
+		}
+
+		std::cout << model << ": " << vertices.size() << " vertices, " << data.bones.size() << " bones, " << FRAME_COUNT
+			<< " frames. Max difference " << max_difference << '\n';
+	}
+}
@@ -0,0 +1,51 @@
+#include "Test.h"
+#include <iostream>
+#include <string>
+#include <exception>
+
+namespace
+{
+	struct NamedTest
+	{
+		const char* name;
+		void (*run)();
+	};
+
+	constexpr NamedTest TESTS[] =
+	{
+		{ "compression", TestClipCompression },
+		{ "skinning", TestSkinning },
+		{ "palette", TestBonePalette },
+	};
+}
+
+// Runs every test, or only the ones named on the command line. Returns the number that failed
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	for (const auto& test : TESTS)
+	{
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i)
+		{
+			selected |= test.name == std::string(argv[i]);
+		}
+
+		if (!selected)
+			continue;
+
+		std::cout << "== " << test.name << " ==\n";
+		try
+		{
+			test.run();
+			std::cout << "passed\n\n";
+		}
+		catch (const std::exception& e)
+		{
+			std::cout << "FAILED: " << e.what() << "\n\n";
+			failed++;
+		}
+	}
+
+	return failed;
+}
@@ -0,0 +1,426 @@
+#include "DxAnimationSystem.h"
+#include "DxModel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	// Instances updated by a single job. Large enough to amortise scheduling, small enough to balance
+	constexpr UINT INSTANCES_PER_JOB = 8;
+
+	// Frames baked by a single job
+	constexpr UINT FRAMES_PER_JOB = 16;
+
+	// Memory the pose cache starts with
+	constexpr size_t DEFAULT_POSE_CACHE_BUDGET = 32 * 1024 * 1024;
+
+	// Advance a clip time, wrapping around at the end of the clip
+	float AdvanceTime(float time, float dt, float end_time)
+	{
+		time += dt;
+		if (time > end_time)
+		{
+			time = end_time > 0.0f ? std::fmod(time, end_time) : 0.0f;
+		}
+
+		return time;
+	}
+}
+
+void DX::AnimationSystem::Create(const DX::Skeleton& skeleton)
+{
+	m_Parents = skeleton.GetParents();
+	m_BindPose = skeleton.GetBindPose();
+	m_InverseBindPoses = skeleton.GetInverseBindPoses();
+
+	m_PoseSize = m_Parents.size();
+	m_Clips.clear();
+	m_Masks.clear();
+	m_Instances.clear();
+
+	m_PoseCache.Clear();
+	if (m_PoseCache.GetBudget() == 0)
+	{
+		m_PoseCache.SetBudget(DEFAULT_POSE_CACHE_BUDGET);
+	}
+}
+
+UINT DX::AnimationSystem::AddClip(const DX::AnimationClip& source, bool compress)
+{
+	auto clip = std::make_unique<Clip>();
+	clip->bone_count = static_cast<UINT>(source.BoneAnimations.size());
+
+	if (compress)
+	{
+		// Skeletal Animation Tests checks the size and error report. Short clips can come out bigger
+		// than their source from the per track ranges, those are kept at full precision
+		DX::ClipCompressionReport report = clip->compressed_clip.Compress(source);
+		clip->compressed = report.compressed_bytes < report.source_bytes;
+		if (!clip->compressed)
+		{
+			clip->compressed_clip = DX::CompressedClip();
+		}
+	}
+
+	if (clip->compressed)
+	{
+		clip->end_time = clip->compressed_clip.GetEndTime();
+	}
+	else
+	{
+		clip->compiled.Compile(source);
+		clip->end_time = clip->compiled.GetEndTime();
+	}
+
+	// Same playback rate the sample has always used
+	clip->time_scale = source.ticks_per_second * 0.1f;
+	clip->bake_rate = source.bake_rate;
+
+	m_PoseSize = std::max<size_t>(m_PoseSize, clip->bone_count);
+
+	for (size_t i = 0; i < m_Parents.size(); ++i)
+	{
+		if (i >= source.BoneAnimations.size() || source.BoneAnimations[i].Keyframes.empty())
+		{
+			clip->unanimated.push_back(static_cast<UINT>(i));
+		}
+	}
+
+	// Reference pose for additive layers
+	std::vector<UINT> cursors;
+	clip->reference.resize(m_PoseSize);
+	SampleClip(*clip, 0.0f, clip->reference.data(), cursors);
+
+	m_Clips.push_back(std::move(clip));
+	return static_cast<UINT>(m_Clips.size()) - 1;
+}
+
+UINT DX::AnimationSystem::AddMask(const std::vector<float>& bone_weights)
+{
+	std::vector<float> mask(m_Parents.size(), 0.0f);
+	std::copy_n(bone_weights.begin(), std::min(bone_weights.size(), mask.size()), mask.begin());
+
+	m_Masks.push_back(std::move(mask));
+	return static_cast<UINT>(m_Masks.size()) - 1;
+}
+
+std::vector<float> DX::AnimationSystem::GetBoneMask(int root_bone) const
+{
+	// Parents come before their children so one pass picks up the whole subtree
+	std::vector<float> mask(m_Parents.size(), 0.0f);
+	for (size_t i = 0; i < m_Parents.size(); ++i)
+	{
+		bool in_subtree = static_cast<int>(i) == root_bone || (m_Parents[i] >= 0 && mask[m_Parents[i]] > 0.0f);
+		mask[i] = in_subtree ? 1.0f : 0.0f;
+	}
+
+	return mask;
+}
+
+UINT DX::AnimationSystem::AddInstance()
+{
+	DX::AnimationInstance instance;
+	instance.pose.resize(m_Parents.size());
+	instance.palette.resize(m_Parents.size());
+
+	m_Instances.push_back(std::move(instance));
+
+	UINT index = static_cast<UINT>(m_Instances.size()) - 1;
+	AddLayer(index, AnimationBlendMode::Override);
+
+	return index;
+}
+
+UINT DX::AnimationSystem::AddLayer(UINT instance, AnimationBlendMode mode)
+{
+	auto& layers = m_Instances[instance].layers;
+	layers.emplace_back();
+	layers.back().mode = mode;
+
+	return static_cast<UINT>(layers.size()) - 1;
+}
+
+void DX::AnimationSystem::Play(UINT instance, UINT layer, UINT clip, float fade_duration, float start_time, float speed)
+{
+	DX::AnimationLayer& target = m_Instances[instance].layers[layer];
+
+	// The current clip becomes the one faded out. Cursors are swapped rather than copied
+	if (fade_duration > 0.0f && target.clip >= 0)
+	{
+		target.previous_clip = target.clip;
+		target.previous_time = target.time;
+		std::swap(target.previous_cursors, target.cursors);
+
+		target.fade_time = 0.0f;
+		target.fade_duration = fade_duration;
+	}
+	else
+	{
+		target.previous_clip = -1;
+	}
+
+	target.clip = static_cast<int>(clip);
+	target.time = start_time;
+	target.speed = speed;
+	std::fill(target.cursors.begin(), target.cursors.end(), 0);
+}
+
+void DX::AnimationSystem::SetLayerWeight(UINT instance, UINT layer, float weight)
+{
+	m_Instances[instance].layers[layer].weight = weight;
+}
+
+void DX::AnimationSystem::SetLayerMask(UINT instance, UINT layer, int mask)
+{
+	m_Instances[instance].layers[layer].mask = mask;
+}
+
+void DX::AnimationSystem::Update(float dt)
+{
+	if (m_Parents.empty())
+		return;
+
+	// Refresh every baked clip instances are about to play before baking any, so making room for one
+	// never evicts another that is in use. The jobs then only read the cache
+	m_UpdateCount++;
+	m_ClipsToBake.clear();
+	for (const auto& instance : m_Instances)
+	{
+		int clip = GetCachedClip(instance);
+		if (clip < 0)
+			continue;
+
+		if (m_PoseCache.IsBaked(clip))
+		{
+			m_PoseCache.Touch(clip, m_UpdateCount);
+		}
+		else if (!m_Clips[clip]->bake_failed && std::find(m_ClipsToBake.begin(), m_ClipsToBake.end(), clip) == m_ClipsToBake.end())
+		{
+			m_ClipsToBake.push_back(clip);
+		}
+	}
+
+	// Clips that don't fit are sampled as usual and not tried again until the budget changes
+	for (UINT clip : m_ClipsToBake)
+	{
+		m_Clips[clip]->bake_failed = !BakeClip(clip);
+	}
+
+	UINT job_count = (GetInstanceCount() + INSTANCES_PER_JOB - 1) / INSTANCES_PER_JOB;
+	if (m_Arenas.size() < job_count)
+	{
+		m_Arenas.resize(job_count);
+	}
+
+	ThreadPool::Get().ParallelFor(job_count, [&](size_t job)
+	{
+		DX::PoseArena& arena = m_Arenas[job];
+
+		UINT start = static_cast<UINT>(job) * INSTANCES_PER_JOB;
+		UINT end = std::min(start + INSTANCES_PER_JOB, GetInstanceCount());
+		for (UINT i = start; i < end; ++i)
+		{
+			arena.Reset();
+			UpdateInstance(m_Instances[i], dt, arena);
+		}
+	});
+}
+
+void DX::AnimationSystem::SetPoseCacheBudget(size_t bytes)
+{
+	m_PoseCache.SetBudget(bytes);
+
+	// Clips that didn't fit may now
+	for (auto& clip : m_Clips)
+	{
+		clip->bake_failed = false;
+	}
+}
+
+void DX::AnimationSystem::SampleClip(const Clip& clip, float time, DX::BoneTransform* pose, std::vector<UINT>& cursors) const
+{
+	if (clip.compressed)
+	{
+		clip.compressed_clip.Sample(time, pose, cursors);
+	}
+	else
+	{
+		clip.compiled.Sample(time, pose, cursors);
+	}
+
+	// Bones the clip doesn't animate hold their bind pose
+	for (UINT bone : clip.unanimated)
+	{
+		pose[bone] = m_BindPose[bone];
+	}
+}
+
+void DX::AnimationSystem::SampleLayer(DX::AnimationLayer& layer, float dt, DX::BoneTransform* pose, DX::PoseArena& arena) const
+{
+	const Clip& clip = *m_Clips[layer.clip];
+	layer.time = AdvanceTime(layer.time, dt * clip.time_scale * layer.speed, clip.end_time);
+	SampleClip(clip, layer.time, pose, layer.cursors);
+
+	if (layer.previous_clip < 0)
+		return;
+
+	// Cross-fade from the previous clip, which keeps playing until the fade is over
+	layer.fade_time += dt;
+	if (layer.fade_time >= layer.fade_duration)
+	{
+		layer.previous_clip = -1;
+		return;
+	}
+
+	const Clip& previous = *m_Clips[layer.previous_clip];
+	layer.previous_time = AdvanceTime(layer.previous_time, dt * previous.time_scale * layer.speed, previous.end_time);
+
+	DX::BoneTransform* previous_pose = arena.Allocate(m_PoseSize);
+	SampleClip(previous, layer.previous_time, previous_pose, layer.previous_cursors);
+
+	DX::BlendPoses(previous_pose, pose, layer.fade_time / layer.fade_duration, nullptr, m_PoseSize, pose);
+}
+
+void DX::AnimationSystem::UpdateInstance(DX::AnimationInstance& instance, float dt, DX::PoseArena& arena) const
+{
+	// https://stackoverflow.com/questions/62998968/how-do-i-calculate-the-start-matrix-for-each-bonet-pose-using-collada-and-ope
+	const size_t bone_count = m_Parents.size();
+
+	// A single clip at full weight plays straight from the pose cache
+	int cached = GetCachedClip(instance);
+	if (cached >= 0 && m_PoseCache.IsBaked(cached))
+	{
+		for (auto& layer : instance.layers)
+		{
+			if (layer.clip == cached)
+			{
+				const Clip& clip = *m_Clips[cached];
+				layer.time = AdvanceTime(layer.time, dt * clip.time_scale * layer.speed, clip.end_time);
+				m_PoseCache.Sample(cached, layer.time, instance.palette.data());
+			}
+		}
+
+		return;
+	}
+
+	// Layers are applied on top of the bind pose, which is also what shows when nothing is playing
+	DX::BoneTransform* pose = arena.Allocate(m_PoseSize);
+	std::copy(m_BindPose.begin(), m_BindPose.end(), pose);
+
+	// Blend in bone space, before any matrix is built
+	DX::BoneTransform* layer_pose = arena.Allocate(m_PoseSize);
+	for (auto& layer : instance.layers)
+	{
+		if (layer.clip < 0)
+			continue;
+
+		// Layers keep playing at zero weight so they stay in step when faded back in
+		SampleLayer(layer, dt, layer_pose, arena);
+		if (layer.weight <= 0.0f)
+			continue;
+
+		const float* mask = layer.mask >= 0 ? m_Masks[layer.mask].data() : nullptr;
+		if (layer.mode == AnimationBlendMode::Additive)
+		{
+			DX::AddPoses(pose, layer_pose, m_Clips[layer.clip]->reference.data(), layer.weight, mask, bone_count, pose);
+		}
+		else
+		{
+			DX::BlendPoses(pose, layer_pose, layer.weight, mask, bone_count, pose);
+		}
+	}
+
+	BuildPalette(pose, instance.pose.data(), instance.palette.data());
+}
+
+void DX::AnimationSystem::BuildPalette(const DX::BoneTransform* pose, DirectX::XMMATRIX* transforms, DirectX::XMMATRIX* palette) const
+{
+	const size_t bone_count = m_Parents.size();
+	DX::ComposePose(pose, bone_count, transforms);
+
+	// Transform to root. Parents come before their children so the parent is already in model space
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		int parent = m_Parents[i];
+		if (parent >= 0)
+		{
+			transforms[i] = DirectX::XMMatrixMultiply(transforms[i], transforms[parent]);
+		}
+	}
+
+	// Transform bone
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		palette[i] = DirectX::XMMatrixMultiply(m_InverseBindPoses[i], transforms[i]);
+	}
+}
+
+int DX::AnimationSystem::GetCachedClip(const DX::AnimationInstance& instance) const
+{
+	int clip = -1;
+	for (const auto& layer : instance.layers)
+	{
+		if (layer.clip < 0)
+			continue;
+
+		// Anything blended on top, fading or masked has to be sampled
+		if (clip >= 0 || layer.mode != AnimationBlendMode::Override || layer.weight < 1.0f || layer.mask >= 0 || layer.previous_clip >= 0)
+			return -1;
+
+		clip = layer.clip;
+	}
+
+	return clip >= 0 && m_Clips[clip]->bake_rate > 0.0f ? clip : -1;
+}
+
+bool DX::AnimationSystem::BakeClip(UINT index)
+{
+	const Clip& clip = *m_Clips[index];
+
+	// Frames cover the clip from time 0, with one past the end so the last span has a frame to lerp to
+	const float frame_interval = clip.time_scale / clip.bake_rate;
+	if (!(frame_interval > 0.0f))
+		return false;
+
+	const UINT frame_count = static_cast<UINT>(clip.end_time / frame_interval) + 2;
+	const UINT bone_count = static_cast<UINT>(m_Parents.size());
+
+	DirectX::XMFLOAT4X3* frames = m_PoseCache.Allocate(index, frame_count, bone_count, frame_interval, m_UpdateCount);
+	if (frames == nullptr)
+		return false;
+
+	UINT job_count = (frame_count + FRAMES_PER_JOB - 1) / FRAMES_PER_JOB;
+	if (m_Arenas.size() < job_count)
+	{
+		m_Arenas.resize(job_count);
+	}
+
+	ThreadPool::Get().ParallelFor(job_count, [&](size_t job)
+	{
+		// Baking is rare, so the scratch here is allocated per job
+		std::vector<UINT> cursors;
+		std::vector<DirectX::XMMATRIX> transforms(bone_count);
+		std::vector<DirectX::XMMATRIX> palette(bone_count);
+
+		DX::PoseArena& arena = m_Arenas[job];
+		arena.Reset();
+		DX::BoneTransform* pose = arena.Allocate(m_PoseSize);
+
+		UINT start = static_cast<UINT>(job) * FRAMES_PER_JOB;
+		UINT end = std::min(start + FRAMES_PER_JOB, frame_count);
+		for (UINT frame = start; frame < end; ++frame)
+		{
+			SampleClip(clip, std::min(frame * frame_interval, clip.end_time), pose, cursors);
+			BuildPalette(pose, transforms.data(), palette.data());
+
+			DirectX::XMFLOAT4X3* output = frames + static_cast<size_t>(frame) * bone_count;
+			for (UINT i = 0; i < bone_count; ++i)
+			{
+				DirectX::XMStoreFloat4x3(&output[i], palette[i]);
+			}
+		}
+	});
+
+	return true;
+}
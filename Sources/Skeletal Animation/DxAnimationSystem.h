@@ -0,0 +1,182 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include "DxPose.h"
+#include "DxSkeleton.h"
+#include "DxPoseCache.h"
+#include "DxCompiledClip.h"
+#include "DxCompressedClip.h"
+#include <DirectXMath.h>
+#include <memory>
+#include <vector>
+
+namespace DX
+{
+	struct AnimationClip;
+
+	// How a layer combines with the layers below it
+	enum class AnimationBlendMode
+	{
+		// Blend towards the layer's pose
+		Override,
+
+		// Add the layer's difference from its clip's first frame
+		Additive
+	};
+
+	// A clip playing on a layer, with the clip it is fading out from
+	struct AnimationLayer
+	{
+		AnimationBlendMode mode = AnimationBlendMode::Override;
+
+		// Contribution of the layer, scaled per bone by the mask
+		float weight = 1.0f;
+		int mask = -1;
+
+		// Playing clip, -1 for none
+		int clip = -1;
+		float time = 0.0f;
+		float speed = 1.0f;
+		std::vector<UINT> cursors;
+
+		// Clip being faded out, -1 once the fade has finished
+		int previous_clip = -1;
+		float previous_time = 0.0f;
+		std::vector<UINT> previous_cursors;
+
+		float fade_time = 0.0f;
+		float fade_duration = 0.0f;
+	};
+
+	// Playback state of a single character
+	struct AnimationInstance
+	{
+		// Layers are applied in order on top of the bind pose
+		std::vector<DX::AnimationLayer> layers;
+
+		// Model space pose of every bone. Not updated while the instance plays from the pose cache
+		std::vector<DirectX::XMMATRIX> pose;
+
+		// Skinning matrix of every bone, packed per draw before it is uploaded
+		std::vector<DirectX::XMMATRIX> palette;
+	};
+
+	// Animates many characters that share a skeleton and a set of clips. Each instance has its own layers
+	// and palette, allocated when the instance is set up. Poses are blended in bone space out of a per job
+	// arena, and instances are independent so they are spread across the thread pool in batches
+	class AnimationSystem
+	{
+	public:
+		AnimationSystem() = default;
+		virtual ~AnimationSystem() = default;
+
+		// Set the skeleton every instance is built on. Clips added afterwards must be in its bone order
+		void Create(const DX::Skeleton& skeleton);
+
+		// Add a clip that instances can play, compressed or at full precision, and return its index. A clip
+		// compression doesn't make smaller stays at full precision. Clips with a bake rate are baked into
+		// the pose cache the first time an instance plays them on its own
+		UINT AddClip(const DX::AnimationClip& clip, bool compress);
+
+		// Add a per bone weight mask and return its index
+		UINT AddMask(const std::vector<float>& bone_weights);
+
+		// Mask covering a bone and all of its descendants
+		std::vector<float> GetBoneMask(int root_bone) const;
+
+		// Add a character with a single override layer and return its index
+		UINT AddInstance();
+
+		// Add a layer to an instance and return its index
+		UINT AddLayer(UINT instance, AnimationBlendMode mode);
+
+		// Play a clip on a layer, cross-fading from the current clip over fade_duration seconds
+		void Play(UINT instance, UINT layer, UINT clip, float fade_duration = 0.0f, float start_time = 0.0f, float speed = 1.0f);
+
+		// Layer controls
+		void SetLayerWeight(UINT instance, UINT layer, float weight);
+		void SetLayerMask(UINT instance, UINT layer, int mask);
+
+		// Advance every instance and rebuild its palette
+		void Update(float dt);
+
+		// Memory the pose cache may use for baked clips. Clips that didn't fit the old budget are tried again
+		void SetPoseCacheBudget(size_t bytes);
+		const DX::PoseCache& GetPoseCache() const { return m_PoseCache; }
+
+		// Instance access
+		UINT GetInstanceCount() const { return static_cast<UINT>(m_Instances.size()); }
+		const DX::AnimationInstance& GetInstance(UINT index) const { return m_Instances[index]; }
+		const std::vector<DirectX::XMMATRIX>& GetPalette(UINT index) const { return m_Instances[index].palette; }
+
+	private:
+		// Playable clip in one of its two forms
+		struct Clip
+		{
+			bool compressed = false;
+			DX::CompiledClip compiled;
+			DX::CompressedClip compressed_clip;
+
+			// Bones the clip animates
+			UINT bone_count = 0;
+
+			// Skeleton bones the clip has no keys for, they hold the bind pose
+			std::vector<UINT> unanimated;
+
+			// Clip time advanced per second of playback
+			float time_scale = 0.0f;
+			float end_time = 0.0f;
+
+			// Frames per second of playback to bake at, 0 if the clip isn't baked
+			float bake_rate = 0.0f;
+
+			// Whether the clip didn't fit in the pose cache under the current budget
+			bool bake_failed = false;
+
+			// First frame, additive layers apply their difference from it
+			std::vector<DX::BoneTransform> reference;
+		};
+
+		// Skeleton, parents before children
+		std::vector<int16_t> m_Parents;
+		std::vector<DX::BoneTransform> m_BindPose;
+		std::vector<DirectX::XMMATRIX> m_InverseBindPoses;
+
+		// Bones a scratch pose has room for - the skeleton or the largest clip
+		size_t m_PoseSize = 0;
+
+		// Clips are kept by pointer so adding one never moves the others
+		std::vector<std::unique_ptr<Clip>> m_Clips;
+		std::vector<std::vector<float>> m_Masks;
+
+		std::vector<DX::AnimationInstance> m_Instances;
+
+		// One scratch arena per job, reset every update
+		std::vector<DX::PoseArena> m_Arenas;
+
+		// Baked palettes, and the update count used to find the least recently used clip
+		DX::PoseCache m_PoseCache;
+		uint64_t m_UpdateCount = 0;
+
+		// Clips instances play this update that aren't baked yet, kept to reuse the memory
+		std::vector<UINT> m_ClipsToBake;
+
+		// Sample a clip into a full pose, bones the clip doesn't animate take the bind pose
+		void SampleClip(const Clip& clip, float time, DX::BoneTransform* pose, std::vector<UINT>& cursors) const;
+
+		// Advance a layer's clips and sample its pose, including any cross-fade
+		void SampleLayer(DX::AnimationLayer& layer, float dt, DX::BoneTransform* pose, DX::PoseArena& arena) const;
+
+		// Advance a single instance and rebuild its palette
+		void UpdateInstance(DX::AnimationInstance& instance, float dt, DX::PoseArena& arena) const;
+
+		// Skinning palette of a bone space pose. Transforms is scratch for the model space pose
+		void BuildPalette(const DX::BoneTransform* pose, DirectX::XMMATRIX* transforms, DirectX::XMMATRIX* palette) const;
+
+		// Clip an instance plays on its own at full weight with a bake rate, -1 if it can't use the cache
+		int GetCachedClip(const DX::AnimationInstance& instance) const;
+
+		// Sample every frame of a clip into the pose cache. Returns false if it doesn't fit
+		bool BakeClip(UINT clip);
+	};
+}
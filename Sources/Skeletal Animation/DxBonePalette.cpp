@@ -0,0 +1,202 @@
+#include "DxBonePalette.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+	// Most bones a single triangle can reference, three vertices of four influences
+	constexpr size_t MAX_TRIANGLE_BONES = 12;
+
+	// Marks a bone or vertex that isn't in the current partition
+	constexpr UINT NOT_IN_PARTITION = ~0u;
+
+	// Pack a skinning matrix as rows of the transposed matrix, what the shader dots the position with
+	void PackAffine(DirectX::FXMMATRIX transform, DirectX::XMFLOAT4* output)
+	{
+		DirectX::XMMATRIX transposed = DirectX::XMMatrixTranspose(transform);
+		DirectX::XMStoreFloat4(&output[0], transposed.r[0]);
+		DirectX::XMStoreFloat4(&output[1], transposed.r[1]);
+		DirectX::XMStoreFloat4(&output[2], transposed.r[2]);
+	}
+
+	// Pack a skinning matrix as a dual quaternion. The dual part is half the translation times the
+	// rotation, q' = 0.5 * t * q
+	void PackDualQuaternion(DirectX::FXMMATRIX transform, DirectX::XMFLOAT4* output)
+	{
+		DirectX::XMVECTOR scale, rotation, translation;
+		if (!DirectX::XMMatrixDecompose(&scale, &rotation, &translation, transform))
+		{
+			rotation = DirectX::XMQuaternionIdentity();
+			translation = transform.r[3];
+		}
+
+		// Keep every bone in the same hemisphere so the shader's sign fix-up rarely has to act
+		rotation = DirectX::XMQuaternionNormalize(rotation);
+		if (DirectX::XMVectorGetW(rotation) < 0.0f)
+		{
+			rotation = DirectX::XMVectorNegate(rotation);
+		}
+
+		DirectX::XMFLOAT4 q;
+		DirectX::XMFLOAT3 t;
+		DirectX::XMStoreFloat4(&q, rotation);
+		DirectX::XMStoreFloat3(&t, translation);
+
+		output[0] = q;
+		output[1] = DirectX::XMFLOAT4(
+			0.5f * (t.x * q.w + t.y * q.z - t.z * q.y),
+			0.5f * (t.y * q.w + t.z * q.x - t.x * q.z),
+			0.5f * (t.z * q.w + t.x * q.y - t.y * q.x),
+			-0.5f * (t.x * q.x + t.y * q.y + t.z * q.z));
+	}
+}
+
+void DX::PartitionByBones(const DX::MeshGeometry& mesh, size_t bone_count, size_t max_bones, std::vector<DX::Vertex>& vertices, std::vector<UINT>& indices, std::vector<DX::BonePartition>& partitions)
+{
+	if (max_bones < MAX_TRIANGLE_BONES)
+		throw std::runtime_error("Bone partitions must hold at least the bones of one triangle");
+
+	vertices.clear();
+	indices.clear();
+	partitions.clear();
+
+	vertices.reserve(mesh.vertex_count);
+	indices.reserve(mesh.index_count);
+
+	// Where each skeleton bone and source vertex landed in the current partition, tagged with the
+	// partition so nothing has to be cleared between partitions
+	std::vector<UINT> bone_slot(bone_count, 0);
+	std::vector<UINT> bone_partition(bone_count, NOT_IN_PARTITION);
+	std::vector<UINT> vertex_slot(mesh.vertex_count, 0);
+	std::vector<UINT> vertex_partition(mesh.vertex_count, NOT_IN_PARTITION);
+
+	auto in_partition = [&](UINT bone)
+	{
+		return bone >= bone_count || bone_partition[bone] == partitions.size() - 1;
+	};
+
+	auto begin_partition = [&](const DX::Subset& subset)
+	{
+		DX::BonePartition partition;
+		partition.startIndex = static_cast<UINT>(indices.size());
+		partition.baseVertex = static_cast<UINT>(vertices.size());
+		partition.transformation = subset.transformation;
+		partitions.push_back(std::move(partition));
+	};
+
+	auto end_partition = [&]()
+	{
+		DX::BonePartition& partition = partitions.back();
+		partition.totalIndex = static_cast<UINT>(indices.size()) - partition.startIndex;
+
+		// Local bone 0 always has to exist, unweighted influences point at it
+		if (partition.bones.empty())
+		{
+			partition.bones.push_back(0);
+		}
+	};
+
+	for (size_t s = 0; s < mesh.subset_count; ++s)
+	{
+		const DX::Subset& subset = mesh.subsets[s];
+		begin_partition(subset);
+
+		for (UINT i = 0; i + 2 < subset.totalIndex; i += 3)
+		{
+			const UINT* triangle = &mesh.indices[subset.startIndex + i];
+
+			// Bones the triangle would add to the partition
+			UINT added[MAX_TRIANGLE_BONES];
+			size_t added_count = 0;
+			for (size_t j = 0; j < 3; ++j)
+			{
+				const DX::Vertex& vertex = mesh.vertices[subset.baseVertex + triangle[j]];
+				for (size_t k = 0; k < 4; ++k)
+				{
+					UINT bone = static_cast<UINT>(vertex.bone[k]);
+					if (vertex.weight[k] == 0.0f || in_partition(bone) || std::find(added, added + added_count, bone) != added + added_count)
+						continue;
+
+					added[added_count++] = bone;
+				}
+			}
+
+			// Full - start a new partition for this triangle
+			if (partitions.back().bones.size() + added_count > max_bones)
+			{
+				end_partition();
+				begin_partition(subset);
+			}
+
+			DX::BonePartition& partition = partitions.back();
+			UINT partition_index = static_cast<UINT>(partitions.size()) - 1;
+
+			for (size_t j = 0; j < 3; ++j)
+			{
+				UINT source = subset.baseVertex + triangle[j];
+				if (vertex_partition[source] != partition_index)
+				{
+					// First use of the vertex in this partition, copy it with local bone indices
+					DX::Vertex vertex = mesh.vertices[source];
+					for (size_t k = 0; k < 4; ++k)
+					{
+						UINT bone = static_cast<UINT>(vertex.bone[k]);
+						if (vertex.weight[k] == 0.0f || bone >= bone_count)
+						{
+							vertex.bone[k] = 0;
+							continue;
+						}
+
+						if (bone_partition[bone] != partition_index)
+						{
+							bone_partition[bone] = partition_index;
+							bone_slot[bone] = static_cast<UINT>(partition.bones.size());
+							partition.bones.push_back(bone);
+						}
+
+						vertex.bone[k] = static_cast<int>(bone_slot[bone]);
+					}
+
+					vertex_partition[source] = partition_index;
+					vertex_slot[source] = static_cast<UINT>(vertices.size()) - partition.baseVertex;
+					vertices.push_back(vertex);
+				}
+
+				indices.push_back(vertex_slot[source]);
+			}
+		}
+
+		end_partition();
+	}
+}
+
+void DX::BonePalette::Build(const DirectX::XMMATRIX* skinning, size_t bone_count, const std::vector<UINT>& bones, BonePaletteFormat format)
+{
+	size_t vectors_per_bone = GetBoneSize(format) / sizeof(DirectX::XMFLOAT4);
+
+	m_Format = format;
+	m_BoneCount = bones.size();
+	m_Data.resize(bones.size() * vectors_per_bone);
+
+	DirectX::XMFLOAT4* output = m_Data.data();
+	for (UINT bone : bones)
+	{
+		DirectX::XMMATRIX transform = bone < bone_count ? skinning[bone] : DirectX::XMMatrixIdentity();
+		if (format == BonePaletteFormat::DualQuaternion)
+		{
+			PackDualQuaternion(transform, output);
+		}
+		else
+		{
+			PackAffine(transform, output);
+		}
+
+		output += vectors_per_bone;
+	}
+}
+
+size_t DX::BonePalette::GetBoneSize(BonePaletteFormat format)
+{
+	return format == BonePaletteFormat::DualQuaternion ? 2 * sizeof(DirectX::XMFLOAT4) : 3 * sizeof(DirectX::XMFLOAT4);
+}
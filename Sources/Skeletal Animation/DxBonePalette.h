@@ -0,0 +1,70 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	struct MeshGeometry;
+	struct Vertex;
+
+	// Bones a single draw can use, matches MAX_PALETTE_BONES in ShaderData.hlsli
+	constexpr size_t MAX_PALETTE_BONES = 256;
+
+	// How each bone of a palette is packed for the shader
+	enum class BonePaletteFormat : UINT
+	{
+		// Transposed 3x4 affine matrix, three float4 rows - 48 bytes
+		Affine = 0,
+
+		// Unit rotation quaternion and its dual part, two float4 - 32 bytes. Carries rotation and
+		// translation only, any scale in the skinning matrix is dropped
+		DualQuaternion = 1
+	};
+
+	// Part of a subset whose vertices only use a limited set of bones. Vertex bone indices within the
+	// partition point into its bones rather than the skeleton
+	struct BonePartition
+	{
+		UINT startIndex = 0;
+		UINT totalIndex = 0;
+		UINT baseVertex = 0;
+		DirectX::XMMATRIX transformation = DirectX::XMMatrixIdentity();
+
+		// Skeleton bone of each palette entry
+		std::vector<UINT> bones;
+	};
+
+	// Split every subset of a mesh into partitions that use at most max_bones of its bone_count bones. Vertices
+	// shared between partitions are duplicated so each can carry its own local bone indices
+	void PartitionByBones(const DX::MeshGeometry& mesh, size_t bone_count, size_t max_bones, std::vector<DX::Vertex>& vertices, std::vector<UINT>& indices, std::vector<DX::BonePartition>& partitions);
+
+	// Packed skinning palette for a single draw. Only the bones the draw uses are written, so what is
+	// uploaded is a few bytes per bone instead of the whole skeleton
+	class BonePalette
+	{
+	public:
+		BonePalette() = default;
+		virtual ~BonePalette() = default;
+
+		// Pack the skinning matrices of the given bones. Bones past the end of skinning pack as identity
+		void Build(const DirectX::XMMATRIX* skinning, size_t bone_count, const std::vector<UINT>& bones, BonePaletteFormat format);
+
+		// Packed bytes, ready to copy into the bone constant buffer
+		const uint8_t* GetData() const { return reinterpret_cast<const uint8_t*>(m_Data.data()); }
+		size_t GetSize() const { return m_Data.size() * sizeof(DirectX::XMFLOAT4); }
+
+		BonePaletteFormat GetFormat() const { return m_Format; }
+		size_t GetBoneCount() const { return m_BoneCount; }
+
+		// Bytes a single bone takes up in a format
+		static size_t GetBoneSize(BonePaletteFormat format);
+
+	private:
+		std::vector<DirectX::XMFLOAT4> m_Data;
+		BonePaletteFormat m_Format = BonePaletteFormat::Affine;
+		size_t m_BoneCount = 0;
+	};
+}
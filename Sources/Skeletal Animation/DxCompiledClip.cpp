@@ -0,0 +1,275 @@
+#include "DxCompiledClip.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	// Spans a cursor steps through before giving up and binary searching
+	constexpr UINT KEY_SCAN_LIMIT = 4;
+
+	// Whether every bone animation is keyed at exactly the same times
+	bool SharesKeyTimes(const DX::AnimationClip& clip)
+	{
+		const auto& first = clip.BoneAnimations.front().Keyframes;
+		for (auto& bone_animation : clip.BoneAnimations)
+		{
+			const auto& keyframes = bone_animation.Keyframes;
+			if (keyframes.size() != first.size() || keyframes.empty())
+				return false;
+
+			for (size_t k = 0; k < keyframes.size(); ++k)
+			{
+				if (keyframes[k].TimePos != first[k].TimePos)
+					return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+void DX::CompiledClip::Compile(const DX::AnimationClip& clip)
+{
+	m_Tracks.clear();
+	m_Times.clear();
+	m_Translations.clear();
+	m_Rotations.clear();
+	m_Scales.clear();
+
+	m_StartTime = 0.0f;
+	m_EndTime = 0.0f;
+	m_SharedTimes = false;
+
+	if (clip.BoneAnimations.empty())
+		return;
+
+	const UINT bone_count = static_cast<UINT>(clip.BoneAnimations.size());
+	m_Tracks.resize(bone_count);
+	m_SharedTimes = SharesKeyTimes(clip);
+
+	size_t key_total = 0;
+	for (auto& bone_animation : clip.BoneAnimations)
+	{
+		key_total += bone_animation.Keyframes.size();
+	}
+
+	m_Translations.resize(key_total);
+	m_Rotations.resize(key_total);
+	m_Scales.resize(key_total);
+
+	if (m_SharedTimes)
+	{
+		// One set of times, keys interleaved by bone so a pose reads bone_count consecutive keys
+		const auto& times = clip.BoneAnimations.front().Keyframes;
+		const UINT key_count = static_cast<UINT>(times.size());
+
+		m_Times.resize(key_count);
+		for (UINT k = 0; k < key_count; ++k)
+		{
+			m_Times[k] = times[k].TimePos;
+		}
+
+		for (UINT bone = 0; bone < bone_count; ++bone)
+		{
+			m_Tracks[bone] = { bone, bone_count, 0, key_count };
+		}
+	}
+	else
+	{
+		// Every bone has its own run of times and keys
+		m_Times.resize(key_total);
+
+		UINT first = 0;
+		for (UINT bone = 0; bone < bone_count; ++bone)
+		{
+			const auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+			const UINT key_count = static_cast<UINT>(keyframes.size());
+
+			for (UINT k = 0; k < key_count; ++k)
+			{
+				m_Times[first + k] = keyframes[k].TimePos;
+			}
+
+			m_Tracks[bone] = { first, 1, first, key_count };
+			first += key_count;
+		}
+	}
+
+	// Scatter the keys into the value arrays. Each rotation is flipped onto the side of the one before it,
+	// so blending neighbouring keys never has to check for the long way round
+	m_StartTime = FLT_MAX;
+	for (UINT bone = 0; bone < bone_count; ++bone)
+	{
+		const Track& track = m_Tracks[bone];
+		const auto& keyframes = clip.BoneAnimations[bone].Keyframes;
+
+		DirectX::XMVECTOR previous = DirectX::XMQuaternionIdentity();
+		for (UINT k = 0; k < track.count; ++k)
+		{
+			const DX::Keyframe& keyframe = keyframes[k];
+			const UINT index = track.first + k * track.stride;
+
+			DirectX::XMVECTOR rotation = DirectX::XMLoadFloat4(&keyframe.RotationQuat);
+			if (k != 0 && DirectX::XMVectorGetX(DirectX::XMQuaternionDot(previous, rotation)) < 0.0f)
+			{
+				rotation = DirectX::XMVectorNegate(rotation);
+			}
+			previous = rotation;
+
+			m_Translations[index] = DirectX::XMFLOAT4A(keyframe.Translation.x, keyframe.Translation.y, keyframe.Translation.z, 0.0f);
+			DirectX::XMStoreFloat4A(&m_Rotations[index], rotation);
+			m_Scales[index] = DirectX::XMFLOAT4A(keyframe.Scale.x, keyframe.Scale.y, keyframe.Scale.z, 0.0f);
+		}
+
+		if (track.count != 0)
+		{
+			m_StartTime = std::min(m_StartTime, keyframes.front().TimePos);
+			m_EndTime = std::max(m_EndTime, keyframes.back().TimePos);
+		}
+	}
+
+	if (m_StartTime == FLT_MAX)
+		m_StartTime = 0.0f;
+}
+
+void DX::CompiledClip::Sample(float t, DX::BoneTransform* pose, std::vector<UINT>& cursors) const
+{
+	const UINT bone_count = GetBoneCount();
+
+	if (m_SharedTimes)
+	{
+		// Every bone blends the same pair of keys by the same weight, and the keys of one time are consecutive
+		cursors.resize(1);
+		const UINT key_count = static_cast<UINT>(m_Times.size());
+		const float weight = FindKey(m_Times.data(), key_count, t, cursors[0]);
+		const DirectX::XMVECTOR weights = DirectX::XMVectorReplicate(weight);
+
+		const UINT first0 = cursors[0] * bone_count;
+		const UINT first1 = std::min(cursors[0] + 1, key_count - 1) * bone_count;
+		const DirectX::XMFLOAT4A* translations0 = m_Translations.data() + first0;
+		const DirectX::XMFLOAT4A* translations1 = m_Translations.data() + first1;
+		const DirectX::XMFLOAT4A* rotations0 = m_Rotations.data() + first0;
+		const DirectX::XMFLOAT4A* rotations1 = m_Rotations.data() + first1;
+		const DirectX::XMFLOAT4A* scales0 = m_Scales.data() + first0;
+		const DirectX::XMFLOAT4A* scales1 = m_Scales.data() + first1;
+
+		// Four bones at a time. Rotations are normalised lerps, transposed so the four lengths come from
+		// plain multiplies and a single reciprocal square root
+		UINT bone = 0;
+		for (; bone + 4 <= bone_count; bone += 4)
+		{
+			DirectX::XMMATRIX rotations;
+			for (UINT i = 0; i < 4; ++i)
+			{
+				const UINT b = bone + i;
+				pose[b].translation = DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&translations0[b]), DirectX::XMLoadFloat4A(&translations1[b]), weights);
+				pose[b].scale = DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&scales0[b]), DirectX::XMLoadFloat4A(&scales1[b]), weights);
+				rotations.r[i] = DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&rotations0[b]), DirectX::XMLoadFloat4A(&rotations1[b]), weights);
+			}
+
+			rotations = DirectX::XMMatrixTranspose(rotations);
+
+			DirectX::XMVECTOR length_sq = DirectX::XMVectorMultiply(rotations.r[0], rotations.r[0]);
+			length_sq = DirectX::XMVectorMultiplyAdd(rotations.r[1], rotations.r[1], length_sq);
+			length_sq = DirectX::XMVectorMultiplyAdd(rotations.r[2], rotations.r[2], length_sq);
+			length_sq = DirectX::XMVectorMultiplyAdd(rotations.r[3], rotations.r[3], length_sq);
+			const DirectX::XMVECTOR inverse_length = DirectX::XMVectorReciprocalSqrt(length_sq);
+
+			for (UINT i = 0; i < 4; ++i)
+			{
+				rotations.r[i] = DirectX::XMVectorMultiply(rotations.r[i], inverse_length);
+			}
+
+			rotations = DirectX::XMMatrixTranspose(rotations);
+			for (UINT i = 0; i < 4; ++i)
+			{
+				pose[bone + i].rotation = rotations.r[i];
+			}
+		}
+
+		for (; bone < bone_count; ++bone)
+		{
+			pose[bone].translation = DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&translations0[bone]), DirectX::XMLoadFloat4A(&translations1[bone]), weights);
+			pose[bone].scale = DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&scales0[bone]), DirectX::XMLoadFloat4A(&scales1[bone]), weights);
+			pose[bone].rotation = DirectX::XMQuaternionNormalize(DirectX::XMVectorLerpV(DirectX::XMLoadFloat4A(&rotations0[bone]), DirectX::XMLoadFloat4A(&rotations1[bone]), weights));
+		}
+	}
+	else
+	{
+		cursors.resize(bone_count);
+		for (UINT bone = 0; bone < bone_count; ++bone)
+		{
+			const Track& track = m_Tracks[bone];
+			if (track.count == 0)
+			{
+				pose[bone] = { DirectX::XMVectorZero(), DirectX::XMQuaternionIdentity(), DirectX::XMVectorSplatOne() };
+				continue;
+			}
+
+			float weight = FindKey(m_Times.data() + track.first_time, track.count, t, cursors[bone]);
+			pose[bone] = Blend(track, cursors[bone], weight);
+		}
+	}
+}
+
+size_t DX::CompiledClip::GetMemoryUsage() const
+{
+	return m_Times.size() * sizeof(float) +
+		(m_Translations.size() + m_Rotations.size() + m_Scales.size()) * sizeof(DirectX::XMFLOAT4A) +
+		m_Tracks.size() * sizeof(Track);
+}
+
+float DX::CompiledClip::FindKey(const float* times, UINT count, float t, UINT& cursor)
+{
+	// Clamp to the ends of the track
+	if (count < 2 || t <= times[0])
+	{
+		cursor = 0;
+		return 0.0f;
+	}
+
+	const UINT last = count - 1;
+	if (t >= times[last])
+	{
+		cursor = last;
+		return 0.0f;
+	}
+
+	// Forward playback - t is normally in the cached span or a few spans after it
+	UINT key = last;
+	if (cursor < last && times[cursor] <= t)
+	{
+		const UINT end = std::min(cursor + KEY_SCAN_LIMIT, last);
+		for (UINT i = cursor; i < end; ++i)
+		{
+			if (t < times[i + 1])
+			{
+				key = i;
+				break;
+			}
+		}
+	}
+
+	// Seeked, looped or skipped a long way - binary search for the first key after t
+	if (key == last)
+	{
+		key = static_cast<UINT>(std::upper_bound(times, times + count, t) - times) - 1;
+	}
+
+	cursor = key;
+	return (t - times[key]) / (times[key + 1] - times[key]);
+}
+
+DX::BoneTransform DX::CompiledClip::Blend(const Track& track, UINT key, float weight) const
+{
+	const UINT index0 = track.first + key * track.stride;
+	const UINT index1 = track.first + std::min(key + 1, track.count - 1) * track.stride;
+
+	DX::BoneTransform transform;
+	transform.scale = DirectX::XMVectorLerp(DirectX::XMLoadFloat4A(&m_Scales[index0]), DirectX::XMLoadFloat4A(&m_Scales[index1]), weight);
+	transform.translation = DirectX::XMVectorLerp(DirectX::XMLoadFloat4A(&m_Translations[index0]), DirectX::XMLoadFloat4A(&m_Translations[index1]), weight);
+	transform.rotation = DirectX::XMQuaternionSlerp(DirectX::XMLoadFloat4A(&m_Rotations[index0]), DirectX::XMLoadFloat4A(&m_Rotations[index1]), weight);
+
+	return transform;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include "DxPose.h"
+#include <DirectXMath.h>
+#include <vector>
+
+namespace DX
+{
+	struct AnimationClip;
+
+	// Animation clip compiled into a structure-of-arrays layout for sampling whole poses at once.
+	// Key times, translations, rotations and scales each live in their own contiguous array. When every
+	// bone is keyed at the same times the times are stored once and the keys are interleaved by bone,
+	// so sampling a pose is a single key search followed by two linear runs through memory
+	class CompiledClip
+	{
+	public:
+		CompiledClip() = default;
+		virtual ~CompiledClip() = default;
+
+		// Build the compiled layout from an imported clip
+		void Compile(const DX::AnimationClip& clip);
+
+		// Sample the bone space transform of every bone at time t. Cursors hold the key each track sampled
+		// last and are sized on first use, so each playing instance keeps its own. With shared times rotations
+		// are normalised lerps, which neighbouring keys keep within a hair of slerp
+		void Sample(float t, DX::BoneTransform* pose, std::vector<UINT>& cursors) const;
+
+		// Clip length
+		float GetStartTime() const { return m_StartTime; }
+		float GetEndTime() const { return m_EndTime; }
+
+		// Number of bones a pose holds
+		UINT GetBoneCount() const { return static_cast<UINT>(m_Tracks.size()); }
+
+		// Whether every bone shares one set of key times
+		bool HasSharedTimes() const { return m_SharedTimes; }
+
+		// Bytes of key data
+		size_t GetMemoryUsage() const;
+
+		// Find the key before t in a run of key times, starting the search from cursor. Returns the
+		// weight of the key after it
+		static float FindKey(const float* times, UINT count, float t, UINT& cursor);
+
+	private:
+		// Where a bone's keys are found. Key k of the track is element first + k * stride of the value
+		// arrays and its time is m_Times[first_time + k]
+		struct Track
+		{
+			UINT first = 0;
+			UINT stride = 1;
+			UINT first_time = 0;
+			UINT count = 0;
+		};
+
+		std::vector<Track> m_Tracks;
+		bool m_SharedTimes = false;
+
+		float m_StartTime = 0.0f;
+		float m_EndTime = 0.0f;
+
+		std::vector<float> m_Times;
+		std::vector<DirectX::XMFLOAT4A> m_Translations;
+		std::vector<DirectX::XMFLOAT4A> m_Rotations;
+		std::vector<DirectX::XMFLOAT4A> m_Scales;
+
+		// Blend two keys of a track
+		DX::BoneTransform Blend(const Track& track, UINT key, float weight) const;
+	};
+}
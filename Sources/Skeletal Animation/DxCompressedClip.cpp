@@ -0,0 +1,328 @@
+#include "DxCompressedClip.h"
+#include "DxCompiledClip.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// Smallest-three components of a unit quaternion lie in [-1/sqrt(2), 1/sqrt(2)]
+	constexpr float SMALLEST_THREE_RANGE = 0.70710678f;
+
+	// Bits per smallest-three component, the spare bits hold the index of the dropped component
+	constexpr float SMALLEST_THREE_SCALE = 32767.0f;
+
+	// Range quantized components use every bit
+	constexpr float RANGE_SCALE = 65535.0f;
+
+	// Longest run of keys a single pair of kept keys may replace. Bounds the cost of key reduction
+	constexpr UINT MAX_REDUCTION_SPAN = 256;
+
+	// Distance between two channel values - angle for rotations, length for translations and scales
+	float ChannelError(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, bool rotation)
+	{
+		if (rotation)
+		{
+			// |a - b| = 2 sin(angle / 4) for unit quaternions, which stays precise for small angles where
+			// acos of the dot product does not. q and -q are the same rotation
+			DirectX::XMVECTOR difference = DirectX::XMVectorSubtract(a, b);
+			DirectX::XMVECTOR sum = DirectX::XMVectorAdd(a, b);
+			float distance = std::min(DirectX::XMVectorGetX(DirectX::XMVector4Length(difference)), DirectX::XMVectorGetX(DirectX::XMVector4Length(sum)));
+			return 4.0f * std::asin(std::min(distance * 0.5f, 1.0f));
+		}
+
+		return DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(a, b)));
+	}
+
+	DirectX::XMVECTOR ChannelBlend(DirectX::FXMVECTOR a, DirectX::FXMVECTOR b, float weight, bool rotation)
+	{
+		return rotation ? DirectX::XMQuaternionSlerp(a, b, weight) : DirectX::XMVectorLerp(a, b, weight);
+	}
+
+	// Keys of a channel that can't be rebuilt from their neighbours within tolerance. The first and last
+	// keys are always kept, a channel that never moves keeps only its first
+	std::vector<UINT> ReduceKeys(const std::vector<float>& times, const std::vector<DirectX::XMVECTOR>& values, bool rotation, float tolerance)
+	{
+		const UINT count = static_cast<UINT>(values.size());
+
+		bool constant = true;
+		for (UINT k = 1; k < count && constant; ++k)
+		{
+			constant = ChannelError(values[k], values[0], rotation) <= tolerance;
+		}
+
+		if (constant)
+			return { 0 };
+
+		// Grow a span from the last kept key until one of the keys inside it no longer fits
+		std::vector<UINT> kept = { 0 };
+		UINT start = 0;
+		for (UINT end = 2; end < count; ++end)
+		{
+			bool fits = end - start <= MAX_REDUCTION_SPAN;
+			float span = times[end] - times[start];
+
+			for (UINT k = start + 1; k < end && fits; ++k)
+			{
+				float weight = span > 0.0f ? (times[k] - times[start]) / span : 0.0f;
+				fits = ChannelError(ChannelBlend(values[start], values[end], weight, rotation), values[k], rotation) <= tolerance;
+			}
+
+			if (!fits)
+			{
+				kept.push_back(end - 1);
+				start = end - 1;
+			}
+		}
+
+		kept.push_back(count - 1);
+		return kept;
+	}
+
+	// Drop the largest component and store the other three in 15 bits each. The largest is made
+	// positive so it can be rebuilt from the other three, its index goes in the top bits of the first two
+	void EncodeRotation(DirectX::FXMVECTOR rotation, uint16_t* output)
+	{
+		DirectX::XMFLOAT4 q;
+		DirectX::XMStoreFloat4(&q, DirectX::XMQuaternionNormalize(rotation));
+
+		float components[4] = { q.x, q.y, q.z, q.w };
+		int largest = 0;
+		for (int i = 1; i < 4; ++i)
+		{
+			if (std::fabs(components[i]) > std::fabs(components[largest]))
+				largest = i;
+		}
+
+		float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+		for (int i = 0, j = 0; i < 4; ++i)
+		{
+			if (i == largest)
+				continue;
+
+			float value = std::clamp(components[i] * sign, -SMALLEST_THREE_RANGE, SMALLEST_THREE_RANGE);
+			output[j++] = static_cast<uint16_t>(std::lround((value + SMALLEST_THREE_RANGE) * (SMALLEST_THREE_SCALE / (2.0f * SMALLEST_THREE_RANGE))));
+		}
+
+		output[0] |= static_cast<uint16_t>((largest & 1) << 15);
+		output[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+	}
+
+	uint16_t EncodeRange(float value, float minimum, float extent)
+	{
+		if (extent <= 0.0f)
+			return 0;
+
+		return static_cast<uint16_t>(std::lround(std::clamp((value - minimum) / extent, 0.0f, 1.0f) * RANGE_SCALE));
+	}
+}
+
+DX::ClipCompressionReport DX::CompressedClip::Compress(const DX::AnimationClip& clip, const ClipCompressionSettings& settings)
+{
+	m_Bones.clear();
+	m_Times.clear();
+	m_Values.clear();
+	m_StartTime = clip.BoneAnimations.empty() ? 0.0f : FLT_MAX;
+	m_EndTime = 0.0f;
+
+	ClipCompressionReport report;
+
+	// Split every bone animation into its channels and compress them separately
+	std::vector<float> times;
+	std::vector<DirectX::XMVECTOR> translations;
+	std::vector<DirectX::XMVECTOR> rotations;
+	std::vector<DirectX::XMVECTOR> scales;
+
+	m_Bones.resize(clip.BoneAnimations.size());
+	for (size_t i = 0; i < clip.BoneAnimations.size(); ++i)
+	{
+		const auto& keyframes = clip.BoneAnimations[i].Keyframes;
+
+		times.clear();
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+
+		for (auto& keyframe : keyframes)
+		{
+			times.push_back(keyframe.TimePos);
+			translations.push_back(DirectX::XMLoadFloat3(&keyframe.Translation));
+			rotations.push_back(DirectX::XMQuaternionNormalize(DirectX::XMLoadFloat4(&keyframe.RotationQuat)));
+			scales.push_back(DirectX::XMLoadFloat3(&keyframe.Scale));
+		}
+
+		m_Bones[i].translation = AddTrack(times, translations, false, settings.translation_tolerance);
+		m_Bones[i].rotation = AddTrack(times, rotations, true, settings.rotation_tolerance);
+		m_Bones[i].scale = AddTrack(times, scales, false, settings.scale_tolerance);
+
+		if (!keyframes.empty())
+		{
+			m_StartTime = std::min(m_StartTime, keyframes.front().TimePos);
+			m_EndTime = std::max(m_EndTime, keyframes.back().TimePos);
+		}
+
+		report.source_keys += keyframes.size() * 3;
+	}
+
+	if (m_StartTime == FLT_MAX)
+		m_StartTime = 0.0f;
+
+	// Measure the error at every source key
+	DirectX::XMVECTOR zero = DirectX::XMVectorZero();
+	DirectX::XMVECTOR one = DirectX::XMVectorSplatOne();
+	for (size_t i = 0; i < clip.BoneAnimations.size(); ++i)
+	{
+		const Bone& bone = m_Bones[i];
+		UINT cursors[3] = { 0, 0, 0 };
+
+		for (auto& keyframe : clip.BoneAnimations[i].Keyframes)
+		{
+			DirectX::XMVECTOR translation = SampleVector(bone.translation, keyframe.TimePos, cursors[0], zero);
+			DirectX::XMVECTOR rotation = SampleRotation(bone.rotation, keyframe.TimePos, cursors[1]);
+			DirectX::XMVECTOR scale = SampleVector(bone.scale, keyframe.TimePos, cursors[2], one);
+
+			report.max_translation_error = std::max(report.max_translation_error, ChannelError(translation, DirectX::XMLoadFloat3(&keyframe.Translation), false));
+			report.max_rotation_error = std::max(report.max_rotation_error, ChannelError(rotation, DirectX::XMQuaternionNormalize(DirectX::XMLoadFloat4(&keyframe.RotationQuat)), true));
+			report.max_scale_error = std::max(report.max_scale_error, ChannelError(scale, DirectX::XMLoadFloat3(&keyframe.Scale), false));
+		}
+	}
+
+	report.source_bytes = report.source_keys / 3 * sizeof(DX::Keyframe);
+	report.compressed_bytes = GetMemoryUsage();
+	report.compressed_keys = m_Times.size();
+
+	return report;
+}
+
+void DX::CompressedClip::Sample(float t, DX::BoneTransform* pose, std::vector<UINT>& cursors) const
+{
+	const UINT bone_count = GetBoneCount();
+	cursors.resize(bone_count * 3);
+
+	DirectX::XMVECTOR zero = DirectX::XMVectorZero();
+	DirectX::XMVECTOR one = DirectX::XMVectorSplatOne();
+
+	// Keys are decoded as they are blended, nothing is expanded ahead of time
+	for (UINT i = 0; i < bone_count; ++i)
+	{
+		const Bone& bone = m_Bones[i];
+		UINT* bone_cursors = &cursors[i * 3];
+
+		pose[i].translation = SampleVector(bone.translation, t, bone_cursors[0], zero);
+		pose[i].rotation = SampleRotation(bone.rotation, t, bone_cursors[1]);
+		pose[i].scale = SampleVector(bone.scale, t, bone_cursors[2], one);
+	}
+}
+
+size_t DX::CompressedClip::GetMemoryUsage() const
+{
+	return m_Times.size() * sizeof(float) + m_Values.size() * sizeof(uint16_t) + m_Bones.size() * sizeof(Bone);
+}
+
+DX::CompressedClip::Track DX::CompressedClip::AddTrack(const std::vector<float>& times, const std::vector<DirectX::XMVECTOR>& values, bool rotation, float tolerance)
+{
+	Track track;
+	if (values.empty())
+		return track;
+
+	std::vector<UINT> kept = ReduceKeys(times, values, rotation, tolerance);
+	track.first = static_cast<UINT>(m_Times.size());
+	track.count = static_cast<UINT>(kept.size());
+
+	// Quantization range of the kept keys
+	if (!rotation)
+	{
+		DirectX::XMVECTOR minimum = values[kept[0]];
+		DirectX::XMVECTOR maximum = values[kept[0]];
+		for (UINT k : kept)
+		{
+			minimum = DirectX::XMVectorMin(minimum, values[k]);
+			maximum = DirectX::XMVectorMax(maximum, values[k]);
+		}
+
+		DirectX::XMStoreFloat3(&track.minimum, minimum);
+		DirectX::XMStoreFloat3(&track.extent, DirectX::XMVectorSubtract(maximum, minimum));
+	}
+
+	for (UINT k : kept)
+	{
+		m_Times.push_back(times[k]);
+
+		uint16_t encoded[3] = {};
+		if (rotation)
+		{
+			EncodeRotation(values[k], encoded);
+		}
+		else
+		{
+			DirectX::XMFLOAT3 value;
+			DirectX::XMStoreFloat3(&value, values[k]);
+			encoded[0] = EncodeRange(value.x, track.minimum.x, track.extent.x);
+			encoded[1] = EncodeRange(value.y, track.minimum.y, track.extent.y);
+			encoded[2] = EncodeRange(value.z, track.minimum.z, track.extent.z);
+		}
+
+		m_Values.insert(m_Values.end(), encoded, encoded + 3);
+	}
+
+	return track;
+}
+
+DirectX::XMVECTOR DX::CompressedClip::DecodeVector(const Track& track, UINT key) const
+{
+	const uint16_t* value = &m_Values[(track.first + key) * 3];
+
+	DirectX::XMVECTOR quantized = DirectX::XMVectorSet(value[0], value[1], value[2], 0.0f);
+	DirectX::XMVECTOR extent = DirectX::XMVectorScale(DirectX::XMLoadFloat3(&track.extent), 1.0f / RANGE_SCALE);
+	return DirectX::XMVectorMultiplyAdd(quantized, extent, DirectX::XMLoadFloat3(&track.minimum));
+}
+
+DirectX::XMVECTOR DX::CompressedClip::DecodeRotation(const Track& track, UINT key) const
+{
+	const uint16_t* value = &m_Values[(track.first + key) * 3];
+	int largest = (value[0] >> 15) | ((value[1] >> 15) << 1);
+
+	DirectX::XMVECTOR quantized = DirectX::XMVectorSet(value[0] & 0x7FFF, value[1] & 0x7FFF, value[2] & 0x7FFF, 0.0f);
+	DirectX::XMVECTOR scale = DirectX::XMVectorReplicate(2.0f * SMALLEST_THREE_RANGE / SMALLEST_THREE_SCALE);
+	DirectX::XMVECTOR smallest = DirectX::XMVectorSubtract(DirectX::XMVectorMultiply(quantized, scale), DirectX::XMVectorReplicate(SMALLEST_THREE_RANGE));
+
+	// Rebuild the dropped component from the unit length
+	DirectX::XMFLOAT3 components;
+	DirectX::XMStoreFloat3(&components, smallest);
+	float dropped = std::sqrt(std::max(0.0f, 1.0f - DirectX::XMVectorGetX(DirectX::XMVector3Dot(smallest, smallest))));
+
+	switch (largest)
+	{
+	case 0: return DirectX::XMVectorSet(dropped, components.x, components.y, components.z);
+	case 1: return DirectX::XMVectorSet(components.x, dropped, components.y, components.z);
+	case 2: return DirectX::XMVectorSet(components.x, components.y, dropped, components.z);
+	default: return DirectX::XMVectorSet(components.x, components.y, components.z, dropped);
+	}
+}
+
+DirectX::XMVECTOR DX::CompressedClip::SampleVector(const Track& track, float t, UINT& cursor, DirectX::FXMVECTOR fallback) const
+{
+	if (track.count == 0)
+		return fallback;
+
+	float weight = DX::CompiledClip::FindKey(m_Times.data() + track.first, track.count, t, cursor);
+	DirectX::XMVECTOR value = DecodeVector(track, cursor);
+	if (weight == 0.0f)
+		return value;
+
+	return DirectX::XMVectorLerp(value, DecodeVector(track, cursor + 1), weight);
+}
+
+DirectX::XMVECTOR DX::CompressedClip::SampleRotation(const Track& track, float t, UINT& cursor) const
+{
+	if (track.count == 0)
+		return DirectX::XMQuaternionIdentity();
+
+	float weight = DX::CompiledClip::FindKey(m_Times.data() + track.first, track.count, t, cursor);
+	DirectX::XMVECTOR rotation = DecodeRotation(track, cursor);
+	if (weight == 0.0f)
+		return rotation;
+
+	return DirectX::XMQuaternionSlerp(rotation, DecodeRotation(track, cursor + 1), weight);
+}
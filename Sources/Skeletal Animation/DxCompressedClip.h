@@ -0,0 +1,104 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include "DxPose.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	struct AnimationClip;
+
+	// How far a compressed clip may drift from its source. Keys that interpolating their neighbours
+	// reproduces within tolerance are removed
+	struct ClipCompressionSettings
+	{
+		float translation_tolerance = 0.001f;
+
+		// Radians
+		float rotation_tolerance = 0.0005f;
+
+		float scale_tolerance = 0.0001f;
+	};
+
+	// Size and accuracy of a compressed clip. Errors are measured in bone space at every source key
+	struct ClipCompressionReport
+	{
+		size_t source_bytes = 0;
+		size_t compressed_bytes = 0;
+
+		size_t source_keys = 0;
+		size_t compressed_keys = 0;
+
+		float max_translation_error = 0.0f;
+
+		// Radians
+		float max_rotation_error = 0.0f;
+
+		float max_scale_error = 0.0f;
+	};
+
+	// Animation clip with redundant keys removed and the remaining keys quantized to 16 bits per
+	// component. Rotations use smallest-three encoding, translations and scales are quantized over the
+	// range of their track. Keys are decoded while sampling so the clip is never expanded in memory
+	class CompressedClip
+	{
+	public:
+		CompressedClip() = default;
+		virtual ~CompressedClip() = default;
+
+		// Compress an imported clip
+		ClipCompressionReport Compress(const DX::AnimationClip& clip, const ClipCompressionSettings& settings = {});
+
+		// Sample the bone space transform of every bone at time t. Cursors hold the key each track sampled
+		// last and are sized on first use, so each playing instance keeps its own
+		void Sample(float t, DX::BoneTransform* pose, std::vector<UINT>& cursors) const;
+
+		// Clip length
+		float GetStartTime() const { return m_StartTime; }
+		float GetEndTime() const { return m_EndTime; }
+
+		// Number of bones a pose holds
+		UINT GetBoneCount() const { return static_cast<UINT>(m_Bones.size()); }
+
+		// Bytes of key data
+		size_t GetMemoryUsage() const;
+
+	private:
+		// Keys of one channel of one bone. Key k has time m_Times[first + k] and its quantized value is
+		// m_Values[(first + k) * 3]. Translations and scales dequantize to minimum + value * extent
+		struct Track
+		{
+			UINT first = 0;
+			UINT count = 0;
+			DirectX::XMFLOAT3 minimum = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+			DirectX::XMFLOAT3 extent = DirectX::XMFLOAT3(0.0f, 0.0f, 0.0f);
+		};
+
+		struct Bone
+		{
+			Track translation;
+			Track rotation;
+			Track scale;
+		};
+
+		std::vector<Bone> m_Bones;
+		std::vector<float> m_Times;
+		std::vector<uint16_t> m_Values;
+
+		float m_StartTime = 0.0f;
+		float m_EndTime = 0.0f;
+
+		// Remove redundant keys from a channel and append the rest to the key arrays
+		Track AddTrack(const std::vector<float>& times, const std::vector<DirectX::XMVECTOR>& values, bool rotation, float tolerance);
+
+		// Decode a single key
+		DirectX::XMVECTOR DecodeVector(const Track& track, UINT key) const;
+		DirectX::XMVECTOR DecodeRotation(const Track& track, UINT key) const;
+
+		// Sample a track at time t
+		DirectX::XMVECTOR SampleVector(const Track& track, float t, UINT& cursor, DirectX::FXMVECTOR fallback) const;
+		DirectX::XMVECTOR SampleRotation(const Track& track, float t, UINT& cursor) const;
+	};
+}
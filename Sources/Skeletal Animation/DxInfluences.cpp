@@ -0,0 +1,134 @@
+#include "DxInfluences.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+void DX::InfluenceBuilder::Reset(size_t vertex_count)
+{
+	m_Influences.assign(vertex_count, Influences());
+}
+
+void DX::InfluenceBuilder::Add(size_t vertex, int bone, float weight)
+{
+	// Also rejects NaN
+	if (!(weight > 0.0f))
+		return;
+
+	Influences& influences = m_Influences[vertex];
+	if (influences.count < MAX_BONE_INFLUENCES)
+	{
+		influences.bone[influences.count] = bone;
+		influences.weight[influences.count] = weight;
+		influences.count++;
+		return;
+	}
+
+	// Full, replace the lightest if this one is heavier
+	size_t lightest = 0;
+	for (size_t i = 1; i < MAX_BONE_INFLUENCES; ++i)
+	{
+		if (influences.weight[i] < influences.weight[lightest])
+		{
+			lightest = i;
+		}
+	}
+
+	if (weight > influences.weight[lightest])
+	{
+		influences.bone[lightest] = bone;
+		influences.weight[lightest] = weight;
+	}
+
+	influences.count++;
+}
+
+void DX::InfluenceBuilder::Resolve(DX::Vertex* vertices) const
+{
+	for (size_t v = 0; v < m_Influences.size(); ++v)
+	{
+		Influences influences = m_Influences[v];
+		size_t count = std::min<size_t>(influences.count, MAX_BONE_INFLUENCES);
+		if (count == 0)
+			continue;
+
+		// Heaviest first, insertion sort is plenty for four
+		for (size_t i = 1; i < count; ++i)
+		{
+			for (size_t j = i; j > 0 && influences.weight[j] > influences.weight[j - 1]; --j)
+			{
+				std::swap(influences.weight[j], influences.weight[j - 1]);
+				std::swap(influences.bone[j], influences.bone[j - 1]);
+			}
+		}
+
+		float total = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+		{
+			total += influences.weight[i];
+		}
+
+		DX::Vertex& vertex = vertices[v];
+		for (size_t i = 0; i < MAX_BONE_INFLUENCES; ++i)
+		{
+			vertex.bone[i] = i < count ? influences.bone[i] : 0;
+			vertex.weight[i] = i < count ? influences.weight[i] / total : 0.0f;
+		}
+	}
+}
+
+size_t DX::InfluenceBuilder::GetClampedCount() const
+{
+	size_t clamped = 0;
+	for (const auto& influences : m_Influences)
+	{
+		if (influences.count > MAX_BONE_INFLUENCES)
+		{
+			clamped++;
+		}
+	}
+
+	return clamped;
+}
+
+void DX::PackVertices(const DX::Vertex* vertices, size_t count, DX::PackedVertex* output)
+{
+	for (size_t v = 0; v < count; ++v)
+	{
+		const DX::Vertex& vertex = vertices[v];
+		DX::PackedVertex& packed = output[v];
+
+		packed.x = vertex.x;
+		packed.y = vertex.y;
+		packed.z = vertex.z;
+		packed.colour = vertex.colour;
+
+		// Round each weight, then hand the rounding error to the heaviest so the sum stays 255
+		int total = 0;
+		size_t heaviest = 0;
+		for (size_t i = 0; i < MAX_BONE_INFLUENCES; ++i)
+		{
+			if (vertex.bone[i] < 0 || vertex.bone[i] > UINT8_MAX)
+				throw std::runtime_error("Bone index doesn't fit in a packed vertex");
+
+			float weight = std::clamp(vertex.weight[i], 0.0f, 1.0f);
+			int quantized = static_cast<int>(std::lround(weight * 255.0f));
+
+			packed.bone[i] = static_cast<uint8_t>(vertex.bone[i]);
+			packed.weight[i] = static_cast<uint8_t>(quantized);
+			total += quantized;
+
+			if (vertex.weight[i] > vertex.weight[heaviest])
+			{
+				heaviest = i;
+			}
+		}
+
+		// Only adjust weights that were meant to add up to one
+		if (total != 0 && std::abs(total - 255) <= static_cast<int>(MAX_BONE_INFLUENCES))
+		{
+			packed.weight[heaviest] = static_cast<uint8_t>(std::clamp(packed.weight[heaviest] + 255 - total, 0, 255));
+		}
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	struct Vertex;
+	struct PackedVertex;
+
+	// Bones a vertex can be skinned by, matches the four slots of DX::Vertex
+	constexpr size_t MAX_BONE_INFLUENCES = 4;
+
+	// Collects bone weights per vertex in any order and keeps the four heaviest. Each weight is a constant
+	// amount of work, so a mesh is done in a single pass over its weights however they are grouped
+	class InfluenceBuilder
+	{
+	public:
+		InfluenceBuilder() = default;
+		virtual ~InfluenceBuilder() = default;
+
+		// Start over for a number of vertices
+		void Reset(size_t vertex_count);
+
+		// Add a bone's weight on a vertex. Weights that aren't positive are ignored
+		void Add(size_t vertex, int bone, float weight);
+
+		// Write the kept influences, heaviest first and normalized to sum to one. Vertices that got no
+		// weight are left as they are
+		void Resolve(DX::Vertex* vertices) const;
+
+		// Vertices that had more than four influences, and so lost some
+		size_t GetClampedCount() const;
+
+	private:
+		struct Influences
+		{
+			int bone[MAX_BONE_INFLUENCES] = {};
+			float weight[MAX_BONE_INFLUENCES] = {};
+			UINT count = 0;
+		};
+
+		std::vector<Influences> m_Influences;
+	};
+
+	// Quantize vertices to a byte per bone index and weight. The weights are rounded so they still sum to
+	// exactly 255. Throws if a bone index doesn't fit in a byte, partition the mesh first
+	void PackVertices(const DX::Vertex* vertices, size_t count, DX::PackedVertex* output);
+}
@@ -0,0 +1,465 @@
+#include "DxMeshCache.h"
+#include "simdjson.h"
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+
+namespace
+{
+	// "DXMC" in little endian
+	constexpr uint32_t CACHE_MAGIC = 0x434D5844;
+
+	// Bump whenever the layout of the file or of DX::Vertex / DX::Subset changes, or the importer output does.
+	// Version 4 stores the bones parent first so the mapped vertices need no remapping
+	constexpr uint32_t CACHE_VERSION = 4;
+
+	// Sections are aligned so the mapped arrays can be used directly (DX::Subset holds an XMMATRIX)
+	constexpr uint64_t CACHE_ALIGNMENT = 16;
+
+	enum Section
+	{
+		SECTION_VERTICES,
+		SECTION_INDICES,
+		SECTION_SUBSETS,
+		SECTION_BONES,
+		SECTION_CLIPS,
+		SECTION_BONE_ANIMATIONS,
+		SECTION_KEYFRAMES,
+		SECTION_CHILDREN,
+		SECTION_STRINGS,
+		SECTION_COUNT
+	};
+
+	struct CacheSection
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct CacheHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+
+		// Guards against a cache written by a build with a different vertex layout
+		uint32_t vertex_size;
+		uint32_t subset_size;
+
+		CacheSection sections[SECTION_COUNT];
+	};
+
+	struct CacheString
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct CacheBone
+	{
+		int parent_id;
+		int bone_index;
+		CacheString name;
+		CacheString parent_name;
+		uint32_t first_child;
+		uint32_t child_count;
+		DirectX::XMFLOAT4X4 bind_pose;
+		DirectX::XMFLOAT4X4 inverse_bind_pose;
+	};
+
+	struct CacheClip
+	{
+		CacheString name;
+		float ticks_per_second;
+		uint32_t first_bone_animation;
+		uint32_t bone_animation_count;
+	};
+
+	struct CacheBoneAnimation
+	{
+		uint32_t first_keyframe;
+		uint32_t keyframe_count;
+	};
+
+	// DX::Keyframe has a vtable so it is stored as plain floats
+	struct CacheKeyframe
+	{
+		float time;
+		DirectX::XMFLOAT3 translation;
+		DirectX::XMFLOAT3 scale;
+		DirectX::XMFLOAT4 rotation;
+	};
+
+	// Append raw records to a section
+	template <typename T>
+	void Append(std::vector<char>& section, const T* data, size_t count)
+	{
+		const char* bytes = reinterpret_cast<const char*>(data);
+		section.insert(section.end(), bytes, bytes + sizeof(T) * count);
+	}
+
+	CacheString AppendString(std::vector<char>& strings, const std::string& value)
+	{
+		CacheString string = { static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.size()) };
+		strings.insert(strings.end(), value.begin(), value.end());
+		return string;
+	}
+
+	// 64-bit FNV-1a
+	uint64_t Hash(const char* data, size_t size, uint64_t hash = 14695981039346656037ull)
+	{
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= static_cast<unsigned char>(data[i]);
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	uint64_t HashFile(const std::filesystem::path& path, uint64_t hash)
+	{
+		MappedFile file(path);
+		return Hash(file.Data(), file.Size(), hash);
+	}
+}
+
+bool DX::MeshCache::Open(const std::filesystem::path& cache_path, uint64_t source_hash)
+{
+	if (!std::filesystem::exists(cache_path))
+		return false;
+
+	m_File = std::make_unique<MappedFile>(cache_path);
+	const char* data = m_File->Data();
+	size_t size = m_File->Size();
+
+	// Validate the header before trusting any offsets
+	CacheHeader header = {};
+	if (size < sizeof(CacheHeader))
+	{
+		m_File = nullptr;
+		return false;
+	}
+
+	std::memcpy(&header, data, sizeof(CacheHeader));
+	if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.source_hash != source_hash ||
+		header.vertex_size != sizeof(DX::Vertex) || header.subset_size != sizeof(DX::Subset))
+	{
+		m_File = nullptr;
+		return false;
+	}
+
+	for (auto& section : header.sections)
+	{
+		if (section.offset % CACHE_ALIGNMENT != 0 || section.offset > size || section.size > size - section.offset)
+		{
+			m_File = nullptr;
+			return false;
+		}
+	}
+
+	// Every section has to hold whole records
+	const size_t record_sizes[SECTION_COUNT] = { sizeof(DX::Vertex), sizeof(UINT), sizeof(DX::Subset), sizeof(CacheBone),
+		sizeof(CacheClip), sizeof(CacheBoneAnimation), sizeof(CacheKeyframe), sizeof(int), 1 };
+
+	for (int i = 0; i < SECTION_COUNT; ++i)
+	{
+		if (header.sections[i].size % record_sizes[i] != 0)
+		{
+			m_File = nullptr;
+			return false;
+		}
+	}
+
+	// Fix up the section offsets into pointers
+	auto section = [&](Section index) { return data + header.sections[index].offset; };
+	auto count = [&](Section index) { return static_cast<size_t>(header.sections[index].size / record_sizes[index]); };
+
+	m_Geometry.vertices = reinterpret_cast<const DX::Vertex*>(section(SECTION_VERTICES));
+	m_Geometry.vertex_count = count(SECTION_VERTICES);
+
+	m_Geometry.indices = reinterpret_cast<const UINT*>(section(SECTION_INDICES));
+	m_Geometry.index_count = count(SECTION_INDICES);
+
+	m_Geometry.subsets = reinterpret_cast<const DX::Subset*>(section(SECTION_SUBSETS));
+	m_Geometry.subset_count = count(SECTION_SUBSETS);
+
+	m_Bones = section(SECTION_BONES);
+	m_BoneCount = count(SECTION_BONES);
+
+	m_Clips = section(SECTION_CLIPS);
+	m_ClipCount = count(SECTION_CLIPS);
+
+	m_BoneAnimations = section(SECTION_BONE_ANIMATIONS);
+	m_BoneAnimationCount = count(SECTION_BONE_ANIMATIONS);
+
+	m_Keyframes = section(SECTION_KEYFRAMES);
+	m_KeyframeCount = count(SECTION_KEYFRAMES);
+
+	m_Children = reinterpret_cast<const int*>(section(SECTION_CHILDREN));
+	m_ChildCount = count(SECTION_CHILDREN);
+
+	m_Strings = section(SECTION_STRINGS);
+	m_StringsSize = count(SECTION_STRINGS);
+
+	if (!Validate())
+	{
+		m_File = nullptr;
+		m_Geometry = {};
+		return false;
+	}
+
+	return true;
+}
+
+bool DX::MeshCache::Validate() const
+{
+	// Ranges are summed in 64 bits so a huge first and count can't wrap around
+	auto in_range = [](uint64_t first, uint64_t count, uint64_t size) { return first + count <= size; };
+	auto valid_string = [&](const CacheString& string) { return in_range(string.offset, string.length, m_StringsSize); };
+
+	// Every index of a subset has to land on a vertex
+	for (size_t i = 0; i < m_Geometry.subset_count; ++i)
+	{
+		const DX::Subset& subset = m_Geometry.subsets[i];
+		if (!in_range(subset.startIndex, subset.totalIndex, m_Geometry.index_count))
+			return false;
+
+		for (UINT j = 0; j < subset.totalIndex; ++j)
+		{
+			if (static_cast<uint64_t>(subset.baseVertex) + m_Geometry.indices[subset.startIndex + j] >= m_Geometry.vertex_count)
+				return false;
+		}
+	}
+
+	// Weighted influences have to land on a bone, unweighted ones are never read
+	for (size_t i = 0; i < m_Geometry.vertex_count; ++i)
+	{
+		const DX::Vertex& vertex = m_Geometry.vertices[i];
+		for (size_t k = 0; k < 4; ++k)
+		{
+			if (vertex.weight[k] != 0.0f && (vertex.bone[k] < 0 || static_cast<uint64_t>(vertex.bone[k]) >= m_BoneCount))
+				return false;
+		}
+	}
+
+	// Bones are stored parent first, a cache that isn't gets imported again rather than rejected by the skeleton
+	const CacheBone* bones = reinterpret_cast<const CacheBone*>(m_Bones);
+	for (size_t i = 0; i < m_BoneCount; ++i)
+	{
+		if (bones[i].parent_id < -1 || bones[i].parent_id >= static_cast<int64_t>(i) ||
+			!valid_string(bones[i].name) || !valid_string(bones[i].parent_name) ||
+			!in_range(bones[i].first_child, bones[i].child_count, m_ChildCount))
+			return false;
+	}
+
+	for (size_t i = 0; i < m_ChildCount; ++i)
+	{
+		if (m_Children[i] < 0 || static_cast<uint64_t>(m_Children[i]) >= m_BoneCount)
+			return false;
+	}
+
+	const CacheClip* clips = reinterpret_cast<const CacheClip*>(m_Clips);
+	for (size_t i = 0; i < m_ClipCount; ++i)
+	{
+		if (!valid_string(clips[i].name) || !in_range(clips[i].first_bone_animation, clips[i].bone_animation_count, m_BoneAnimationCount))
+			return false;
+	}
+
+	const CacheBoneAnimation* bone_animations = reinterpret_cast<const CacheBoneAnimation*>(m_BoneAnimations);
+	for (size_t i = 0; i < m_BoneAnimationCount; ++i)
+	{
+		if (!in_range(bone_animations[i].first_keyframe, bone_animations[i].keyframe_count, m_KeyframeCount))
+			return false;
+	}
+
+	return true;
+}
+
+void DX::MeshCache::ReadAnimation(DX::Mesh* mesh) const
+{
+	auto read_string = [&](const CacheString& string) { return std::string(m_Strings + string.offset, string.length); };
+
+	// Bones
+	const CacheBone* bones = reinterpret_cast<const CacheBone*>(m_Bones);
+	mesh->bones.resize(m_BoneCount);
+	for (size_t i = 0; i < m_BoneCount; ++i)
+	{
+		DX::BoneInfo& bone = mesh->bones[i];
+		bone.parentId = bones[i].parent_id;
+		bone.bone_index = bones[i].bone_index;
+		bone.name = read_string(bones[i].name);
+		bone.parentName = read_string(bones[i].parent_name);
+		bone.children.assign(m_Children + bones[i].first_child, m_Children + bones[i].first_child + bones[i].child_count);
+		bone.bind_pose = DirectX::XMLoadFloat4x4(&bones[i].bind_pose);
+		bone.inverse_bind_pose = DirectX::XMLoadFloat4x4(&bones[i].inverse_bind_pose);
+	}
+
+	// Animations
+	const CacheClip* clips = reinterpret_cast<const CacheClip*>(m_Clips);
+	const CacheBoneAnimation* bone_animations = reinterpret_cast<const CacheBoneAnimation*>(m_BoneAnimations);
+	const CacheKeyframe* keyframes = reinterpret_cast<const CacheKeyframe*>(m_Keyframes);
+
+	mesh->animations.clear();
+	for (size_t i = 0; i < m_ClipCount; ++i)
+	{
+		DX::AnimationClip clip;
+		clip.ticks_per_second = clips[i].ticks_per_second;
+		clip.BoneAnimations.resize(clips[i].bone_animation_count);
+
+		for (uint32_t j = 0; j < clips[i].bone_animation_count; ++j)
+		{
+			const CacheBoneAnimation& bone_animation = bone_animations[clips[i].first_bone_animation + j];
+
+			auto& frames = clip.BoneAnimations[j].Keyframes;
+			frames.resize(bone_animation.keyframe_count);
+			for (uint32_t k = 0; k < bone_animation.keyframe_count; ++k)
+			{
+				const CacheKeyframe& keyframe = keyframes[bone_animation.first_keyframe + k];
+				frames[k].TimePos = keyframe.time;
+				frames[k].Translation = keyframe.translation;
+				frames[k].Scale = keyframe.scale;
+				frames[k].RotationQuat = keyframe.rotation;
+			}
+		}
+
+		mesh->animations[read_string(clips[i].name)] = std::move(clip);
+	}
+}
+
+void DX::MeshCache::Write(const std::filesystem::path& cache_path, uint64_t source_hash, const DX::Mesh& mesh)
+{
+	std::vector<char> sections[SECTION_COUNT];
+
+	// Geometry
+	Append(sections[SECTION_VERTICES], mesh.vertices.data(), mesh.vertices.size());
+	Append(sections[SECTION_INDICES], mesh.indices.data(), mesh.indices.size());
+	Append(sections[SECTION_SUBSETS], mesh.subsets.data(), mesh.subsets.size());
+
+	// Bones
+	for (auto& bone : mesh.bones)
+	{
+		CacheBone record = {};
+		record.parent_id = bone.parentId;
+		record.bone_index = bone.bone_index;
+		record.name = AppendString(sections[SECTION_STRINGS], bone.name);
+		record.parent_name = AppendString(sections[SECTION_STRINGS], bone.parentName);
+		record.first_child = static_cast<uint32_t>(sections[SECTION_CHILDREN].size() / sizeof(int));
+		record.child_count = static_cast<uint32_t>(bone.children.size());
+		DirectX::XMStoreFloat4x4(&record.bind_pose, bone.bind_pose);
+		DirectX::XMStoreFloat4x4(&record.inverse_bind_pose, bone.inverse_bind_pose);
+
+		Append(sections[SECTION_CHILDREN], bone.children.data(), bone.children.size());
+		Append(sections[SECTION_BONES], &record, 1);
+	}
+
+	// Animations
+	uint32_t bone_animation_total = 0;
+	uint32_t keyframe_total = 0;
+	for (auto& animation : mesh.animations)
+	{
+		const DX::AnimationClip& clip = animation.second;
+
+		CacheClip record = {};
+		record.name = AppendString(sections[SECTION_STRINGS], animation.first);
+		record.ticks_per_second = clip.ticks_per_second;
+		record.first_bone_animation = bone_animation_total;
+		record.bone_animation_count = static_cast<uint32_t>(clip.BoneAnimations.size());
+		Append(sections[SECTION_CLIPS], &record, 1);
+
+		for (auto& bone_animation : clip.BoneAnimations)
+		{
+			CacheBoneAnimation bone_record = { keyframe_total, static_cast<uint32_t>(bone_animation.Keyframes.size()) };
+			Append(sections[SECTION_BONE_ANIMATIONS], &bone_record, 1);
+
+			for (auto& frame : bone_animation.Keyframes)
+			{
+				CacheKeyframe keyframe = { frame.TimePos, frame.Translation, frame.Scale, frame.RotationQuat };
+				Append(sections[SECTION_KEYFRAMES], &keyframe, 1);
+			}
+
+			keyframe_total += bone_record.keyframe_count;
+		}
+
+		bone_animation_total += record.bone_animation_count;
+	}
+
+	// Lay the sections out after the header
+	CacheHeader header = {};
+	header.magic = CACHE_MAGIC;
+	header.version = CACHE_VERSION;
+	header.source_hash = source_hash;
+	header.vertex_size = sizeof(DX::Vertex);
+	header.subset_size = sizeof(DX::Subset);
+
+	auto align = [](uint64_t offset) { return (offset + CACHE_ALIGNMENT - 1) & ~(CACHE_ALIGNMENT - 1); };
+
+	uint64_t offset = align(sizeof(CacheHeader));
+	for (int i = 0; i < SECTION_COUNT; ++i)
+	{
+		header.sections[i].offset = offset;
+		header.sections[i].size = sections[i].size();
+		offset = align(offset + sections[i].size());
+	}
+
+	// Write to a temporary file first so a failed write never leaves a half written cache behind
+	auto temp_path = cache_path;
+	temp_path += ".tmp";
+	{
+		std::ofstream file(temp_path, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+		if (!file)
+			throw std::runtime_error("Could not write mesh cache: " + cache_path.string());
+
+		const char padding[CACHE_ALIGNMENT] = {};
+		file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+		file.write(padding, header.sections[0].offset - sizeof(CacheHeader));
+
+		for (int i = 0; i < SECTION_COUNT; ++i)
+		{
+			file.write(sections[i].data(), sections[i].size());
+
+			uint64_t end = header.sections[i].offset + header.sections[i].size;
+			file.write(padding, align(end) - end);
+		}
+
+		if (!file)
+			throw std::runtime_error("Could not write mesh cache: " + cache_path.string());
+	}
+
+	std::filesystem::rename(temp_path, cache_path);
+}
+
+std::filesystem::path DX::MeshCache::GetCachePath(const std::filesystem::path& source_path)
+{
+	auto cache_path = source_path;
+	cache_path += ".dxmesh";
+	return cache_path;
+}
+
+uint64_t DX::MeshCache::HashSource(const std::filesystem::path& source_path)
+{
+	uint64_t hash = HashFile(source_path, 14695981039346656037ull);
+
+	// A .gltf is only the JSON, the geometry lives in the buffers it references
+	if (source_path.extension() == ".gltf")
+	{
+		simdjson::dom::parser parser;
+		simdjson::dom::element document = parser.load(source_path.string());
+
+		simdjson::dom::array buffers;
+		if (document["buffers"].get_array().get(buffers) == simdjson::SUCCESS)
+		{
+			for (auto buffer : buffers)
+			{
+				std::string_view uri;
+				// Embedded data URIs are already part of the JSON hash
+				if (buffer["uri"].get_string().get(uri) == simdjson::SUCCESS && uri.substr(0, 5) != "data:")
+				{
+					hash = HashFile(source_path.parent_path() / uri, hash);
+				}
+			}
+		}
+	}
+
+	return hash;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "DxModel.h"
+#include "MappedFile.h"
+#include <filesystem>
+#include <memory>
+#include <cstdint>
+
+namespace DX
+{
+	// Binary cache of an imported mesh. Vertices, indices and subsets are stored exactly as DX::Mesh
+	// holds them and are used straight from the mapping, so opening a cache is a single file mapping plus
+	// turning section offsets into pointers. Every offset, count and index is checked against the section
+	// it points into first. Each cache is tagged with a hash of the source file so a stale cache is rebuilt
+	class MeshCache
+	{
+	public:
+		MeshCache() = default;
+		virtual ~MeshCache() = default;
+
+		// Map a cache file. Returns false if it is missing, from another version, was cooked from different
+		// source data, holds an offset, count or index outside its sections or has bones out of parent first order
+		bool Open(const std::filesystem::path& cache_path, uint64_t source_hash);
+
+		// Rebuild the bones and animation clips, which hold strings and vectors. The geometry stays in the mapping
+		void ReadAnimation(DX::Mesh* mesh) const;
+
+		// Vertices, indices and subsets in the mapping, valid while the cache is open
+		const DX::MeshGeometry& GetGeometry() const { return m_Geometry; }
+
+		// Write a mesh to a cache file
+		static void Write(const std::filesystem::path& cache_path, uint64_t source_hash, const DX::Mesh& mesh);
+
+		// Cooked mesh of a source model, which sits next to it
+		static std::filesystem::path GetCachePath(const std::filesystem::path& source_path);
+
+		// Hash the source file, including the buffers a .gltf references
+		static uint64_t HashSource(const std::filesystem::path& source_path);
+
+	private:
+		std::unique_ptr<MappedFile> m_File = nullptr;
+
+		DX::MeshGeometry m_Geometry;
+
+		// Bones and animations hold strings and vectors so they are rebuilt from packed records
+		const char* m_Bones = nullptr;
+		size_t m_BoneCount = 0;
+
+		const char* m_Clips = nullptr;
+		size_t m_ClipCount = 0;
+
+		const char* m_BoneAnimations = nullptr;
+		size_t m_BoneAnimationCount = 0;
+
+		const char* m_Keyframes = nullptr;
+		size_t m_KeyframeCount = 0;
+
+		const int* m_Children = nullptr;
+		size_t m_ChildCount = 0;
+
+		const char* m_Strings = nullptr;
+		size_t m_StringsSize = 0;
+
+		// Check every record and index of the mapped sections
+		bool Validate() const;
+	};
+}
\ No newline at end of file
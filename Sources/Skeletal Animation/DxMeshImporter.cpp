@@ -0,0 +1,57 @@
+#include "DxMeshImporter.h"
+#include "DxSkeleton.h"
+#include "ModelLoader.h"
+#include <iostream>
+
+DX::Mesh DX::ImportMesh(const std::filesystem::path& path)
+{
+	// Load model
+	Assimp::Loader loader;
+	Assimp::Model model = loader.Load(path.string());
+
+	const Assimp::LoadStatistics& stats = loader.GetStatistics();
+	if (stats.clamped_vertex_count > 0)
+	{
+		std::cerr << path.filename().string() << ": " << stats.clamped_vertex_count << " vertices had more than four bone influences, the lightest were dropped\n";
+	}
+
+	DX::Mesh mesh;
+
+	// The loader already builds DX::Vertex, so the big arrays are moved rather than copied
+	mesh.vertices = std::move(model.vertices);
+	mesh.indices = std::move(model.indices);
+
+	// Assign subset
+	mesh.subsets.reserve(model.subset.size());
+	for (auto& s : model.subset)
+	{
+		DX::Subset subset = {};
+		subset.baseVertex = s.base_vertex;
+		subset.startIndex = s.start_index;
+		subset.totalIndex = s.total_index;
+		subset.transformation = s.transformation;
+		mesh.subsets.push_back(subset);
+	}
+
+	// Assign bones
+	mesh.bones.reserve(model.bones.size());
+	for (auto& b : model.bones)
+	{
+		DX::BoneInfo bone;
+		bone.name = std::move(b.name);
+		bone.parentName = std::move(b.parent_name);
+		bone.bind_pose = b.bind_pose;
+		bone.inverse_bind_pose = b.inverse_bind_pose;
+		bone.parentId = b.parent_id;
+		mesh.bones.push_back(std::move(bone));
+	}
+
+	mesh.animations = std::move(model.animations);
+
+	// Sort the bones parent first, the mesh and clips follow the new order
+	DX::Skeleton skeleton;
+	skeleton.Compile(mesh.bones);
+	skeleton.Remap(mesh);
+
+	return mesh;
+}
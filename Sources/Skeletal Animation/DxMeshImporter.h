@@ -0,0 +1,11 @@
+#pragma once
+
+#include "DxModel.h"
+#include <filesystem>
+
+namespace DX
+{
+	// Import a model with Assimp. Bones come out sorted parent first with the vertices and clips following
+	// them, the order mesh caches are cooked in, so a mapped cache can be drawn without remapping
+	DX::Mesh ImportMesh(const std::filesystem::path& path);
+}
@@ -0,0 +1,414 @@
+#include "DxMeshOptimizer.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+namespace
+{
+	// LRU cache the triangle order is scored against. Bigger than the hardware FIFO so the order holds up on any of them
+	constexpr UINT SCORE_CACHE_SIZE = 32;
+
+	// Forsyth's weights. The last triangle's vertices get a flat score so the next triangle doesn't have to share them
+	constexpr float CACHE_DECAY_POWER = 1.5f;
+	constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+	constexpr float VALENCE_BOOST_SCALE = 2.0f;
+	constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+	// Valences past this all score the same
+	constexpr UINT MAX_SCORED_VALENCE = 32;
+
+	constexpr UINT NO_VERTEX = std::numeric_limits<UINT>::max();
+
+	struct ScoreTables
+	{
+		float cache[SCORE_CACHE_SIZE];
+		float valence[MAX_SCORED_VALENCE + 1];
+
+		ScoreTables()
+		{
+			for (UINT i = 0; i < SCORE_CACHE_SIZE; ++i)
+			{
+				cache[i] = i < 3 ? LAST_TRIANGLE_SCORE : std::pow(1.0f - static_cast<float>(i - 3) / (SCORE_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+			}
+
+			valence[0] = 0.0f;
+			for (UINT i = 1; i <= MAX_SCORED_VALENCE; ++i)
+			{
+				valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+			}
+		}
+	};
+
+	const ScoreTables& GetScoreTables()
+	{
+		static const ScoreTables tables;
+		return tables;
+	}
+
+	// Score of a vertex by where it sits in the cache and how many triangles still need it
+	float VertexScore(int cache_position, UINT remaining)
+	{
+		const ScoreTables& tables = GetScoreTables();
+		if (remaining == 0)
+			return -1.0f;
+
+		float score = cache_position >= 0 ? tables.cache[cache_position] : 0.0f;
+		return score + tables.valence[std::min(remaining, MAX_SCORED_VALENCE)];
+	}
+
+	DirectX::XMVECTOR LoadPosition(const float* positions, size_t vertex_stride, UINT index)
+	{
+		const float* position = reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex_stride * index);
+		return DirectX::XMVectorSet(position[0], position[1], position[2], 0.0f);
+	}
+
+	// FIFO post transform cache. Vertices are stamped with the miss count when they go in, and are still
+	// cached while fewer than size misses have come after them
+	struct FifoCache
+	{
+		std::vector<size_t> inserted;
+		size_t misses = 0;
+		size_t flushed = 0;
+		UINT size = 0;
+
+		FifoCache(size_t vertex_count, UINT cache_size) : inserted(vertex_count, 0), size(cache_size) {}
+
+		// Empty the cache without touching every vertex
+		void Flush() { flushed = misses; }
+
+		// True on a hit
+		bool Access(UINT index)
+		{
+			if (inserted[index] > flushed && misses - inserted[index] < size)
+				return true;
+
+			inserted[index] = ++misses;
+			return false;
+		}
+	};
+
+	// Cluster of triangles and what its draw order is sorted by
+	struct Cluster
+	{
+		size_t start = 0;
+		size_t end = 0;
+		float sort_key = 0.0f;
+	};
+}
+
+DX::VertexCacheStatistics DX::AnalyzeVertexCache(const UINT* indices, size_t index_count, size_t vertex_count, UINT cache_size)
+{
+	VertexCacheStatistics statistics;
+	statistics.triangles = index_count / 3;
+
+	FifoCache cache(vertex_count, cache_size);
+	std::vector<bool> referenced(vertex_count, false);
+
+	for (size_t i = 0; i < index_count; ++i)
+	{
+		UINT index = indices[i];
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			statistics.unique_vertices++;
+		}
+
+		cache.Access(index);
+	}
+
+	size_t misses = cache.misses;
+	statistics.vertices_transformed = misses;
+	statistics.acmr = statistics.triangles > 0 ? static_cast<float>(misses) / statistics.triangles : 0.0f;
+	statistics.atvr = statistics.unique_vertices > 0 ? static_cast<float>(misses) / statistics.unique_vertices : 0.0f;
+
+	return statistics;
+}
+
+void DX::OptimizeVertexCache(UINT* destination, const UINT* indices, size_t index_count, size_t vertex_count)
+{
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	// Work from a copy so the destination can be the source
+	std::vector<UINT> source(indices, indices + triangle_count * 3);
+
+	// Triangles of every vertex as one flat array. The first remaining[v] of a vertex's entries are the ones not drawn yet
+	std::vector<UINT> triangle_start(vertex_count + 1, 0);
+	for (UINT index : source)
+	{
+		triangle_start[index + 1]++;
+	}
+
+	for (size_t i = 0; i < vertex_count; ++i)
+	{
+		triangle_start[i + 1] += triangle_start[i];
+	}
+
+	std::vector<UINT> vertex_triangles(triangle_start[vertex_count]);
+	std::vector<UINT> remaining(vertex_count, 0);
+	for (size_t t = 0; t < triangle_count; ++t)
+	{
+		for (size_t k = 0; k < 3; ++k)
+		{
+			UINT index = source[t * 3 + k];
+			vertex_triangles[triangle_start[index] + remaining[index]++] = static_cast<UINT>(t);
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (size_t v = 0; v < vertex_count; ++v)
+	{
+		vertex_score[v] = VertexScore(-1, remaining[v]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; ++t)
+	{
+		triangle_score[t] = vertex_score[source[t * 3]] + vertex_score[source[t * 3 + 1]] + vertex_score[source[t * 3 + 2]];
+	}
+
+	// Start from the best scoring triangle
+	size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+
+	// Room for a full cache plus the three vertices pushed in by a triangle
+	UINT cache[SCORE_CACHE_SIZE + 3];
+	UINT cache_count = 0;
+
+	size_t next_unemitted = 0;
+	for (size_t output = 0; output < triangle_count; ++output)
+	{
+		// Nothing in the cache has triangles left, carry on from the first triangle not drawn yet
+		if (best == triangle_count)
+		{
+			while (emitted[next_unemitted])
+			{
+				next_unemitted++;
+			}
+
+			best = next_unemitted;
+		}
+
+		const UINT* triangle = &source[best * 3];
+		destination[output * 3 + 0] = triangle[0];
+		destination[output * 3 + 1] = triangle[1];
+		destination[output * 3 + 2] = triangle[2];
+		emitted[best] = true;
+
+		// Take the triangle off its vertices' lists
+		for (size_t k = 0; k < 3; ++k)
+		{
+			UINT index = triangle[k];
+			UINT* list = &vertex_triangles[triangle_start[index]];
+			UINT* found = std::find(list, list + remaining[index], static_cast<UINT>(best));
+			*found = list[--remaining[index]];
+		}
+
+		// Push the triangle's vertices to the front of the LRU
+		UINT new_cache[SCORE_CACHE_SIZE + 3];
+		UINT new_count = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			new_cache[new_count++] = triangle[k];
+		}
+
+		for (UINT i = 0; i < cache_count; ++i)
+		{
+			UINT index = cache[i];
+			if (index != triangle[0] && index != triangle[1] && index != triangle[2])
+			{
+				new_cache[new_count++] = index;
+			}
+		}
+
+		// Rescore everything that moved, including the vertices that just fell out
+		for (UINT i = 0; i < new_count; ++i)
+		{
+			UINT index = new_cache[i];
+			cache_position[index] = i < SCORE_CACHE_SIZE ? static_cast<int>(i) : -1;
+			vertex_score[index] = VertexScore(cache_position[index], remaining[index]);
+		}
+
+		// The next triangle is the best one touching the cache
+		best = triangle_count;
+		float best_score = -std::numeric_limits<float>::max();
+		for (UINT i = 0; i < new_count; ++i)
+		{
+			UINT index = new_cache[i];
+			const UINT* list = &vertex_triangles[triangle_start[index]];
+			for (UINT j = 0; j < remaining[index]; ++j)
+			{
+				UINT t = list[j];
+				const UINT* corners = &source[t * 3];
+				float score = vertex_score[corners[0]] + vertex_score[corners[1]] + vertex_score[corners[2]];
+
+				if (score > best_score)
+				{
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+
+		cache_count = std::min(new_count, SCORE_CACHE_SIZE);
+		std::memcpy(cache, new_cache, cache_count * sizeof(UINT));
+	}
+}
+
+void DX::OptimizeOverdraw(UINT* destination, const UINT* indices, size_t index_count, const float* positions, size_t vertex_count, size_t vertex_stride, float threshold)
+{
+	using namespace DirectX;
+
+	const size_t triangle_count = index_count / 3;
+	if (triangle_count == 0)
+		return;
+
+	std::vector<UINT> source(indices, indices + triangle_count * 3);
+
+	// Hard boundaries are where the cache order starts over, a triangle with no cached vertex
+	FifoCache cache(vertex_count, VERTEX_CACHE_SIZE);
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangle_count; ++t)
+	{
+		UINT triangle_misses = 0;
+		for (size_t k = 0; k < 3; ++k)
+		{
+			triangle_misses += cache.Access(source[t * 3 + k]) ? 0 : 1;
+		}
+
+		if (t == 0 || triangle_misses == 3)
+		{
+			hard.push_back(t);
+		}
+	}
+
+	hard.push_back(triangle_count);
+
+	// Soft boundaries split a hard cluster wherever the part so far is already about as cache efficient as the whole
+	std::vector<Cluster> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); ++h)
+	{
+		size_t start = hard[h];
+		size_t end = hard[h + 1];
+
+		cache.Flush();
+		size_t hard_start_misses = cache.misses;
+		for (size_t i = start * 3; i < end * 3; ++i)
+		{
+			cache.Access(source[i]);
+		}
+
+		float cluster_acmr = static_cast<float>(cache.misses - hard_start_misses) / (end - start);
+
+		// The next cluster might be drawn after anything, so each one starts with a cold cache
+		cache.Flush();
+		size_t cluster_start = start;
+		size_t cluster_start_misses = cache.misses;
+		for (size_t t = start; t < end; ++t)
+		{
+			for (size_t k = 0; k < 3; ++k)
+			{
+				cache.Access(source[t * 3 + k]);
+			}
+
+			size_t cluster_triangles = t + 1 - cluster_start;
+			size_t cluster_misses = cache.misses - cluster_start_misses;
+			if (t + 1 < end && static_cast<float>(cluster_misses) <= threshold * cluster_acmr * cluster_triangles)
+			{
+				clusters.push_back({ cluster_start, t + 1 });
+
+				cache.Flush();
+				cluster_start = t + 1;
+				cluster_start_misses = cache.misses;
+			}
+		}
+
+		clusters.push_back({ cluster_start, end });
+	}
+
+	// Area weighted middle of the mesh
+	XMVECTOR mesh_centroid = XMVectorZero();
+	float mesh_area = 0.0f;
+
+	std::vector<XMFLOAT3> cluster_centroid(clusters.size());
+	std::vector<XMFLOAT3> cluster_normal(clusters.size());
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		XMVECTOR centroid = XMVectorZero();
+		XMVECTOR normal = XMVectorZero();
+		float area = 0.0f;
+
+		for (size_t t = clusters[c].start; t < clusters[c].end; ++t)
+		{
+			XMVECTOR a = LoadPosition(positions, vertex_stride, source[t * 3]);
+			XMVECTOR b = LoadPosition(positions, vertex_stride, source[t * 3 + 1]);
+			XMVECTOR c0 = LoadPosition(positions, vertex_stride, source[t * 3 + 2]);
+
+			// Cross product is the normal scaled by twice the area
+			XMVECTOR cross = XMVector3Cross(XMVectorSubtract(b, a), XMVectorSubtract(c0, a));
+			float triangle_area = XMVectorGetX(XMVector3Length(cross));
+
+			XMVECTOR middle = XMVectorScale(XMVectorAdd(XMVectorAdd(a, b), c0), 1.0f / 3.0f);
+			centroid = XMVectorAdd(centroid, XMVectorScale(middle, triangle_area));
+			normal = XMVectorAdd(normal, cross);
+			area += triangle_area;
+		}
+
+		mesh_centroid = XMVectorAdd(mesh_centroid, centroid);
+		mesh_area += area;
+
+		XMStoreFloat3(&cluster_centroid[c], area > 0.0f ? XMVectorScale(centroid, 1.0f / area) : centroid);
+		XMStoreFloat3(&cluster_normal[c], XMVector3Normalize(normal));
+	}
+
+	if (mesh_area > 0.0f)
+	{
+		mesh_centroid = XMVectorScale(mesh_centroid, 1.0f / mesh_area);
+	}
+
+	// Clusters facing away from the middle are on the outside, and likely in front of the rest
+	for (size_t c = 0; c < clusters.size(); ++c)
+	{
+		XMVECTOR offset = XMVectorSubtract(XMLoadFloat3(&cluster_centroid[c]), mesh_centroid);
+		clusters[c].sort_key = XMVectorGetX(XMVector3Dot(offset, XMLoadFloat3(&cluster_normal[c])));
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sort_key > b.sort_key; });
+
+	UINT* output = destination;
+	for (const auto& cluster : clusters)
+	{
+		output = std::copy(source.begin() + cluster.start * 3, source.begin() + cluster.end * 3, output);
+	}
+}
+
+size_t DX::OptimizeVertexFetch(void* destination, UINT* indices, size_t index_count, const void* vertices, size_t vertex_count, size_t vertex_size)
+{
+	// Work from a copy so the destination can be the source
+	const uint8_t* bytes = static_cast<const uint8_t*>(vertices);
+	std::vector<uint8_t> source(bytes, bytes + vertex_count * vertex_size);
+
+	std::vector<UINT> remap(vertex_count, NO_VERTEX);
+	UINT next = 0;
+
+	uint8_t* output = static_cast<uint8_t*>(destination);
+	for (size_t i = 0; i < index_count; ++i)
+	{
+		UINT index = indices[i];
+		if (remap[index] == NO_VERTEX)
+		{
+			std::memcpy(output + static_cast<size_t>(next) * vertex_size, &source[static_cast<size_t>(index) * vertex_size], vertex_size);
+			remap[index] = next++;
+		}
+
+		indices[i] = remap[index];
+	}
+
+	return next;
+}
@@ -7,174 +7,181 @@
 #include <exception>
 #include <fstream>
 
-#include "ModelLoader.h"
 #include "GltfModelLoader.h"
+#include "DxMeshCache.h"
+#include "DxMeshImporter.h"
+#include "DxSkinning.h"
+#include "DxInfluences.h"
+#include "DxMeshOptimizer.h"
+#include <algorithm>
 using namespace DX;
 
+namespace
+{
+	// Play clips compressed where that makes them smaller, instead of at full precision
+	constexpr bool COMPRESS_ANIMATION = true;
+
+	// Frames per second to bake clips into the pose cache at, 0 to sample them every update
+	constexpr float ANIMATION_BAKE_RATE = 30.0f;
+
+	// How bones are packed for the shader. Dual quaternions are smaller but can't carry scale
+	constexpr DX::BonePaletteFormat PALETTE_FORMAT = DX::BonePaletteFormat::Affine;
+
+	// Upload vertices with byte bone indices and weights. Partitions keep indices under 256
+	constexpr bool PACK_VERTICES = true;
+}
+
 DX::Model::Model(DX::Renderer* renderer, DX::Shader* shader) : m_DxRenderer(renderer), m_DxShader(shader)
 {
 	World = DirectX::XMMatrixTranslation(0.0f, 0.0f, 0.0f);
 }
 
+DX::Model::~Model() = default;
+
 void DX::Model::Create()
 {
-	// Load model
-	Assimp::Loader loader;
-	Assimp::Model model = loader.Load("..\\..\\Resources\\Models\\3bone.gltf");
+	const std::filesystem::path model_path = "..\\..\\Resources\\Models\\3bone.gltf";
 
-	// Assign vertices
-	for (auto& v : model.vertices)
+	// Draw the cooked mesh straight from its mapping if it was built from the current source, otherwise import and cook it
+	auto cache_path = DX::MeshCache::GetCachePath(model_path);
+	uint64_t source_hash = DX::MeshCache::HashSource(model_path);
+
+	m_MeshCache = std::make_unique<DX::MeshCache>();
+	if (m_MeshCache->Open(cache_path, source_hash))
 	{
-		DX::Vertex vertex;
-
-		// Set position
-		vertex.x = v.x;
-		vertex.y = v.y;
-		vertex.z = v.z;
-
-		// Set bone
-		vertex.bone[0] = v.bone[0];
-		vertex.bone[1] = v.bone[1];
-		vertex.bone[2] = v.bone[2];
-		vertex.bone[3] = v.bone[3];
-
-		// Set weight
-		vertex.weight[0] = v.weight[0];
-		vertex.weight[1] = v.weight[1];
-		vertex.weight[2] = v.weight[2];
-		vertex.weight[3] = v.weight[3];
-
-		m_Mesh.vertices.push_back(vertex);
+		m_MeshCache->ReadAnimation(&m_Mesh);
+		m_Geometry = m_MeshCache->GetGeometry();
 	}
+	else
+	{
+		m_MeshCache = nullptr;
+		m_Mesh = DX::ImportMesh(model_path);
+		m_Geometry = m_Mesh.GetGeometry();
 
-	// Assign indices
-	m_Mesh.indices = model.indices;
+		try
+		{
+			DX::MeshCache::Write(cache_path, source_hash, m_Mesh);
+		}
+		catch (const std::exception& e)
+		{
+			// Not being able to cook only costs us the import again next time
+			std::cerr << e.what() << '\n';
+		}
+	}
+
+	// Imported and cooked bones are already parent first, so the compiled skeleton uses the mesh's bone indices
+	m_Skeleton.Compile(m_Mesh.bones);
+	if (!m_Skeleton.IsSourceOrder())
+		throw std::runtime_error("Mesh bones are not sorted parent first");
 
-	// Assign subset
-	for (auto& s : model.subset)
+	// Animation - every clip can be played, start with the first one we find
+	m_Animation.Create(m_Skeleton);
+	for (auto& animation : m_Mesh.animations)
 	{
-		DX::Subset subset = {};
-		subset.baseVertex = s.base_vertex;
-		subset.startIndex = s.start_index;
-		subset.totalIndex = s.total_index;
-		subset.transformation = s.transformation;
-		m_Mesh.subsets.push_back(subset);
+		animation.second.bake_rate = ANIMATION_BAKE_RATE;
+		m_AnimationClips[animation.first] = m_Animation.AddClip(animation.second, COMPRESS_ANIMATION);
 	}
 
-	// Assign bones
-	for (auto& b : model.bones)
+	m_Animation.AddInstance();
+	if (!m_Mesh.animations.empty())
 	{
-		DX::BoneInfo bone;
-		bone.name = b.name;
-		bone.parentName = b.parent_name;
-		bone.bind_pose = b.bind_pose;
-		bone.inverse_bind_pose = b.inverse_bind_pose;
-		bone.parentId = b.parent_id;
-		m_Mesh.bones.push_back(bone);
+		m_Animation.Play(0, 0, m_AnimationClips.begin()->second);
 	}
 
-	m_Mesh.animations = model.animations;
+	// Split the subsets by the bones they use, the GPU copy of the mesh has per draw bone indices
+	std::vector<DX::Vertex> vertices;
+	std::vector<UINT> indices;
+	DX::PartitionByBones(m_Geometry, m_Mesh.bones.size(), DX::MAX_PALETTE_BONES, vertices, indices, m_Partitions);
+
+	// Reorder for the GPU caches before uploading
+	Optimize(vertices, indices);
 
 	// Create buffers
-	CreateVertexBuffer();
-	CreateIndexBuffer();
+	CreateVertexBuffer(vertices);
+	CreateIndexBuffer(indices);
 }
 
-void DX::Model::Update(float dt)
+void DX::Model::Optimize(std::vector<DX::Vertex>& vertices, std::vector<UINT>& indices)
 {
-	// If there is no bones, set the bone buffer to an identity matrix so we can still view the model
-	if (m_Mesh.bones.empty())
+	for (size_t i = 0; i < m_Partitions.size(); ++i)
 	{
-		BoneBuffer bone_buffer = {};
-		bone_buffer.transform[0] = DirectX::XMMatrixIdentity();
-		m_DxShader->UpdateBoneConstantBuffer(bone_buffer);
-		return;
-	}
-
-	// https://stackoverflow.com/questions/62998968/how-do-i-calculate-the-start-matrix-for-each-bonet-pose-using-collada-and-ope
+		auto& partition = m_Partitions[i];
 
-	// Time to interpolate each frame between
-	static float time_in_seconds = 0.0f;
+		// Each partition's vertices run up to the next partition's
+		size_t vertex_end = i + 1 < m_Partitions.size() ? m_Partitions[i + 1].baseVertex : vertices.size();
+		size_t vertex_count = vertex_end - partition.baseVertex;
 
-	// Parent transforms
-	std::vector<DirectX::XMMATRIX> parent_transform(m_Mesh.bones.size());
+		UINT* partition_indices = indices.data() + partition.startIndex;
+		DX::Vertex* partition_vertices = vertices.data() + partition.baseVertex;
 
-	// Animation - Take the first one we find - we can also select the animation by name with "find"
-	auto clip = m_Mesh.animations.begin();
-	if (clip != m_Mesh.animations.end())
-	{
-		// Time to interpolate each frame between
-		time_in_seconds += dt * clip->second.ticks_per_second * 0.1f;
+		DX::OptimizeVertexCache(partition_indices, partition_indices, partition.totalIndex, vertex_count);
+		DX::OptimizeOverdraw(partition_indices, partition_indices, partition.totalIndex, &partition_vertices->x, vertex_count, sizeof(DX::Vertex));
 
-		clip->second.Interpolate(time_in_seconds, parent_transform);
-		if (time_in_seconds > clip->second.GetClipEndTime())
-		{
-			time_in_seconds = 0.0f;
-		}
-	}
-	else
-	{ 
-		// If there is no animation then set the parent transform to the default bind pose
-		for (size_t i = 0; i < m_Mesh.bones.size(); ++i)
-		{
-			parent_transform[i] = m_Mesh.bones[i].bind_pose;
-		}
+		// Vertices nothing draws are left at the end of the partition's range
+		DX::OptimizeVertexFetch(partition_vertices, partition_indices, partition.totalIndex, partition_vertices, vertex_count, sizeof(DX::Vertex));
 	}
+}
 
-	// Transform to root
-	std::vector<DirectX::XMMATRIX> local_transform(m_Mesh.bones.size());
-	local_transform[0] = parent_transform[0];
-	for (UINT i = 1; i < m_Mesh.bones.size(); ++i)
-	{
-		DirectX::XMMATRIX parent = parent_transform[i];
-		DirectX::XMMATRIX root = local_transform[m_Mesh.bones[i].parentId];
-		local_transform[i] = XMMatrixMultiply(parent, root);
-	}
+void DX::Model::Update(float dt)
+{
+	m_Animation.Update(dt);
+}
 
-	// Transform bone
-	BoneBuffer bone_buffer = {}; 
-	for (size_t i = 0; i < m_Mesh.bones.size(); i++)
+void DX::Model::PlayAnimation(const std::string& name, float fade_duration)
+{
+	auto clip = m_AnimationClips.find(name);
+	if (clip != m_AnimationClips.end())
 	{
-		DirectX::XMMATRIX inverse_bind_pose = m_Mesh.bones[i].inverse_bind_pose;
-		DirectX::XMMATRIX local = local_transform[i];
-		DirectX::XMMATRIX final_transform = DirectX::XMMatrixMultiply(inverse_bind_pose, local);
-
-		bone_buffer.transform[i] = DirectX::XMMatrixTranspose(final_transform);
+		m_Animation.Play(0, 0, clip->second, fade_duration);
 	}
+}
 
-	// Store final transform into bone buffer
-	m_DxShader->UpdateBoneConstantBuffer(bone_buffer);
+void DX::Model::GetSkinnedPositions(std::vector<DirectX::XMFLOAT3>& positions) const
+{
+	positions.resize(m_Geometry.vertex_count);
+	const auto& palette = m_Animation.GetPalette(0);
+	DX::SkinVertices(m_Geometry.vertices, m_Geometry.vertex_count, palette.data(), palette.size(), positions.data());
 }
 
-void DX::Model::CreateVertexBuffer()
+void DX::Model::CreateVertexBuffer(const std::vector<DX::Vertex>& vertices)
 {
 	auto d3dDevice = m_DxRenderer->GetDevice();
 
-	// Create index buffer
+	// Quantize the influences if asked to
+	std::vector<DX::PackedVertex> packed;
+	if (PACK_VERTICES)
+	{
+		packed.resize(vertices.size());
+		DX::PackVertices(vertices.data(), vertices.size(), packed.data());
+	}
+
+	m_VertexStride = PACK_VERTICES ? sizeof(DX::PackedVertex) : sizeof(DX::Vertex);
+
+	// Create vertex buffer
 	D3D11_BUFFER_DESC vertex_buffer_desc = {};
 	vertex_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(Vertex) * m_Mesh.vertices.size());
+	vertex_buffer_desc.ByteWidth = static_cast<UINT>(m_VertexStride * vertices.size());
 	vertex_buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 
 	D3D11_SUBRESOURCE_DATA vertex_subdata = {};
-	vertex_subdata.pSysMem = m_Mesh.vertices.data();
+	vertex_subdata.pSysMem = PACK_VERTICES ? static_cast<const void*>(packed.data()) : static_cast<const void*>(vertices.data());
 
 	DX::Check(d3dDevice->CreateBuffer(&vertex_buffer_desc, &vertex_subdata, m_d3dVertexBuffer.ReleaseAndGetAddressOf()));
 }
 
-void DX::Model::CreateIndexBuffer()
+void DX::Model::CreateIndexBuffer(const std::vector<UINT>& indices)
 {
 	auto d3dDevice = m_DxRenderer->GetDevice();
-	m_IndexCount = static_cast<UINT>(m_Mesh.indices.size());
+	m_IndexCount = static_cast<UINT>(indices.size());
 
 	// Create index buffer
 	D3D11_BUFFER_DESC index_buffer_desc = {};
 	index_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-	index_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(UINT) * m_Mesh.indices.size());
+	index_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(UINT) * indices.size());
 	index_buffer_desc.BindFlags = D3D11_BIND_INDEX_BUFFER;
 
 	D3D11_SUBRESOURCE_DATA index_subdata = {};
-	index_subdata.pSysMem = m_Mesh.indices.data();
+	index_subdata.pSysMem = indices.data();
 
 	DX::Check(d3dDevice->CreateBuffer(&index_buffer_desc, &index_subdata, m_d3dIndexBuffer.ReleaseAndGetAddressOf()));
 }
@@ -184,9 +191,12 @@ void DX::Model::Render(DX::Camera* camera)
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
 
 	// We need the stride and offset for the vertex
-	UINT vertex_stride = sizeof(Vertex);
+	UINT vertex_stride = m_VertexStride;
 	auto vertex_offset = 0u;
 
+	// Input layout has to match how the vertices were uploaded
+	m_DxShader->SetVertexFormat(PACK_VERTICES ? DX::VertexFormat::Packed : DX::VertexFormat::Full);
+
 	// Bind the vertex buffer to the pipeline's Input Assembler stage
 	d3dDeviceContext->IASetVertexBuffers(0, 1, m_d3dVertexBuffer.GetAddressOf(), &vertex_stride, &vertex_offset);
 
@@ -196,11 +206,17 @@ void DX::Model::Render(DX::Camera* camera)
 	// Bind the geometry topology to the pipeline's Input Assembler stage
 	d3dDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
+	const auto& skinning = m_Animation.GetPalette(0);
+
 	// Render all geometry
-	for (auto& subset : m_Mesh.subsets)
+	for (auto& partition : m_Partitions)
 	{
+		// Upload just the bones this draw uses
+		m_Palette.Build(skinning.data(), skinning.size(), partition.bones, PALETTE_FORMAT);
+		m_DxShader->UpdateBoneConstantBuffer(m_Palette);
+
 		// Set obj transformation
-		auto matrix = DirectX::XMMatrixMultiply(World, subset.transformation);
+		auto matrix = DirectX::XMMatrixMultiply(World, partition.transformation);
 
 		// Apply object transformation
 		DX::WorldBuffer world_buffer = {};
@@ -210,7 +226,7 @@ void DX::Model::Render(DX::Camera* camera)
 		m_DxShader->UpdateWorldConstantBuffer(world_buffer);
 
 		// Render object
-		d3dDeviceContext->DrawIndexed(subset.totalIndex, subset.startIndex, subset.baseVertex);
+		d3dDeviceContext->DrawIndexed(partition.totalIndex, partition.startIndex, partition.baseVertex);
 	}
 }
 
@@ -251,35 +267,43 @@ void DX::BoneAnimation::Interpolate(float t, DirectX::XMMATRIX& M)const
 	else
 	{
 		// Only want to interpolate between current frame and next frame determined by the frame time
-		for (UINT i = 0; i < Keyframes.size() - 1; ++i)
-		{
-			if (t >= Keyframes[i].TimePos && t <= Keyframes[i + 1].TimePos)
-			{
-				float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i + 1].TimePos - Keyframes[i].TimePos);
+		UINT i = FindKeyframe(t);
 
-				DirectX::XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
-				DirectX::XMVECTOR s1 = XMLoadFloat3(&Keyframes[i + 1].Scale);
+		float lerpPercent = (t - Keyframes[i].TimePos) / (Keyframes[i + 1].TimePos - Keyframes[i].TimePos);
 
-				DirectX::XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
-				DirectX::XMVECTOR p1 = XMLoadFloat3(&Keyframes[i + 1].Translation);
+		DirectX::XMVECTOR s0 = XMLoadFloat3(&Keyframes[i].Scale);
+		DirectX::XMVECTOR s1 = XMLoadFloat3(&Keyframes[i + 1].Scale);
 
-				DirectX::XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
-				DirectX::XMVECTOR q1 = XMLoadFloat4(&Keyframes[i + 1].RotationQuat);
+		DirectX::XMVECTOR p0 = XMLoadFloat3(&Keyframes[i].Translation);
+		DirectX::XMVECTOR p1 = XMLoadFloat3(&Keyframes[i + 1].Translation);
 
-				DirectX::XMVECTOR S = DirectX::XMVectorLerp(s0, s1, lerpPercent);
-				DirectX::XMVECTOR P = DirectX::XMVectorLerp(p0, p1, lerpPercent);
-				DirectX::XMVECTOR Q = DirectX::XMQuaternionSlerp(q0, q1, lerpPercent);
+		DirectX::XMVECTOR q0 = XMLoadFloat4(&Keyframes[i].RotationQuat);
+		DirectX::XMVECTOR q1 = XMLoadFloat4(&Keyframes[i + 1].RotationQuat);
 
-				DirectX::XMVECTOR zero = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-				M = DirectX::XMMatrixAffineTransformation(S, zero, Q, P);
+		DirectX::XMVECTOR S = DirectX::XMVectorLerp(s0, s1, lerpPercent);
+		DirectX::XMVECTOR P = DirectX::XMVectorLerp(p0, p1, lerpPercent);
+		DirectX::XMVECTOR Q = DirectX::XMQuaternionSlerp(q0, q1, lerpPercent);
 
-				// Exit early as we have found the frame to interpolate between
-				break;
-			}
-		}
+		DirectX::XMVECTOR zero = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+		M = DirectX::XMMatrixAffineTransformation(S, zero, Q, P);
 	}
 }
 
+UINT DX::BoneAnimation::FindKeyframe(float t) const
+{
+	// Only called with front < t < back so there are always at least two keys
+	const UINT last = static_cast<UINT>(Keyframes.size()) - 2;
+
+	// First key after t
+	auto next = std::upper_bound(Keyframes.begin(), Keyframes.end(), t, [](float time, const DX::Keyframe& keyframe)
+	{
+		return time < keyframe.TimePos;
+	});
+
+	UINT index = static_cast<UINT>(next - Keyframes.begin());
+	return std::clamp<UINT>(index, 1, last + 1) - 1;
+}
+
 void DX::BoneAnimation::Frame(int frame, DirectX::XMMATRIX& bone_transforms) const
 {
 	frame = std::clamp<int>(frame, 1, static_cast<int>(Keyframes.size())) - 1;
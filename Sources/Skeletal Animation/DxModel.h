@@ -2,13 +2,18 @@
 
 #include "DxRenderer.h"
 #include <vector>
+#include <cstdint>
 #include <DirectXColors.h>
 #include <DirectXMath.h>
 #include "DxShader.h"
 #include <cmath>
 #include <map>
 #include <string>
+#include <filesystem>
+#include <memory>
 #include "DxCamera.h"
+#include "DxAnimationSystem.h"
+#include "DxBonePalette.h"
 
 #undef min
 #include <assimp/Importer.hpp>
@@ -18,6 +23,8 @@
 
 namespace DX
 {
+	class MeshCache;
+
 	struct Colour
 	{
 		float r = 0;
@@ -43,6 +50,20 @@ namespace DX
 		int bone[4] = { 0, 0, 0, 0 };
 	};
 
+	// Vertex as uploaded when influences are packed, 36 bytes instead of 60. Bone indices are a byte
+	// each so they must be local to a partition, weights are unorm bytes that sum to 255
+	struct PackedVertex
+	{
+		float x = 0;
+		float y = 0;
+		float z = 0;
+
+		Colour colour = {};
+
+		uint8_t bone[4] = { 0, 0, 0, 0 };
+		uint8_t weight[4] = { 0, 0, 0, 0 };
+	};
+
 	///<summary>
 	/// A Keyframe defines the bone transformation at an instant in time.
 	///</summary>
@@ -73,6 +94,9 @@ namespace DX
 
 		void Frame(int frame, DirectX::XMMATRIX& bone_transforms) const;
 
+		// Index of the keyframe that starts the span containing t, by binary search
+		UINT FindKeyframe(float t) const;
+
 		std::vector<Keyframe> Keyframes;
 	};
 
@@ -94,6 +118,10 @@ namespace DX
 		std::map<std::string, DX::BoneAnimation> BoneAnimationsMap;
 
 		float ticks_per_second = 0;
+
+		// Frames per second of playback to bake the clip into the animation system's pose cache at.
+		// 0 samples the clip every update instead
+		float bake_rate = 0;
 	};
 
 	struct BoneInfo
@@ -116,6 +144,19 @@ namespace DX
 		DirectX::XMMATRIX transformation;
 	};
 
+	// Read-only view of a mesh's vertices, indices and subsets, wherever they are stored
+	struct MeshGeometry
+	{
+		const Vertex* vertices = nullptr;
+		size_t vertex_count = 0;
+
+		const UINT* indices = nullptr;
+		size_t index_count = 0;
+
+		const Subset* subsets = nullptr;
+		size_t subset_count = 0;
+	};
+
 	struct Mesh
 	{
 		std::vector<Vertex> vertices;
@@ -124,13 +165,15 @@ namespace DX
 		std::map<std::string, BoneInfo> bonemap;
 		std::map<std::string, AnimationClip> animations;
 		std::vector<Subset> subsets;
+
+		MeshGeometry GetGeometry() const { return { vertices.data(), vertices.size(), indices.data(), indices.size(), subsets.data(), subsets.size() }; }
 	};
 
 	class Model
 	{
 	public:
 		Model(DX::Renderer* renderer, DX::Shader* shader);
-		virtual ~Model() = default;
+		virtual ~Model();
 
 		// Create device
 		void Create();
@@ -141,6 +184,12 @@ namespace DX
 		// Render the model
 		void Render(DX::Camera* camera);
 
+		// Cross-fade to one of the model's animations
+		void PlayAnimation(const std::string& name, float fade_duration);
+
+		// Vertex positions in the current pose, skinned on the CPU
+		void GetSkinnedPositions(std::vector<DirectX::XMFLOAT3>& positions) const;
+
 		// World 
 		DirectX::XMMATRIX World;
 
@@ -148,19 +197,40 @@ namespace DX
 		DX::Renderer* m_DxRenderer = nullptr;
 		DX::Shader* m_DxShader = nullptr;
 
-		// Mesh data
+		// Mesh data. The geometry is the mesh's own when it was imported, or the mapped cache's
 		DX::Mesh m_Mesh;
+		DX::MeshGeometry m_Geometry;
+		std::unique_ptr<DX::MeshCache> m_MeshCache;
+
+		// Bones sorted parent first
+		DX::Skeleton m_Skeleton;
+
+		// Plays the model's clips, looked up by animation name
+		DX::AnimationSystem m_Animation;
+		std::map<std::string, UINT> m_AnimationClips;
+
+		// Draws, split so each uses no more bones than the shader palette holds
+		std::vector<DX::BonePartition> m_Partitions;
+
+		// Palette of the draw being rendered
+		DX::BonePalette m_Palette;
+
+		// Reorder each partition's triangles and vertices for the vertex cache, overdraw and vertex fetch
+		void Optimize(std::vector<DX::Vertex>& vertices, std::vector<UINT>& indices);
 
 		// Number of indices to draw
 		UINT m_IndexCount = 0;
 
+		// Size of a vertex in the vertex buffer, full or packed
+		UINT m_VertexStride = sizeof(DX::Vertex);
+
 		// Vertex buffer
 		ComPtr<ID3D11Buffer> m_d3dVertexBuffer = nullptr;
 		ComPtr<ID3D11Buffer> m_d3dBoneVertexBuffer = nullptr;
-		void CreateVertexBuffer();
+		void CreateVertexBuffer(const std::vector<DX::Vertex>& vertices);
 
 		// Index buffer
 		ComPtr<ID3D11Buffer> m_d3dIndexBuffer = nullptr;
-		void CreateIndexBuffer();
+		void CreateIndexBuffer(const std::vector<UINT>& indices);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "DxPose.h"
+#include <algorithm>
+
+namespace
+{
+	// Bone transforms per arena block. A block holds several poses of a large skeleton
+	constexpr size_t ARENA_BLOCK_SIZE = 4096;
+
+	// Normalised lerp along the shortest arc. Close enough to slerp for blending poses and much cheaper
+	DirectX::XMVECTOR BlendRotation(DirectX::FXMVECTOR from, DirectX::FXMVECTOR to, float weight)
+	{
+		DirectX::XMVECTOR target = to;
+		if (DirectX::XMVectorGetX(DirectX::XMQuaternionDot(from, to)) < 0.0f)
+		{
+			target = DirectX::XMVectorNegate(to);
+		}
+
+		return DirectX::XMQuaternionNormalize(DirectX::XMVectorLerp(from, target, weight));
+	}
+}
+
+DX::BoneTransform* DX::PoseArena::Allocate(size_t count)
+{
+	// Carry on through the blocks kept from earlier frames
+	while (m_Block < m_Blocks.size())
+	{
+		auto& block = m_Blocks[m_Block];
+		if (m_Offset + count <= block.size())
+		{
+			DX::BoneTransform* transforms = block.data() + m_Offset;
+			m_Offset += count;
+			return transforms;
+		}
+
+		m_Block++;
+		m_Offset = 0;
+	}
+
+	// Out of space - grow. Moving the blocks doesn't move the memory they own
+	m_Blocks.emplace_back(std::max(count, ARENA_BLOCK_SIZE));
+	m_Block = m_Blocks.size() - 1;
+	m_Offset = count;
+
+	return m_Blocks.back().data();
+}
+
+void DX::PoseArena::Reset()
+{
+	m_Block = 0;
+	m_Offset = 0;
+}
+
+void DX::BlendPoses(const DX::BoneTransform* from, const DX::BoneTransform* to, float weight, const float* mask, size_t count, DX::BoneTransform* output)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		float bone_weight = mask != nullptr ? weight * mask[i] : weight;
+
+		// Exact at the ends, so a full weight layer reproduces its clip
+		if (bone_weight <= 0.0f)
+		{
+			output[i] = from[i];
+			continue;
+		}
+
+		if (bone_weight >= 1.0f)
+		{
+			output[i] = to[i];
+			continue;
+		}
+
+		output[i].translation = DirectX::XMVectorLerp(from[i].translation, to[i].translation, bone_weight);
+		output[i].rotation = BlendRotation(from[i].rotation, to[i].rotation, bone_weight);
+		output[i].scale = DirectX::XMVectorLerp(from[i].scale, to[i].scale, bone_weight);
+	}
+}
+
+void DX::AddPoses(const DX::BoneTransform* base, const DX::BoneTransform* pose, const DX::BoneTransform* reference, float weight, const float* mask, size_t count, DX::BoneTransform* output)
+{
+	DirectX::XMVECTOR identity = DirectX::XMQuaternionIdentity();
+	DirectX::XMVECTOR one = DirectX::XMVectorSplatOne();
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		float bone_weight = mask != nullptr ? weight * mask[i] : weight;
+
+		// Difference from the reference pose, scaled by the weight
+		DirectX::XMVECTOR translation = DirectX::XMVectorSubtract(pose[i].translation, reference[i].translation);
+		DirectX::XMVECTOR rotation = DirectX::XMQuaternionMultiply(DirectX::XMQuaternionInverse(reference[i].rotation), pose[i].rotation);
+		DirectX::XMVECTOR scale = DirectX::XMVectorDivide(pose[i].scale, reference[i].scale);
+
+		rotation = BlendRotation(identity, rotation, bone_weight);
+		scale = DirectX::XMVectorLerp(one, scale, bone_weight);
+
+		output[i].translation = DirectX::XMVectorMultiplyAdd(translation, DirectX::XMVectorReplicate(bone_weight), base[i].translation);
+		output[i].rotation = DirectX::XMQuaternionNormalize(DirectX::XMQuaternionMultiply(base[i].rotation, rotation));
+		output[i].scale = DirectX::XMVectorMultiply(base[i].scale, scale);
+	}
+}
+
+void DX::ComposePose(const DX::BoneTransform* pose, size_t count, DirectX::XMMATRIX* output)
+{
+	DirectX::XMVECTOR zero = DirectX::XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+	for (size_t i = 0; i < count; ++i)
+	{
+		output[i] = DirectX::XMMatrixAffineTransformation(pose[i].scale, zero, pose[i].rotation, pose[i].translation);
+	}
+}
+
+DX::BoneTransform DX::DecomposeTransform(DirectX::FXMMATRIX transform)
+{
+	DX::BoneTransform bone;
+	if (!DirectX::XMMatrixDecompose(&bone.scale, &bone.rotation, &bone.translation, transform))
+	{
+		bone.translation = transform.r[3];
+		bone.rotation = DirectX::XMQuaternionIdentity();
+		bone.scale = DirectX::XMVectorSplatOne();
+	}
+
+	return bone;
+}
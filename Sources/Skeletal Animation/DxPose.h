@@ -0,0 +1,47 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <vector>
+
+namespace DX
+{
+	// Bone space transform kept as its parts so poses can be blended before any matrix is built
+	struct BoneTransform
+	{
+		DirectX::XMVECTOR translation;
+		DirectX::XMVECTOR rotation;
+		DirectX::XMVECTOR scale;
+	};
+
+	// Scratch poses for a single frame. Allocation bumps an offset and Reset hands everything back at
+	// once, so after the first few frames have grown the arena it never touches the heap again
+	class PoseArena
+	{
+	public:
+		PoseArena() = default;
+		virtual ~PoseArena() = default;
+
+		// Uninitialised space for count bone transforms, valid until the next Reset
+		DX::BoneTransform* Allocate(size_t count);
+
+		// Reclaim every allocation
+		void Reset();
+
+	private:
+		std::vector<std::vector<DX::BoneTransform>> m_Blocks;
+		size_t m_Block = 0;
+		size_t m_Offset = 0;
+	};
+
+	// Blend from one pose towards another. Mask scales the weight per bone and may be null
+	void BlendPoses(const DX::BoneTransform* from, const DX::BoneTransform* to, float weight, const float* mask, size_t count, DX::BoneTransform* output);
+
+	// Add the difference between pose and reference on top of base. Mask scales the weight per bone and may be null
+	void AddPoses(const DX::BoneTransform* base, const DX::BoneTransform* pose, const DX::BoneTransform* reference, float weight, const float* mask, size_t count, DX::BoneTransform* output);
+
+	// Build the bone space matrices of a pose
+	void ComposePose(const DX::BoneTransform* pose, size_t count, DirectX::XMMATRIX* output);
+
+	// Split a bone space matrix into its parts
+	DX::BoneTransform DecomposeTransform(DirectX::FXMMATRIX transform);
+}
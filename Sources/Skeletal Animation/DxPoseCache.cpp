@@ -0,0 +1,104 @@
+#include "DxPoseCache.h"
+#include <algorithm>
+
+DirectX::XMFLOAT4X3* DX::PoseCache::Allocate(UINT clip, UINT frame_count, UINT bone_count, float frame_interval, uint64_t stamp)
+{
+	if (clip >= m_Entries.size())
+	{
+		m_Entries.resize(clip + 1);
+	}
+
+	Evict(clip);
+
+	const size_t size = static_cast<size_t>(frame_count) * bone_count * sizeof(DirectX::XMFLOAT4X3);
+	if (size == 0 || size > m_Budget)
+		return nullptr;
+
+	// Give up before evicting anything if the clips used this frame leave too little room
+	size_t in_use = 0;
+	for (auto& entry : m_Entries)
+	{
+		if (entry.last_used >= stamp)
+		{
+			in_use += entry.frames.size() * sizeof(DirectX::XMFLOAT4X3);
+		}
+	}
+
+	if (in_use + size > m_Budget)
+		return nullptr;
+
+	// Make room, least recently used first. Clips used this frame are never evicted
+	while (m_Usage + size > m_Budget)
+	{
+		Entry* oldest = nullptr;
+		for (auto& entry : m_Entries)
+		{
+			if (!entry.frames.empty() && entry.last_used < stamp && (oldest == nullptr || entry.last_used < oldest->last_used))
+			{
+				oldest = &entry;
+			}
+		}
+
+		if (oldest == nullptr)
+			return nullptr;
+
+		Evict(static_cast<UINT>(oldest - m_Entries.data()));
+	}
+
+	Entry& entry = m_Entries[clip];
+	entry.frames.resize(static_cast<size_t>(frame_count) * bone_count);
+	entry.frame_count = frame_count;
+	entry.bone_count = bone_count;
+	entry.frame_interval = frame_interval;
+	entry.last_used = stamp;
+
+	m_Usage += size;
+	return entry.frames.data();
+}
+
+void DX::PoseCache::Sample(UINT clip, float time, DirectX::XMMATRIX* palette) const
+{
+	const Entry& entry = m_Entries[clip];
+
+	// Frames either side of the time
+	float position = std::max(time, 0.0f) / entry.frame_interval;
+	UINT frame = std::min(static_cast<UINT>(position), entry.frame_count - 1);
+	UINT next = std::min(frame + 1, entry.frame_count - 1);
+	float weight = std::min(position - static_cast<float>(frame), 1.0f);
+
+	const DirectX::XMFLOAT4X3* from = &entry.frames[static_cast<size_t>(frame) * entry.bone_count];
+	const DirectX::XMFLOAT4X3* to = &entry.frames[static_cast<size_t>(next) * entry.bone_count];
+
+	// Frames are close enough together that lerping the matrices stays near rigid
+	for (UINT i = 0; i < entry.bone_count; ++i)
+	{
+		DirectX::XMMATRIX a = DirectX::XMLoadFloat4x3(&from[i]);
+		DirectX::XMMATRIX b = DirectX::XMLoadFloat4x3(&to[i]);
+
+		palette[i].r[0] = DirectX::XMVectorLerp(a.r[0], b.r[0], weight);
+		palette[i].r[1] = DirectX::XMVectorLerp(a.r[1], b.r[1], weight);
+		palette[i].r[2] = DirectX::XMVectorLerp(a.r[2], b.r[2], weight);
+		palette[i].r[3] = DirectX::XMVectorLerp(a.r[3], b.r[3], weight);
+	}
+}
+
+void DX::PoseCache::Evict(UINT clip)
+{
+	if (clip >= m_Entries.size())
+		return;
+
+	Entry& entry = m_Entries[clip];
+	m_Usage -= entry.frames.size() * sizeof(DirectX::XMFLOAT4X3);
+
+	// Hand the memory back rather than keeping the capacity around
+	std::vector<DirectX::XMFLOAT4X3>().swap(entry.frames);
+	entry.frame_count = 0;
+}
+
+void DX::PoseCache::Clear()
+{
+	for (UINT i = 0; i < m_Entries.size(); ++i)
+	{
+		Evict(i);
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// Skinning palettes of whole clips baked at a fixed rate and shared by every instance playing them.
+	// Playback lerps between the two frames either side of the time. The cache has a memory budget, when
+	// a clip doesn't fit the clips that have gone unused the longest are evicted to make room
+	class PoseCache
+	{
+	public:
+		PoseCache() = default;
+		virtual ~PoseCache() = default;
+
+		// Bytes of frames the cache may hold. Lowering the budget evicts on the next allocation
+		void SetBudget(size_t bytes) { m_Budget = bytes; }
+		size_t GetBudget() const { return m_Budget; }
+
+		// Bytes of frames held
+		size_t GetMemoryUsage() const { return m_Usage; }
+
+		// Space for a clip's frames, frame_count palettes of bone_count bones taken frame_interval clip time
+		// apart. Clips last used before stamp are evicted to make room. Returns null if the clip doesn't
+		// fit even then, without evicting anything, and the clip should be sampled as usual
+		DirectX::XMFLOAT4X3* Allocate(UINT clip, UINT frame_count, UINT bone_count, float frame_interval, uint64_t stamp);
+
+		// Whether a clip's frames are held
+		bool IsBaked(UINT clip) const { return clip < m_Entries.size() && !m_Entries[clip].frames.empty(); }
+
+		// Mark a baked clip as used, so it is the last to be evicted
+		void Touch(UINT clip, uint64_t stamp) { m_Entries[clip].last_used = stamp; }
+
+		// Palette of a baked clip at a time, lerped between the nearest two frames
+		void Sample(UINT clip, float time, DirectX::XMMATRIX* palette) const;
+
+		// Drop one clip or all of them
+		void Evict(UINT clip);
+		void Clear();
+
+	private:
+		struct Entry
+		{
+			// Frame f is bone_count row-vector matrices starting at frames[f * bone_count]
+			std::vector<DirectX::XMFLOAT4X3> frames;
+			UINT frame_count = 0;
+			UINT bone_count = 0;
+			float frame_interval = 0.0f;
+
+			uint64_t last_used = 0;
+		};
+
+		std::vector<Entry> m_Entries;
+		size_t m_Budget = 0;
+		size_t m_Usage = 0;
+	};
+}
@@ -1,6 +1,14 @@
 #include "DxShader.h"
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+	// Size of the bone constant buffer, room for the largest palette in the largest format
+	constexpr size_t BONE_BUFFER_SIZE = sizeof(DX::BoneBufferHeader) + DX::MAX_PALETTE_BONES * 3 * sizeof(DirectX::XMFLOAT4);
+}
 
 DX::Shader::Shader(Renderer* renderer) : m_DxRenderer(renderer)
 {
@@ -25,11 +33,23 @@ void DX::Shader::LoadVertexShader(std::string&& vertex_shader_path)
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "COLOUR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 		{ "WEIGHT", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "BONE", 0, DXGI_FORMAT_R32G32B32A32_SINT, 0, 44, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+		{ "BONE", 0, DXGI_FORMAT_R32G32B32A32_UINT, 0, 44, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 	};
 
 	UINT numElements = ARRAYSIZE(layout);
 	DX::Check(d3dDevice->CreateInputLayout(layout, numElements, data.data(), data.size(), m_d3dVertexLayout.ReleaseAndGetAddressOf()));
+
+	// Same shader input, with bytes for the bones and weights. The input assembler widens them
+	D3D11_INPUT_ELEMENT_DESC packed_layout[] =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "COLOUR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "BONE", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "WEIGHT", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+	};
+
+	numElements = ARRAYSIZE(packed_layout);
+	DX::Check(d3dDevice->CreateInputLayout(packed_layout, numElements, data.data(), data.size(), m_d3dPackedVertexLayout.ReleaseAndGetAddressOf()));
 }
 
 void DX::Shader::LoadPixelShader(std::string&& pixel_shader_path)
@@ -49,7 +69,7 @@ void DX::Shader::Use()
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
 
 	// Bind the input layout to the pipeline's Input Assembler stage
-	d3dDeviceContext->IASetInputLayout(m_d3dVertexLayout.Get());
+	d3dDeviceContext->IASetInputLayout(m_VertexFormat == VertexFormat::Packed ? m_d3dPackedVertexLayout.Get() : m_d3dVertexLayout.Get());
 
 	// Bind the vertex shader to the pipeline's Vertex Shader stage
 	d3dDeviceContext->VSSetShader(m_d3dVertexShader.Get(), nullptr, 0);
@@ -64,16 +84,36 @@ void DX::Shader::Use()
 	d3dDeviceContext->VSSetConstantBuffers(1, 1, m_d3dBoneConstantBuffer.GetAddressOf());
 }
 
+void DX::Shader::SetVertexFormat(VertexFormat format)
+{
+	m_VertexFormat = format;
+
+	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
+	d3dDeviceContext->IASetInputLayout(format == VertexFormat::Packed ? m_d3dPackedVertexLayout.Get() : m_d3dVertexLayout.Get());
+}
+
 void DX::Shader::UpdateWorldConstantBuffer(const WorldBuffer& worldBuffer)
 {
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
 	d3dDeviceContext->UpdateSubresource(m_d3dWorldConstantBuffer.Get(), 0, nullptr, &worldBuffer, 0, 0);
 }
 
-void DX::Shader::UpdateBoneConstantBuffer(const BoneBuffer& buffer)
+void DX::Shader::UpdateBoneConstantBuffer(const DX::BonePalette& palette)
 {
+	if (sizeof(BoneBufferHeader) + palette.GetSize() > BONE_BUFFER_SIZE)
+		throw std::runtime_error("Bone palette is larger than the bone constant buffer");
+
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
-	d3dDeviceContext->UpdateSubresource(m_d3dBoneConstantBuffer.Get(), 0, nullptr, &buffer, 0, 0);
+
+	BoneBufferHeader header;
+	header.format = static_cast<UINT>(palette.GetFormat());
+
+	// Discard and write just the bones in use, the rest of the buffer is never read
+	D3D11_MAPPED_SUBRESOURCE resource = {};
+	DX::Check(d3dDeviceContext->Map(m_d3dBoneConstantBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &resource));
+	std::memcpy(resource.pData, &header, sizeof(BoneBufferHeader));
+	std::memcpy(static_cast<uint8_t*>(resource.pData) + sizeof(BoneBufferHeader), palette.GetData(), palette.GetSize());
+	d3dDeviceContext->Unmap(m_d3dBoneConstantBuffer.Get(), 0);
 }
 
 void DX::Shader::CreateWorldConstantBuffer()
@@ -93,11 +133,12 @@ void DX::Shader::CreateBoneConstantBuffer()
 {
 	auto d3dDevice = m_DxRenderer->GetDevice();
 
-	// Create world constant buffer
+	// Create bone constant buffer, written with Map every draw
 	D3D11_BUFFER_DESC bd = {};
-	bd.Usage = D3D11_USAGE_DEFAULT;
-	bd.ByteWidth = sizeof(BoneBuffer);
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = static_cast<UINT>(BONE_BUFFER_SIZE);
 	bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 
 	DX::Check(d3dDevice->CreateBuffer(&bd, nullptr, m_d3dBoneConstantBuffer.ReleaseAndGetAddressOf()));
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DxRenderer.h"
+#include "DxBonePalette.h"
 #include <DirectXMath.h>
 #include <string>
 
@@ -13,9 +14,18 @@ namespace DX
 		DirectX::XMMATRIX projection;
 	};
 
-	struct BoneBuffer
+	// Start of the bone constant buffer, the packed palette follows it
+	struct BoneBufferHeader
 	{
-		DirectX::XMMATRIX transform[96];
+		UINT format = 0;
+		UINT padding[3] = {};
+	};
+
+	// Vertex layouts the vertex shader can read, DX::Vertex or DX::PackedVertex
+	enum class VertexFormat
+	{
+		Full,
+		Packed
 	};
 
 	class Shader
@@ -33,11 +43,14 @@ namespace DX
 		// Bind the shader to the pipeline
 		void Use();
 
+		// Pick the input layout for the vertices being drawn
+		void SetVertexFormat(VertexFormat format);
+
 		// Set world constant buffer from camera
 		void UpdateWorldConstantBuffer(const WorldBuffer& worldBuffer);
 
-		// Set bone constant buffer from camera
-		void UpdateBoneConstantBuffer(const BoneBuffer& buffer);
+		// Set bone constant buffer from a packed palette, only the bones in the palette are copied
+		void UpdateBoneConstantBuffer(const DX::BonePalette& palette);
 
 	private:
 		Renderer* m_DxRenderer = nullptr;
@@ -45,8 +58,10 @@ namespace DX
 		// Vertex shader
 		ComPtr<ID3D11VertexShader> m_d3dVertexShader = nullptr;
 
-		// Vertex shader input layout
+		// Vertex shader input layouts, full and packed
 		ComPtr<ID3D11InputLayout> m_d3dVertexLayout = nullptr;
+		ComPtr<ID3D11InputLayout> m_d3dPackedVertexLayout = nullptr;
+		VertexFormat m_VertexFormat = VertexFormat::Full;
 
 		// Pixel shader
 		ComPtr<ID3D11PixelShader> m_d3dPixelShader = nullptr;
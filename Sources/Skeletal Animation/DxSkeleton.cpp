@@ -0,0 +1,168 @@
+#include "DxSkeleton.h"
+#include "DxModel.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+void DX::Skeleton::Compile(const std::vector<DX::BoneInfo>& bones)
+{
+	const size_t bone_count = bones.size();
+	if (bone_count > static_cast<size_t>(std::numeric_limits<int16_t>::max()))
+		throw std::runtime_error("Skeleton has too many bones for 16 bit parent indices");
+
+	// Children of every bone as one flat array, counted then filled, so the sort stays linear
+	std::vector<UINT> child_start(bone_count + 1, 0);
+	std::vector<UINT> roots;
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		int parent = bones[i].parentId;
+		if (parent < 0 || parent == static_cast<int>(i))
+		{
+			roots.push_back(static_cast<UINT>(i));
+			continue;
+		}
+
+		if (parent >= static_cast<int>(bone_count))
+			throw std::runtime_error("Bone " + bones[i].name + " has a parent outside the skeleton");
+
+		child_start[parent + 1]++;
+	}
+
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		child_start[i + 1] += child_start[i];
+	}
+
+	std::vector<UINT> children(child_start[bone_count]);
+	std::vector<UINT> child_fill(child_start.begin(), child_start.end() - 1);
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		int parent = bones[i].parentId;
+		if (parent >= 0 && parent != static_cast<int>(i))
+		{
+			children[child_fill[parent]++] = static_cast<UINT>(i);
+		}
+	}
+
+	// Depth first from each root keeps every subtree contiguous. Bones in a cycle are never reached
+	m_Order.clear();
+	m_Order.reserve(bone_count);
+
+	std::vector<UINT> stack;
+	for (UINT root : roots)
+	{
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			UINT bone = stack.back();
+			stack.pop_back();
+			m_Order.push_back(bone);
+
+			// Pushed in reverse so children come out in their source order
+			for (UINT c = child_start[bone + 1]; c > child_start[bone]; --c)
+			{
+				stack.push_back(children[c - 1]);
+			}
+		}
+	}
+
+	if (m_Order.size() != bone_count)
+		throw std::runtime_error("Skeleton hierarchy has a cycle");
+
+	m_Remap.assign(bone_count, 0);
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		m_Remap[m_Order[i]] = static_cast<UINT>(i);
+	}
+
+	// Fill the compiled arrays
+	m_Parents.resize(bone_count);
+	m_BindPose.resize(bone_count);
+	m_InverseBindPoses.resize(bone_count);
+	m_Names.resize(bone_count);
+	for (size_t i = 0; i < bone_count; ++i)
+	{
+		const DX::BoneInfo& bone = bones[m_Order[i]];
+
+		bool root = bone.parentId < 0 || bone.parentId == static_cast<int>(m_Order[i]);
+		m_Parents[i] = root ? -1 : static_cast<int16_t>(m_Remap[bone.parentId]);
+		m_BindPose[i] = DX::DecomposeTransform(bone.bind_pose);
+		m_InverseBindPoses[i] = bone.inverse_bind_pose;
+		m_Names[i] = bone.name;
+	}
+
+	Validate();
+}
+
+void DX::Skeleton::Remap(DX::Mesh& mesh) const
+{
+	if (mesh.bones.size() != m_Order.size())
+		throw std::runtime_error("Mesh bones don't match the compiled skeleton");
+
+	if (IsSourceOrder())
+	{
+		// Only the root convention can differ
+		for (size_t i = 0; i < mesh.bones.size(); ++i)
+		{
+			mesh.bones[i].parentId = m_Parents[i];
+		}
+
+		return;
+	}
+
+	std::vector<DX::BoneInfo> bones(mesh.bones.size());
+	for (size_t i = 0; i < bones.size(); ++i)
+	{
+		bones[i] = std::move(mesh.bones[m_Order[i]]);
+		bones[i].parentId = m_Parents[i];
+	}
+
+	mesh.bones = std::move(bones);
+
+	for (auto& vertex : mesh.vertices)
+	{
+		for (int& bone : vertex.bone)
+		{
+			if (bone >= 0 && static_cast<size_t>(bone) < m_Remap.size())
+			{
+				bone = static_cast<int>(m_Remap[bone]);
+			}
+		}
+	}
+
+	// Tracks follow their bones. Bones a clip had no track for get an empty one
+	for (auto& animation : mesh.animations)
+	{
+		auto& tracks = animation.second.BoneAnimations;
+
+		std::vector<DX::BoneAnimation> sorted(std::max(tracks.size(), m_Remap.size()));
+		for (size_t i = 0; i < tracks.size(); ++i)
+		{
+			size_t target = i < m_Remap.size() ? m_Remap[i] : i;
+			sorted[target] = std::move(tracks[i]);
+		}
+
+		tracks = std::move(sorted);
+	}
+}
+
+bool DX::Skeleton::IsSourceOrder() const
+{
+	for (size_t i = 0; i < m_Order.size(); ++i)
+	{
+		if (m_Order[i] != i)
+			return false;
+	}
+
+	return true;
+}
+
+void DX::Skeleton::Validate() const
+{
+	for (size_t i = 0; i < m_Parents.size(); ++i)
+	{
+		if (m_Parents[i] >= static_cast<int>(i))
+			throw std::runtime_error("Bone " + m_Names[i] + " comes before its parent");
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "DxRenderer.h"
+#include "DxPose.h"
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	struct BoneInfo;
+	struct Mesh;
+
+	// Skeleton compiled for pose evaluation. Bones are sorted so every parent comes before its children,
+	// which turns building model space transforms into a single forward pass. Parents are kept as a compact
+	// int16 array, -1 for a root, and names are kept apart from the data touched every frame
+	class Skeleton
+	{
+	public:
+		Skeleton() = default;
+		virtual ~Skeleton() = default;
+
+		// Sort and validate bones in any order. A bone is a root when its parent is negative or itself.
+		// Throws if a parent is out of range or the hierarchy has a cycle
+		void Compile(const std::vector<DX::BoneInfo>& bones);
+
+		// Put a mesh's bones, vertex bone indices and animation tracks into the compiled order
+		void Remap(DX::Mesh& mesh) const;
+
+		// Bone data in compiled order
+		size_t GetBoneCount() const { return m_Parents.size(); }
+		const std::vector<int16_t>& GetParents() const { return m_Parents; }
+		const std::vector<DX::BoneTransform>& GetBindPose() const { return m_BindPose; }
+		const std::vector<DirectX::XMMATRIX>& GetInverseBindPoses() const { return m_InverseBindPoses; }
+		const std::vector<std::string>& GetNames() const { return m_Names; }
+
+		// Compiled index of a bone given in the order passed to Compile
+		UINT GetCompiledIndex(UINT source_index) const { return m_Remap[source_index]; }
+
+		// True when Compile didn't have to move any bone
+		bool IsSourceOrder() const;
+
+	private:
+		// Hot data, read every pose evaluation
+		std::vector<int16_t> m_Parents;
+		std::vector<DX::BoneTransform> m_BindPose;
+		std::vector<DirectX::XMMATRIX> m_InverseBindPoses;
+
+		// Cold data
+		std::vector<std::string> m_Names;
+
+		// Source index of each compiled bone, and the reverse
+		std::vector<UINT> m_Order;
+		std::vector<UINT> m_Remap;
+
+		// Check that every parent comes before its child
+		void Validate() const;
+	};
+}
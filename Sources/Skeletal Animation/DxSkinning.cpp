@@ -0,0 +1,111 @@
+#include "DxSkinning.h"
+#include "DxModel.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace
+{
+	// Vertices skinned by a single job. Enough work to be worth handing to another thread
+	constexpr size_t VERTICES_PER_JOB = 4096;
+
+	// Bone a vertex influence reads. Out of range indices fall back to the first bone rather than reading
+	// past the palette
+	size_t BoneIndex(int bone, size_t bone_count)
+	{
+		return static_cast<size_t>(bone) < bone_count ? static_cast<size_t>(bone) : 0;
+	}
+}
+
+void DX::SkinVertices(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output)
+{
+	if (count <= VERTICES_PER_JOB)
+	{
+		DX::SkinVertexRange(vertices, count, palette, bone_count, output);
+		return;
+	}
+
+	// Vertices are independent so each job takes its own range
+	size_t job_count = (count + VERTICES_PER_JOB - 1) / VERTICES_PER_JOB;
+	ThreadPool::Get().ParallelFor(job_count, [&](size_t job)
+	{
+		size_t start = job * VERTICES_PER_JOB;
+		size_t end = std::min(start + VERTICES_PER_JOB, count);
+		DX::SkinVertexRange(vertices + start, end - start, palette, bone_count, output + start);
+	});
+}
+
+void DX::SkinVertexRange(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const DX::Vertex& vertex = vertices[i];
+
+		DirectX::XMVECTOR position = DirectX::XMLoadFloat3(reinterpret_cast<const DirectX::XMFLOAT3*>(&vertex.x));
+		DirectX::XMVECTOR weights = DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(vertex.weight));
+
+		DirectX::XMVECTOR x = DirectX::XMVectorSplatX(position);
+		DirectX::XMVECTOR y = DirectX::XMVectorSplatY(position);
+		DirectX::XMVECTOR z = DirectX::XMVectorSplatZ(position);
+
+		// Transform by each bone and accumulate the weighted results. Same sum as blending the matrices
+		// first, with fewer operations as the position is only splatted once
+		DirectX::XMVECTOR weight[4] =
+		{
+			DirectX::XMVectorSplatX(weights),
+			DirectX::XMVectorSplatY(weights),
+			DirectX::XMVectorSplatZ(weights),
+			DirectX::XMVectorSplatW(weights)
+		};
+
+		DirectX::XMVECTOR result = DirectX::XMVectorZero();
+		for (size_t j = 0; j < 4; ++j)
+		{
+			const DirectX::XMMATRIX& bone = palette[BoneIndex(vertex.bone[j], bone_count)];
+
+			DirectX::XMVECTOR skinned = DirectX::XMVectorMultiplyAdd(z, bone.r[2], bone.r[3]);
+			skinned = DirectX::XMVectorMultiplyAdd(y, bone.r[1], skinned);
+			skinned = DirectX::XMVectorMultiplyAdd(x, bone.r[0], skinned);
+
+			result = DirectX::XMVectorMultiplyAdd(weight[j], skinned, result);
+		}
+
+		DirectX::XMStoreFloat3(&output[i], result);
+	}
+}
+
+void DX::SkinVerticesReference(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const DX::Vertex& vertex = vertices[i];
+
+		// Blend the matrices as the shader does, one element at a time
+		float skin[4][4] = {};
+		for (size_t j = 0; j < 4; ++j)
+		{
+			DirectX::XMFLOAT4X4 bone;
+			DirectX::XMStoreFloat4x4(&bone, palette[BoneIndex(vertex.bone[j], bone_count)]);
+
+			for (size_t row = 0; row < 4; ++row)
+			{
+				for (size_t column = 0; column < 4; ++column)
+				{
+					skin[row][column] += vertex.weight[j] * bone.m[row][column];
+				}
+			}
+		}
+
+		// Row vector times matrix
+		float position[4] = { vertex.x, vertex.y, vertex.z, 1.0f };
+		float result[3] = {};
+		for (size_t column = 0; column < 3; ++column)
+		{
+			for (size_t row = 0; row < 4; ++row)
+			{
+				result[column] += position[row] * skin[row][column];
+			}
+		}
+
+		output[i] = DirectX::XMFLOAT3(result[0], result[1], result[2]);
+	}
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <cstddef>
+
+namespace DX
+{
+	struct Vertex;
+
+	// CPU skinning, for when the skinned positions are needed outside the vertex shader. Does the same
+	// blend as the affine path of VertexShader.hlsl - each position is moved by its four weighted bones in
+	// model space. Palettes hold the skinning matrix of every bone in row-vector form
+
+	// Skin vertices across the thread pool with the SIMD kernel
+	void SkinVertices(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output);
+
+	// Skin a range of vertices on the calling thread with the SIMD kernel
+	void SkinVertexRange(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output);
+
+	// Plain scalar version of the same blend, to check the fast path against
+	void SkinVerticesReference(const DX::Vertex* vertices, size_t count, const DirectX::XMMATRIX* palette, size_t bone_count, DirectX::XMFLOAT3* output);
+}
@@ -1,71 +1,295 @@
 #include "GltfModelLoader.h"
-#include <fstream>
+#include "ThreadPool.h"
 #include <map>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <limits>
+#include <type_traits>
 
 namespace
 {
-	struct Position
+	// Binary glTF container header
+	struct GlbHeader
 	{
-		float x;
-		float y;
-		float z;
+		uint32_t magic;
+		uint32_t version;
+		uint32_t length;
 	};
 
-	struct Joint
+	struct GlbChunkHeader
 	{
-		unsigned char x;
-		unsigned char y;
-		unsigned char z;
-		unsigned char w;
+		uint32_t length;
+		uint32_t type;
 	};
 
-	struct Weight
+	// "glTF", "JSON" and "BIN\0" in little endian
+	constexpr uint32_t GLB_MAGIC = 0x46546C67;
+	constexpr uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+	constexpr uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+	// Largest number of vertices or indices decoded by a single job
+	constexpr UINT DECODE_BATCH_SIZE = 16384;
+
+	// Batch of vertices or indices of a single primitive
+	struct DecodeJob
 	{
-		float x;
-		float y;
-		float z;
-		float w;
+		UINT primitive;
+		bool indices;
+		UINT start;
+		UINT end;
 	};
 
-	/*struct InverseBindMatrix
+	// Milliseconds since start, then restart the clock for the next stage
+	double LapMilliseconds(std::chrono::steady_clock::time_point& start)
 	{
-		float m00, m01, m02, m03;
-		float m10, m11, m12, m13;
-		float m20, m21, m22, m23;
-		float m30, m31, m32, m33;
-	};*/
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double, std::milli>(now - start).count();
+		start = now;
+
+		return elapsed;
+	}
 
-	struct InverseBindMatrix
+	// Number of components in an element of the given accessor type
+	size_t ComponentCount(std::string_view type)
 	{
-		float a1, a2, a3, a4;
-		float b1, b2, b3, b4;
-		float c1, c2, c3, c4;
-		float d1, d2, d3, d4;
-	};
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		if (type == "MAT2") return 4;
+		if (type == "MAT3") return 9;
+		if (type == "MAT4") return 16;
+
+		throw std::runtime_error("Unknown glTF accessor type");
+	}
 
-	struct Scale
+	// Convert a single component. Normalized integers map onto [0, 1] or [-1, 1] when read as float
+	template <typename Source, typename T>
+	T ConvertComponent(const char* input, bool normalized)
 	{
-		float x;
-		float y;
-		float z;
-	};
+		Source value;
+		std::memcpy(&value, input, sizeof(Source));
+
+		if constexpr (std::is_floating_point<T>::value && std::is_integral<Source>::value)
+		{
+			if (normalized)
+				return std::max(static_cast<float>(value) * (1.0f / std::numeric_limits<Source>::max()), -1.0f);
+		}
+
+		return static_cast<T>(value);
+	}
 
-	struct Quaternion
+	// Strided loop with the component count known at compile time so the inner loop unrolls
+	template <typename Source, typename T, size_t Components>
+	void ConvertElements(const char* input, size_t input_stride, size_t count, bool normalized, char* output, size_t output_stride)
 	{
-		float x;
-		float y;
-		float z;
-		float w;
-	};
+		for (size_t i = 0; i < count; ++i)
+		{
+			const char* element = input + i * input_stride;
+			T* target = reinterpret_cast<T*>(output + i * output_stride);
+			for (size_t c = 0; c < Components; ++c)
+			{
+				target[c] = ConvertComponent<Source, T>(element + c * sizeof(Source), normalized);
+			}
+		}
+	}
+
+	template <typename Source, typename T>
+	void Convert(const char* input, size_t input_stride, size_t input_components, size_t count, bool normalized,
+		T* output, size_t output_components, size_t output_stride)
+	{
+		char* target = reinterpret_cast<char*>(output);
+		size_t components = std::min(input_components, output_components);
+
+		// Both sides tightly packed - a single flat loop over every component, which the compiler vectorises
+		if (input_stride == sizeof(Source) * input_components && output_stride == sizeof(T) * components && input_components == components)
+		{
+			for (size_t i = 0; i < count * components; ++i)
+			{
+				output[i] = ConvertComponent<Source, T>(input + i * sizeof(Source), normalized);
+			}
+
+			return;
+		}
+
+		switch (components)
+		{
+		case 1: ConvertElements<Source, T, 1>(input, input_stride, count, normalized, target, output_stride); return;
+		case 2: ConvertElements<Source, T, 2>(input, input_stride, count, normalized, target, output_stride); return;
+		case 3: ConvertElements<Source, T, 3>(input, input_stride, count, normalized, target, output_stride); return;
+		case 4: ConvertElements<Source, T, 4>(input, input_stride, count, normalized, target, output_stride); return;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			const char* element = input + i * input_stride;
+			T* values = reinterpret_cast<T*>(target + i * output_stride);
+			for (size_t c = 0; c < components; ++c)
+			{
+				values[c] = ConvertComponent<Source, T>(element + c * sizeof(Source), normalized);
+			}
+		}
+	}
+}
+
+size_t GltfAccessor::ComponentSize() const
+{
+	switch (component_type)
+	{
+	case GLTF_BYTE:
+	case GLTF_UNSIGNED_BYTE:
+		return 1;
+	case GLTF_SHORT:
+	case GLTF_UNSIGNED_SHORT:
+		return 2;
+	case GLTF_UNSIGNED_INT:
+	case GLTF_FLOAT:
+		return 4;
+	}
+
+	throw std::runtime_error("Unknown glTF component type");
+}
+
+template <typename T>
+void GltfAccessor::Read(size_t start, size_t end, T* output, size_t output_components, size_t output_stride) const
+{
+	end = std::min(end, count);
+	if (start >= end)
+		return;
+
+	const char* input = data + start * stride;
+	size_t elements = end - start;
+
+	// Pick the conversion once per range rather than once per component
+	switch (component_type)
+	{
+	case GLTF_BYTE:
+		Convert<int8_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_BYTE:
+		Convert<uint8_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_SHORT:
+		Convert<int16_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_SHORT:
+		Convert<uint16_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_UNSIGNED_INT:
+		Convert<uint32_t>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	case GLTF_FLOAT:
+		Convert<float>(input, stride, components, elements, normalized, output, output_components, output_stride);
+		break;
+	default:
+		throw std::runtime_error("Unknown glTF component type");
+	}
 }
 
+template void GltfAccessor::Read<float>(size_t, size_t, float*, size_t, size_t) const;
+template void GltfAccessor::Read<int>(size_t, size_t, int*, size_t, size_t) const;
+template void GltfAccessor::Read<UINT>(size_t, size_t, UINT*, size_t, size_t) const;
+
+// Primitive resolved by the planning pass. Holds everything the decode pass needs so the
+// document doesn't have to be touched from the worker threads
+struct GltfModelLoader::PrimitiveTask
+{
+	GltfAccessor positions;
+	GltfAccessor joints;
+	GltfAccessor weights;
+	GltfAccessor indices;
+
+	bool skinned = false;
+	bool indexed = false;
+
+	UINT vertex_count = 0;
+	UINT index_count = 0;
+
+	// Where the primitive is written to in the output vertices and indices
+	UINT base_vertex = 0;
+	UINT start_index = 0;
+};
+
 GltfFileData GltfModelLoader::Load(const std::filesystem::path path)
 {
 	m_Path = path;
+	m_Statistics = {};
+
+	auto stage_start = std::chrono::steady_clock::now();
 
 	// Parser
 	parser parser;
-	m_Document = parser.load(path.string());
+	if (path.extension() == ".glb")
+	{
+		// Binary glTF - a single mapping serves both the JSON and every buffer
+		m_Files.push_back(std::make_unique<MappedFile>(path));
+		m_Document = ParseBinary(parser, *m_Files.back());
+	}
+	else
+	{
+		m_Document = parser.load(path.string());
+		m_Statistics.bytes_read += std::filesystem::file_size(path);
+	}
+
+	m_Statistics.parse_ms = LapMilliseconds(stage_start);
+
+	// Planning pass - size every primitive up front so they can all be decoded straight into place
+	std::vector<PrimitiveTask> primitives = PlanPrimitives();
+	m_Statistics.plan_ms = LapMilliseconds(stage_start);
+
+	// Decode pass - split the primitives into batches and decode them on the thread pool
+	std::vector<DecodeJob> jobs;
+	for (UINT i = 0; i < primitives.size(); ++i)
+	{
+		for (UINT start = 0; start < primitives[i].vertex_count; start += DECODE_BATCH_SIZE)
+		{
+			jobs.push_back({ i, false, start, std::min(start + DECODE_BATCH_SIZE, primitives[i].vertex_count) });
+		}
+
+		for (UINT start = 0; start < primitives[i].index_count; start += DECODE_BATCH_SIZE)
+		{
+			jobs.push_back({ i, true, start, std::min(start + DECODE_BATCH_SIZE, primitives[i].index_count) });
+		}
+	}
+
+	DX::Vertex* vertices = m_Data.vertices.data();
+	UINT* indices = m_Data.indices.data();
+	ThreadPool::Get().ParallelFor(jobs.size(), [&](size_t i)
+	{
+		const DecodeJob& job = jobs[i];
+		if (job.indices)
+		{
+			DecodeIndices(primitives[job.primitive], job.start, job.end, indices);
+		}
+		else
+		{
+			DecodeVertices(primitives[job.primitive], job.start, job.end, vertices);
+		}
+	});
+
+	m_Statistics.decode_ms = LapMilliseconds(stage_start);
+
+	LoadAnimations();
+	m_Statistics.animation_ms = LapMilliseconds(stage_start);
+
+	// Everything has been copied into the final layout so the buffers can be unmapped
+	for (auto& file : m_Files)
+	{
+		m_Statistics.bytes_read += file->Size();
+	}
+
+	m_Buffers.clear();
+	m_Files.clear();
+	m_SparseData.clear();
+	m_BinaryChunk = {};
+
+	return m_Data;
+}
+
+std::vector<GltfModelLoader::PrimitiveTask> GltfModelLoader::PlanPrimitives()
+{
+	std::vector<PrimitiveTask> primitives;
 
 	// Vertex total - want to keep track of this so we know the base vertex for each object when rendering
 	UINT vertex_total = 0;
@@ -81,154 +305,320 @@ GltfFileData GltfModelLoader::Load(const std::filesystem::path path)
 		if (mesh_index.error() != simdjson::SUCCESS)
 			continue;
 
-		// Model data
-		DX::Subset object_data = {};
-
 		// Load transformation
 		auto transformation_matrix = LoadTransformation(node);
-		// object_data.transformation = transformation_matrix;
 
 		// Read mesh
 		auto mesh = m_Document["meshes"].at(mesh_index.value());
 
-		// Mesh name
-		auto mesh_name = mesh["name"].get_string();
+		// Every primitive of the mesh becomes its own subset
+		for (auto primitive : mesh["primitives"])
+		{
+			PrimitiveTask task = {};
+			auto attributes = primitive["attributes"];
+
+			// Position is the only attribute we require
+			task.positions = LoadAccessor(attributes["POSITION"].get_int64().value());
+			task.vertex_count = static_cast<UINT>(task.positions.count);
+
+			// Unskinned primitives are bound fully to the first bone
+			int64_t joints_index = 0;
+			int64_t weights_index = 0;
+			if (attributes["JOINTS_0"].get_int64().get(joints_index) == simdjson::SUCCESS &&
+				attributes["WEIGHTS_0"].get_int64().get(weights_index) == simdjson::SUCCESS)
+			{
+				task.skinned = true;
+				task.joints = LoadAccessor(joints_index);
+				task.weights = LoadAccessor(weights_index);
+			}
 
-		// Get first mesh primitive - we're only assuming we will ever have 1 mesh primitive in this situation
-		auto mesh_primitives = mesh["primitives"].at(0);
+			// Non-indexed primitives draw their vertices in order
+			int64_t indices_index = 0;
+			if (primitive["indices"].get_int64().get(indices_index) == simdjson::SUCCESS)
+			{
+				task.indexed = true;
+				task.indices = LoadAccessor(indices_index);
+				task.index_count = static_cast<UINT>(task.indices.count);
+			}
+			else
+			{
+				task.index_count = task.vertex_count;
+			}
 
-		// Load mesh vertices
-		UINT vertex_count = LoadVertices(mesh_primitives.value());
+			// Reserve the output slices
+			task.base_vertex = vertex_total;
+			task.start_index = index_total;
+			vertex_total += task.vertex_count;
+			index_total += task.index_count;
+
+			// Model data
+			DX::Subset object_data = {};
+			object_data.baseVertex = task.base_vertex;
+			object_data.startIndex = task.start_index;
+			object_data.totalIndex = task.index_count;
+			// object_data.transformation = transformation_matrix;
+
+			m_Data.model_object_data.push_back(object_data);
+			primitives.push_back(task);
+		}
 
-		// Set base vertex
-		object_data.baseVertex = vertex_total;
+		// Load joint data
+		int64_t skin_index = 0;
+		if (node["skin"].get_int64().get(skin_index) == simdjson::SUCCESS)
+		{
+			m_Data.bones = LoadSkin(skin_index);
+		}
+	}
 
-		// Increase total vertex
-		vertex_total += vertex_count;
+	// Allocate the output once, decoding writes straight into it
+	m_Data.vertices.resize(vertex_total);
+	m_Data.indices.resize(index_total);
 
-		// Load mesh indices
-		auto mesh_indices_index = mesh_primitives["indices"].get_int64();
-		UINT index_count = LoadIndices(mesh_indices_index.value());
+	return primitives;
+}
 
-		// Set index data
-		object_data.startIndex = index_total;
-		object_data.totalIndex = index_count;
+void GltfModelLoader::DecodeVertices(const PrimitiveTask& primitive, UINT start, UINT end, DX::Vertex* vertices)
+{
+	// Each attribute is converted straight into its fields of the output vertices
+	DX::Vertex* output = vertices + primitive.base_vertex + start;
+	primitive.positions.Read(start, end, &output->x, 3, sizeof(DX::Vertex));
 
-		// Increase total index so we know when the next object index start is
-		index_total += index_count;
+	if (primitive.skinned)
+	{
+		primitive.joints.Read(start, end, output->bone, 4, sizeof(DX::Vertex));
+		primitive.weights.Read(start, end, output->weight, 4, sizeof(DX::Vertex));
+	}
+	else
+	{
+		for (UINT i = 0; i < end - start; ++i)
+		{
+			output[i].weight[0] = 1.0f;
+		}
+	}
+}
 
-		// Load joint data
-		auto skin_index = node["skin"].get_int64();
-		auto bones = LoadSkin(skin_index.value());
-		m_Data.bones = bones;
+void GltfModelLoader::DecodeIndices(const PrimitiveTask& primitive, UINT start, UINT end, UINT* indices)
+{
+	UINT* output = indices + primitive.start_index + start;
+	if (primitive.indexed)
+	{
+		// 8, 16 and 32 bit indices all widen to UINT
+		primitive.indices.Read(start, end, output, 1, sizeof(UINT));
+	}
+	else
+	{
+		for (UINT i = start; i < end; ++i)
+		{
+			output[i - start] = i;
+		}
+	}
+}
 
-		// Store the model object data
-		m_Data.model_object_data.push_back(object_data);
+simdjson_result<element> GltfModelLoader::ParseBinary(parser& parser, const MappedFile& file)
+{
+	// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#binary-gltf-layout
+	const char* data = file.Data();
+	size_t size = file.Size();
+
+	GlbHeader header = {};
+	if (size < sizeof(GlbHeader))
+		throw std::runtime_error("Invalid glb file");
+
+	std::memcpy(&header, data, sizeof(GlbHeader));
+	if (header.magic != GLB_MAGIC || header.version != 2 || header.length > size)
+		throw std::runtime_error("Invalid glb file");
+
+	// Walk the chunks - JSON is always first, followed by an optional binary chunk
+	const char* json = nullptr;
+	size_t json_length = 0;
+
+	size_t offset = sizeof(GlbHeader);
+	while (offset + sizeof(GlbChunkHeader) <= header.length)
+	{
+		GlbChunkHeader chunk = {};
+		std::memcpy(&chunk, data + offset, sizeof(GlbChunkHeader));
+		offset += sizeof(GlbChunkHeader);
+
+		if (offset + chunk.length > header.length)
+			throw std::runtime_error("Invalid glb chunk");
+
+		if (chunk.type == GLB_CHUNK_JSON && json == nullptr)
+		{
+			json = data + offset;
+			json_length = chunk.length;
+		}
+		else if (chunk.type == GLB_CHUNK_BIN && m_BinaryChunk.data == nullptr)
+		{
+			m_BinaryChunk.data = data + offset;
+			m_BinaryChunk.size = chunk.length;
+		}
+
+		offset += chunk.length;
 	}
 
-	LoadAnimations();
+	if (json == nullptr)
+		throw std::runtime_error("glb file has no JSON chunk");
 
-	return m_Data;
+	// simdjson reads up to SIMDJSON_PADDING bytes past the end of the input. When the binary chunk
+	// follows the JSON there is enough of the mapping left to parse in place, otherwise it takes a copy
+	bool parse_in_place = static_cast<size_t>((json + json_length) - data) + SIMDJSON_PADDING <= size;
+	return parser.parse(json, json_length, !parse_in_place);
 }
 
-UINT GltfModelLoader::LoadVertices(simdjson::dom::element& primitive)
+GltfModelLoader::Buffer GltfModelLoader::LoadBuffer(int64_t buffer_index)
 {
-	auto position_index = primitive["attributes"]["POSITION"].get_int64().value();
-	auto joints_index = primitive["attributes"]["JOINTS_0"].get_int64().value();
-	auto weights_index = primitive["attributes"]["WEIGHTS_0"].get_int64().value();
+	// Each buffer is only mapped once no matter how many accessors reference it
+	auto it = m_Buffers.find(buffer_index);
+	if (it != m_Buffers.end())
+		return it->second;
+
+	Buffer buffer;
+	auto buffer_uri = m_Document["buffers"].at(buffer_index)["uri"].get_string();
+	if (buffer_uri.error() == simdjson::SUCCESS)
+	{
+		// External buffer file
+		auto buffer_file = m_Path.parent_path() / buffer_uri.value();
+		m_Files.push_back(std::make_unique<MappedFile>(buffer_file));
 
-	// Get vertex position accessors
-	auto position_accessor = m_Document["accessors"].at(position_index);
-	auto joints_accessor = m_Document["accessors"].at(joints_index);
-	auto weights_accessor = m_Document["accessors"].at(weights_index);
+		buffer.data = m_Files.back()->Data();
+		buffer.size = m_Files.back()->Size();
+	}
+	else if (m_BinaryChunk.data != nullptr)
+	{
+		// A buffer without a uri refers to the binary chunk of the .glb
+		buffer = m_BinaryChunk;
+	}
+	else
+	{
+		throw std::runtime_error("glTF buffer has no data");
+	}
 
-	// Vertex count
-	auto vertex_count = static_cast<UINT>(position_accessor["count"].get_int64().value());
+	return m_Buffers[buffer_index] = buffer;
+}
 
-	// Buffer
-	std::vector<char> position_buffer = LoadBuffer(position_accessor["bufferView"].get_int64().value());
-	std::vector<char> joints_buffer = LoadBuffer(joints_accessor["bufferView"].get_int64().value());
-	std::vector<char> weights_buffer = LoadBuffer(weights_accessor["bufferView"].get_int64().value());
+GltfModelLoader::Buffer GltfModelLoader::LoadBufferView(int64_t buffer_view_index, int64_t byte_offset, size_t* byte_stride)
+{
+	auto buffer_view = m_Document["bufferViews"].at(buffer_view_index);
+	Buffer buffer = LoadBuffer(buffer_view["buffer"].get_int64().value());
 
-	// Reinterpret the data to what we set in the input layout
-	Position* position = reinterpret_cast<Position*>(position_buffer.data());
-	Joint* joints = reinterpret_cast<Joint*>(joints_buffer.data());
-	Weight* weights = reinterpret_cast<Weight*>(weights_buffer.data());
+	int64_t view_byte_offset = 0;
+	buffer_view["byteOffset"].get_int64().get(view_byte_offset);
 
-	// Set vertices
-	for (UINT i = 0; i < vertex_count; ++i)
+	int64_t view_byte_length = buffer_view["byteLength"].get_int64().value();
+	if (view_byte_offset + view_byte_length > static_cast<int64_t>(buffer.size) || byte_offset > view_byte_length)
+		throw std::runtime_error("glTF buffer view is out of range");
+
+	// Interleaved buffer views store a stride, otherwise the elements are tightly packed
+	if (byte_stride != nullptr)
 	{
-		DX::Vertex vertex;
+		int64_t stride = 0;
+		buffer_view["byteStride"].get_int64().get(stride);
+		*byte_stride = static_cast<size_t>(stride);
+	}
+
+	Buffer view;
+	view.data = buffer.data + view_byte_offset + byte_offset;
+	view.size = static_cast<size_t>(view_byte_length - byte_offset);
 
-		// Position
-		vertex.x = position[i].x;
-		vertex.y = position[i].y;
-		vertex.z = position[i].z;
+	return view;
+}
+
+GltfAccessor GltfModelLoader::LoadAccessor(int64_t accessor_index)
+{
+	simdjson::dom::element accessor = m_Document["accessors"].at(accessor_index);
+
+	GltfAccessor view;
+	view.count = static_cast<size_t>(accessor["count"].get_int64().value());
+	view.component_type = static_cast<int>(accessor["componentType"].get_int64().value());
+	view.components = ComponentCount(accessor["type"].get_string().value());
+	view.stride = view.ElementSize();
+	accessor["normalized"].get_bool().get(view.normalized);
+
+	// Accessors without a buffer view are all zeros apart from their sparse substitutions
+	int64_t buffer_view_index = 0;
+	if (accessor["bufferView"].get_int64().get(buffer_view_index) == simdjson::SUCCESS)
+	{
+		// Accessor byte offset is optional and relative to the start of the buffer view
+		int64_t accessor_byte_offset = 0;
+		accessor["byteOffset"].get_int64().get(accessor_byte_offset);
 
-		// Joint
-		vertex.bone[0] = joints[i].x;
-		vertex.bone[1] = joints[i].y;
-		vertex.bone[2] = joints[i].z;
-		vertex.bone[3] = joints[i].w;
+		size_t byte_stride = 0;
+		Buffer buffer = LoadBufferView(buffer_view_index, accessor_byte_offset, &byte_stride);
 
-		// Weight
-		vertex.weight[0] = weights[i].x;
-		vertex.weight[1] = weights[i].y;
-		vertex.weight[2] = weights[i].z;
-		vertex.weight[3] = weights[i].w;
+		view.data = buffer.data;
+		if (byte_stride != 0)
+			view.stride = byte_stride;
 
-		m_Data.vertices.push_back(vertex);
+		if (view.count != 0 && (view.count - 1) * view.stride + view.ElementSize() > buffer.size)
+			throw std::runtime_error("glTF accessor is out of range");
 	}
 
-	// Return vertex count for rendering
-	return vertex_count;
+	if (view.data == nullptr || accessor["sparse"].error() == simdjson::SUCCESS)
+		return ExpandAccessor(accessor, view);
+
+	return view;
 }
 
-UINT GltfModelLoader::LoadIndices(int64_t indices_index)
+GltfAccessor GltfModelLoader::ExpandAccessor(simdjson::dom::element& accessor, const GltfAccessor& view)
 {
-	// Indices count
-	auto mesh_indices_accessor = m_Document["accessors"].at(indices_index);
-	auto indices_count = mesh_indices_accessor["count"].get_int64();
+	// Tightly packed copy of the base elements, or zeros if there is no buffer view
+	size_t element_size = view.ElementSize();
+	std::vector<char> elements(view.count * element_size);
+	if (view.data != nullptr)
+	{
+		for (size_t i = 0; i < view.count; ++i)
+		{
+			std::memcpy(elements.data() + i * element_size, view.data + i * view.stride, element_size);
+		}
+	}
 
-	// Buffer
-	auto indices_buffer_view_index = mesh_indices_accessor["bufferView"].get_int64();
-	std::vector<char> buffer = LoadBuffer(indices_buffer_view_index.value());
+	// https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#sparse-accessors
+	simdjson::dom::element sparse;
+	if (accessor["sparse"].get(sparse) == simdjson::SUCCESS)
+	{
+		size_t sparse_count = static_cast<size_t>(sparse["count"].get_int64().value());
+		auto sparse_indices = sparse["indices"];
+		auto sparse_values = sparse["values"];
 
-	// Reinterpret the data to what we set in the input layout
-	USHORT* raw_indices = reinterpret_cast<USHORT*>(buffer.data());
-	std::vector<UINT> indices(raw_indices, raw_indices + indices_count.value());
+		int64_t indices_byte_offset = 0;
+		sparse_indices["byteOffset"].get_int64().get(indices_byte_offset);
 
-	// Set indices
-	m_Data.indices.insert(m_Data.indices.end(), indices.begin(), indices.end());
+		int64_t values_byte_offset = 0;
+		sparse_values["byteOffset"].get_int64().get(values_byte_offset);
 
-	// Return indices count
-	return static_cast<UINT>(indices.size());
-}
+		// Indices of the substituted elements
+		GltfAccessor indices;
+		indices.component_type = static_cast<int>(sparse_indices["componentType"].get_int64().value());
+		indices.stride = indices.ComponentSize();
+		indices.count = sparse_count;
 
-std::vector<char> GltfModelLoader::LoadBuffer(int64_t index)
-{
-	// Buffer view data
-	auto vertex_buffer_view = m_Document["bufferViews"].at(index);
-	auto buffer_index = vertex_buffer_view["buffer"].get_int64();
-	auto buffer_byte_length = vertex_buffer_view["byteLength"].get_int64();
-	auto buffer_byte_offset = vertex_buffer_view["byteOffset"].get_int64();
-
-	// Set buffer data
-	auto buffer = m_Document["buffers"].at(buffer_index.value());
-	auto buffer_length = buffer["byteLength"].get_int64();
-	auto buffer_uri = buffer["uri"].get_string();
-
-	// Read buffer
-	auto buffer_file = m_Path.parent_path() / buffer_uri.value();
-	std::ifstream file(buffer_file.string(), std::fstream::in | std::fstream::binary);
-	file.seekg(buffer_byte_offset.value());
-
-	std::vector<char> data;
-	data.resize(buffer_byte_length.value());
-	file.read(data.data(), buffer_byte_length.value());
-	file.close();
-
-	return data;
+		Buffer indices_buffer = LoadBufferView(sparse_indices["bufferView"].get_int64().value(), indices_byte_offset, nullptr);
+		Buffer values_buffer = LoadBufferView(sparse_values["bufferView"].get_int64().value(), values_byte_offset, nullptr);
+		if (sparse_count * indices.stride > indices_buffer.size || sparse_count * element_size > values_buffer.size)
+			throw std::runtime_error("glTF sparse accessor is out of range");
+
+		indices.data = indices_buffer.data;
+
+		std::vector<UINT> targets(sparse_count);
+		indices.Read(0, sparse_count, targets.data(), 1, sizeof(UINT));
+
+		// Values are tightly packed in the same layout as the elements they replace
+		for (size_t i = 0; i < sparse_count; ++i)
+		{
+			if (targets[i] >= view.count)
+				throw std::runtime_error("glTF sparse index is out of range");
+
+			std::memcpy(elements.data() + targets[i] * element_size, values_buffer.data + i * element_size, element_size);
+		}
+	}
+
+	m_SparseData.push_back(std::move(elements));
+
+	GltfAccessor expanded = view;
+	expanded.data = m_SparseData.back().data();
+	expanded.stride = element_size;
+
+	return expanded;
 }
 
 DirectX::XMMATRIX GltfModelLoader::LoadTransformation(simdjson::dom::element& node)
@@ -283,39 +673,9 @@ std::vector<DX::BoneInfo> GltfModelLoader::LoadSkin(int64_t skin_index)
 	auto inverseBindMatrices_index = skin["inverseBindMatrices"].get_int64();
 
 	// Invese bind matrix 
-	auto accessor = m_Document["accessors"].at(inverseBindMatrices_index.value());
-	auto componentType = accessor["componentType"].get_int64();
-	auto count = accessor["count"].get_int64();
-	auto type = accessor["type"].get_string();
-
-	auto bufferView_index = accessor["bufferView"].get_int64();
-	/*std::vector<char> buffer = LoadBuffer(bufferView_index.value());
-	InverseBindMatrix* raw_inverseBindMatrix = reinterpret_cast<InverseBindMatrix*>(buffer.data());*/
-
-	/////////////////////////////
-	// Buffer view data
-	auto vertex_buffer_view = m_Document["bufferViews"].at(bufferView_index.value());
-	auto buffer_index = vertex_buffer_view["buffer"].get_int64();
-	auto buffer_byte_length = vertex_buffer_view["byteLength"].get_int64();
-	auto buffer_byte_offset = vertex_buffer_view["byteOffset"].get_int64();
-
-	// Set buffer data
-	auto buffer = m_Document["buffers"].at(buffer_index.value());
-	auto buffer_length = buffer["byteLength"].get_int64();
-	auto buffer_uri = buffer["uri"].get_string();
-
-	// Read buffer
-	auto buffer_file = m_Path.parent_path() / buffer_uri.value();
-	std::ifstream file(buffer_file.string(), std::fstream::in | std::fstream::binary);
-	file.seekg(buffer_byte_offset.value());
-
-	std::vector<unsigned char> data;
-	data.resize(buffer_byte_length.value());
-	file.read((char*)(data.data()), buffer_byte_length.value());
-	file.close();
-
-
-	InverseBindMatrix* raw_inverseBindMatrix = reinterpret_cast<InverseBindMatrix*>(data.data());
+	auto raw_inverseBindMatrix = LoadAccessor(inverseBindMatrices_index.value());
+	std::vector<DirectX::XMFLOAT4X4> inverse_bind_matrices(raw_inverseBindMatrix.count);
+	raw_inverseBindMatrix.Read(0, raw_inverseBindMatrix.count, reinterpret_cast<float*>(inverse_bind_matrices.data()), 16, sizeof(DirectX::XMFLOAT4X4));
 
 	// List of joints
 	int index_count = 0;
@@ -357,11 +717,7 @@ std::vector<DX::BoneInfo> GltfModelLoader::LoadSkin(int64_t skin_index)
 		}
 
 		// Inverse bind
-		auto m = raw_inverseBindMatrix[index_count];
-		DirectX::XMMATRIX ibm(m.a1, m.a2, m.a3, m.a4,
-							  m.b1, m.b2, m.b3, m.b4,
-							  m.c1, m.c2, m.c3, m.c4,
-							  m.d1, m.d2, m.d3, m.d4);
+		DirectX::XMMATRIX ibm = DirectX::XMLoadFloat4x4(&inverse_bind_matrices[index_count]);
 
 		// Fill struct
 		bone.name = name;
@@ -372,33 +728,34 @@ std::vector<DX::BoneInfo> GltfModelLoader::LoadSkin(int64_t skin_index)
 		index_count++;
 	}
 
-	// Set bone parent
-	for (auto& bone : bones)
+	// Joint of every node, -1 for nodes that aren't in the skin
+	size_t node_count = m_Document["nodes"].get_array().value().size();
+	std::vector<int> node_joint(node_count, -1);
+	for (size_t i = 0; i < bones.size(); ++i)
 	{
-		for (auto& child_index : bone.children)
+		if (bones[i].bone_index >= 0 && static_cast<size_t>(bones[i].bone_index) < node_count)
 		{
-			auto child_bone = std::find_if(bones.begin(), bones.end(), [&](const DX::BoneInfo& bone)
-			{
-				return (bone.bone_index == child_index);
-			});
-
-			(*child_bone).parentName = bone.name;
+			node_joint[bones[i].bone_index] = static_cast<int>(i);
 		}
 	}
 
-	for (int i = 0; i < bones.size(); ++i)
+	// Set bone parent. Joints whose parent isn't a joint are roots
+	for (auto& bone : bones)
+	{
+		bone.parentId = -1;
+	}
+
+	for (size_t i = 0; i < bones.size(); ++i)
 	{
-		int parentId = 0;
-		for (int j = 0; j < bones.size(); ++j)
+		for (int child_index : bones[i].children)
 		{
-			if (bones[i].parentName == bones[j].name)
-			{
-				parentId = j;
-				break;
-			}
-		}
+			int child = child_index >= 0 && static_cast<size_t>(child_index) < node_count ? node_joint[child_index] : -1;
+			if (child < 0)
+				continue;
 
-		bones[i].parentId = parentId;
+			bones[child].parentId = static_cast<int>(i);
+			bones[child].parentName = bones[i].name;
+		}
 	}
 
 	return bones;
@@ -406,17 +763,22 @@ std::vector<DX::BoneInfo> GltfModelLoader::LoadSkin(int64_t skin_index)
 
 void GltfModelLoader::LoadAnimations()
 {
+	// Animations are optional
+	auto animations = m_Document["animations"].get_array();
+	if (animations.error() != simdjson::SUCCESS)
+		return;
+
 	// Animations
-	for (auto animation : m_Document["animations"])
+	for (auto animation : animations)
 	{
 		auto name = animation["name"].get_string();
 		auto channels = animation["channels"];
 		auto samplers = animation["samplers"];
 
-		std::map<int, std::vector<float>> times;
-		std::map<int, std::vector<Position>> translations;
-		std::map<int, std::vector<Scale>> scales;
-		std::map<int, std::vector<Quaternion>> rotations;
+		std::map<int, GltfAccessor> times;
+		std::map<int, GltfAccessor> translations;
+		std::map<int, GltfAccessor> scales;
+		std::map<int, GltfAccessor> rotations;
 
 		// Set channels
 		for (auto channel_iterator = channels.begin(); channel_iterator != channels.end(); ++channel_iterator)
@@ -435,58 +797,43 @@ void GltfModelLoader::LoadAnimations()
 			auto interpolation = sampler["interpolation"].get_string();
 
 			// Input value
-			auto input_accessor = m_Document["accessors"].at(input_index.value());
-			auto input_accessor_count = input_accessor["count"].get_int64();
-			std::vector<char> input_buffer = LoadBuffer(input_accessor["bufferView"].get_int64().value());
-
-			float* raw_input_data = reinterpret_cast<float*>(input_buffer.data());
-			std::vector<float> time_frame_data(raw_input_data, raw_input_data + input_accessor_count.value());
-			times[bone_index] = time_frame_data;
+			times[bone_index] = LoadAccessor(input_index.value());
 
 			// Output
-			auto output_accessor = m_Document["accessors"].at(output_index.value());
-			auto output_accessor_count = output_accessor["count"].get_int64();
-			std::vector<char> buffer = LoadBuffer(output_accessor["bufferView"].get_int64().value());
-
 			if (path == "translation")
 			{
-				Position* raw_data = reinterpret_cast<Position*>(buffer.data());
-				std::vector<Position> data(raw_data, raw_data + output_accessor_count.value());
-				translations[bone_index] = data;
+				translations[bone_index] = LoadAccessor(output_index.value());
 			}
 			else if (path == "scale")
 			{
-				Scale* raw_data = reinterpret_cast<Scale*>(buffer.data());
-				std::vector<Scale> data(raw_data, raw_data + output_accessor_count.value());
-				scales[bone_index] = data;
+				scales[bone_index] = LoadAccessor(output_index.value());
 			}
 			else if (path == "rotation")
 			{
-				Quaternion* raw_data = reinterpret_cast<Quaternion*>(buffer.data());
-				std::vector<Quaternion> data(raw_data, raw_data + output_accessor_count.value());
-				rotations[bone_index] = data;
+				rotations[bone_index] = LoadAccessor(output_index.value());
 			}
 		}
 
-		// Turn data into framedata
+		// Turn data into framedata - each channel is converted straight into its keyframe fields,
+		// channels the bone doesn't animate keep the keyframe defaults
 		DX::AnimationClip clip;
 		clip.BoneAnimations.resize(times.size());
 		for (int i = 0; i < times.size(); ++i)
 		{
-			for (unsigned k = 0; k < times[i].size(); ++k)
+			auto& frames = clip.BoneAnimations[times.size() - i - 1].Keyframes;
+			size_t frame_count = times[i].size();
+			if (frame_count == 0)
+				continue;
+
+			frames.resize(frame_count);
+			times[i].Read(0, frame_count, &frames[0].TimePos, 1, sizeof(DX::Keyframe));
+			translations[i].Read(0, frame_count, &frames[0].Translation.x, 3, sizeof(DX::Keyframe));
+			rotations[i].Read(0, frame_count, &frames[0].RotationQuat.x, 4, sizeof(DX::Keyframe));
+			scales[i].Read(0, frame_count, &frames[0].Scale.x, 3, sizeof(DX::Keyframe));
+
+			for (auto& frame : frames)
 			{
-				auto time = times[i][k];
-				auto position = translations[i][k];
-				auto rotation = rotations[i][k];
-				auto scale = scales[i][k];
-
-				DX::Keyframe frame;
-				frame.TimePos = static_cast<float>(time * 1000.0f);
-				frame.Translation = DirectX::XMFLOAT3(position.x, position.y, position.z);
-				frame.RotationQuat = DirectX::XMFLOAT4(rotation.x, rotation.y, rotation.z, rotation.w);
-				frame.Scale = DirectX::XMFLOAT3(scale.x, scale.y, scale.z);
-
-				clip.BoneAnimations[times.size() - i - 1].Keyframes.push_back(frame);
+				frame.TimePos = frame.TimePos * 1000.0f;
 			}
 		}
 
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <filesystem>
+#include <cstddef>
+
+// Read-only memory mapped file. The whole file is mapped once on construction and unmapped
+// when the object is destroyed, so callers can read straight from the mapping without copying
+class MappedFile
+{
+public:
+	MappedFile(const std::filesystem::path& path);
+	virtual ~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Start of the mapped file
+	const char* Data() const { return m_Data; }
+
+	// Size of the mapped file in bytes
+	size_t Size() const { return m_Size; }
+
+private:
+	const char* m_Data = nullptr;
+	size_t m_Size = 0;
+
+#ifdef _WIN32
+	void* m_File = nullptr;
+	void* m_Mapping = nullptr;
+#else
+	int m_File = -1;
+#endif
+};
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "ModelLoader.h"
+#include "ThreadPool.h"
+#include "DxInfluences.h"
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 #undef min
@@ -18,10 +22,26 @@ namespace
 
 		return _matrix;
 	}
+
+	// Milliseconds since start, and restart the clock for the next stage
+	double LapMilliseconds(std::chrono::steady_clock::time_point& start)
+	{
+		auto now = std::chrono::steady_clock::now();
+		double elapsed = std::chrono::duration<double, std::milli>(now - start).count();
+		start = now;
+
+		return elapsed;
+	}
 }
 
 Assimp::Model Assimp::Loader::Load(const std::string& path)
 {
+	m_ModelData = {};
+	m_Statistics = {};
+	bonemap.clear();
+
+	auto stage_start = std::chrono::steady_clock::now();
+
 	Assimp::Importer importer;
 
 	// Assimp will remove bones that aren't connect to a vertex. We want all the bones loaded regardless as the bones can have children bones that are animated
@@ -35,14 +55,28 @@ Assimp::Model Assimp::Loader::Load(const std::string& path)
 		throw std::runtime_error("Could not load model");
 	}
 
+	m_Statistics.read_ms = LapMilliseconds(stage_start);
+
 	LoadMesh(scene);
+	m_Statistics.convert_ms = LapMilliseconds(stage_start);
+
 	LoadAnimations(scene);
+	m_Statistics.animation_ms = LapMilliseconds(stage_start);
+
+	m_Statistics.vertex_count = m_ModelData.vertices.size();
+	m_Statistics.index_count = m_ModelData.indices.size();
 
-	return m_ModelData;
+	// Hand the data over rather than copying it
+	return std::move(m_ModelData);
 }
 
 void Assimp::Loader::LoadMesh(const aiScene* scene)
 {
+	// Lay the meshes out one after another so each can be converted into its own slice
+	std::vector<MeshRange> ranges(scene->mNumMeshes);
+	size_t vertex_count = 0;
+	size_t index_count = 0;
+
 	m_ModelData.subset.resize(scene->mNumMeshes);
 	for (UINT i = 0; i < scene->mNumMeshes; ++i)
 	{
@@ -55,119 +89,150 @@ void Assimp::Loader::LoadMesh(const aiScene* scene)
 		// Set mesh name
 		m_ModelData.subset[i].name = mesh->mName.C_Str();
 
+		// Triangle meshes need no face walk to count their indices
+		UINT total_index = 0;
+		if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE)
+		{
+			total_index = mesh->mNumFaces * 3;
+		}
+		else
+		{
+			for (UINT k = 0; k < mesh->mNumFaces; ++k)
+			{
+				total_index += mesh->mFaces[k].mNumIndices;
+			}
+		}
+
 		// Set start vertex and index
-		m_ModelData.subset[i].base_vertex = static_cast<UINT>(m_ModelData.vertices.size());
-		m_ModelData.subset[i].start_index = static_cast<UINT>(m_ModelData.indices.size());
+		ranges[i].base_vertex = static_cast<UINT>(vertex_count);
+		ranges[i].start_index = static_cast<UINT>(index_count);
+		ranges[i].total_index = total_index;
 
-		// Load mesh vertices
-		LoadMeshVertices(mesh);
+		m_ModelData.subset[i].base_vertex = ranges[i].base_vertex;
+		m_ModelData.subset[i].start_index = ranges[i].start_index;
+		m_ModelData.subset[i].total_index = total_index;
 
-		// Load mesh indices
-		UINT indices = LoadMeshIndices(mesh);
+		vertex_count += mesh->mNumVertices;
+		index_count += total_index;
 
-		// Set total indices for this mesh
-		m_ModelData.subset[i].total_index = indices;
+		// Bones are shared across meshes so they are gathered here, before the parallel part
+		LoadMeshBones(mesh, ranges[i]);
+	}
 
-		// Set bone data
-		LoadMeshBones(mesh);
+	// Set bone hierarchy. Bones whose parent node isn't a bone are roots
+	for (auto& bone : m_ModelData.bones)
+	{
+		auto parent = bonemap.find(bone.parent_name);
+		bone.parent_id = parent != bonemap.end() ? parent->second : -1;
+	}
+
+	// Allocate once, then every mesh writes its own range
+	m_ModelData.vertices.resize(vertex_count);
+	m_ModelData.indices.resize(index_count);
+
+	std::vector<size_t> clamped(scene->mNumMeshes, 0);
+	ThreadPool::Get().ParallelFor(scene->mNumMeshes, [&](size_t i)
+	{
+		const aiMesh* mesh = scene->mMeshes[i];
+		LoadMeshVertices(mesh, ranges[i]);
+		LoadMeshIndices(mesh, ranges[i]);
+		clamped[i] = LoadMeshWeights(mesh, ranges[i]);
+	});
+
+	for (size_t count : clamped)
+	{
+		m_Statistics.clamped_vertex_count += count;
 	}
 }
 
-void Assimp::Loader::LoadMeshVertices(const aiMesh* mesh)
+void Assimp::Loader::LoadMeshVertices(const aiMesh* mesh, const MeshRange& range)
 {
+	DX::Vertex* vertices = m_ModelData.vertices.data() + range.base_vertex;
 	for (UINT i = 0; i < mesh->mNumVertices; ++i)
 	{
 		// Set the positions
-		float x = static_cast<float>(mesh->mVertices[i].x);
-		float y = static_cast<float>(mesh->mVertices[i].y);
-		float z = static_cast<float>(mesh->mVertices[i].z);
-
-		// Create a vertex to store the mesh's vertices temporarily
-		Assimp::Vertex vertex = {};
-		vertex.x = x;
-		vertex.y = y;
-		vertex.z = z;
+		DX::Vertex& vertex = vertices[i];
+		vertex.x = static_cast<float>(mesh->mVertices[i].x);
+		vertex.y = static_cast<float>(mesh->mVertices[i].y);
+		vertex.z = static_cast<float>(mesh->mVertices[i].z);
 
 		// If the mesh doesn't have any bone data then add weight of 1
 		if (!mesh->HasBones())
 		{
 			vertex.weight[0] = 1.0f;
 		}
-
-		// Add the vertex to the vertices vector
-		m_ModelData.vertices.push_back(vertex);
 	}
 }
 
-UINT Assimp::Loader::LoadMeshIndices(const aiMesh* mesh)
+void Assimp::Loader::LoadMeshIndices(const aiMesh* mesh, const MeshRange& range)
 {
-	std::vector<UINT> indices;
+	UINT* indices = m_ModelData.indices.data() + range.start_index;
 	for (UINT i = 0; i < mesh->mNumFaces; ++i)
 	{
 		// Get the face
 		const aiFace& face = mesh->mFaces[i];
 
-		// Add the indices of the face to the vector
+		// Add the indices of the face
 		for (UINT k = 0; k < face.mNumIndices; ++k)
 		{
-			indices.push_back(face.mIndices[k]);
+			*indices++ = face.mIndices[k];
 		}
 	}
-
-	m_ModelData.indices.insert(m_ModelData.indices.end(), indices.begin(), indices.end());
-	return static_cast<UINT>(indices.size());
 }
 
-void Assimp::Loader::LoadMeshBones(const aiMesh* mesh)
+void Assimp::Loader::LoadMeshBones(const aiMesh* mesh, MeshRange& range)
 {
-	// Set bone data
-	std::vector<Bone> bones(mesh->mNumBones);
+	range.bones.resize(mesh->mNumBones);
 	for (UINT i = 0; i < mesh->mNumBones; ++i)
 	{
 		aiBone* bone = mesh->mBones[i];
+		std::string name = bone->mName.C_Str();
+
+		// Already added by an earlier mesh
+		auto existing = bonemap.find(name);
+		if (existing != bonemap.end())
+		{
+			range.bones[i] = existing->second;
+			continue;
+		}
 
 		// Set bone data
-		bones[i].id = i;
-		bones[i].name = bone->mName.C_Str();
-		bones[i].parent_name = bone->mNode->mParent->mName.C_Str();
-		bones[i].bind_pose = ConvertToDirectXMatrix(bone->mNode->mTransformation);
-		bones[i].inverse_bind_pose = ConvertToDirectXMatrix(bone->mOffsetMatrix);
+		Assimp::Bone model_bone;
+		model_bone.id = static_cast<int>(m_ModelData.bones.size());
+		model_bone.name = name;
+		model_bone.parent_name = bone->mNode->mParent->mName.C_Str();
+		model_bone.bind_pose = ConvertToDirectXMatrix(bone->mNode->mTransformation);
+		model_bone.inverse_bind_pose = ConvertToDirectXMatrix(bone->mOffsetMatrix);
 
 		// Set to map
-		bonemap[bones[i].name] = bones[i];
+		bonemap.emplace(name, model_bone.id);
 
-		// Set vertex bone id and weight influence
-		for (UINT j = 0; j < bone->mNumWeights; ++j)
-		{
-			const aiVertexWeight& vertex_weight = bone->mWeights[j];
-			UINT vertex_id = vertex_weight.mVertexId;
-			ai_real weight = vertex_weight.mWeight;
+		range.bones[i] = model_bone.id;
+		m_ModelData.bones.push_back(std::move(model_bone));
+	}
+}
 
-			// A bone can influence multiple vertices
-			Assimp::Vertex& vertex = m_ModelData.vertices[vertex_id];
+size_t Assimp::Loader::LoadMeshWeights(const aiMesh* mesh, const MeshRange& range)
+{
+	if (!mesh->HasBones())
+		return 0;
 
-			// We only want a vertex to be influences by a max of 4 bones
-			const int MAX_BONE_INFLUENCE = 4;
-			for (int k = 0; k < MAX_BONE_INFLUENCE; ++k)
-			{
-				if (vertex.weight[k] == 0.0)
-				{
-					vertex.weight[k] = weight;
-					vertex.bone[k] = i;
-					break;
-				}
-			}
-		}
-	}
+	// Weights come grouped by bone, gather them per vertex and keep the heaviest
+	DX::InfluenceBuilder influences;
+	influences.Reset(mesh->mNumVertices);
 
-	// Set bone hierarchy
-	for (auto& bone : bones)
+	for (UINT i = 0; i < mesh->mNumBones; ++i)
 	{
-		bone.parent_id = bonemap[bone.parent_name].id;
+		const aiBone* bone = mesh->mBones[i];
+		for (UINT j = 0; j < bone->mNumWeights; ++j)
+		{
+			const aiVertexWeight& vertex_weight = bone->mWeights[j];
+			influences.Add(vertex_weight.mVertexId, range.bones[i], static_cast<float>(vertex_weight.mWeight));
+		}
 	}
 
-	// Assign to bones
-	m_ModelData.bones.insert(m_ModelData.bones.end(), bones.begin(), bones.end());
+	influences.Resolve(m_ModelData.vertices.data() + range.base_vertex);
+	return influences.GetClampedCount();
 }
 
 void Assimp::Loader::LoadAnimations(const aiScene* scene)
@@ -180,14 +245,20 @@ void Assimp::Loader::LoadAnimations(const aiScene* scene)
 		// Animation clip
 		DX::AnimationClip clip;
 		clip.ticks_per_second = static_cast<float>(animation->mTicksPerSecond);
-		clip.BoneAnimations.resize(animation->mNumChannels);
+		clip.BoneAnimations.resize(m_ModelData.bones.size());
 
 		// Channel is the bones being animated
 		for (UINT j = 0; j < animation->mNumChannels; ++j)
 		{
 			const aiNodeAnim* channel = animation->mChannels[j];
 			std::string bone_name = channel->mNodeName.C_Str();
-			int bone_id = bonemap[bone_name].id;
+
+			// Channels can animate nodes that aren't bones, nothing is skinned to those
+			auto bone = bonemap.find(bone_name);
+			if (bone == bonemap.end())
+				continue;
+
+			int bone_id = bone->second;
 
 			// Frames of the bone
 			for (UINT k = 0; k < channel->mNumPositionKeys; ++k)
@@ -5,24 +5,10 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 
 namespace Assimp
 {
-	// Vertex data
-	struct Vertex
-	{
-		// Position
-		float x = 0;
-		float y = 0;
-		float z = 0;
-
-		// Weights
-		float weight[4] = { 0, 0, 0, 0 };
-
-		// Bone index
-		int bone[4] = { 0, 0, 0, 0 };
-	};
-
 	// Bone data
 	struct Bone
 	{
@@ -44,16 +30,30 @@ namespace Assimp
 		DirectX::XMMATRIX transformation;
 	};
 
-	// Model data
+	// Model data. Vertices are converted straight into the layout the renderer uses
 	struct Model
 	{
-		std::vector<Vertex> vertices;
+		std::vector<DX::Vertex> vertices;
 		std::vector<UINT> indices;
 		std::vector<Subset> subset;
 		std::vector<Bone> bones;
 		std::map<std::string, DX::AnimationClip> animations;
 	};
 
+	// Time spent in each stage of the last load
+	struct LoadStatistics
+	{
+		double read_ms = 0.0;
+		double convert_ms = 0.0;
+		double animation_ms = 0.0;
+
+		size_t vertex_count = 0;
+		size_t index_count = 0;
+
+		// Vertices that had more than four bone influences, the lightest were dropped
+		size_t clamped_vertex_count = 0;
+	};
+
 	// Model loader
 	class Loader
 	{
@@ -61,25 +61,44 @@ namespace Assimp
 		Loader() = default;
 		virtual ~Loader() = default;
 
-		// Load model
+		// Load model. The data is moved out, so the loader is left empty
 		Assimp::Model Load(const std::string& path);
 
+		// Timings of the last load
+		const LoadStatistics& GetStatistics() const { return m_Statistics; }
+
 	private:
 		Model m_ModelData;
+		LoadStatistics m_Statistics;
 
-		std::map<std::string, Assimp::Bone> bonemap;
+		// Model bone id by name
+		std::unordered_map<std::string, int> bonemap;
+
+		// Where a mesh's data lands in the model, worked out before the meshes are converted in parallel
+		struct MeshRange
+		{
+			UINT base_vertex = 0;
+			UINT start_index = 0;
+			UINT total_index = 0;
+
+			// Model bone of each of the mesh's bones
+			std::vector<int> bones;
+		};
 
 		// Load mesh data
 		void LoadMesh(const aiScene* scene);
 
-		// Load mesh vertices
-		void LoadMeshVertices(const aiMesh* mesh);
+		// Load mesh vertices into the mesh's range
+		void LoadMeshVertices(const aiMesh* mesh, const MeshRange& range);
+
+		// Load mesh indices into the mesh's range
+		void LoadMeshIndices(const aiMesh* mesh, const MeshRange& range);
 
-		// Load mesh indices
-		UINT LoadMeshIndices(const aiMesh* mesh);
+		// Add the mesh's bones to the model, bones shared between meshes are only added once
+		void LoadMeshBones(const aiMesh* mesh, MeshRange& range);
 
-		// Load bones
-		void LoadMeshBones(const aiMesh* mesh);
+		// Set the four heaviest bone influences of the mesh's vertices. Returns how many vertices had more
+		size_t LoadMeshWeights(const aiMesh* mesh, const MeshRange& range);
 
 		// Load animations
 		void LoadAnimations(const aiScene* scene);
@@ -4,7 +4,7 @@ struct VertexInput
 	float3 position : POSITION;
 	float4 colour : COLOUR;
 	float4 weight : WEIGHT;
-	int4 bone : BONE;
+	uint4 bone : BONE;
 };
 
 // Vertex output / pixel input structure
@@ -22,8 +22,18 @@ cbuffer WorldBuffer : register(b0)
 	matrix cProjection;
 }
 
-// Bone constant buffer
+// Bones a single draw can use, matches DX::MAX_PALETTE_BONES
+#define MAX_PALETTE_BONES 256
+
+// Palette formats, match DX::BonePaletteFormat
+#define PALETTE_AFFINE 0
+#define PALETTE_DUAL_QUATERNION 1
+
+// Bone constant buffer. Affine bones are three rows of a transposed 3x4 matrix, dual quaternion
+// bones are the rotation followed by the dual part. Only the bones the draw uses are written
 cbuffer BoneBuffer : register(b1)
 {
-	matrix cBoneTransform[96];
+	uint cPaletteFormat;
+	uint3 cPalettePadding;
+	float4 cBonePalette[MAX_PALETTE_BONES * 3];
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+namespace
+{
+	// Shared state of a single ParallelFor call. Helpers that are scheduled after the loop has
+	// finished only see an exhausted counter, so the state is reference counted
+	struct LoopState
+	{
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		size_t count = 0;
+		const std::function<void(size_t)>* job = nullptr;
+
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		void Run()
+		{
+			size_t completed = 0;
+			for (size_t index = next++; index < count; index = next++)
+			{
+				(*job)(index);
+				completed++;
+			}
+
+			// Last index to complete wakes the calling thread
+			if (completed != 0 && done.fetch_add(completed) + completed == count)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				finished.notify_all();
+			}
+		}
+	};
+}
+
+ThreadPool::ThreadPool(unsigned thread_count)
+{
+	// The calling thread also runs jobs so we need one less worker
+	thread_count = std::max(thread_count, 1u) - 1;
+
+	m_Threads.reserve(thread_count);
+	for (unsigned i = 0; i < thread_count; ++i)
+	{
+		m_Threads.emplace_back(&ThreadPool::Worker, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+
+	m_Condition.notify_all();
+	for (auto& thread : m_Threads)
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& job)
+{
+	if (count == 0)
+		return;
+
+	// Not worth waking the workers for a single job
+	if (count == 1 || m_Threads.empty())
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			job(i);
+		}
+
+		return;
+	}
+
+	auto state = std::make_shared<LoopState>();
+	state->count = count;
+	state->job = &job;
+
+	// Wake as many helpers as there is work for
+	size_t helpers = std::min(count - 1, m_Threads.size());
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (size_t i = 0; i < helpers; ++i)
+		{
+			m_Jobs.push([state] { state->Run(); });
+		}
+	}
+
+	m_Condition.notify_all();
+
+	// Help out on the calling thread then wait for the stragglers
+	state->Run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&] { return state->done == count; });
+}
+
+ThreadPool& ThreadPool::Get()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::Worker()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [&] { return m_Stopping || !m_Jobs.empty(); });
+
+			if (m_Stopping && m_Jobs.empty())
+				return;
+
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop();
+		}
+
+		job();
+	}
+}
\ No newline at end of file
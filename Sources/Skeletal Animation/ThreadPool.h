@@ -0,0 +1,41 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <queue>
+#include <vector>
+
+// Fixed size pool of worker threads. Work is submitted as a parallel loop and the calling thread
+// takes part in the loop, so it is safe to call ParallelFor from inside another ParallelFor job
+class ThreadPool
+{
+public:
+	ThreadPool(unsigned thread_count = std::thread::hardware_concurrency());
+	virtual ~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Run job(index) for every index in [0, count) and wait until they have all finished
+	void ParallelFor(size_t count, const std::function<void(size_t)>& job);
+
+	// Number of threads that can run a loop, including the calling thread
+	unsigned GetThreadCount() const { return static_cast<unsigned>(m_Threads.size()) + 1; }
+
+	// Pool shared by the application
+	static ThreadPool& Get();
+
+private:
+	std::vector<std::thread> m_Threads;
+
+	// Pending jobs
+	std::queue<std::function<void()>> m_Jobs;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	bool m_Stopping = false;
+
+	// Worker thread loop
+	void Worker();
+};
\ No newline at end of file
@@ -1,20 +1,74 @@
 #include "ShaderData.hlsli"
 
+// Blend the affine bones and transform the position
+float3 SkinAffine(float3 position, float4 weight, uint4 bone)
+{
+	float4 row0 = 0.0f;
+	float4 row1 = 0.0f;
+	float4 row2 = 0.0f;
+
+	[unroll]
+	for (int i = 0; i < 4; ++i)
+	{
+		row0 += weight[i] * cBonePalette[bone[i] * 3 + 0];
+		row1 += weight[i] * cBonePalette[bone[i] * 3 + 1];
+		row2 += weight[i] * cBonePalette[bone[i] * 3 + 2];
+	}
+
+	float4 p = float4(position, 1.0f);
+	return float3(dot(row0, p), dot(row1, p), dot(row2, p));
+}
+
+// Blend the dual quaternion bones and transform the position
+// https://users.cs.utah.edu/~ladislav/kavan07skinning/kavan07skinning.pdf
+float3 SkinDualQuaternion(float3 position, float4 weight, uint4 bone)
+{
+	float4 first = cBonePalette[bone.x * 2];
+
+	float4 real = 0.0f;
+	float4 dual = 0.0f;
+
+	[unroll]
+	for (int i = 0; i < 4; ++i)
+	{
+		float4 bone_real = cBonePalette[bone[i] * 2];
+		float4 bone_dual = cBonePalette[bone[i] * 2 + 1];
+
+		// Blend along the shortest path
+		float w = dot(first, bone_real) < 0.0f ? -weight[i] : weight[i];
+		real += w * bone_real;
+		dual += w * bone_dual;
+	}
+
+	float magnitude = max(length(real), 1e-6f);
+	real /= magnitude;
+	dual /= magnitude;
+
+	// Rotate, then translate by 2 * dual * conjugate(real)
+	float3 rotated = position + 2.0f * cross(real.xyz, cross(real.xyz, position) + real.w * position);
+	float3 translation = 2.0f * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz));
+
+	return rotated + translation;
+}
+
 // Entry point for the vertex shader - will be executed for each vertex
 VertexOutput main(VertexInput input)
 {
 	VertexOutput output;
 
-	matrix skinMatrix =
-		input.weight.x * cBoneTransform[int(input.bone.x)] +
-		input.weight.y * cBoneTransform[int(input.bone.y)] +
-		input.weight.z * cBoneTransform[int(input.bone.z)] +
-		input.weight.w * cBoneTransform[int(input.bone.w)];
+	// Same format for the whole draw so the branch is uniform
+	float3 skinned;
+	if (cPaletteFormat == PALETTE_DUAL_QUATERNION)
+	{
+		skinned = SkinDualQuaternion(input.position, input.weight, input.bone);
+	}
+	else
+	{
+		skinned = SkinAffine(input.position, input.weight, input.bone);
+	}
 
 	// Transform to homogeneous clip space.
-	//output.position = mul(float4(input.position, 1.0f), cWorld);
-	output.position = mul(float4(input.position, 1.0f), skinMatrix);
-	output.position = mul(output.position, cWorld);
+	output.position = mul(float4(skinned, 1.0f), cWorld);
 	output.position = mul(output.position, cView);
 	output.position = mul(output.position, cProjection);
 
@@ -22,4 +76,4 @@ VertexOutput main(VertexInput input)
 	output.colour = input.colour;
 
 	return output;
-}
\ No newline at end of file
+}
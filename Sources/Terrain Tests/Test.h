@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+// Fail the running test with message unless condition holds
+inline void Expect(bool condition, const std::string& message)
+{
+	if (!condition)
+		throw std::runtime_error(message);
+}
+
+// Tile a large synthetic heightmap and stream it along a camera path, checking the budget, the tiles and their bounds
+void TestTerrainStreamer();
+
+// Sample heights and normals from the quadtree's leaf corners and check them against the patches it draws
+void TestTerrainSampler();
+
+// Intersect rays with noise, sine and wall heightmaps and check the hits against a dense march
+void TestTerrainIntersect();
+
+// Select patches from several cameras and check balance, stitched corners, edge factors and culling, timing each selection
+void TestTerrainQuadtree();
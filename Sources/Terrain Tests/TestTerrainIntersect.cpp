@@ -0,0 +1,313 @@
+#include "Test.h"
+#include "DxTerrainSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+	// Not a power of two, so the top nodes of the bounds quadtree are partly past the edge
+	constexpr uint32_t HEIGHTMAP_WIDTH = 97;
+	constexpr uint32_t HEIGHTMAP_HEIGHT = 61;
+
+	// Off the origin, with texels running towards -z like the sample's terrain
+	constexpr float ORIGIN_X = -10.0f;
+	constexpr float ORIGIN_Z = 5.0f;
+	constexpr float CELL_X = 0.5f;
+	constexpr float CELL_Z = -0.25f;
+
+	constexpr int RAY_COUNT = 3000;
+	constexpr float MAX_DISTANCE = 400.0f;
+
+	// Highest texel of every field, rays only meet the surface below it
+	constexpr float MAX_HEIGHT = 3.0f;
+
+	// March steps per cell crossed, and per unit of height for rays that mostly fall
+	constexpr double MARCH_SAMPLES_PER_CELL = 16.0;
+	constexpr double MARCH_SAMPLES_PER_HEIGHT = 256.0;
+
+	// Height a march sample may be under the surface before the ray should have hit there
+	constexpr double HEIGHT_TOLERANCE = 1e-3;
+
+	// Distance along the ray, in lengths of its direction, an intersection and the march may disagree by
+	constexpr double DISTANCE_TOLERANCE = 1e-3;
+
+	// Samples over one march step after a hit the march missed, to find the dip it stepped over
+	constexpr int GRAZE_SAMPLES = 1000;
+
+	struct Field
+	{
+		const char* name;
+		std::function<float(uint32_t x, uint32_t z)> height;
+	};
+
+	// Ray in texel space, x and z in cells and y in height. t runs the same in the world
+	struct Ray
+	{
+		double origin[3];
+		double direction[3];
+	};
+
+	// Span of t the ray spends over the heightmap and below top, empty if begin > end
+	void ClipToHeightmap(const Ray& ray, double top, double& begin, double& end)
+	{
+		begin = 0.0;
+		end = MAX_DISTANCE;
+		const double low[3] = { 0.0, -std::numeric_limits<double>::infinity(), 0.0 };
+		const double high[3] = { HEIGHTMAP_WIDTH - 1.0, top, HEIGHTMAP_HEIGHT - 1.0 };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (ray.direction[axis] == 0.0)
+			{
+				if (ray.origin[axis] < low[axis] || ray.origin[axis] > high[axis])
+				{
+					begin = std::numeric_limits<double>::infinity();
+				}
+
+				continue;
+			}
+
+			double t0 = (low[axis] - ray.origin[axis]) / ray.direction[axis];
+			double t1 = (high[axis] - ray.origin[axis]) / ray.direction[axis];
+			begin = std::max(begin, std::min(t0, t1));
+			end = std::min(end, std::max(t0, t1));
+		}
+	}
+
+	// How far the ray is above the surface at t, negative under it
+	double GetClearance(const DX::TerrainSampler& sampler, const Ray& ray, double t)
+	{
+		float x = static_cast<float>(ORIGIN_X + (ray.origin[0] + ray.direction[0] * t) * CELL_X);
+		float z = static_cast<float>(ORIGIN_Z + (ray.origin[2] + ray.direction[2] * t) * CELL_Z);
+		return ray.origin[1] + ray.direction[1] * t - sampler.GetHeight(x, z);
+	}
+
+	double GetMarchStep(const Ray& ray)
+	{
+		double cells = std::hypot(ray.direction[0], ray.direction[2]);
+		return 1.0 / std::max(cells * MARCH_SAMPLES_PER_CELL, std::abs(ray.direction[1]) * MARCH_SAMPLES_PER_HEIGHT);
+	}
+
+	// Fine steps over the span, and every crossing of a cell edge so no kink of the surface falls between samples
+	std::vector<double> GetMarchSamples(const Ray& ray, double begin, double end)
+	{
+		double step = GetMarchStep(ray);
+		std::vector<double> samples;
+		for (double t = begin; t < end; t += step)
+		{
+			samples.push_back(t);
+		}
+
+		samples.push_back(end);
+		for (int axis : { 0, 2 })
+		{
+			if (ray.direction[axis] == 0.0)
+				continue;
+
+			double first = ray.origin[axis] + ray.direction[axis] * begin;
+			double last = ray.origin[axis] + ray.direction[axis] * end;
+			for (double line = std::ceil(std::min(first, last)); line <= std::max(first, last); ++line)
+			{
+				samples.push_back(std::clamp((line - ray.origin[axis]) / ray.direction[axis], begin, end));
+			}
+		}
+
+		std::sort(samples.begin(), samples.end());
+		return samples;
+	}
+
+	// Rays from above, from the side, from underneath, straight down and along the axes
+	Ray CreateRay(std::mt19937& random, float top)
+	{
+		std::uniform_real_distribution<double> unit(0.0, 1.0);
+		std::uniform_real_distribution<double> signed_unit(-1.0, 1.0);
+
+		Ray ray;
+		ray.origin[0] = -20.0 + (HEIGHTMAP_WIDTH + 40.0) * unit(random);
+		ray.origin[1] = -1.0 + (top + 4.0) * unit(random);
+		ray.origin[2] = -20.0 + (HEIGHTMAP_HEIGHT + 40.0) * unit(random);
+
+		// Aimed at a point on the terrain, so most rays cross it
+		double target[3] = { (HEIGHTMAP_WIDTH - 1.0) * unit(random), top * unit(random), (HEIGHTMAP_HEIGHT - 1.0) * unit(random) };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			ray.direction[axis] = (target[axis] - ray.origin[axis]) * (0.05 + unit(random));
+		}
+
+		switch (random() % 8)
+		{
+		case 0:
+			// Straight down
+			ray.direction[0] = ray.direction[2] = 0.0;
+			ray.direction[1] = -1.0;
+			break;
+		case 1:
+			// Along x or along z
+			ray.direction[random() % 2 == 0 ? 0 : 2] = 0.0;
+			break;
+		case 2:
+			// Nearly level, grazing the tops
+			ray.direction[1] = signed_unit(random) * 0.01;
+			break;
+		default:
+			break;
+		}
+
+		return ray;
+	}
+}
+
+void TestTerrainIntersect()
+{
+	const Field fields[] =
+	{
+		// Every texel its own height, the bounds of neighbours tell little about each other
+		{ "noise", [](uint32_t x, uint32_t z) { return static_cast<float>((x * 73856093u ^ z * 19349663u) % 1000u) / 1000.0f * MAX_HEIGHT; } },
+
+		// Smooth hills, long grazing runs over the crests
+		{ "sine", [](uint32_t x, uint32_t z) { return 1.5f + std::sin(x * 0.31f) * std::cos(z * 0.23f); } },
+
+		// Flat ground and a wall a texel thin, which the coarse nodes must not step over
+		{ "wall", [](uint32_t x, uint32_t z) { return x == HEIGHTMAP_WIDTH / 2 || (z == HEIGHTMAP_HEIGHT / 3 && x > 10) ? MAX_HEIGHT : 0.0f; } },
+	};
+
+	// Hits the march stepped over, the largest distance between the two, the sampler's steps per hit and march samples per ray
+	std::cout << std::left << std::setw(10) << "field" << std::right << std::setw(8) << "rays" << std::setw(8) << "hits"
+		<< std::setw(8) << "grazes" << std::setw(12) << "max diff" << std::setw(12) << "steps" << std::setw(12) << "samples" << "\n";
+
+	for (const auto& field : fields)
+	{
+		auto rows = [&](uint32_t z, float* row)
+		{
+			for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+			{
+				row[x] = field.height(x, z);
+			}
+		};
+
+		DX::TerrainSampler sampler(rows, HEIGHTMAP_WIDTH, HEIGHTMAP_HEIGHT, DirectX::XMFLOAT2(ORIGIN_X, ORIGIN_Z), DirectX::XMFLOAT2(CELL_X, CELL_Z), 1.0f);
+
+		std::mt19937 random(11);
+		size_t hits = 0;
+		size_t grazes = 0;
+		size_t steps = 0;
+		size_t samples = 0;
+		double max_difference = 0.0;
+		for (int i = 0; i < RAY_COUNT; ++i)
+		{
+			Ray ray = CreateRay(random, MAX_HEIGHT);
+			const std::string name = std::string(field.name) + " ray " + std::to_string(i);
+
+			DirectX::XMVECTOR origin = DirectX::XMVectorSet(static_cast<float>(ORIGIN_X + ray.origin[0] * CELL_X), static_cast<float>(ray.origin[1]),
+				static_cast<float>(ORIGIN_Z + ray.origin[2] * CELL_Z), 1.0f);
+			DirectX::XMVECTOR direction = DirectX::XMVectorSet(static_cast<float>(ray.direction[0] * CELL_X), static_cast<float>(ray.direction[1]),
+				static_cast<float>(ray.direction[2] * CELL_Z), 0.0f);
+
+			// The ray as the sampler sees it, after its float round trip
+			DirectX::XMFLOAT3 world_origin, world_direction;
+			DirectX::XMStoreFloat3(&world_origin, origin);
+			DirectX::XMStoreFloat3(&world_direction, direction);
+			ray.origin[0] = (world_origin.x - ORIGIN_X) / static_cast<double>(CELL_X);
+			ray.origin[1] = world_origin.y;
+			ray.origin[2] = (world_origin.z - ORIGIN_Z) / static_cast<double>(CELL_Z);
+			ray.direction[0] = world_direction.x / static_cast<double>(CELL_X);
+			ray.direction[1] = world_direction.y;
+			ray.direction[2] = world_direction.z / static_cast<double>(CELL_Z);
+
+			DX::TerrainRayHit hit;
+			bool intersects = sampler.Intersect(origin, direction, MAX_DISTANCE, hit);
+
+			// March the part over the heightmap for the first sample on or under the surface
+			double begin, end;
+			ClipToHeightmap(ray, MAX_HEIGHT, begin, end);
+
+			double march_hit = std::numeric_limits<double>::infinity();
+			if (begin <= end)
+			{
+				std::vector<double> march = GetMarchSamples(ray, begin, end);
+				for (size_t k = 0; k < march.size(); ++k)
+				{
+					samples++;
+
+					// A sample well under the surface before the intersection means it missed an earlier hit
+					double clearance = GetClearance(sampler, ray, march[k]);
+					double limit = intersects ? hit.distance - DISTANCE_TOLERANCE : end;
+					if (march[k] <= limit && clearance <= -HEIGHT_TOLERANCE)
+						throw std::runtime_error(name + " is " + std::to_string(-clearance) + " under the surface at " + std::to_string(march[k]) +
+							(intersects ? " before its hit at " + std::to_string(hit.distance) : " but missed"));
+
+					if (clearance <= 0.0)
+					{
+						// Between the last sample above and this one, refined by bisection
+						double above = k > 0 ? march[k - 1] : begin;
+						double below = march[k];
+						for (int bisection = 0; bisection < 60 && k > 0; ++bisection)
+						{
+							double middle = (above + below) * 0.5;
+							(GetClearance(sampler, ray, middle) <= 0.0 ? below : above) = middle;
+						}
+
+						march_hit = below;
+						break;
+					}
+				}
+			}
+
+			if (!intersects)
+				continue;
+
+			hits++;
+			steps += hit.steps;
+
+			// On the surface, or under it where the ray comes over the edge of the heightmap or down from above it
+			double clearance = GetClearance(sampler, ray, hit.distance);
+			Expect(hit.distance >= begin - DISTANCE_TOLERANCE && hit.distance <= end + DISTANCE_TOLERANCE, name + " hit at " +
+				std::to_string(hit.distance) + " outside the heightmap's span " + std::to_string(begin) + " to " + std::to_string(end));
+			Expect(std::abs(clearance) <= HEIGHT_TOLERANCE || (clearance < 0.0 && std::abs(hit.distance - begin) <= DISTANCE_TOLERANCE), name + " hit " +
+				std::to_string(clearance) + " off the surface at " + std::to_string(hit.distance));
+
+			// A ray can dip under a peak for less than a march step. Then the dip has to be right after the hit,
+			// otherwise both found the same one
+			if (hit.distance < march_hit - DISTANCE_TOLERANCE)
+			{
+				double step = GetMarchStep(ray) / GRAZE_SAMPLES;
+				bool dips = false;
+				for (int k = 0; k <= GRAZE_SAMPLES && !dips; ++k)
+				{
+					dips = GetClearance(sampler, ray, hit.distance + step * k) <= 0.0;
+				}
+
+				Expect(dips, name + " hit at " + std::to_string(hit.distance) + " stays above the surface, the march hit at " + std::to_string(march_hit));
+				grazes++;
+			}
+			else if (march_hit != std::numeric_limits<double>::infinity())
+			{
+				double difference = std::abs(march_hit - hit.distance);
+				Expect(difference <= DISTANCE_TOLERANCE, name + " hit at " + std::to_string(hit.distance) + ", the march at " + std::to_string(march_hit));
+				max_difference = std::max(max_difference, difference);
+			}
+
+			// The hit's position and texel agree with its distance
+			DirectX::XMVECTOR expected = DirectX::XMVectorMultiplyAdd(direction, DirectX::XMVectorReplicate(hit.distance), origin);
+			Expect(DirectX::XMVectorGetX(DirectX::XMVector3Length(DirectX::XMVectorSubtract(DirectX::XMLoadFloat3(&hit.position), expected))) <= 1e-4f,
+				name + " hit position is not at its distance");
+
+			double u = ray.origin[0] + ray.direction[0] * hit.distance;
+			double v = ray.origin[2] + ray.direction[2] * hit.distance;
+			Expect(std::abs(hit.texel_x - u) <= 0.5 + 1e-3 && std::abs(hit.texel_z - v) <= 0.5 + 1e-3, name + " hit texel (" +
+				std::to_string(hit.texel_x) + ", " + std::to_string(hit.texel_z) + ") is not the nearest to (" + std::to_string(u) + ", " + std::to_string(v) + ")");
+		}
+
+		Expect(hits > RAY_COUNT / 4, std::string(field.name) + ": only " + std::to_string(hits) + " rays hit, the test isn't aiming at the terrain");
+
+		std::cout << std::left << std::setw(10) << field.name << std::right << std::setw(8) << RAY_COUNT << std::setw(8) << hits
+			<< std::setw(8) << grazes << std::setw(12) << std::setprecision(3) << max_difference << std::setw(12) << static_cast<double>(steps) / hits
+			<< std::setw(12) << static_cast<double>(samples) / RAY_COUNT << "\n";
+	}
+}
@@ -0,0 +1,334 @@
+#include "Test.h"
+#include "DxTerrainQuadtree.h"
+#include "DxFrustum.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+
+namespace
+{
+	// Neither side a multiple of the leaf size, so the last leaves reach past the heightmap's edge
+	constexpr uint32_t HEIGHTMAP_WIDTH = 1025;
+	constexpr uint32_t HEIGHTMAP_HEIGHT = 771;
+	constexpr uint32_t LEAF_SIZE = 8;
+
+	// Terrain space like the sample's, 8 bit heights scaled to one
+	constexpr float CELL_SPACING = 0.05f;
+	constexpr float HEIGHT_SCALE = 1.0f / 255.0f;
+
+	constexpr float FIELD_OF_VIEW = 1.0f;
+	constexpr float ASPECT_RATIO = 16.0f / 9.0f;
+	constexpr float VIEWPORT_HEIGHT = 1080.0f;
+	constexpr float TESSELLATION = 16.0f;
+
+	// Selections timed from every camera
+	constexpr int SELECT_RUNS = 20;
+
+	// Heights in texels agree once stitched if they are this close, a few float steps of the largest
+	constexpr float HEIGHT_TOLERANCE = 1e-3f;
+
+	// Rolling hills with a tall ridge across them, so height bounds decide whether some nodes are seen
+	float GetTexel(uint32_t x, uint32_t z)
+	{
+		float hills = 90.0f + 50.0f * std::sin(x * 0.013f) * std::cos(z * 0.017f) + 20.0f * std::sin((x * 3 + z * 5) * 0.011f);
+		float ridge = 100.0f * std::exp(-std::pow((x * 0.6f - z * 0.8f - 150.0f) / 30.0f, 2.0f));
+		return std::round(std::min(hills + ridge, 255.0f));
+	}
+
+	DX::HeightmapRows GetRows()
+	{
+		return [](uint32_t z, float* row)
+		{
+			for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+			{
+				row[x] = GetTexel(x, z);
+			}
+		};
+	}
+
+	// Texel the quadtree reads for a leaf corner, repeating the last ones past the edge
+	float GetCornerTexel(int64_t x, int64_t z)
+	{
+		return GetTexel(static_cast<uint32_t>(std::min<int64_t>(x * LEAF_SIZE, HEIGHTMAP_WIDTH - 1)), static_cast<uint32_t>(std::min<int64_t>(z * LEAF_SIZE, HEIGHTMAP_HEIGHT - 1)));
+	}
+
+	struct Camera
+	{
+		const char* name;
+		DirectX::XMFLOAT3 eye;
+		DirectX::XMFLOAT3 target;
+		DirectX::XMFLOAT3 up;
+		float pixel_error;
+	};
+
+	// Height bounds of every leaf straight from the heightmap, and which leaves hold some of it
+	struct LeafBounds
+	{
+		uint32_t count = 0;
+		std::vector<float> low;
+		std::vector<float> high;
+		std::vector<bool> empty;
+
+		explicit LeafBounds(uint32_t leaf_count) : count(leaf_count), low(static_cast<size_t>(leaf_count) * leaf_count), high(low.size()), empty(low.size())
+		{
+			for (uint32_t z = 0; z < count; ++z)
+			{
+				for (uint32_t x = 0; x < count; ++x)
+				{
+					size_t leaf = static_cast<size_t>(z) * count + x;
+					empty[leaf] = x * LEAF_SIZE >= HEIGHTMAP_WIDTH - 1 || z * LEAF_SIZE >= HEIGHTMAP_HEIGHT - 1;
+					low[leaf] = std::numeric_limits<float>::max();
+					high[leaf] = std::numeric_limits<float>::lowest();
+					for (uint32_t k = 0; !empty[leaf] && k <= LEAF_SIZE; ++k)
+					{
+						for (uint32_t i = 0; i <= LEAF_SIZE; ++i)
+						{
+							float texel = GetTexel(std::min(x * LEAF_SIZE + i, HEIGHTMAP_WIDTH - 1), std::min(z * LEAF_SIZE + k, HEIGHTMAP_HEIGHT - 1));
+							low[leaf] = std::min(low[leaf], texel);
+							high[leaf] = std::max(high[leaf], texel);
+						}
+					}
+				}
+			}
+		}
+
+		// Terrain space box of leaves [x0, x1) x [z0, z1) of the heightmap
+		bool IsVisible(const DX::Frustum& frustum, uint32_t x0, uint32_t z0, uint32_t x1, uint32_t z1) const
+		{
+			float min_height = std::numeric_limits<float>::max();
+			float max_height = std::numeric_limits<float>::lowest();
+			for (uint32_t z = z0; z < z1; ++z)
+			{
+				for (uint32_t x = x0; x < x1; ++x)
+				{
+					size_t leaf = static_cast<size_t>(z) * count + x;
+					if (!empty[leaf])
+					{
+						min_height = std::min(min_height, low[leaf]);
+						max_height = std::max(max_height, high[leaf]);
+					}
+				}
+			}
+
+			float leaf_spacing = LEAF_SIZE * CELL_SPACING;
+			return frustum.IntersectsBox(DirectX::XMFLOAT3(x0 * leaf_spacing, min_height * HEIGHT_SCALE, z0 * leaf_spacing),
+				DirectX::XMFLOAT3(x1 * leaf_spacing, max_height * HEIGHT_SCALE, z1 * leaf_spacing));
+		}
+	};
+
+	// Height of a drawn patch at a leaf corner on or inside it
+	float GetPatchHeight(const DX::TerrainPatch& patch, int64_t x, int64_t z)
+	{
+		float u = static_cast<float>(x * LEAF_SIZE - patch.x) / patch.size;
+		float v = static_cast<float>(z * LEAF_SIZE - patch.z) / patch.size;
+		return (patch.heights[0] * (1.0f - u) + patch.heights[1] * u) * (1.0f - v) + (patch.heights[2] * (1.0f - u) + patch.heights[3] * u) * v;
+	}
+
+	// What checking a selection found, beyond it being right
+	struct SelectionCheck
+	{
+		size_t t_junctions = 0;
+		size_t halved_edges = 0;
+		size_t culled_leaves = 0;
+	};
+
+	SelectionCheck CheckSelection(const std::vector<DX::TerrainPatch>& patches, const LeafBounds& bounds, const DX::Frustum& frustum, const std::string& name)
+	{
+		SelectionCheck check;
+		const uint32_t leaf_count = bounds.count;
+
+		// The patch drawn over every leaf, each leaf drawn once at most
+		std::vector<int64_t> drawn(static_cast<size_t>(leaf_count) * leaf_count, -1);
+		for (size_t p = 0; p < patches.size(); ++p)
+		{
+			const auto& patch = patches[p];
+			uint32_t leaves = patch.size / LEAF_SIZE;
+			Expect(patch.size % LEAF_SIZE == 0 && leaves == leaf_count >> patch.level, name + ": patch " + std::to_string(p) + " is " + std::to_string(patch.size) + " cells at level " + std::to_string(patch.level));
+			Expect(patch.x % patch.size == 0 && patch.z % patch.size == 0, name + ": patch " + std::to_string(p) + " is not on its level's grid");
+			Expect(bounds.IsVisible(frustum, patch.x / LEAF_SIZE, patch.z / LEAF_SIZE, patch.x / LEAF_SIZE + leaves, patch.z / LEAF_SIZE + leaves),
+				name + ": patch " + std::to_string(p) + " is outside the frustum");
+
+			for (uint32_t z = patch.z / LEAF_SIZE; z < patch.z / LEAF_SIZE + leaves; ++z)
+			{
+				for (uint32_t x = patch.x / LEAF_SIZE; x < patch.x / LEAF_SIZE + leaves; ++x)
+				{
+					int64_t& leaf = drawn[static_cast<size_t>(z) * leaf_count + x];
+					Expect(leaf < 0, name + ": leaf " + std::to_string(x) + ", " + std::to_string(z) + " is drawn twice");
+					leaf = static_cast<int64_t>(p);
+				}
+			}
+		}
+
+		// Leaves left out are outside the frustum, judged on their own height bounds
+		for (uint32_t z = 0; z < leaf_count; ++z)
+		{
+			for (uint32_t x = 0; x < leaf_count; ++x)
+			{
+				size_t leaf = static_cast<size_t>(z) * leaf_count + x;
+				if (drawn[leaf] >= 0 || bounds.empty[leaf])
+					continue;
+
+				Expect(!bounds.IsVisible(frustum, x, z, x + 1, z + 1), name + ": leaf " + std::to_string(x) + ", " + std::to_string(z) + " is in view but not drawn");
+				check.culled_leaves++;
+			}
+		}
+
+		auto get_drawn = [&](int64_t x, int64_t z) -> const DX::TerrainPatch*
+		{
+			if (x < 0 || z < 0 || x >= leaf_count || z >= leaf_count)
+				return nullptr;
+
+			int64_t p = drawn[static_cast<size_t>(z) * leaf_count + x];
+			return p < 0 ? nullptr : &patches[p];
+		};
+
+		for (size_t p = 0; p < patches.size(); ++p)
+		{
+			const auto& patch = patches[p];
+			int64_t x0 = patch.x / LEAF_SIZE;
+			int64_t z0 = patch.z / LEAF_SIZE;
+			int64_t leaves = patch.size / LEAF_SIZE;
+
+			// Neighbours a level apart at most, and edges halved where a neighbour is coarser
+			for (uint32_t edge = 0; edge < 4; ++edge)
+			{
+				bool coarser = false;
+				for (int64_t k = 0; k < leaves; ++k)
+				{
+					const DX::TerrainPatch* neighbour = nullptr;
+					switch (edge)
+					{
+					case DX::EDGE_X0: neighbour = get_drawn(x0 - 1, z0 + k); break;
+					case DX::EDGE_Z0: neighbour = get_drawn(x0 + k, z0 - 1); break;
+					case DX::EDGE_X1: neighbour = get_drawn(x0 + leaves, z0 + k); break;
+					case DX::EDGE_Z1: neighbour = get_drawn(x0 + k, z0 + leaves); break;
+					}
+
+					if (neighbour == nullptr)
+						continue;
+
+					Expect(std::abs(static_cast<int>(neighbour->level) - static_cast<int>(patch.level)) <= 1, name + ": patch " + std::to_string(p) + " at level " +
+						std::to_string(patch.level) + " borders a patch at level " + std::to_string(neighbour->level));
+					coarser |= neighbour->level < patch.level;
+				}
+
+				float expected = coarser ? TESSELLATION * 0.5f : TESSELLATION;
+				Expect(patch.edges[edge] == expected, name + ": patch " + std::to_string(p) + " edge " + std::to_string(edge) + " has factor " + std::to_string(patch.edges[edge]) +
+					" instead of " + std::to_string(expected));
+				check.halved_edges += coarser ? 1 : 0;
+			}
+
+			// Every patch around a corner puts it at the same height. A corner inside a coarser patch's edge is a
+			// T-junction and has to lie on the line along that edge
+			for (uint32_t corner = 0; corner < 4; ++corner)
+			{
+				int64_t cx = x0 + (corner & 1) * leaves;
+				int64_t cz = z0 + (corner >> 1) * leaves;
+				bool t_junction = false;
+				bool next_to_undrawn = false;
+
+				for (uint32_t around = 0; around < 4; ++around)
+				{
+					const DX::TerrainPatch* other = get_drawn(cx - (around & 1), cz - (around >> 1));
+					if (other == nullptr)
+					{
+						next_to_undrawn = true;
+						continue;
+					}
+
+					float height = GetPatchHeight(*other, cx, cz);
+					Expect(std::abs(height - patch.heights[corner]) <= HEIGHT_TOLERANCE, name + ": corner " + std::to_string(cx) + ", " + std::to_string(cz) + " is at " +
+						std::to_string(patch.heights[corner]) + " in one patch and " + std::to_string(height) + " in its neighbour");
+
+					bool other_corner = (cx * LEAF_SIZE == other->x || cx * LEAF_SIZE == other->x + other->size) && (cz * LEAF_SIZE == other->z || cz * LEAF_SIZE == other->z + other->size);
+					t_junction |= !other_corner;
+				}
+
+				// Corners only drawn patches share are left where the heightmap has them
+				if (!t_junction && !next_to_undrawn)
+				{
+					Expect(patch.heights[corner] == GetCornerTexel(cx, cz), name + ": corner " + std::to_string(cx) + ", " + std::to_string(cz) + " moved without a coarser edge through it");
+				}
+
+				check.t_junctions += t_junction ? 1 : 0;
+			}
+		}
+
+		return check;
+	}
+}
+
+void TestTerrainQuadtree()
+{
+	using namespace DirectX;
+
+	DX::TerrainQuadtree quadtree(GetRows(), HEIGHTMAP_WIDTH, HEIGHTMAP_HEIGHT, LEAF_SIZE, CELL_SPACING, HEIGHT_SCALE);
+	const uint32_t leaf_count = 1u << (quadtree.GetLevelCount() - 1);
+	Expect(static_cast<uint64_t>(leaf_count) * LEAF_SIZE >= HEIGHTMAP_WIDTH - 1 && static_cast<uint64_t>(leaf_count / 2) * LEAF_SIZE < HEIGHTMAP_WIDTH - 1,
+		"quadtree has " + std::to_string(leaf_count) + " leaves a side");
+
+	LeafBounds bounds(leaf_count);
+	size_t leaf_patches = std::count(bounds.empty.begin(), bounds.empty.end(), false);
+	Expect(quadtree.GetLeafPatchCount() == leaf_patches, "quadtree counts " + std::to_string(quadtree.GetLeafPatchCount()) + " leaf patches instead of " + std::to_string(leaf_patches));
+
+	float size_x = (HEIGHTMAP_WIDTH - 1) * CELL_SPACING;
+	float size_z = (HEIGHTMAP_HEIGHT - 1) * CELL_SPACING;
+	const Camera cameras[] =
+	{
+		// Everything in view and no error allowed, so every leaf is drawn
+		{ "overhead", { size_x * 0.5f, 2.0f * size_x, size_z * 0.5f }, { size_x * 0.5f, 0.0f, size_z * 0.5f }, { 0.0f, 0.0f, 1.0f }, 0.0f },
+		{ "walking", { size_x * 0.3f, 1.2f, size_z * 0.2f }, { size_x * 0.7f, 0.2f, size_z * 0.8f }, { 0.0f, 1.0f, 0.0f }, 1.0f },
+		{ "from the corner", { -2.0f, 3.0f, -2.0f }, { size_x * 0.5f, 0.0f, size_z * 0.5f }, { 0.0f, 1.0f, 0.0f }, 2.0f },
+		// Level with the hills, looking across them at the ridge
+		{ "level", { size_x * 0.9f, 0.75f, size_z * 0.05f }, { size_x * 0.1f, 0.9f, size_z * 0.7f }, { 0.0f, 1.0f, 0.0f }, 1.0f },
+		{ "at the sky", { size_x * 0.5f, 5.0f, size_z * 0.5f }, { size_x * 0.5f, 10.0f, size_z * 0.5f }, { 0.0f, 0.0f, 1.0f }, 1.0f },
+	};
+
+	std::cout << leaf_count << " x " << leaf_count << " leaves, " << quadtree.GetLevelCount() << " levels, " << quadtree.GetLeafPatchCount() << " leaf patches\n";
+	std::cout << std::left << std::setw(18) << "camera" << std::right << std::setw(10) << "patches" << std::setw(10) << "of grid" << std::setw(10) << "splits"
+		<< std::setw(8) << "culled" << std::setw(8) << "T" << std::setw(8) << "halved" << std::setw(12) << "select ms" << "\n" << std::fixed << std::setprecision(3);
+
+	size_t t_junctions = 0;
+	size_t halved_edges = 0;
+	size_t culled_leaves = 0;
+	std::vector<DX::TerrainPatch> patches;
+	for (const auto& camera : cameras)
+	{
+		XMVECTOR eye = XMLoadFloat3(&camera.eye);
+		XMMATRIX view = XMMatrixLookAtLH(eye, XMLoadFloat3(&camera.target), XMLoadFloat3(&camera.up));
+		XMMATRIX view_projection = XMMatrixMultiply(view, XMMatrixPerspectiveFovLH(FIELD_OF_VIEW, ASPECT_RATIO, 0.05f, 200.0f));
+
+		auto start = std::chrono::steady_clock::now();
+		DX::TerrainSelectionStatistics statistics;
+		for (int run = 0; run < SELECT_RUNS; ++run)
+		{
+			statistics = quadtree.Select(view_projection, eye, FIELD_OF_VIEW, VIEWPORT_HEIGHT, camera.pixel_error, TESSELLATION, patches);
+		}
+
+		double select_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / SELECT_RUNS;
+
+		Expect(statistics.patches == patches.size(), std::string(camera.name) + ": statistics count " + std::to_string(statistics.patches) + " patches");
+		SelectionCheck check = CheckSelection(patches, bounds, DX::Frustum(view_projection), camera.name);
+		t_junctions += check.t_junctions;
+		halved_edges += check.halved_edges;
+		culled_leaves += check.culled_leaves;
+
+		std::cout << std::left << std::setw(18) << camera.name << std::right << std::setw(10) << patches.size() << std::setw(10) << quadtree.GetLeafPatchCount()
+			<< std::setw(10) << statistics.balance_splits << std::setw(8) << check.culled_leaves << std::setw(8) << check.t_junctions << std::setw(8) << check.halved_edges
+			<< std::setw(12) << select_ms << "\n";
+
+		if (camera.pixel_error == 0.0f)
+		{
+			Expect(patches.size() == quadtree.GetLeafPatchCount(), std::string(camera.name) + ": drew " + std::to_string(patches.size()) + " of " +
+				std::to_string(quadtree.GetLeafPatchCount()) + " leaves at full detail");
+		}
+	}
+
+	// The cameras have to have exercised what was checked
+	Expect(t_junctions > 0 && halved_edges > 0, "no camera selected neighbours of different levels");
+	Expect(culled_leaves > 0, "no camera culled anything");
+	Expect(patches.empty(), "looking at the sky drew " + std::to_string(patches.size()) + " patches");
+}
@@ -0,0 +1,142 @@
+#include "Test.h"
+#include "DxTerrainQuadtree.h"
+#include "DxTerrainSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace
+{
+	// Neither side a multiple of the leaf size, so the last leaves reach past the heightmap's edge
+	constexpr uint32_t HEIGHTMAP_WIDTH = 203;
+	constexpr uint32_t HEIGHTMAP_HEIGHT = 150;
+	constexpr uint32_t LEAF_SIZE = 4;
+
+	// Terrain space like the sample's, 8 bit heights scaled to one
+	constexpr float CELL_SPACING = 0.05f;
+	constexpr float HEIGHT_SCALE = 1.0f / 255.0f;
+
+	// Points checked in every patch, besides its corners and middle
+	constexpr int POINTS_PER_PATCH = 16;
+
+	// Largest difference allowed from the drawn patch, a few float steps of the heights
+	constexpr float TOLERANCE = 1e-5f;
+
+	// Bumpy enough everywhere that no node is flat and a zero pixel error splits all the way to the leaves
+	float GetTexel(uint32_t x, uint32_t z)
+	{
+		return std::round(127.5f + 60.0f * std::sin(x * 0.21f) * std::cos(z * 0.17f) + 40.0f * std::sin((x * 3 + z * 5) * 0.13f));
+	}
+
+	DX::HeightmapRows GetRows()
+	{
+		return [](uint32_t z, float* row)
+		{
+			for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+			{
+				row[x] = GetTexel(x, z);
+			}
+		};
+	}
+
+	float Bilinear(const float heights[4], float u, float v)
+	{
+		return (heights[0] * (1.0f - u) + heights[1] * u) * (1.0f - v) + (heights[2] * (1.0f - u) + heights[3] * u) * v;
+	}
+}
+
+void TestTerrainSampler()
+{
+	using namespace DirectX;
+
+	DX::TerrainQuadtree quadtree(GetRows(), HEIGHTMAP_WIDTH, HEIGHTMAP_HEIGHT, LEAF_SIZE, CELL_SPACING, HEIGHT_SCALE);
+	Expect(quadtree.GetCornerWidth() == (HEIGHTMAP_WIDTH - 1 + LEAF_SIZE - 1) / LEAF_SIZE + 1 && quadtree.GetCornerHeight() == (HEIGHTMAP_HEIGHT - 1 + LEAF_SIZE - 1) / LEAF_SIZE + 1,
+		"quadtree has " + std::to_string(quadtree.GetCornerWidth()) + " x " + std::to_string(quadtree.GetCornerHeight()) + " leaf corners");
+
+	// Over the quadtree's leaf corners, in terrain space
+	float leaf_spacing = CELL_SPACING * LEAF_SIZE;
+	DX::TerrainSampler sampler(quadtree.GetCornerRows(), quadtree.GetCornerWidth(), quadtree.GetCornerHeight(), XMFLOAT2(0.0f, 0.0f), XMFLOAT2(leaf_spacing, leaf_spacing), HEIGHT_SCALE);
+
+	// From high over the middle with the whole terrain in view, and no error allowed so every leaf is drawn
+	float size_x = (HEIGHTMAP_WIDTH - 1) * CELL_SPACING;
+	float size_z = (HEIGHTMAP_HEIGHT - 1) * CELL_SPACING;
+	XMVECTOR eye = XMVectorSet(size_x * 0.5f, 2.0f * std::max(size_x, size_z), size_z * 0.5f, 1.0f);
+	XMMATRIX view = XMMatrixLookAtLH(eye, XMVectorSet(size_x * 0.5f, 0.0f, size_z * 0.5f, 1.0f), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f));
+	XMMATRIX projection = XMMatrixPerspectiveFovLH(XMConvertToRadians(90.0f), 1.0f, 0.1f, 100.0f);
+
+	std::vector<DX::TerrainPatch> patches;
+	quadtree.Select(XMMatrixMultiply(view, projection), eye, XMConvertToRadians(90.0f), 1080.0f, 0.0f, 1.0f, patches);
+	Expect(patches.size() == quadtree.GetLeafPatchCount(), "selected " + std::to_string(patches.size()) + " patches of " + std::to_string(quadtree.GetLeafPatchCount()) + " leaves");
+
+	// Every drawn patch is bilinear between its corners, the sampler has to give the same heights inside it
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<float> xs, zs, expected;
+	for (const auto& patch : patches)
+	{
+		Expect(patch.size == LEAF_SIZE, "patch at (" + std::to_string(patch.x) + ", " + std::to_string(patch.z) + ") is " + std::to_string(patch.size) + " cells");
+
+		std::vector<std::pair<float, float>> points = { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 0.5f, 0.5f } };
+		for (int i = 0; i < POINTS_PER_PATCH; ++i)
+		{
+			points.emplace_back(unit(random), unit(random));
+		}
+
+		for (const auto& point : points)
+		{
+			xs.push_back((patch.x + point.first * patch.size) * CELL_SPACING);
+			zs.push_back((patch.z + point.second * patch.size) * CELL_SPACING);
+			expected.push_back(Bilinear(patch.heights, point.first, point.second) * HEIGHT_SCALE);
+		}
+	}
+
+	std::vector<float> heights(xs.size());
+	sampler.GetHeights(xs.data(), zs.data(), heights.data(), heights.size());
+
+	float max_difference = 0.0f;
+	for (size_t i = 0; i < heights.size(); ++i)
+	{
+		float difference = std::abs(heights[i] - expected[i]);
+		Expect(difference <= TOLERANCE, "sampler height at (" + std::to_string(xs[i]) + ", " + std::to_string(zs[i]) + ") is " +
+			std::to_string(heights[i]) + ", the drawn patch is at " + std::to_string(expected[i]));
+		Expect(sampler.GetHeight(xs[i], zs[i]) == heights[i], "single and batched heights differ at point " + std::to_string(i));
+		max_difference = std::max(max_difference, difference);
+	}
+
+	// Normals are the patch's, across the slope the heights give
+	float max_normal_error = 0.0f;
+	for (size_t i = 0; i < heights.size(); i += 7)
+	{
+		// Inside a cell, away from the creases between patches
+		float x = (std::floor(xs[i] / leaf_spacing) + 0.5f) * leaf_spacing;
+		float z = (std::floor(zs[i] / leaf_spacing) + 0.5f) * leaf_spacing;
+		if (x > size_x || z > size_z)
+			continue;
+
+		float step = leaf_spacing * 0.01f;
+		float dx = (sampler.GetHeight(x + step, z) - sampler.GetHeight(x - step, z)) / (2.0f * step);
+		float dz = (sampler.GetHeight(x, z + step) - sampler.GetHeight(x, z - step)) / (2.0f * step);
+		XMVECTOR expected_normal = XMVector3Normalize(XMVectorSet(-dx, 1.0f, -dz, 0.0f));
+
+		XMFLOAT3 normal = sampler.GetNormal(x, z);
+		float error = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&normal), expected_normal)));
+		Expect(error <= 1e-3f, "normal at (" + std::to_string(x) + ", " + std::to_string(z) + ") is " + std::to_string(error) + " from the slope");
+		max_normal_error = std::max(max_normal_error, error);
+	}
+
+	// Texels between leaf corners are not drawn at full detail, so the sampler doesn't follow them
+	float max_texel_difference = 0.0f;
+	for (uint32_t z = 0; z < HEIGHTMAP_HEIGHT; ++z)
+	{
+		for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+		{
+			max_texel_difference = std::max(max_texel_difference, std::abs(sampler.GetHeight(x * CELL_SPACING, z * CELL_SPACING) - GetTexel(x, z) * HEIGHT_SCALE));
+		}
+	}
+
+	Expect(max_texel_difference > TOLERANCE, "heightmap texels all lie on the leaf patches, the test map is too smooth");
+
+	std::cout << patches.size() << " patches, " << heights.size() << " points. Max difference from the drawn patches " << max_difference
+		<< ", normals " << max_normal_error << ", from the heightmap texels " << max_texel_difference << "\n";
+}
@@ -0,0 +1,281 @@
+#include "Test.h"
+#include "DxTerrainTiles.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace
+{
+	// Neither side a multiple of the tile size, so the last tiles repeat the edge samples
+	constexpr uint32_t HEIGHTMAP_WIDTH = 2000;
+	constexpr uint32_t HEIGHTMAP_HEIGHT = 1500;
+	constexpr uint32_t TILE_SIZE = 32;
+
+	// Twice as many tiles touch the radius as the budget holds, like the sample
+	constexpr float STREAMING_RADIUS = 160.0f;
+	constexpr size_t MAX_RESIDENT_TILES = 40;
+
+	// Camera steps along the scripted path
+	constexpr int PATH_STEPS = 240;
+
+	// 16 bit heights of the synthetic map, hills over ridges with a cliff down the middle
+	uint16_t GetHeight(uint32_t x, uint32_t z)
+	{
+		float hills = 16000.0f * std::sin(x * 0.013f) * std::cos(z * 0.007f);
+		float ridges = 9000.0f * std::sin((x + 2.0f * z) * 0.031f);
+		float cliff = x < HEIGHTMAP_WIDTH / 2 ? -6000.0f : 6000.0f;
+		return static_cast<uint16_t>(std::clamp(std::lround(32768.0f + hills + ridges + cliff), 0l, 65535l));
+	}
+
+	// A raw 16 bit heightmap the way the sample's are stored, little endian
+	void WriteRawHeightmap(const std::filesystem::path& path)
+	{
+		std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+		std::vector<uint8_t> row(HEIGHTMAP_WIDTH * 2);
+		for (uint32_t z = 0; z < HEIGHTMAP_HEIGHT; ++z)
+		{
+			for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+			{
+				uint16_t height = GetHeight(x, z);
+				row[x * 2] = static_cast<uint8_t>(height & 0xff);
+				row[x * 2 + 1] = static_cast<uint8_t>(height >> 8);
+			}
+
+			file.write(reinterpret_cast<const char*>(row.data()), row.size());
+		}
+
+		Expect(static_cast<bool>(file), "Could not write " + path.string());
+	}
+
+	// Where the camera is at step, in texels. Across the map, a loop, then a jump to the far corner
+	void GetCameraPosition(int step, float& x, float& z)
+	{
+		float t = static_cast<float>(step) / PATH_STEPS;
+		if (t < 0.4f)
+		{
+			x = HEIGHTMAP_WIDTH * t / 0.4f;
+			z = HEIGHTMAP_HEIGHT * 0.3f;
+		}
+		else if (t < 0.8f)
+		{
+			float angle = (t - 0.4f) / 0.4f * 6.2831853f;
+			x = HEIGHTMAP_WIDTH * 0.5f + 400.0f * std::cos(angle);
+			z = HEIGHTMAP_HEIGHT * 0.5f + 400.0f * std::sin(angle);
+		}
+		else
+		{
+			x = HEIGHTMAP_WIDTH - 1.0f;
+			z = HEIGHTMAP_HEIGHT - 1.0f;
+		}
+	}
+
+	// Distance from (x, z) to a tile's square, like the streamer measures it
+	float GetTileDistance(const DX::TerrainTileLayout& layout, uint32_t tx, uint32_t tz, float x, float z)
+	{
+		float low_x = static_cast<float>(tx * layout.tile_size);
+		float low_z = static_cast<float>(tz * layout.tile_size);
+		float dx = std::max({ low_x - x, 0.0f, x - (low_x + layout.tile_size) });
+		float dz = std::max({ low_z - z, 0.0f, z - (low_z + layout.tile_size) });
+		return std::sqrt(dx * dx + dz * dz);
+	}
+
+	// Every loaded tile holds the source heights to within half a quantization step, and its bounds are its lowest and highest
+	void CheckTiles(DX::TerrainStreamer& streamer, float tolerance)
+	{
+		const auto& layout = streamer.GetLayout();
+		const uint32_t samples = layout.GetTileSamples();
+
+		std::vector<std::shared_ptr<const DX::TerrainTile>> tiles;
+		streamer.GetResidentTiles(tiles);
+		for (const auto& tile : tiles)
+		{
+			const std::string name = "tile (" + std::to_string(tile->x) + ", " + std::to_string(tile->z) + ")";
+			Expect(tile->heights.size() == static_cast<size_t>(samples) * samples, name + " has " + std::to_string(tile->heights.size()) + " heights");
+
+			float low = tile->heights[0];
+			float high = tile->heights[0];
+			for (uint32_t k = 0; k < samples; ++k)
+			{
+				for (uint32_t i = 0; i < samples; ++i)
+				{
+					float height = tile->heights[static_cast<size_t>(k) * samples + i];
+					float expected = GetHeight(std::min(tile->x * TILE_SIZE + i, HEIGHTMAP_WIDTH - 1), std::min(tile->z * TILE_SIZE + k, HEIGHTMAP_HEIGHT - 1));
+					if (std::abs(height - expected) > tolerance)
+						throw std::runtime_error(name + " sample (" + std::to_string(i) + ", " + std::to_string(k) + ") is " +
+							std::to_string(height) + ", the heightmap has " + std::to_string(expected));
+
+					low = std::min(low, height);
+					high = std::max(high, height);
+				}
+			}
+
+			const DX::TerrainTileBounds& bounds = streamer.GetBounds(tile->x, tile->z);
+			Expect(bounds.min_height == low && bounds.max_height == high, name + " bounds " + std::to_string(bounds.min_height) + " to " +
+				std::to_string(bounds.max_height) + " but its heights run " + std::to_string(low) + " to " + std::to_string(high));
+		}
+	}
+
+	// Once the streamer is idle it holds the tiles nearest to (x, z) within the radius, as many as the budget allows.
+	// Tiles as far as the last one that fits may have lost a tie, nearer ones may not be missing
+	void CheckResidency(DX::TerrainStreamer& streamer, float x, float z, float radius, size_t budget)
+	{
+		const auto& layout = streamer.GetLayout();
+
+		std::vector<std::pair<float, uint32_t>> wanted;
+		for (uint32_t tz = 0; tz < layout.tiles_z; ++tz)
+		{
+			for (uint32_t tx = 0; tx < layout.tiles_x; ++tx)
+			{
+				float distance = GetTileDistance(layout, tx, tz, x, z);
+				if (distance <= radius)
+				{
+					wanted.emplace_back(distance, tz * layout.tiles_x + tx);
+				}
+			}
+		}
+
+		std::sort(wanted.begin(), wanted.end());
+		float cutoff = wanted.size() > budget ? wanted[budget - 1].first : radius + 1.0f;
+
+		size_t nearest_resident = 0;
+		for (const auto& tile : wanted)
+		{
+			bool resident = streamer.GetTile(tile.second % layout.tiles_x, tile.second / layout.tiles_x) != nullptr;
+			Expect(resident || tile.first >= cutoff, "tile " + std::to_string(tile.second) + " is " + std::to_string(tile.first) + " texels from (" +
+				std::to_string(x) + ", " + std::to_string(z) + ") but not loaded");
+			nearest_resident += resident && tile.first <= cutoff;
+		}
+
+		Expect(nearest_resident >= std::min(wanted.size(), budget), "only " + std::to_string(nearest_resident) + " of the nearest " +
+			std::to_string(std::min(wanted.size(), budget)) + " tiles are loaded");
+	}
+}
+
+void TestTerrainStreamer()
+{
+	const auto directory = std::filesystem::temp_directory_path();
+	const auto raw_path = directory / "terrain_streamer_test.raw";
+	const auto tiles_path = directory / "terrain_streamer_test.tiles";
+
+	WriteRawHeightmap(raw_path);
+
+	// Tiled from the raw file a band of rows at a time, the way the sample tiles its heightmap
+	auto rows = DX::ReadRawHeightmapRows(raw_path, HEIGHTMAP_WIDTH, HEIGHTMAP_HEIGHT, 16);
+	DX::TerrainTileLayout layout = DX::WriteTerrainTiles(tiles_path, HEIGHTMAP_WIDTH, HEIGHTMAP_HEIGHT, TILE_SIZE, rows);
+
+	Expect(layout.tiles_x == (HEIGHTMAP_WIDTH - 1 + TILE_SIZE - 1) / TILE_SIZE && layout.tiles_z == (HEIGHTMAP_HEIGHT - 1 + TILE_SIZE - 1) / TILE_SIZE,
+		"layout has " + std::to_string(layout.tiles_x) + " x " + std::to_string(layout.tiles_z) + " tiles");
+
+	// Heights span the map's range in 65535 steps
+	uint16_t low = 65535;
+	uint16_t high = 0;
+	for (uint32_t z = 0; z < HEIGHTMAP_HEIGHT; ++z)
+	{
+		for (uint32_t x = 0; x < HEIGHTMAP_WIDTH; ++x)
+		{
+			low = std::min(low, GetHeight(x, z));
+			high = std::max(high, GetHeight(x, z));
+		}
+	}
+
+	float tolerance = (high - low) / 65535.0f * 0.5f + high * 1e-6f;
+
+	{
+		// Waiting for every step, the nearest tiles are always there
+		DX::TerrainStreamer streamer(tiles_path, MAX_RESIDENT_TILES);
+		Expect(streamer.GetLayout().tiles_x == layout.tiles_x && streamer.GetLayout().tiles_z == layout.tiles_z, "streamer read a different layout");
+
+		// Bounds of every tile, loaded or not, are its source range to within the quantization
+		for (uint32_t tz = 0; tz < layout.tiles_z; ++tz)
+		{
+			for (uint32_t tx = 0; tx < layout.tiles_x; ++tx)
+			{
+				uint16_t tile_low = 65535;
+				uint16_t tile_high = 0;
+				for (uint32_t k = 0; k < layout.GetTileSamples(); ++k)
+				{
+					for (uint32_t i = 0; i < layout.GetTileSamples(); ++i)
+					{
+						uint16_t height = GetHeight(std::min(tx * TILE_SIZE + i, HEIGHTMAP_WIDTH - 1), std::min(tz * TILE_SIZE + k, HEIGHTMAP_HEIGHT - 1));
+						tile_low = std::min(tile_low, height);
+						tile_high = std::max(tile_high, height);
+					}
+				}
+
+				const DX::TerrainTileBounds& bounds = streamer.GetBounds(tx, tz);
+				Expect(std::abs(bounds.min_height - tile_low) <= tolerance && std::abs(bounds.max_height - tile_high) <= tolerance, "tile (" +
+					std::to_string(tx) + ", " + std::to_string(tz) + ") bounds " + std::to_string(bounds.min_height) + " to " + std::to_string(bounds.max_height) +
+					" but the heightmap runs " + std::to_string(tile_low) + " to " + std::to_string(tile_high));
+			}
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (int step = 0; step <= PATH_STEPS; ++step)
+		{
+			float x, z;
+			GetCameraPosition(step, x, z);
+			streamer.Update(x, z, STREAMING_RADIUS);
+			streamer.WaitIdle();
+
+			DX::TerrainStreamerStatistics statistics = streamer.GetStatistics();
+			Expect(statistics.resident <= MAX_RESIDENT_TILES, std::to_string(statistics.resident) + " tiles resident at step " + std::to_string(step));
+			Expect(statistics.failed == 0, "tiles failed to load at step " + std::to_string(step));
+
+			CheckResidency(streamer, x, z, STREAMING_RADIUS, MAX_RESIDENT_TILES);
+			CheckTiles(streamer, tolerance);
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		DX::TerrainStreamerStatistics statistics = streamer.GetStatistics();
+		Expect(statistics.bytes_read == statistics.loaded * layout.GetTileSamples() * layout.GetTileSamples() * sizeof(uint16_t), "bytes read don't match the tiles loaded");
+
+		std::cout << layout.tiles_x << " x " << layout.tiles_z << " tiles, " << statistics.loaded << " loaded, " << statistics.evicted << " evicted, "
+			<< statistics.bytes_read / (1024.0 * 1024.0) << " MB read in " << seconds * 1000.0 << " ms\n";
+	}
+
+	{
+		// Without waiting the budget still holds while tiles arrive, and the last point catches up
+		DX::TerrainStreamer streamer(tiles_path, MAX_RESIDENT_TILES);
+
+		float x = 0.0f, z = 0.0f;
+		for (int step = 0; step <= PATH_STEPS; ++step)
+		{
+			GetCameraPosition(step, x, z);
+			streamer.Update(x, z, STREAMING_RADIUS);
+
+			size_t resident = streamer.GetStatistics().resident;
+			Expect(resident <= MAX_RESIDENT_TILES, std::to_string(resident) + " tiles resident while streaming at step " + std::to_string(step));
+		}
+
+		streamer.WaitIdle();
+		CheckResidency(streamer, x, z, STREAMING_RADIUS, MAX_RESIDENT_TILES);
+		CheckTiles(streamer, tolerance);
+
+		// A radius the budget covers loads every tile it touches
+		streamer.Update(HEIGHTMAP_WIDTH * 0.5f, HEIGHTMAP_HEIGHT * 0.5f, TILE_SIZE * 1.5f);
+		streamer.WaitIdle();
+		CheckResidency(streamer, HEIGHTMAP_WIDTH * 0.5f, HEIGHTMAP_HEIGHT * 0.5f, TILE_SIZE * 1.5f, MAX_RESIDENT_TILES);
+
+		DX::TerrainStreamerStatistics statistics = streamer.GetStatistics();
+		std::cout << "without waiting: " << statistics.loaded << " loaded, " << statistics.evicted << " evicted\n";
+	}
+
+	// Anything but a tiled heightmap is refused
+	bool refused = false;
+	try
+	{
+		DX::TerrainStreamer streamer(raw_path, MAX_RESIDENT_TILES);
+	}
+	catch (const std::runtime_error&)
+	{
+		refused = true;
+	}
+
+	Expect(refused, "streamer opened a raw heightmap");
+
+	std::filesystem::remove(raw_path);
+	std::filesystem::remove(tiles_path);
+}
@@ -79,7 +79,7 @@ int Application::Execute()
 
                 // Update tessellation rate depending on the scroll wheel direction
                 m_TessellationRate += direction;
-                m_TessellationRate = std::clamp(m_TessellationRate, 1.0f, 64.0f);
+                m_TessellationRate = std::clamp(m_TessellationRate, 1.0f, m_DxModel->GetMaxTessellationRate());
 
                 // Update world constant buffer with new camera view and perspective
                 UpdateWorldBuffer();
@@ -106,7 +106,7 @@ int Application::Execute()
             m_DxShader->Use();
 
             // Render the model
-            m_DxModel->Render();
+            m_DxModel->Render(m_DxCamera.get());
 
             // Display the rendered scene
             m_DxRenderer->Present();
@@ -122,7 +122,7 @@ void Application::UpdateWorldBuffer()
     world_buffer.world = DirectX::XMMatrixTranspose(m_DxModel->World);
     world_buffer.view = DirectX::XMMatrixTranspose(m_DxCamera->GetView());
     world_buffer.projection = DirectX::XMMatrixTranspose(m_DxCamera->GetProjection());
-    world_buffer.tess = DirectX::XMFLOAT4(m_TessellationRate, 0.0f, 0.0f, 0.0f);
+    world_buffer.tess = DirectX::XMFLOAT4(m_TessellationRate, m_DxModel->GetMaxTessellationRate(), 0.0f, 0.0f);
 
     m_DxShader->UpdateWorldConstantBuffer(world_buffer);
 }
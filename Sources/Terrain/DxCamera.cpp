@@ -7,6 +7,7 @@ DX::Camera::Camera(int width, int height)
 	Rotate(pitch_radians, 0.0f);
 
 	m_AspectRatio = static_cast<float>(width) / height;
+	m_ViewportHeight = height;
 	CalculateProjection();
 }
 
@@ -33,6 +34,7 @@ void DX::Camera::UpdateAspectRatio(int width, int height)
 {
 	// Calculate window aspect ratio
 	m_AspectRatio = static_cast<float>(width) / height;
+	m_ViewportHeight = height;
 	CalculateProjection();
 }
 
@@ -46,7 +48,7 @@ void DX::Camera::UpdateFov(float fov)
 void DX::Camera::CalculateProjection()
 {
 	// Convert degrees to radians
-	auto field_of_view_radians = DirectX::XMConvertToRadians(m_FieldOfViewDegrees);
+	auto field_of_view_radians = GetFieldOfViewRadians();
 
 	// Calculate camera's perspective
 	m_Projection = DirectX::XMMatrixPerspectiveFovLH(field_of_view_radians, m_AspectRatio, 0.01f, 100.0f);
@@ -0,0 +1,39 @@
+#include "DxFrustum.h"
+
+DX::Frustum::Frustum(DirectX::FXMMATRIX view_projection)
+{
+	using namespace DirectX;
+
+	// From the columns of the matrix. D3D depth is 0 to w
+	XMMATRIX columns = XMMatrixTranspose(view_projection);
+	XMVECTOR planes[6] =
+	{
+		XMVectorAdd(columns.r[3], columns.r[0]),
+		XMVectorSubtract(columns.r[3], columns.r[0]),
+		XMVectorAdd(columns.r[3], columns.r[1]),
+		XMVectorSubtract(columns.r[3], columns.r[1]),
+		columns.r[2],
+		XMVectorSubtract(columns.r[3], columns.r[2])
+	};
+
+	for (size_t i = 0; i < 6; ++i)
+	{
+		XMStoreFloat4(&m_Planes[i], XMPlaneNormalize(planes[i]));
+	}
+}
+
+bool DX::Frustum::IntersectsBox(const DirectX::XMFLOAT3& low, const DirectX::XMFLOAT3& high) const
+{
+	for (const auto& plane : m_Planes)
+	{
+		// Corner of the box furthest along the plane normal
+		float x = plane.x >= 0.0f ? high.x : low.x;
+		float y = plane.y >= 0.0f ? high.y : low.y;
+		float z = plane.z >= 0.0f ? high.z : low.z;
+
+		if (plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+namespace DX
+{
+	// View frustum as six planes, for culling on the CPU before anything is drawn
+	class Frustum
+	{
+	public:
+		Frustum() = default;
+
+		// Planes of a row-vector view projection matrix, in the space the matrix takes points from
+		explicit Frustum(DirectX::FXMMATRIX view_projection);
+
+		// False only when the box is entirely outside one of the planes
+		bool IntersectsBox(const DirectX::XMFLOAT3& low, const DirectX::XMFLOAT3& high) const;
+
+	private:
+		DirectX::XMFLOAT4 m_Planes[6] = {};
+	};
+}
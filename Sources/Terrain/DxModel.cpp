@@ -3,13 +3,39 @@
 #include <vector>
 #include "GeometryGenerator.h"
 #include "DDSTextureLoader.h"
+#include "DxFrustum.h"
 #include <fstream>
+#include <filesystem>
 #include <numeric>
 #undef min
 #undef max
 #include <iostream>
 #include <algorithm>
 
+namespace
+{
+	// Heightmap and the tiled copy the terrain streams from, made on first run
+	constexpr auto HEIGHTMAP_PATH = "..\\..\\Resources\\Terrain\\heightmap_256.raw";
+	constexpr auto TILED_HEIGHTMAP_PATH = "..\\..\\Resources\\Terrain\\heightmap_256.tiles";
+	constexpr uint32_t HEIGHTMAP_SIZE = 256;
+	constexpr uint32_t HEIGHTMAP_BITS = 8;
+	constexpr uint32_t TILE_SIZE = 32;
+
+	// Tiles within this many world units of the camera are streamed in, as many as the budget allows
+	constexpr float STREAMING_RADIUS = 3.0f;
+	constexpr size_t MAX_RESIDENT_TILES = 40;
+
+	// The terrain streams tiles around the camera and draws them whole, so only the tiles near it are in memory.
+	// Set this to draw the patches a quadtree picks by screen space error instead. The quadtree reads the whole
+	// heightmap once to build, keeping node bounds and leaf corner heights, and does not stream
+	constexpr bool QUADTREE_LOD = false;
+	constexpr uint32_t QUADTREE_LEAF_SIZE = 4;
+	constexpr float QUADTREE_PIXEL_ERROR = 1.0f;
+
+	// Edge factor between patches of the same size, the shader's rate multiplies it. Halved next to a coarser patch
+	constexpr float QUADTREE_TESSELLATION = 2.0f;
+}
+
 DX::Model::Model(DX::Renderer* renderer) : m_DxRenderer(renderer)
 {
 	World *= DirectX::XMMatrixTranslation(0.0f, 0.0f, 0.0f);
@@ -17,56 +43,113 @@ DX::Model::Model(DX::Renderer* renderer) : m_DxRenderer(renderer)
 
 void DX::Model::Create()
 {
+	m_CellSpacing = m_TerrainSize / (HEIGHTMAP_SIZE - 1);
 
-	// Load height map
-	std::ifstream file("..\\..\\Resources\\heightmap_64.raw", std::fstream::in | std::fstream::binary);
-	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-	//m_Heightmap = data;
+	// One path or the other draws the terrain, only that one is built
+	if (QUADTREE_LOD)
+	{
+		// The quadtree keeps bounds and errors per node and heights at leaf corners, it reads the heightmap a band at a time
+		auto rows = DX::ReadRawHeightmapRows(HEIGHTMAP_PATH, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, HEIGHTMAP_BITS);
+		m_Quadtree = std::make_unique<DX::TerrainQuadtree>(rows, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, QUADTREE_LEAF_SIZE, m_CellSpacing, m_HeightScale);
+		CreatePatchVertexBuffer(m_Quadtree->GetLeafPatchCount());
+	}
+	else
+	{
+		// Stream the heightmap as tiles rather than load it whole
+		CreateTiles();
 
-	int length = std::sqrt(data.size());
+		// Patches of one tile, every tile draws them over its own vertices
+		uint32_t samples = m_TerrainStreamer->GetLayout().GetTileSamples();
+		GeometryGenerator::CreateQuadGrid(1.0f, 1.0f, samples, samples, this);
+
+		// Create input buffers
+		CreateIndexBuffer();
+	}
 
-	GeometryGenerator::CreateQuadGrid(3.0f, 3.0f, 64, 64, this);
-	int size = std::sqrt(Vertices.size());
+	// Load texture
+	LoadTexture();
+}
 
-	int index = 0;
-	for (size_t i = 0; i < size; i++)
+void DX::Model::CreateTiles()
+{
+	if (!std::filesystem::exists(TILED_HEIGHTMAP_PATH))
 	{
-		for (size_t j = 0; j < size; j++)
-		{
-			float factor = ((float)data.size() / (float)Vertices.size());
-			int index2 = index * factor;
+		auto rows = DX::ReadRawHeightmapRows(HEIGHTMAP_PATH, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, HEIGHTMAP_BITS);
+		DX::WriteTerrainTiles(TILED_HEIGHTMAP_PATH, HEIGHTMAP_SIZE, HEIGHTMAP_SIZE, TILE_SIZE, rows);
+	}
 
-			float height = (float)data[index2];
+	m_TerrainStreamer = std::make_unique<DX::TerrainStreamer>(TILED_HEIGHTMAP_PATH, MAX_RESIDENT_TILES);
+}
+
+void DX::Model::UpdateTiles(DX::Camera* camera)
+{
+	// Camera position in heightmap texels, the terrain is centred on the origin with rows running towards -z
+	auto eye = DirectX::XMMatrixInverse(nullptr, DirectX::XMMatrixMultiply(World, camera->GetView())).r[3];
+	float half_size = m_TerrainSize * 0.5f;
+	float texel_x = (DirectX::XMVectorGetX(eye) + half_size) / m_CellSpacing;
+	float texel_z = (half_size - DirectX::XMVectorGetZ(eye)) / m_CellSpacing;
+	m_TerrainStreamer->Update(texel_x, texel_z, STREAMING_RADIUS / m_CellSpacing);
 
-			Vertices[index].y = height / 255.0f; /*normalise(height, 255.0f, 0.0f);*/
-			//std::cout << "Index: " << index << '\n';
+	// Vertex buffers for tiles that arrived, and none for the ones that were let go
+	std::vector<std::shared_ptr<const DX::TerrainTile>> tiles;
+	m_TerrainStreamer->GetResidentTiles(tiles);
 
-			index++;
+	const auto& layout = m_TerrainStreamer->GetLayout();
+	std::unordered_map<uint32_t, TileMesh> meshes;
+	for (auto& tile : tiles)
+	{
+		uint32_t index = tile->z * layout.tiles_x + tile->x;
+		auto mesh = m_TileMeshes.find(index);
+		if (mesh != m_TileMeshes.end() && mesh->second.tile == tile)
+		{
+			meshes[index] = std::move(mesh->second);
+			continue;
 		}
-	}
 
-	// Create input buffers
-	CreateVertexBuffer();
-	CreateIndexBuffer();
+		meshes[index] = { tile, CreateTileVertexBuffer(*tile) };
+	}
 
-	// Load texture
-	LoadTexture();
+	m_TileMeshes = std::move(meshes);
 }
 
-void DX::Model::CreateVertexBuffer()
+ComPtr<ID3D11Buffer> DX::Model::CreateTileVertexBuffer(const DX::TerrainTile& tile)
 {
+	const auto& layout = m_TerrainStreamer->GetLayout();
+	uint32_t samples = layout.GetTileSamples();
+	float half_size = m_TerrainSize * 0.5f;
+
+	// Same grid as the shared patches, moved to the tile and raised to its heights
+	std::vector<Vertex> vertices(Vertices.size());
+	for (uint32_t k = 0; k < samples; ++k)
+	{
+		for (uint32_t i = 0; i < samples; ++i)
+		{
+			uint32_t texel_x = tile.x * layout.tile_size + i;
+			uint32_t texel_z = tile.z * layout.tile_size + k;
+
+			Vertex& vertex = vertices[k * samples + i];
+			vertex.x = -half_size + texel_x * m_CellSpacing;
+			vertex.y = tile.heights[k * samples + i] * m_HeightScale;
+			vertex.z = half_size - texel_z * m_CellSpacing;
+			vertex.u = static_cast<float>(texel_x) / (layout.width - 1);
+			vertex.v = static_cast<float>(texel_z) / (layout.height - 1);
+		}
+	}
+
 	auto d3dDevice = m_DxRenderer->GetDevice();
 
-	// Create index buffer
+	// Create vertex buffer
 	D3D11_BUFFER_DESC vertex_buffer_desc = {};
-	vertex_buffer_desc.Usage = D3D11_USAGE_DEFAULT;
-	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(Vertex) * Vertices.size());
+	vertex_buffer_desc.Usage = D3D11_USAGE_IMMUTABLE;
+	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(Vertex) * vertices.size());
 	vertex_buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 
 	D3D11_SUBRESOURCE_DATA vertex_subdata = {};
-	vertex_subdata.pSysMem = Vertices.data();
+	vertex_subdata.pSysMem = vertices.data();
 
-	DX::Check(d3dDevice->CreateBuffer(&vertex_buffer_desc, &vertex_subdata, m_d3dVertexBuffer.ReleaseAndGetAddressOf()));
+	ComPtr<ID3D11Buffer> vertex_buffer = nullptr;
+	DX::Check(d3dDevice->CreateBuffer(&vertex_buffer_desc, &vertex_subdata, vertex_buffer.ReleaseAndGetAddressOf()));
+	return vertex_buffer;
 }
 
 void DX::Model::CreateIndexBuffer()
@@ -94,16 +177,105 @@ void DX::Model::LoadTexture()
 		resource.ReleaseAndGetAddressOf(), m_DiffuseTexture.ReleaseAndGetAddressOf()));
 }
 
-void DX::Model::Render()
+float DX::Model::GetMaxTessellationRate() const
+{
+	// Quadtree patches multiply the rate by their edge factors, the tiles' patches by one
+	float max_edge = QUADTREE_LOD ? QUADTREE_TESSELLATION : 1.0f;
+	return D3D11_TESSELLATOR_MAX_TESSELLATION_FACTOR / max_edge;
+}
+
+void DX::Model::Render(DX::Camera* camera)
+{
+	if (QUADTREE_LOD)
+	{
+		RenderPatches(camera);
+	}
+	else
+	{
+		RenderTiles(camera);
+	}
+}
+
+void DX::Model::CreatePatchVertexBuffer(size_t patch_count)
 {
+	auto d3dDevice = m_DxRenderer->GetDevice();
+
+	// Written by the CPU every frame, four control points a patch
+	D3D11_BUFFER_DESC vertex_buffer_desc = {};
+	vertex_buffer_desc.Usage = D3D11_USAGE_DYNAMIC;
+	vertex_buffer_desc.ByteWidth = static_cast<UINT>(sizeof(Vertex) * 4 * std::max<size_t>(patch_count, 1));
+	vertex_buffer_desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	vertex_buffer_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	DX::Check(d3dDevice->CreateBuffer(&vertex_buffer_desc, nullptr, m_d3dPatchVertexBuffer.ReleaseAndGetAddressOf()));
+}
+
+void DX::Model::RenderPatches(DX::Camera* camera)
+{
+	// Terrain space starts at the first texel with rows along +z, the world has the terrain centred with rows along -z
+	float half_size = m_TerrainSize * 0.5f;
+	auto terrain_to_world = DirectX::XMMatrixMultiply(DirectX::XMMatrixScaling(1.0f, 1.0f, -1.0f), DirectX::XMMatrixTranslation(-half_size, 0.0f, half_size));
+	auto terrain_view = DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(terrain_to_world, World), camera->GetView());
+	auto eye = DirectX::XMMatrixInverse(nullptr, terrain_view).r[3];
+
+	m_Quadtree->Select(DirectX::XMMatrixMultiply(terrain_view, camera->GetProjection()), eye, camera->GetFieldOfViewRadians(), static_cast<float>(camera->GetViewportHeight()),
+		QUADTREE_PIXEL_ERROR, QUADTREE_TESSELLATION, m_Patches);
+
+	if (m_Patches.empty())
+		return;
+
 	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
 
+	D3D11_MAPPED_SUBRESOURCE mapped_resource = {};
+	DX::Check(d3dDeviceContext->Map(m_d3dPatchVertexBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped_resource));
+
+	// Corners in the quad grid's control point order
+	Vertex* vertices = static_cast<Vertex*>(mapped_resource.pData);
+	for (const auto& patch : m_Patches)
+	{
+		for (uint32_t corner = 0; corner < 4; ++corner)
+		{
+			uint32_t texel_x = patch.x + (corner & 1) * patch.size;
+			uint32_t texel_z = patch.z + (corner >> 1) * patch.size;
+
+			Vertex& vertex = *vertices++;
+			vertex.x = -half_size + texel_x * m_CellSpacing;
+			vertex.y = patch.heights[corner] * m_HeightScale;
+			vertex.z = half_size - texel_z * m_CellSpacing;
+			vertex.u = static_cast<float>(texel_x) / (HEIGHTMAP_SIZE - 1);
+			vertex.v = static_cast<float>(texel_z) / (HEIGHTMAP_SIZE - 1);
+			std::copy(std::begin(patch.edges), std::end(patch.edges), vertex.edges);
+		}
+	}
+
+	d3dDeviceContext->Unmap(m_d3dPatchVertexBuffer.Get(), 0);
+
 	// We need the stride and offset for the vertex
 	UINT vertex_stride = sizeof(Vertex);
 	auto vertex_offset = 0u;
 
 	// Bind the vertex buffer to the pipeline's Input Assembler stage
-	d3dDeviceContext->IASetVertexBuffers(0, 1, m_d3dVertexBuffer.GetAddressOf(), &vertex_stride, &vertex_offset);
+	d3dDeviceContext->IASetVertexBuffers(0, 1, m_d3dPatchVertexBuffer.GetAddressOf(), &vertex_stride, &vertex_offset);
+
+	// Bind the geometry topology to the pipeline's Input Assembler stage
+	d3dDeviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_4_CONTROL_POINT_PATCHLIST);
+
+	// Bind texture to the pixel shader
+	d3dDeviceContext->PSSetShaderResources(0, 1, m_DiffuseTexture.GetAddressOf());
+
+	// Render geometry
+	d3dDeviceContext->Draw(static_cast<UINT>(m_Patches.size() * 4), 0);
+}
+
+void DX::Model::RenderTiles(DX::Camera* camera)
+{
+	UpdateTiles(camera);
+
+	auto d3dDeviceContext = m_DxRenderer->GetDeviceContext();
+
+	// We need the stride and offset for the vertex
+	UINT vertex_stride = sizeof(Vertex);
+	auto vertex_offset = 0u;
 
 	// Bind the index buffer to the pipeline's Input Assembler stage
 	d3dDeviceContext->IASetIndexBuffer(m_d3dIndexBuffer.Get(), DXGI_FORMAT_R32_UINT, 0);
@@ -114,7 +286,25 @@ void DX::Model::Render()
 	// Bind texture to the pixel shader
 	d3dDeviceContext->PSSetShaderResources(0, 1, m_DiffuseTexture.GetAddressOf());
 
-	// Render geometry
-	d3dDeviceContext->DrawIndexed(static_cast<UINT>(Indices.size()), 0, 0);
+	// Tiles are culled by their box, from the bounds in the tiled file
+	DX::Frustum frustum(DirectX::XMMatrixMultiply(DirectX::XMMatrixMultiply(World, camera->GetView()), camera->GetProjection()));
+	const auto& layout = m_TerrainStreamer->GetLayout();
+	float half_size = m_TerrainSize * 0.5f;
+
+	for (auto& mesh : m_TileMeshes)
+	{
+		const DX::TerrainTile& tile = *mesh.second.tile;
+		const DX::TerrainTileBounds& bounds = m_TerrainStreamer->GetBounds(tile.x, tile.z);
+
+		DirectX::XMFLOAT3 low(-half_size + tile.x * layout.tile_size * m_CellSpacing, bounds.min_height * m_HeightScale, half_size - (tile.z + 1) * layout.tile_size * m_CellSpacing);
+		DirectX::XMFLOAT3 high(low.x + layout.tile_size * m_CellSpacing, bounds.max_height * m_HeightScale, low.z + layout.tile_size * m_CellSpacing);
+		if (!frustum.IntersectsBox(low, high))
+			continue;
+
+		// Bind the vertex buffer to the pipeline's Input Assembler stage
+		d3dDeviceContext->IASetVertexBuffers(0, 1, mesh.second.vertexBuffer.GetAddressOf(), &vertex_stride, &vertex_offset);
+
+		// Render geometry
+		d3dDeviceContext->DrawIndexed(static_cast<UINT>(Indices.size()), 0, 0);
+	}
 }
- 
\ No newline at end of file
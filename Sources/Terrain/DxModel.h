@@ -1,7 +1,12 @@
 #pragma once
 
 #include "DxRenderer.h"
+#include "DxCamera.h"
+#include "DxTerrainTiles.h"
+#include "DxTerrainQuadtree.h"
 #include <vector>
+#include <memory>
+#include <unordered_map>
 #include <DirectXColors.h>
 
 namespace DX
@@ -16,6 +21,9 @@ namespace DX
 		// Texture UV
 		float u = 0;
 		float v = 0;
+
+		// Patch edge tessellation factors, zero leaves it to the shader's rate alone
+		float edges[4] = {};
 	};
 
 	class Model
@@ -27,25 +35,24 @@ namespace DX
 		// Create device
 		void Create();
 
-		// Render the model
-		void Render();
+		// Render the terrain as the camera sees it
+		void Render(DX::Camera* camera);
+
+		// Highest tessellation rate before the largest patch edge factor passes the hardware's limit
+		float GetMaxTessellationRate() const;
 
 		// World 
 		DirectX::XMMATRIX World = DirectX::XMMatrixIdentity();
 
-		// Vertices
+		// Vertices, of one tile's patch grid before it is moved into place
 		std::vector<Vertex> Vertices;
 
-		// Indices
+		// Indices, of one tile's patches and shared by every tile
 		std::vector<UINT> Indices;
 
 	private:
 		DX::Renderer* m_DxRenderer = nullptr;
 
-		// Vertex buffer
-		ComPtr<ID3D11Buffer> m_d3dVertexBuffer = nullptr;
-		void CreateVertexBuffer();
-
 		// Index buffer
 		ComPtr<ID3D11Buffer> m_d3dIndexBuffer = nullptr;
 		void CreateIndexBuffer();
@@ -54,20 +61,38 @@ namespace DX
 		ComPtr<ID3D11ShaderResourceView> m_DiffuseTexture = nullptr;
 		void LoadTexture();
 
-		// Heightmap
-		std::vector<float> m_Heightmap;
-		std::vector<DirectX::XMFLOAT2> mPatchBoundsY;
-		void CalcPatchBoundsY(UINT i, UINT j);
-
-		int CellsPerPatch = 64;
-		float m_HeightScale = 50.0f;
-		float m_HeightmapWidth = 2049;
-		float m_HeightmapHeight = 2049;
-		float m_CellSpacing = 0.5f;
-
-		float mNumPatchVertRows = 0;
-		float mNumPatchVertCols = 0;
-		float mNumPatchVertices = 0;
-		float mNumPatchQuadFaces = 0;
+		// Tiled heightmap, streamed in around the camera when the tiles are drawn rather than the quadtree
+		std::unique_ptr<DX::TerrainStreamer> m_TerrainStreamer = nullptr;
+		void CreateTiles();
+
+		// Vertex buffer of every loaded tile, by tile index
+		struct TileMesh
+		{
+			std::shared_ptr<const DX::TerrainTile> tile;
+			ComPtr<ID3D11Buffer> vertexBuffer;
+		};
+
+		std::unordered_map<uint32_t, TileMesh> m_TileMeshes;
+		void UpdateTiles(DX::Camera* camera);
+		ComPtr<ID3D11Buffer> CreateTileVertexBuffer(const DX::TerrainTile& tile);
+
+		// Stream the tiles around the camera and render the ones it can see
+		void RenderTiles(DX::Camera* camera);
+
+		// Quadtree over the whole heightmap, and the patches it picked this frame. Only built when it draws
+		std::unique_ptr<DX::TerrainQuadtree> m_Quadtree = nullptr;
+		std::vector<DX::TerrainPatch> m_Patches;
+
+		// Patch control points, rewritten every frame
+		ComPtr<ID3D11Buffer> m_d3dPatchVertexBuffer = nullptr;
+		void CreatePatchVertexBuffer(size_t patch_count);
+
+		// Render the patches the quadtree picks for the camera
+		void RenderPatches(DX::Camera* camera);
+
+		// Terrain size in world units, and heightmap values to world heights
+		float m_TerrainSize = 3.0f;
+		float m_HeightScale = 1.0f / 255.0f;
+		float m_CellSpacing = 0.0f;
 	};
 }
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "DxTerrainQuadtree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	// Selected levels are kept per leaf, with the top bit set for nodes outside the frustum
+	constexpr uint8_t EMPTY_LEVEL = 0xff;
+	constexpr uint8_t CULLED_LEVEL = 0x80;
+
+	float Bilinear(float h00, float h10, float h01, float h11, float u, float v)
+	{
+		return (h00 * (1.0f - u) + h10 * u) * (1.0f - v) + (h01 * (1.0f - u) + h11 * u) * v;
+	}
+}
+
+DX::TerrainQuadtree::TerrainQuadtree(const HeightmapRows& rows, uint32_t width, uint32_t height, uint32_t leaf_size, float cell_spacing, float height_scale)
+	: m_LeafSize(std::max(leaf_size, 1u)), m_CellSpacing(cell_spacing), m_HeightScale(height_scale)
+{
+	// Leaves a side, a power of two so every node splits evenly
+	uint32_t cells = std::max(std::max(width, height), 2u) - 1;
+	uint32_t depth = 0;
+	m_LeafCount = 1;
+	while (static_cast<uint64_t>(m_LeafCount) * m_LeafSize < cells)
+	{
+		m_LeafCount *= 2;
+		depth++;
+	}
+
+	m_Levels.resize(depth + 1);
+	for (uint32_t level = 0; level <= depth; ++level)
+	{
+		m_Levels[level].resize(static_cast<size_t>(1) << (level * 2));
+	}
+
+	m_Corners.resize(static_cast<size_t>(m_LeafCount + 1) * (m_LeafCount + 1));
+	m_CornerWidth = (std::max(width, 2u) - 1 + m_LeafSize - 1) / m_LeafSize + 1;
+	m_CornerHeight = (std::max(height, 2u) - 1 + m_LeafSize - 1) / m_LeafSize + 1;
+	m_SelectedLevel.resize(static_cast<size_t>(m_LeafCount) * m_LeafCount, EMPTY_LEVEL);
+	m_StitchedCorners.resize(m_Corners.size());
+
+	// Leaves from bands of leaf_size + 1 rows, samples past the edge repeat the last ones
+	std::vector<float> band(static_cast<size_t>(m_LeafSize + 1) * width);
+	auto sample = [&](uint32_t x, uint32_t k) { return band[static_cast<size_t>(k) * width + std::min(x, width - 1)]; };
+
+	std::vector<Node>& leaves = m_Levels[depth];
+	for (uint32_t z = 0; z < m_LeafCount; ++z)
+	{
+		uint32_t z0 = z * m_LeafSize;
+		for (uint32_t k = 0; k <= m_LeafSize; ++k)
+		{
+			rows(std::min(z0 + k, height - 1), band.data() + static_cast<size_t>(k) * width);
+		}
+
+		for (uint32_t x = 0; x <= m_LeafCount; ++x)
+		{
+			m_Corners[static_cast<size_t>(z) * (m_LeafCount + 1) + x] = sample(x * m_LeafSize, 0);
+			if (z + 1 == m_LeafCount)
+			{
+				m_Corners[static_cast<size_t>(z + 1) * (m_LeafCount + 1) + x] = sample(x * m_LeafSize, m_LeafSize);
+			}
+		}
+
+		for (uint32_t x = 0; x < m_LeafCount; ++x)
+		{
+			Node& node = leaves[static_cast<size_t>(z) * m_LeafCount + x];
+			uint32_t x0 = x * m_LeafSize;
+			if (x0 >= width - 1 || z0 >= height - 1)
+			{
+				node.min_height = std::numeric_limits<float>::max();
+				node.max_height = std::numeric_limits<float>::lowest();
+				continue;
+			}
+
+			float h00 = sample(x0, 0);
+			float h10 = sample(x0 + m_LeafSize, 0);
+			float h01 = sample(x0, m_LeafSize);
+			float h11 = sample(x0 + m_LeafSize, m_LeafSize);
+
+			node.min_height = std::numeric_limits<float>::max();
+			node.max_height = std::numeric_limits<float>::lowest();
+			for (uint32_t k = 0; k <= m_LeafSize; ++k)
+			{
+				for (uint32_t i = 0; i <= m_LeafSize; ++i)
+				{
+					float value = sample(x0 + i, k);
+					float patch = Bilinear(h00, h10, h01, h11, static_cast<float>(i) / m_LeafSize, static_cast<float>(k) / m_LeafSize);
+					node.min_height = std::min(node.min_height, value);
+					node.max_height = std::max(node.max_height, value);
+					node.error = std::max(node.error, std::abs(value - patch));
+				}
+			}
+
+			m_LeafPatchCount++;
+		}
+	}
+
+	// Parents bound their children. A child is its own bilinear patch give or take its error, and two bilinear
+	// patches differ most at the child's corners, so that difference plus the child's error bounds the parent
+	for (uint32_t level = depth; level-- > 0;)
+	{
+		uint32_t nodes = 1u << level;
+		uint32_t size = m_LeafCount >> level;
+		for (uint32_t z = 0; z < nodes; ++z)
+		{
+			for (uint32_t x = 0; x < nodes; ++x)
+			{
+				Node& node = m_Levels[level][static_cast<size_t>(z) * nodes + x];
+				node.min_height = std::numeric_limits<float>::max();
+				node.max_height = std::numeric_limits<float>::lowest();
+
+				uint32_t x0 = x * size;
+				uint32_t z0 = z * size;
+				float h00 = GetCorner(x0, z0);
+				float h10 = GetCorner(x0 + size, z0);
+				float h01 = GetCorner(x0, z0 + size);
+				float h11 = GetCorner(x0 + size, z0 + size);
+
+				for (uint32_t child = 0; child < 4; ++child)
+				{
+					uint32_t cx = x * 2 + (child & 1);
+					uint32_t cz = z * 2 + (child >> 1);
+					const Node& child_node = m_Levels[level + 1][static_cast<size_t>(cz) * nodes * 2 + cx];
+					if (child_node.IsEmpty())
+						continue;
+
+					float deviation = 0.0f;
+					uint32_t half = size / 2;
+					for (uint32_t corner = 0; corner < 4; ++corner)
+					{
+						uint32_t gx = cx * half + (corner & 1) * half;
+						uint32_t gz = cz * half + (corner >> 1) * half;
+						float patch = Bilinear(h00, h10, h01, h11, static_cast<float>(gx - x0) / size, static_cast<float>(gz - z0) / size);
+						deviation = std::max(deviation, std::abs(GetCorner(gx, gz) - patch));
+					}
+
+					node.min_height = std::min(node.min_height, child_node.min_height);
+					node.max_height = std::max(node.max_height, child_node.max_height);
+					node.error = std::max(node.error, child_node.error + deviation);
+				}
+			}
+		}
+	}
+}
+
+DX::TerrainSelectionStatistics DX::TerrainQuadtree::Select(DirectX::FXMMATRIX view_projection, DirectX::FXMVECTOR eye, float field_of_view_radians, float viewport_height,
+	float pixel_error, float tessellation, std::vector<TerrainPatch>& patches)
+{
+	TerrainSelectionStatistics statistics;
+	patches.clear();
+	m_Selected.clear();
+	std::fill(m_SelectedLevel.begin(), m_SelectedLevel.end(), EMPTY_LEVEL);
+	std::fill(m_StitchedCorners.begin(), m_StitchedCorners.end(), std::numeric_limits<float>::quiet_NaN());
+
+	DX::Frustum frustum(view_projection);
+	DirectX::XMFLOAT3 eye_position;
+	DirectX::XMStoreFloat3(&eye_position, eye);
+
+	// Pixels a unit of error covers at a distance of one
+	float pixels_per_unit = viewport_height / (2.0f * std::tan(field_of_view_radians * 0.5f));
+	uint32_t leaf_level = GetLevelCount() - 1;
+
+	auto get_box = [this](uint32_t level, uint32_t x, uint32_t z, DirectX::XMFLOAT3& low, DirectX::XMFLOAT3& high)
+	{
+		const Node& node = m_Levels[level][(static_cast<size_t>(z) << level) + x];
+		float size = static_cast<float>(m_LeafCount >> level) * m_LeafSize * m_CellSpacing;
+		low = DirectX::XMFLOAT3(x * size, node.min_height * m_HeightScale, z * size);
+		high = DirectX::XMFLOAT3(low.x + size, node.max_height * m_HeightScale, low.z + size);
+	};
+
+	// Down from the root until a node's error is small enough on screen
+	std::vector<SelectedNode> stack;
+	if (!m_Levels[0][0].IsEmpty())
+	{
+		stack.push_back({ 0, 0, 0, true });
+	}
+
+	while (!stack.empty())
+	{
+		SelectedNode node = stack.back();
+		stack.pop_back();
+		statistics.nodes_visited++;
+
+		DirectX::XMFLOAT3 low;
+		DirectX::XMFLOAT3 high;
+		get_box(node.level, node.x, node.z, low, high);
+		if (!frustum.IntersectsBox(low, high))
+		{
+			node.visible = false;
+			statistics.frustum_culled++;
+			m_Selected.push_back(node);
+			MarkSelected(node);
+			continue;
+		}
+
+		float dx = std::max({ low.x - eye_position.x, 0.0f, eye_position.x - high.x });
+		float dy = std::max({ low.y - eye_position.y, 0.0f, eye_position.y - high.y });
+		float dz = std::max({ low.z - eye_position.z, 0.0f, eye_position.z - high.z });
+		float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+		const Node& data = m_Levels[node.level][(static_cast<size_t>(node.z) << node.level) + node.x];
+		bool split = node.level < leaf_level && (distance <= 0.0f || data.error * m_HeightScale * pixels_per_unit / distance > pixel_error);
+		if (!split)
+		{
+			m_Selected.push_back(node);
+			MarkSelected(node);
+			continue;
+		}
+
+		for (uint32_t child = 0; child < 4; ++child)
+		{
+			SelectedNode child_node = { node.level + 1, node.x * 2 + (child & 1), node.z * 2 + (child >> 1), true };
+			if (!m_Levels[child_node.level][(static_cast<size_t>(child_node.z) << child_node.level) + child_node.x].IsEmpty())
+			{
+				stack.push_back(child_node);
+			}
+		}
+	}
+
+	// Split visible nodes until no neighbour is more than a level finer. Splitting only adds levels, so this settles
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (size_t n = 0; n < m_Selected.size(); ++n)
+		{
+			SelectedNode node = m_Selected[n];
+			if (!node.visible || node.level == leaf_level)
+				continue;
+
+			int64_t size = m_LeafCount >> node.level;
+			int64_t x0 = node.x * size;
+			int64_t z0 = node.z * size;
+			uint32_t finest = 0;
+			auto finer = [this, &finest](int64_t x, int64_t z)
+			{
+				uint32_t level = GetLevelAt(x, z);
+				if (level != EMPTY_LEVEL)
+				{
+					finest = std::max(finest, level);
+				}
+			};
+
+			for (int64_t k = 0; k < size; ++k)
+			{
+				finer(x0 - 1, z0 + k);
+				finer(x0 + size, z0 + k);
+				finer(x0 + k, z0 - 1);
+				finer(x0 + k, z0 + size);
+			}
+
+			if (finest <= node.level + 1)
+				continue;
+
+			// The children take the node's place in the list
+			SelectedNode children[4];
+			for (uint32_t child = 0; child < 4; ++child)
+			{
+				SelectedNode& child_node = children[child];
+				child_node = { node.level + 1, node.x * 2 + (child & 1), node.z * 2 + (child >> 1), false };
+				if (!m_Levels[child_node.level][(static_cast<size_t>(child_node.z) << child_node.level) + child_node.x].IsEmpty())
+				{
+					DirectX::XMFLOAT3 low;
+					DirectX::XMFLOAT3 high;
+					get_box(child_node.level, child_node.x, child_node.z, low, high);
+					child_node.visible = frustum.IntersectsBox(low, high);
+				}
+
+				MarkSelected(child_node);
+			}
+
+			m_Selected[n] = children[0];
+			m_Selected.insert(m_Selected.end(), children + 1, children + 4);
+			statistics.balance_splits++;
+			changed = true;
+		}
+	}
+
+	// Patches with their corners stitched, and edges halved where the neighbour is coarser
+	for (const auto& node : m_Selected)
+	{
+		if (!node.visible)
+			continue;
+
+		uint32_t size = m_LeafCount >> node.level;
+		uint32_t x0 = node.x * size;
+		uint32_t z0 = node.z * size;
+
+		TerrainPatch patch;
+		patch.x = x0 * m_LeafSize;
+		patch.z = z0 * m_LeafSize;
+		patch.size = size * m_LeafSize;
+		patch.level = node.level;
+		patch.heights[0] = GetStitchedHeight(x0, z0);
+		patch.heights[1] = GetStitchedHeight(x0 + size, z0);
+		patch.heights[2] = GetStitchedHeight(x0, z0 + size);
+		patch.heights[3] = GetStitchedHeight(x0 + size, z0 + size);
+
+		uint32_t coarsest[4] = { node.level, node.level, node.level, node.level };
+		auto coarser = [this](uint32_t& current, int64_t x, int64_t z)
+		{
+			uint32_t level = GetLevelAt(x, z);
+			if (level != EMPTY_LEVEL)
+			{
+				current = std::min(current, level);
+			}
+		};
+
+		for (uint32_t k = 0; k < size; ++k)
+		{
+			coarser(coarsest[EDGE_X0], static_cast<int64_t>(x0) - 1, z0 + k);
+			coarser(coarsest[EDGE_Z0], x0 + k, static_cast<int64_t>(z0) - 1);
+			coarser(coarsest[EDGE_X1], static_cast<int64_t>(x0) + size, z0 + k);
+			coarser(coarsest[EDGE_Z1], x0 + k, static_cast<int64_t>(z0) + size);
+		}
+
+		for (uint32_t edge = 0; edge < 4; ++edge)
+		{
+			patch.edges[edge] = coarsest[edge] < node.level ? tessellation * 0.5f : tessellation;
+		}
+
+		patches.push_back(patch);
+	}
+
+	statistics.patches = patches.size();
+	return statistics;
+}
+
+DX::HeightmapRows DX::TerrainQuadtree::GetCornerRows() const
+{
+	return [this](uint32_t z, float* row)
+	{
+		for (uint32_t x = 0; x < m_CornerWidth; ++x)
+		{
+			row[x] = GetCorner(x, z);
+		}
+	};
+}
+
+void DX::TerrainQuadtree::MarkSelected(const SelectedNode& node)
+{
+	bool empty = m_Levels[node.level][(static_cast<size_t>(node.z) << node.level) + node.x].IsEmpty();
+	uint8_t value = empty ? EMPTY_LEVEL : static_cast<uint8_t>(node.level | (node.visible ? 0 : CULLED_LEVEL));
+
+	uint32_t size = m_LeafCount >> node.level;
+	for (uint32_t z = node.z * size; z < (node.z + 1) * size; ++z)
+	{
+		std::fill_n(m_SelectedLevel.begin() + static_cast<size_t>(z) * m_LeafCount + node.x * size, size, value);
+	}
+}
+
+uint32_t DX::TerrainQuadtree::GetLevelAt(int64_t x, int64_t z) const
+{
+	// Only visible nodes count, nothing is drawn next to the others
+	if (x < 0 || z < 0 || x >= m_LeafCount || z >= m_LeafCount)
+		return EMPTY_LEVEL;
+
+	uint8_t value = m_SelectedLevel[static_cast<size_t>(z) * m_LeafCount + x];
+	return value == EMPTY_LEVEL || (value & CULLED_LEVEL) != 0 ? EMPTY_LEVEL : value;
+}
+
+float DX::TerrainQuadtree::GetStitchedHeight(uint32_t x, uint32_t z)
+{
+	float& stitched = m_StitchedCorners[static_cast<size_t>(z) * (m_LeafCount + 1) + x];
+	if (!std::isnan(stitched))
+		return stitched;
+
+	// A corner in the middle of a coarser node's edge takes the height of that edge, the coarsest one wins.
+	// The ends of that edge are corners of an even larger node or none, so this ends
+	float height = GetCorner(x, z);
+	uint32_t best_size = 0;
+
+	for (uint32_t around = 0; around < 4; ++around)
+	{
+		int64_t cx = static_cast<int64_t>(x) - (around & 1);
+		int64_t cz = static_cast<int64_t>(z) - (around >> 1);
+		if (cx < 0 || cz < 0 || cx >= m_LeafCount || cz >= m_LeafCount)
+			continue;
+
+		uint8_t value = m_SelectedLevel[static_cast<size_t>(cz) * m_LeafCount + cx];
+		if (value == EMPTY_LEVEL)
+			continue;
+
+		uint32_t size = m_LeafCount >> (value & ~CULLED_LEVEL);
+		uint32_t x0 = static_cast<uint32_t>(cx) / size * size;
+		uint32_t z0 = static_cast<uint32_t>(cz) / size * size;
+		bool on_x_edge = x == x0 || x == x0 + size;
+		bool on_z_edge = z == z0 || z == z0 + size;
+		if ((on_x_edge && on_z_edge) || size <= best_size)
+			continue;
+
+		best_size = size;
+		if (on_x_edge)
+		{
+			float t = static_cast<float>(z - z0) / size;
+			height = GetStitchedHeight(x, z0) * (1.0f - t) + GetStitchedHeight(x, z0 + size) * t;
+		}
+		else
+		{
+			float t = static_cast<float>(x - x0) / size;
+			height = GetStitchedHeight(x0, z) * (1.0f - t) + GetStitchedHeight(x0 + size, z) * t;
+		}
+	}
+
+	stitched = height;
+	return height;
+}
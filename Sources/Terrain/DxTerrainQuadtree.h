@@ -0,0 +1,117 @@
+#pragma once
+
+#include "DxTerrainTiles.h"
+#include "DxFrustum.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// Patch edges in SV_TessFactor order for the quad domain, with control points ordered like the quad grid:
+	// (x0, z0), (x1, z0), (x0, z1), (x1, z1)
+	enum TerrainPatchEdge
+	{
+		EDGE_X0 = 0,
+		EDGE_Z0 = 1,
+		EDGE_X1 = 2,
+		EDGE_Z1 = 3
+	};
+
+	// One quad patch to draw, a node the quadtree chose. Corners on the edge of a coarser neighbour are moved
+	// onto that edge and the edge factors along it are halved, so both sides put their vertices in the same place
+	struct TerrainPatch
+	{
+		// First cell and size in cells
+		uint32_t x = 0;
+		uint32_t z = 0;
+		uint32_t size = 0;
+		uint32_t level = 0;
+
+		// Corner heights in control point order, and tessellation factors in edge order
+		float heights[4] = {};
+		float edges[4] = {};
+	};
+
+	// What a selection looked at
+	struct TerrainSelectionStatistics
+	{
+		size_t nodes_visited = 0;
+		size_t frustum_culled = 0;
+		size_t balance_splits = 0;
+		size_t patches = 0;
+	};
+
+	// Quadtree over a heightmap with the height bounds and the error of every node, for picking patches on the
+	// CPU. Terrain space has cells cell_spacing apart along x and z, starting at the origin with rows along +z,
+	// and heights scaled by height_scale. Leaves are leaf_size cells a side
+	class TerrainQuadtree
+	{
+	public:
+		TerrainQuadtree(const HeightmapRows& rows, uint32_t width, uint32_t height, uint32_t leaf_size, float cell_spacing, float height_scale);
+		virtual ~TerrainQuadtree() = default;
+
+		// Levels, the root is level 0 and leaves are the last
+		uint32_t GetLevelCount() const { return static_cast<uint32_t>(m_Levels.size()); }
+
+		// Leaves that hold some of the heightmap, what drawing the full grid of patches would submit
+		size_t GetLeafPatchCount() const { return m_LeafPatchCount; }
+
+		// Leaf corners a side under those leaves, leaf_size cells apart. Patches are bilinear between them, so
+		// a heightmap of these corners is the surface at full detail
+		uint32_t GetCornerWidth() const { return m_CornerWidth; }
+		uint32_t GetCornerHeight() const { return m_CornerHeight; }
+
+		// Corner heights a row at a time, before height_scale, the way the heightmap was read
+		HeightmapRows GetCornerRows() const;
+
+		// Patches that keep the projected error of every visible node under pixel_error. Nodes outside the
+		// frustum of view_projection are dropped, neighbours differ by one level at most. The matrix and eye
+		// are in terrain space, tessellation is the factor along a patch edge with neighbours of the same size
+		TerrainSelectionStatistics Select(DirectX::FXMMATRIX view_projection, DirectX::FXMVECTOR eye, float field_of_view_radians, float viewport_height,
+			float pixel_error, float tessellation, std::vector<TerrainPatch>& patches);
+
+	private:
+		// Height bounds, and how far the heights stray from the node drawn as one bilinear patch. Empty nodes
+		// lie past the edge of the heightmap
+		struct Node
+		{
+			float min_height = 0.0f;
+			float max_height = 0.0f;
+			float error = 0.0f;
+
+			bool IsEmpty() const { return min_height > max_height; }
+		};
+
+		std::vector<std::vector<Node>> m_Levels;
+		uint32_t m_LeafSize = 0;
+		uint32_t m_LeafCount = 0;
+		size_t m_LeafPatchCount = 0;
+		uint32_t m_CornerWidth = 0;
+		uint32_t m_CornerHeight = 0;
+		float m_CellSpacing = 0.0f;
+		float m_HeightScale = 0.0f;
+
+		// Heights at the corners of every leaf, every node's corners are among them
+		std::vector<float> m_Corners;
+		float GetCorner(uint32_t x, uint32_t z) const { return m_Corners[static_cast<size_t>(z) * (m_LeafCount + 1) + x]; }
+
+		// Level chosen for every leaf this selection, and the chosen nodes
+		struct SelectedNode
+		{
+			uint32_t level = 0;
+			uint32_t x = 0;
+			uint32_t z = 0;
+			bool visible = false;
+		};
+
+		std::vector<uint8_t> m_SelectedLevel;
+		std::vector<SelectedNode> m_Selected;
+		void MarkSelected(const SelectedNode& node);
+		uint32_t GetLevelAt(int64_t x, int64_t z) const;
+
+		// Corner heights after stitching, worked out once per selection as corners are shared and stitching recurses
+		std::vector<float> m_StitchedCorners;
+		float GetStitchedHeight(uint32_t x, uint32_t z);
+	};
+}
@@ -0,0 +1,383 @@
+#include "DxTerrainSampler.h"
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+namespace
+{
+	// How far past a node's edge, in cells, the ray is looked up so it lands in the next node
+	constexpr double NODE_NUDGE = 1e-5;
+
+	// Span of t where origin + direction * t lies within [low, high] along one axis
+	void ClipSlab(double origin, double direction, double low, double high, double& t_begin, double& t_end)
+	{
+		if (direction == 0.0)
+		{
+			if (origin < low || origin > high)
+			{
+				t_begin = std::numeric_limits<double>::infinity();
+			}
+
+			return;
+		}
+
+		double t0 = (low - origin) / direction;
+		double t1 = (high - origin) / direction;
+		t_begin = std::max(t_begin, std::min(t0, t1));
+		t_end = std::min(t_end, std::max(t0, t1));
+	}
+}
+
+DX::TerrainSampler::TerrainSampler(const HeightmapRows& rows, uint32_t width, uint32_t height, DirectX::XMFLOAT2 origin, DirectX::XMFLOAT2 cell_size, float height_scale)
+	: m_Width(width), m_Height(height), m_Origin(origin), m_CellSize(cell_size)
+{
+	if (width < 2 || height < 2 || cell_size.x == 0.0f || cell_size.y == 0.0f)
+		throw std::runtime_error("Terrain sampler needs at least one cell of non zero size");
+
+	m_InverseCellSize = DirectX::XMFLOAT2(1.0f / cell_size.x, 1.0f / cell_size.y);
+
+	m_Heights.resize(static_cast<size_t>(width) * height);
+	for (uint32_t z = 0; z < height; ++z)
+	{
+		float* row = m_Heights.data() + static_cast<size_t>(z) * width;
+		rows(z, row);
+
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			row[x] *= height_scale;
+		}
+	}
+
+	CreateBoundsLevels();
+}
+
+void DX::TerrainSampler::CreateBoundsLevels()
+{
+	// A patch never leaves the range of its corners
+	BoundsLevel cells;
+	cells.width = m_Width - 1;
+	cells.height = m_Height - 1;
+	cells.bounds.resize(static_cast<size_t>(cells.width) * cells.height);
+	for (uint32_t z = 0; z < cells.height; ++z)
+	{
+		for (uint32_t x = 0; x < cells.width; ++x)
+		{
+			const float* texel = m_Heights.data() + static_cast<size_t>(z) * m_Width + x;
+			auto& bounds = cells.bounds[static_cast<size_t>(z) * cells.width + x];
+			bounds.min_height = std::min(std::min(texel[0], texel[1]), std::min(texel[m_Width], texel[m_Width + 1]));
+			bounds.max_height = std::max(std::max(texel[0], texel[1]), std::max(texel[m_Width], texel[m_Width + 1]));
+		}
+	}
+
+	m_BoundsLevels.push_back(std::move(cells));
+
+	while (m_BoundsLevels.back().width > 1 || m_BoundsLevels.back().height > 1)
+	{
+		const auto& below = m_BoundsLevels.back();
+
+		BoundsLevel level;
+		level.width = (below.width + 1) / 2;
+		level.height = (below.height + 1) / 2;
+		level.bounds.resize(static_cast<size_t>(level.width) * level.height);
+		for (uint32_t z = 0; z < level.height; ++z)
+		{
+			for (uint32_t x = 0; x < level.width; ++x)
+			{
+				auto& bounds = level.bounds[static_cast<size_t>(z) * level.width + x];
+				bounds.min_height = std::numeric_limits<float>::max();
+				bounds.max_height = std::numeric_limits<float>::lowest();
+
+				// Children past an odd edge do not exist
+				for (uint32_t child_z = z * 2; child_z < std::min(z * 2 + 2, below.height); ++child_z)
+				{
+					for (uint32_t child_x = x * 2; child_x < std::min(x * 2 + 2, below.width); ++child_x)
+					{
+						const auto& child = below.bounds[static_cast<size_t>(child_z) * below.width + child_x];
+						bounds.min_height = std::min(bounds.min_height, child.min_height);
+						bounds.max_height = std::max(bounds.max_height, child.max_height);
+					}
+				}
+			}
+		}
+
+		m_BoundsLevels.push_back(std::move(level));
+	}
+}
+
+float DX::TerrainSampler::GetHeight(float x, float z) const
+{
+	auto cells = GetCells(DirectX::XMVectorReplicate(x), DirectX::XMVectorReplicate(z));
+	return DirectX::XMVectorGetX(GetHeights(cells));
+}
+
+DirectX::XMFLOAT3 DX::TerrainSampler::GetNormal(float x, float z) const
+{
+	auto cells = GetCells(DirectX::XMVectorReplicate(x), DirectX::XMVectorReplicate(z));
+
+	DirectX::XMVECTOR nx, ny, nz;
+	GetNormals(cells, nx, ny, nz);
+	return DirectX::XMFLOAT3(DirectX::XMVectorGetX(nx), DirectX::XMVectorGetX(ny), DirectX::XMVectorGetX(nz));
+}
+
+void DX::TerrainSampler::GetHeights(const float* x, const float* z, float* heights, size_t count) const
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto cells = GetCells(DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(x + i)), DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(z + i)));
+		DirectX::XMStoreFloat4(reinterpret_cast<DirectX::XMFLOAT4*>(heights + i), GetHeights(cells));
+	}
+
+	for (; i < count; ++i)
+	{
+		heights[i] = GetHeight(x[i], z[i]);
+	}
+}
+
+void DX::TerrainSampler::GetNormals(const float* x, const float* z, DirectX::XMFLOAT3* normals, size_t count) const
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto cells = GetCells(DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(x + i)), DirectX::XMLoadFloat4(reinterpret_cast<const DirectX::XMFLOAT4*>(z + i)));
+
+		DirectX::XMVECTOR nx, ny, nz;
+		GetNormals(cells, nx, ny, nz);
+
+		// Back from a component per register to a normal per position
+		DirectX::XMFLOAT4 x4, y4, z4;
+		DirectX::XMStoreFloat4(&x4, nx);
+		DirectX::XMStoreFloat4(&y4, ny);
+		DirectX::XMStoreFloat4(&z4, nz);
+
+		normals[i + 0] = DirectX::XMFLOAT3(x4.x, y4.x, z4.x);
+		normals[i + 1] = DirectX::XMFLOAT3(x4.y, y4.y, z4.y);
+		normals[i + 2] = DirectX::XMFLOAT3(x4.z, y4.z, z4.z);
+		normals[i + 3] = DirectX::XMFLOAT3(x4.w, y4.w, z4.w);
+	}
+
+	for (; i < count; ++i)
+	{
+		normals[i] = GetNormal(x[i], z[i]);
+	}
+}
+
+DX::TerrainSampler::Cells DX::TerrainSampler::GetCells(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z) const
+{
+	// Position in texels, clamped onto the heightmap
+	auto u = DirectX::XMVectorMultiply(DirectX::XMVectorSubtract(x, DirectX::XMVectorReplicate(m_Origin.x)), DirectX::XMVectorReplicate(m_InverseCellSize.x));
+	auto v = DirectX::XMVectorMultiply(DirectX::XMVectorSubtract(z, DirectX::XMVectorReplicate(m_Origin.y)), DirectX::XMVectorReplicate(m_InverseCellSize.y));
+	u = DirectX::XMVectorClamp(u, DirectX::XMVectorZero(), DirectX::XMVectorReplicate(static_cast<float>(m_Width - 1)));
+	v = DirectX::XMVectorClamp(v, DirectX::XMVectorZero(), DirectX::XMVectorReplicate(static_cast<float>(m_Height - 1)));
+
+	// The last row and column of texels belong to the cells before them
+	auto cell_u = DirectX::XMVectorMin(DirectX::XMVectorFloor(u), DirectX::XMVectorReplicate(static_cast<float>(m_Width - 2)));
+	auto cell_v = DirectX::XMVectorMin(DirectX::XMVectorFloor(v), DirectX::XMVectorReplicate(static_cast<float>(m_Height - 2)));
+
+	DirectX::XMFLOAT4 cell_x, cell_z;
+	DirectX::XMStoreFloat4(&cell_x, cell_u);
+	DirectX::XMStoreFloat4(&cell_z, cell_v);
+
+	// Gather the corners of every cell
+	const float* cell_xs = &cell_x.x;
+	const float* cell_zs = &cell_z.x;
+	DirectX::XMFLOAT4 h00, h10, h01, h11;
+	float* corners[4] = { &h00.x, &h10.x, &h01.x, &h11.x };
+	for (size_t lane = 0; lane < 4; ++lane)
+	{
+		const float* texel = m_Heights.data() + static_cast<size_t>(cell_zs[lane]) * m_Width + static_cast<size_t>(cell_xs[lane]);
+		corners[0][lane] = texel[0];
+		corners[1][lane] = texel[1];
+		corners[2][lane] = texel[m_Width];
+		corners[3][lane] = texel[m_Width + 1];
+	}
+
+	Cells cells;
+	cells.h00 = DirectX::XMLoadFloat4(&h00);
+	cells.h10 = DirectX::XMLoadFloat4(&h10);
+	cells.h01 = DirectX::XMLoadFloat4(&h01);
+	cells.h11 = DirectX::XMLoadFloat4(&h11);
+	cells.u = DirectX::XMVectorSubtract(u, cell_u);
+	cells.v = DirectX::XMVectorSubtract(v, cell_v);
+	return cells;
+}
+
+DirectX::XMVECTOR DX::TerrainSampler::GetHeights(const Cells& cells) const
+{
+	// The domain shader's interpolation, along u on both edges then along v
+	auto h0 = DirectX::XMVectorLerpV(cells.h00, cells.h10, cells.u);
+	auto h1 = DirectX::XMVectorLerpV(cells.h01, cells.h11, cells.u);
+	return DirectX::XMVectorLerpV(h0, h1, cells.v);
+}
+
+void DX::TerrainSampler::GetNormals(const Cells& cells, DirectX::XMVECTOR& nx, DirectX::XMVECTOR& ny, DirectX::XMVECTOR& nz) const
+{
+	// Slopes of the bilinear patch along u and v, then along x and z
+	auto du = DirectX::XMVectorLerpV(DirectX::XMVectorSubtract(cells.h10, cells.h00), DirectX::XMVectorSubtract(cells.h11, cells.h01), cells.v);
+	auto dv = DirectX::XMVectorLerpV(DirectX::XMVectorSubtract(cells.h01, cells.h00), DirectX::XMVectorSubtract(cells.h11, cells.h10), cells.u);
+	auto dx = DirectX::XMVectorMultiply(du, DirectX::XMVectorReplicate(m_InverseCellSize.x));
+	auto dz = DirectX::XMVectorMultiply(dv, DirectX::XMVectorReplicate(m_InverseCellSize.y));
+
+	// Normalize (-dx, 1, -dz)
+	auto length_sq = DirectX::XMVectorMultiplyAdd(dx, dx, DirectX::XMVectorMultiplyAdd(dz, dz, DirectX::XMVectorReplicate(1.0f)));
+	auto inverse_length = DirectX::XMVectorReciprocalSqrt(length_sq);
+	nx = DirectX::XMVectorNegate(DirectX::XMVectorMultiply(dx, inverse_length));
+	ny = inverse_length;
+	nz = DirectX::XMVectorNegate(DirectX::XMVectorMultiply(dz, inverse_length));
+}
+
+bool DX::TerrainSampler::Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float max_distance, TerrainRayHit& hit) const
+{
+	DirectX::XMFLOAT3 world_origin, world_direction;
+	DirectX::XMStoreFloat3(&world_origin, origin);
+	DirectX::XMStoreFloat3(&world_direction, direction);
+
+	// Along x and z the ray is walked in cells, heights stay as they are
+	double ray_origin[3] = { (world_origin.x - m_Origin.x) * static_cast<double>(m_InverseCellSize.x), world_origin.y, (world_origin.z - m_Origin.y) * static_cast<double>(m_InverseCellSize.y) };
+	double ray_direction[3] = { world_direction.x * static_cast<double>(m_InverseCellSize.x), world_direction.y, world_direction.z * static_cast<double>(m_InverseCellSize.y) };
+
+	// Clip to the heightmap and to below its highest point
+	const auto& root = m_BoundsLevels.back().bounds[0];
+	double t_begin = 0.0;
+	double t_end = max_distance;
+	ClipSlab(ray_origin[0], ray_direction[0], 0.0, m_Width - 1.0, t_begin, t_end);
+	ClipSlab(ray_origin[2], ray_direction[2], 0.0, m_Height - 1.0, t_begin, t_end);
+	ClipSlab(ray_origin[1], ray_direction[1], -std::numeric_limits<double>::infinity(), root.max_height, t_begin, t_end);
+	if (t_begin > t_end)
+		return false;
+
+	double nudge = NODE_NUDGE / std::max({ std::abs(ray_direction[0]), std::abs(ray_direction[2]), NODE_NUDGE });
+
+	uint32_t top = static_cast<uint32_t>(m_BoundsLevels.size() - 1);
+	uint32_t level = top;
+	size_t steps = 0;
+	double t = t_begin;
+	while (t <= t_end)
+	{
+		steps++;
+
+		// Node at this level the ray is in just past t, so a ray on an edge is in the node it is heading into
+		double u = ray_origin[0] + ray_direction[0] * (t + nudge);
+		double v = ray_origin[2] + ray_direction[2] * (t + nudge);
+		uint32_t cell_x = static_cast<uint32_t>(std::clamp(u, 0.0, m_Width - 2.0));
+		uint32_t cell_z = static_cast<uint32_t>(std::clamp(v, 0.0, m_Height - 2.0));
+		uint32_t node_x = cell_x >> level;
+		uint32_t node_z = cell_z >> level;
+
+		// Where the ray leaves the node
+		double low_x = static_cast<double>(node_x << level);
+		double low_z = static_cast<double>(node_z << level);
+		double node_begin = -std::numeric_limits<double>::infinity();
+		double node_end = t_end;
+		ClipSlab(ray_origin[0], ray_direction[0], low_x, std::min(low_x + (1u << level), m_Width - 1.0), node_begin, node_end);
+		ClipSlab(ray_origin[2], ray_direction[2], low_z, std::min(low_z + (1u << level), m_Height - 1.0), node_begin, node_end);
+		node_end = std::max(node_end, t + nudge);
+
+		const auto& level_bounds = m_BoundsLevels[level];
+		const auto& bounds = level_bounds.bounds[static_cast<size_t>(node_z) * level_bounds.width + node_x];
+
+		// Straight past a node the ray stays above, then back up a level for bigger steps
+		double y_begin = ray_origin[1] + ray_direction[1] * t;
+		double y_end = ray_origin[1] + ray_direction[1] * node_end;
+		if (std::min(y_begin, y_end) > bounds.max_height)
+		{
+			t = node_end;
+			level = std::min(level + 1, top);
+			continue;
+		}
+
+		// Look closer unless the ray is already under everything in the node, then the hit is where the walk is
+		if (y_begin > bounds.min_height)
+		{
+			if (level > 0)
+			{
+				level--;
+				continue;
+			}
+
+			double t_hit = 0.0;
+			if (!IntersectCell(cell_x, cell_z, ray_origin, ray_direction, t, node_end, t_hit))
+			{
+				t = node_end;
+				level = std::min(level + 1, top);
+				continue;
+			}
+
+			t = t_hit;
+		}
+
+		// Back to the world, with the texel nearest the hit
+		DirectX::XMStoreFloat3(&hit.position, DirectX::XMVectorMultiplyAdd(direction, DirectX::XMVectorReplicate(static_cast<float>(t)), origin));
+		hit.distance = static_cast<float>(t);
+		hit.texel_x = static_cast<uint32_t>(std::clamp(std::round(ray_origin[0] + ray_direction[0] * t), 0.0, m_Width - 1.0));
+		hit.texel_z = static_cast<uint32_t>(std::clamp(std::round(ray_origin[2] + ray_direction[2] * t), 0.0, m_Height - 1.0));
+		hit.steps = steps;
+		return true;
+	}
+
+	return false;
+}
+
+bool DX::TerrainSampler::IntersectCell(uint32_t x, uint32_t z, const double origin[3], const double direction[3], double t_begin, double t_end, double& t_hit) const
+{
+	const float* texel = m_Heights.data() + static_cast<size_t>(z) * m_Width + x;
+	double h00 = texel[0];
+	double h10 = texel[1];
+	double h01 = texel[m_Width];
+	double h11 = texel[m_Width + 1];
+
+	// The patch is h00 + du * a + dv * b + twist * a * b with (a, b) the position in the cell. Along the ray
+	// from t_begin, a and b move linearly, so the ray's height over the patch is a quadratic in s = t - t_begin
+	double du = h10 - h00;
+	double dv = h01 - h00;
+	double twist = h00 - h10 - h01 + h11;
+
+	double a = origin[0] + direction[0] * t_begin - x;
+	double b = origin[2] + direction[2] * t_begin - z;
+	double y = origin[1] + direction[1] * t_begin;
+
+	double qa = -twist * direction[0] * direction[2];
+	double qb = direction[1] - du * direction[0] - dv * direction[2] - twist * (a * direction[2] + b * direction[0]);
+	double qc = y - (h00 + du * a + dv * b + twist * a * b);
+
+	// On or under the patch already
+	if (qc <= 0.0)
+	{
+		t_hit = t_begin;
+		return true;
+	}
+
+	// Smallest root within the cell, the ray is above the patch before it
+	double length = t_end - t_begin;
+	double s = std::numeric_limits<double>::infinity();
+	if (std::abs(qa) < 1e-12)
+	{
+		if (qb < 0.0)
+		{
+			s = -qc / qb;
+		}
+	}
+	else
+	{
+		double discriminant = qb * qb - 4.0 * qa * qc;
+		if (discriminant < 0.0)
+			return false;
+
+		// Roots without cancellation
+		double q = -0.5 * (qb + std::copysign(std::sqrt(discriminant), qb));
+		for (double root : { q / qa, q != 0.0 ? qc / q : std::numeric_limits<double>::infinity() })
+		{
+			if (root >= 0.0 && root < s)
+			{
+				s = root;
+			}
+		}
+	}
+
+	if (s > length)
+		return false;
+
+	t_hit = t_begin + s;
+	return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "DxTerrainTiles.h"
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+namespace DX
+{
+	// Where a ray first meets the terrain. Distance is in lengths of the ray's direction, texel is the one
+	// nearest the hit and steps counts the nodes visited to find it
+	struct TerrainRayHit
+	{
+		DirectX::XMFLOAT3 position = {};
+		float distance = 0.0f;
+		uint32_t texel_x = 0;
+		uint32_t texel_z = 0;
+		size_t steps = 0;
+	};
+
+	// Heights, normals and ray hits of the terrain surface for gameplay, on the CPU. Each cell is a bilinear patch
+	// between its four texels, like the patches the domain shader draws. Queries land on what is rendered when
+	// the rows are the grid that is drawn: the heightmap for tiles, or the quadtree's leaf corners with
+	// cell_size a leaf wide for quadtree patches. Texel (0, 0) sits at origin on the xz plane and texels step
+	// cell_size along x and z, negative to run the other way. Heights are scaled by height_scale and queries
+	// past the edge are clamped onto it.
+	// The rows are copied in whole, with a bounds pyramid about as large again, so build it from the quadtree's
+	// GetCornerRows(), a leaf_size squared fraction of the heightmap. A heightmap too large to hold, as the
+	// streamed tiles are, is too large to sample this way
+	class TerrainSampler
+	{
+	public:
+		TerrainSampler(const HeightmapRows& rows, uint32_t width, uint32_t height, DirectX::XMFLOAT2 origin, DirectX::XMFLOAT2 cell_size, float height_scale);
+		virtual ~TerrainSampler() = default;
+
+		float GetHeight(float x, float z) const;
+
+		// Unit normal of the bilinear patch under (x, z)
+		DirectX::XMFLOAT3 GetNormal(float x, float z) const;
+
+		// Batched queries for many positions at once, four at a time. Positions and results are separate arrays
+		void GetHeights(const float* x, const float* z, float* heights, size_t count) const;
+		void GetNormals(const float* x, const float* z, DirectX::XMFLOAT3* normals, size_t count) const;
+
+		// First hit along the ray within max_distance, or false if it misses. A ray that starts under the surface
+		// hits where it enters the heightmap. Walks a quadtree of cell height bounds, skipping whole nodes the
+		// ray passes over, so it takes around log n steps rather than one per cell crossed
+		bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float max_distance, TerrainRayHit& hit) const;
+
+	private:
+		uint32_t m_Width = 0;
+		uint32_t m_Height = 0;
+		DirectX::XMFLOAT2 m_Origin = {};
+		DirectX::XMFLOAT2 m_CellSize = {};
+		DirectX::XMFLOAT2 m_InverseCellSize = {};
+
+		// Scaled heights row by row
+		std::vector<float> m_Heights;
+
+		// Lowest and highest height under every node of the cell quadtree, level 0 holds a node per cell and
+		// every level above halves it until a single node covers everything
+		struct HeightBounds
+		{
+			float min_height = 0.0f;
+			float max_height = 0.0f;
+		};
+
+		struct BoundsLevel
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			std::vector<HeightBounds> bounds;
+		};
+
+		std::vector<BoundsLevel> m_BoundsLevels;
+		void CreateBoundsLevels();
+
+		// First point of the ray within cell (x, z) between t_begin and t_end that is on or under the patch
+		bool IntersectCell(uint32_t x, uint32_t z, const double origin[3], const double direction[3], double t_begin, double t_end, double& t_hit) const;
+
+		// Corner heights and where in the cell four positions fall
+		struct Cells
+		{
+			DirectX::XMVECTOR h00;
+			DirectX::XMVECTOR h10;
+			DirectX::XMVECTOR h01;
+			DirectX::XMVECTOR h11;
+			DirectX::XMVECTOR u;
+			DirectX::XMVECTOR v;
+		};
+
+		Cells GetCells(DirectX::FXMVECTOR x, DirectX::FXMVECTOR z) const;
+		DirectX::XMVECTOR GetHeights(const Cells& cells) const;
+		void GetNormals(const Cells& cells, DirectX::XMVECTOR& nx, DirectX::XMVECTOR& ny, DirectX::XMVECTOR& nz) const;
+	};
+}
@@ -0,0 +1,354 @@
+#include "DxTerrainTiles.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace
+{
+	constexpr uint32_t TILE_FILE_MAGIC = 0x454c4954; // "TILE"
+	constexpr uint32_t TILE_FILE_VERSION = 1;
+
+	struct TileFileHeader
+	{
+		uint32_t magic = TILE_FILE_MAGIC;
+		uint32_t version = TILE_FILE_VERSION;
+		DX::TerrainTileLayout layout;
+		float height_low = 0.0f;
+		float height_scale = 0.0f;
+	};
+
+	size_t GetTileBytes(const DX::TerrainTileLayout& layout)
+	{
+		return static_cast<size_t>(layout.GetTileSamples()) * layout.GetTileSamples() * sizeof(uint16_t);
+	}
+}
+
+DX::HeightmapRows DX::ReadRawHeightmapRows(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t bits)
+{
+	if (bits != 8 && bits != 16)
+		throw std::runtime_error("Raw heightmaps are 8 or 16 bits: " + path.string());
+
+	auto file = std::make_shared<std::ifstream>(path, std::ifstream::binary);
+	if (!file->is_open())
+		throw std::runtime_error("Could not open file: " + path.string());
+
+	size_t texel_bytes = bits / 8;
+	return [file, width, height, texel_bytes, path](uint32_t z, float* row)
+	{
+		std::vector<uint8_t> bytes(width * texel_bytes);
+		file->clear();
+		file->seekg(static_cast<std::streamoff>(z) * width * texel_bytes);
+		if (z >= height || !file->read(reinterpret_cast<char*>(bytes.data()), bytes.size()))
+			throw std::runtime_error("Could not read heightmap row " + std::to_string(z) + ": " + path.string());
+
+		// 16 bit heights are little endian
+		for (uint32_t x = 0; x < width; ++x)
+		{
+			row[x] = texel_bytes == 1 ? bytes[x] : static_cast<float>(bytes[x * 2] | (bytes[x * 2 + 1] << 8));
+		}
+	};
+}
+
+DX::TerrainTileLayout DX::WriteTerrainTiles(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tile_size, const HeightmapRows& rows)
+{
+	if (width < 2 || height < 2 || tile_size == 0)
+		throw std::runtime_error("Heightmap too small to tile: " + path.string());
+
+	TileFileHeader header;
+	header.layout.width = width;
+	header.layout.height = height;
+	header.layout.tile_size = tile_size;
+	header.layout.tiles_x = (width - 1 + tile_size - 1) / tile_size;
+	header.layout.tiles_z = (height - 1 + tile_size - 1) / tile_size;
+	const TerrainTileLayout& layout = header.layout;
+
+	// Range of the whole heightmap, the 16 bit heights span it
+	std::vector<float> row(width);
+	float low = std::numeric_limits<float>::max();
+	float high = std::numeric_limits<float>::lowest();
+	for (uint32_t z = 0; z < height; ++z)
+	{
+		rows(z, row.data());
+		for (float value : row)
+		{
+			low = std::min(low, value);
+			high = std::max(high, value);
+		}
+	}
+
+	header.height_low = low;
+	header.height_scale = (high - low) / 65535.0f;
+
+	std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+	if (!file.is_open())
+		throw std::runtime_error("Could not create file: " + path.string());
+
+	// Bounds are filled in once the tiles are written
+	std::vector<TerrainTileBounds> bounds(static_cast<size_t>(layout.tiles_x) * layout.tiles_z);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	std::streamoff bounds_offset = file.tellp();
+	file.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(TerrainTileBounds));
+
+	// A band of rows is all the tiles in a row of tiles need
+	const uint32_t samples = layout.GetTileSamples();
+	std::vector<float> band(static_cast<size_t>(width) * samples);
+	std::vector<uint16_t> tile(static_cast<size_t>(samples) * samples);
+
+	for (uint32_t tz = 0; tz < layout.tiles_z; ++tz)
+	{
+		for (uint32_t k = 0; k < samples; ++k)
+		{
+			rows(std::min(tz * tile_size + k, height - 1), band.data() + static_cast<size_t>(k) * width);
+		}
+
+		for (uint32_t tx = 0; tx < layout.tiles_x; ++tx)
+		{
+			// Bounds of the heights as the streamer will give them back, not the ones before quantizing
+			TerrainTileBounds& tile_bounds = bounds[static_cast<size_t>(tz) * layout.tiles_x + tx];
+			uint16_t tile_low = std::numeric_limits<uint16_t>::max();
+			uint16_t tile_high = 0;
+
+			for (uint32_t k = 0; k < samples; ++k)
+			{
+				const float* band_row = band.data() + static_cast<size_t>(k) * width;
+				for (uint32_t i = 0; i < samples; ++i)
+				{
+					float value = band_row[std::min(tx * tile_size + i, width - 1)];
+					float unorm = header.height_scale > 0.0f ? (value - low) / header.height_scale : 0.0f;
+					uint16_t quantized = static_cast<uint16_t>(std::clamp(std::lround(unorm), 0l, 65535l));
+
+					tile[static_cast<size_t>(k) * samples + i] = quantized;
+					tile_low = std::min(tile_low, quantized);
+					tile_high = std::max(tile_high, quantized);
+				}
+			}
+
+			tile_bounds.min_height = low + tile_low * header.height_scale;
+			tile_bounds.max_height = low + tile_high * header.height_scale;
+			file.write(reinterpret_cast<const char*>(tile.data()), tile.size() * sizeof(uint16_t));
+		}
+	}
+
+	file.seekp(bounds_offset);
+	file.write(reinterpret_cast<const char*>(bounds.data()), bounds.size() * sizeof(TerrainTileBounds));
+
+	if (!file)
+		throw std::runtime_error("Could not write file: " + path.string());
+
+	return layout;
+}
+
+DX::TerrainStreamer::TerrainStreamer(const std::filesystem::path& path, size_t max_resident_tiles) : m_MaxResidentTiles(std::max<size_t>(max_resident_tiles, 1))
+{
+	m_File.open(path, std::ifstream::binary);
+	if (!m_File.is_open())
+		throw std::runtime_error("Could not open file: " + path.string());
+
+	TileFileHeader header;
+	if (!m_File.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != TILE_FILE_MAGIC || header.version != TILE_FILE_VERSION)
+		throw std::runtime_error("Not a tiled heightmap: " + path.string());
+
+	m_Layout = header.layout;
+	m_HeightLow = header.height_low;
+	m_HeightScale = header.height_scale;
+
+	// Bounds of every tile stay in memory, they are small and culling needs them before the tiles
+	m_Bounds.resize(static_cast<size_t>(m_Layout.tiles_x) * m_Layout.tiles_z);
+	if (!m_File.read(reinterpret_cast<char*>(m_Bounds.data()), m_Bounds.size() * sizeof(TerrainTileBounds)))
+		throw std::runtime_error("Could not read tile bounds: " + path.string());
+
+	m_TileDataOffset = m_File.tellg();
+	m_Thread = std::thread(&TerrainStreamer::Loader, this);
+}
+
+DX::TerrainStreamer::~TerrainStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stopping = true;
+	}
+
+	m_Condition.notify_all();
+	if (m_Thread.joinable())
+	{
+		m_Thread.join();
+	}
+}
+
+void DX::TerrainStreamer::Update(float x, float z, float radius)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_FocusX = x;
+	m_FocusZ = z;
+
+	// Tiles that touch the circle, only as many of the nearest as the budget holds
+	auto tile_at = [this](float position, uint32_t tiles) { return static_cast<uint32_t>(std::clamp(std::floor(position / m_Layout.tile_size), 0.0f, tiles - 1.0f)); };
+	uint32_t low_x = tile_at(x - radius, m_Layout.tiles_x);
+	uint32_t high_x = tile_at(x + radius, m_Layout.tiles_x);
+	uint32_t low_z = tile_at(z - radius, m_Layout.tiles_z);
+	uint32_t high_z = tile_at(z + radius, m_Layout.tiles_z);
+
+	std::vector<std::pair<float, uint32_t>> wanted;
+	for (uint32_t tz = low_z; tz <= high_z; ++tz)
+	{
+		for (uint32_t tx = low_x; tx <= high_x; ++tx)
+		{
+			uint32_t index = tz * m_Layout.tiles_x + tx;
+			float distance = GetDistance(index);
+			if (distance <= radius)
+			{
+				wanted.emplace_back(distance, index);
+			}
+		}
+	}
+
+	std::sort(wanted.begin(), wanted.end());
+	wanted.resize(std::min(wanted.size(), m_MaxResidentTiles));
+
+	std::unordered_set<uint32_t> keep;
+	m_Queue.clear();
+	for (const auto& tile : wanted)
+	{
+		keep.insert(tile.second);
+		if (m_Resident.count(tile.second) == 0 && m_Failed.count(tile.second) == 0)
+		{
+			m_Queue.push_back(tile.second);
+		}
+	}
+
+	// Make room for what is queued, a tile that is wanted is never given up for another
+	while (m_Resident.size() + m_Queue.size() > m_MaxResidentTiles && EvictFurthest(keep))
+	{
+	}
+
+	m_Condition.notify_one();
+}
+
+std::shared_ptr<const DX::TerrainTile> DX::TerrainStreamer::GetTile(uint32_t x, uint32_t z) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	auto tile = m_Resident.find(z * m_Layout.tiles_x + x);
+	return tile != m_Resident.end() ? tile->second : nullptr;
+}
+
+void DX::TerrainStreamer::GetResidentTiles(std::vector<std::shared_ptr<const TerrainTile>>& tiles) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	tiles.clear();
+	for (const auto& tile : m_Resident)
+	{
+		tiles.push_back(tile.second);
+	}
+}
+
+void DX::TerrainStreamer::WaitIdle()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_Idle.wait(lock, [this]() { return m_Queue.empty() && !m_Loading; });
+}
+
+DX::TerrainStreamerStatistics DX::TerrainStreamer::GetStatistics() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	TerrainStreamerStatistics statistics = m_Statistics;
+	statistics.resident = m_Resident.size();
+	statistics.queued = m_Queue.size();
+	return statistics;
+}
+
+void DX::TerrainStreamer::Loader()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true)
+	{
+		m_Condition.wait(lock, [this]() { return m_Stopping || !m_Queue.empty(); });
+		if (m_Stopping)
+			return;
+
+		uint32_t index = m_Queue.front();
+		m_Queue.pop_front();
+		m_Loading = true;
+
+		// The file is read without holding the lock, so the render thread never waits on it
+		lock.unlock();
+		std::shared_ptr<TerrainTile> tile = ReadTile(index);
+		lock.lock();
+
+		m_Loading = false;
+		if (tile != nullptr)
+		{
+			m_Resident[index] = std::move(tile);
+			m_Statistics.loaded++;
+			m_Statistics.bytes_read += GetTileBytes(m_Layout);
+
+			// The point may have moved on while the tile was read, the furthest tile goes, maybe this one
+			while (m_Resident.size() > m_MaxResidentTiles && EvictFurthest({}))
+			{
+			}
+		}
+		else
+		{
+			m_Failed.insert(index);
+			m_Statistics.failed++;
+		}
+
+		if (m_Queue.empty())
+		{
+			m_Idle.notify_all();
+		}
+	}
+}
+
+std::shared_ptr<DX::TerrainTile> DX::TerrainStreamer::ReadTile(uint32_t index)
+{
+	std::vector<uint16_t> quantized(GetTileBytes(m_Layout) / sizeof(uint16_t));
+
+	m_File.clear();
+	m_File.seekg(m_TileDataOffset + static_cast<std::streamoff>(index) * GetTileBytes(m_Layout));
+	if (!m_File.read(reinterpret_cast<char*>(quantized.data()), quantized.size() * sizeof(uint16_t)))
+		return nullptr;
+
+	auto tile = std::make_shared<TerrainTile>();
+	tile->x = index % m_Layout.tiles_x;
+	tile->z = index / m_Layout.tiles_x;
+	tile->heights.resize(quantized.size());
+	for (size_t i = 0; i < quantized.size(); ++i)
+	{
+		tile->heights[i] = m_HeightLow + quantized[i] * m_HeightScale;
+	}
+
+	return tile;
+}
+
+float DX::TerrainStreamer::GetDistance(uint32_t index) const
+{
+	// Distance from the point to the tile's square, zero inside it
+	float low_x = static_cast<float>(index % m_Layout.tiles_x * m_Layout.tile_size);
+	float low_z = static_cast<float>(index / m_Layout.tiles_x * m_Layout.tile_size);
+	float dx = std::max({ low_x - m_FocusX, 0.0f, m_FocusX - (low_x + m_Layout.tile_size) });
+	float dz = std::max({ low_z - m_FocusZ, 0.0f, m_FocusZ - (low_z + m_Layout.tile_size) });
+	return std::sqrt(dx * dx + dz * dz);
+}
+
+bool DX::TerrainStreamer::EvictFurthest(const std::unordered_set<uint32_t>& keep)
+{
+	auto furthest = m_Resident.end();
+	float furthest_distance = -1.0f;
+	for (auto tile = m_Resident.begin(); tile != m_Resident.end(); ++tile)
+	{
+		float distance = GetDistance(tile->first);
+		if (keep.count(tile->first) == 0 && distance > furthest_distance)
+		{
+			furthest = tile;
+			furthest_distance = distance;
+		}
+	}
+
+	if (furthest == m_Resident.end())
+		return false;
+
+	m_Resident.erase(furthest);
+	m_Statistics.evicted++;
+	return true;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <cstdint>
+
+namespace DX
+{
+	// Heightmap rows produced one at a time, so a heightmap never has to be in memory as a whole. Fills width
+	// floats of row z, and may be called more than once for the same row
+	using HeightmapRows = std::function<void(uint32_t z, float* row)>;
+
+	// Rows of a raw heightmap file, 8 or 16 bits per texel, read as they are asked for
+	HeightmapRows ReadRawHeightmapRows(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t bits);
+
+	// How a tiled heightmap is cut up. Tiles are tile_size cells wide, so they hold tile_size + 1 samples a side
+	// and share their edge samples with their neighbours. Tiles past the heightmap's edge repeat its last samples
+	struct TerrainTileLayout
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t tile_size = 0;
+		uint32_t tiles_x = 0;
+		uint32_t tiles_z = 0;
+
+		// Samples along a tile side
+		uint32_t GetTileSamples() const { return tile_size + 1; }
+	};
+
+	// Lowest and highest height in a tile, for culling without the tile
+	struct TerrainTileBounds
+	{
+		float min_height = 0.0f;
+		float max_height = 0.0f;
+	};
+
+	// A tile's heights, row by row, starting at texel (x * tile_size, z * tile_size)
+	struct TerrainTile
+	{
+		uint32_t x = 0;
+		uint32_t z = 0;
+		std::vector<float> heights;
+	};
+
+	// Write a heightmap as tiles. The file holds the layout, then the bounds of every tile, then the tiles
+	// themselves as 16 bit heights across the heightmap's range. Rows are read twice, once for the range
+	// and once as tile_size + 1 row bands for the tiles
+	TerrainTileLayout WriteTerrainTiles(const std::filesystem::path& path, uint32_t width, uint32_t height, uint32_t tile_size, const HeightmapRows& rows);
+
+	// What the streamer has been doing
+	struct TerrainStreamerStatistics
+	{
+		size_t resident = 0;
+		size_t queued = 0;
+		size_t loaded = 0;
+		size_t evicted = 0;
+		size_t failed = 0;
+		size_t bytes_read = 0;
+	};
+
+	// Keeps the tiles around a point loaded, reading them on a background thread. No more than
+	// max_resident_tiles tiles are held at once, the ones furthest from the point go first.
+	// Positions and radii are in texels of the heightmap
+	class TerrainStreamer
+	{
+	public:
+		TerrainStreamer(const std::filesystem::path& path, size_t max_resident_tiles);
+		virtual ~TerrainStreamer();
+
+		TerrainStreamer(const TerrainStreamer&) = delete;
+		TerrainStreamer& operator=(const TerrainStreamer&) = delete;
+
+		// Layout of the tiled file
+		const TerrainTileLayout& GetLayout() const { return m_Layout; }
+
+		// Bounds of any tile, loaded or not
+		const TerrainTileBounds& GetBounds(uint32_t x, uint32_t z) const { return m_Bounds[z * m_Layout.tiles_x + x]; }
+
+		// Ask for the tiles within radius of (x, z), nearest first, and let go of the rest once over budget
+		void Update(float x, float z, float radius);
+
+		// Tile if it is loaded. Holding on to it keeps it alive after it is evicted
+		std::shared_ptr<const TerrainTile> GetTile(uint32_t x, uint32_t z) const;
+
+		// Every loaded tile
+		void GetResidentTiles(std::vector<std::shared_ptr<const TerrainTile>>& tiles) const;
+
+		// Block until nothing is queued or being read
+		void WaitIdle();
+
+		TerrainStreamerStatistics GetStatistics() const;
+
+	private:
+		TerrainTileLayout m_Layout;
+		std::vector<TerrainTileBounds> m_Bounds;
+		float m_HeightLow = 0.0f;
+		float m_HeightScale = 0.0f;
+		size_t m_MaxResidentTiles = 0;
+
+		// Only the loader thread reads the file
+		std::ifstream m_File;
+		std::streamoff m_TileDataOffset = 0;
+
+		// Everything below is shared with the loader thread
+		mutable std::mutex m_Mutex;
+		std::condition_variable m_Condition;
+		std::condition_variable m_Idle;
+		bool m_Stopping = false;
+		bool m_Loading = false;
+
+		// Tiles by index, the wanted ones in order of distance, and where the point was last
+		std::unordered_map<uint32_t, std::shared_ptr<const TerrainTile>> m_Resident;
+		std::unordered_set<uint32_t> m_Failed;
+		std::deque<uint32_t> m_Queue;
+		float m_FocusX = 0.0f;
+		float m_FocusZ = 0.0f;
+		TerrainStreamerStatistics m_Statistics;
+
+		std::thread m_Thread;
+		void Loader();
+
+		std::shared_ptr<TerrainTile> ReadTile(uint32_t index);
+		float GetDistance(uint32_t index) const;
+		bool EvictFurthest(const std::unordered_set<uint32_t>& keep);
+	};
+}
@@ -5,21 +5,30 @@ HullConstDataOutput CalcHSPatchConstants(InputPatch<HullInputType, 4> patch, uin
 {
 	HullConstDataOutput pt;
 
-	float tess = cTess.x;
+	// cTess.y keeps rate times edge factor within 64. It is the same for every patch, so edges still match
+	float tess = min(cTess.x, cTess.y);
 
-	pt.EdgeTess[0] = tess;
-	pt.EdgeTess[1] = tess;
-	pt.EdgeTess[2] = tess;
-	pt.EdgeTess[3] = tess;
+	// Patches from the quadtree bring edge factors that match their neighbours, scaled by the same rate on
+	// both sides of an edge they still match
+	float4 edges = patch[0].edges;
+	if (edges.x <= 0.0f)
+	{
+		edges = float4(1.0f, 1.0f, 1.0f, 1.0f);
+	}
 
-	pt.InsideTess[0] = tess;
-	pt.InsideTess[1] = tess;
+	pt.EdgeTess[0] = tess * edges.x;
+	pt.EdgeTess[1] = tess * edges.y;
+	pt.EdgeTess[2] = tess * edges.z;
+	pt.EdgeTess[3] = tess * edges.w;
+
+	pt.InsideTess[0] = max(pt.EdgeTess[1], pt.EdgeTess[3]);
+	pt.InsideTess[1] = max(pt.EdgeTess[0], pt.EdgeTess[2]);
 
 	return pt;
 }
 
 [domain("quad")]
-[partitioning("fractional_odd")]
+[partitioning("integer")]
 [outputtopology("triangle_cw")]
 [outputcontrolpoints(4)]
 [patchconstantfunc("CalcHSPatchConstants")]
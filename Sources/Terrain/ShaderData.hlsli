@@ -4,7 +4,7 @@ cbuffer WorldBuffer : register(b0)
 	matrix cWorld;
 	matrix cView;
 	matrix cProjection;
-	float4 cTess;
+	float4 cTess; // x rate, y highest rate the patch edge factors allow
 }
 
 // Vertex input
@@ -12,6 +12,7 @@ struct VertexInputType
 {
 	float3 position : POSITION;
 	float2 tex : TEXTURE;
+	float4 edges : TESS;
 };
 
 // Hull input / vertex output
@@ -19,6 +20,7 @@ struct HullInputType
 {
 	float3 position : POSITION;
 	float2 tex : TEXTURE;
+	float4 edges : TESS;
 };
 
 // Domain input / Hull output
@@ -11,5 +11,8 @@ HullInputType main(VertexInputType input)
 	// Set the vertex colour
 	output.tex = input.tex;
 
+	// Patch edge tessellation, zero when the patch has none of its own
+	output.edges = input.edges;
+
 	return output;
 }
\ No newline at end of file